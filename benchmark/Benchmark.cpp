@@ -0,0 +1,850 @@
+#include "ZipArchive.h"
+#include "Cleanup.h"
+#include "File.h"
+#include "Path.hpp"
+#include "StringConverter.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <set>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#ifdef _WIN32
+#include <Windows.h>
+#include <Psapi.h>
+#else
+#include <codecvt>
+#include <cwchar>
+#include <unistd.h>
+#include <sys/resource.h>
+#endif
+
+#define ZIP_STATIC
+#include <zip.h>
+
+// COMMENT: throughput benchmark of zip_archive::UnpackToFolder on synthetic archives shaped like real payloads.
+// Prints one JSON object per measurement, so results can be collected and compared between builds.
+//
+// benchmark [--shapes=classes,blobs,mixed,deep] [--threads=1,2,4] [--scale=1.0] [--repeat=3] [--out=results.jsonl]
+//           [--preallocate=1] [--temporary=0] [--direct-io-mb=0]
+//
+// --threads runs that many extractions of the same archive at once, each into its own directory.
+// --scale multiplies entry counts and sizes, 0.05 gives a quick smoke run.
+// --preallocate, --temporary and --direct-io-mb set zip_archive::UnpackOptions, runs with and without each of them
+// show what it gains. The blobs shape has the large entries direct I/O is meant for.
+//
+// benchmark --transcode [--repeat=3] [--out=results.jsonl]
+//
+// checks ConvertUtf8ToUtf16 against MultiByteToWideChar on all code points and all sequences of up to three bytes,
+// then measures both on entry names. Exits with a failure on any mismatch. On POSIX the standard library conversion
+// takes the place of MultiByteToWideChar, it rejects invalid input as a whole, so only valid input is compared.
+
+namespace
+{
+
+const std::wstring TmpPrefix(L"infomaximum_bench_");
+
+struct Options
+{
+	std::vector<std::string> shapes = { "classes", "blobs", "mixed", "deep" };
+	std::vector<unsigned> threads = { 1, 2, 4 };
+	double scale = 1.0;
+	unsigned repeat = 3;
+	std::string out;
+	bool transcode = false;
+	zip_archive::UnpackOptions unpackOptions;
+};
+
+const size_t TranscodeNames = 200000;
+
+// COMMENT: deterministic, so every build measures the same archives.
+class Random
+{
+public:
+
+	explicit Random(uint64_t seed)
+		: state(seed == 0 ? 0x9E3779B97F4A7C15ULL : seed)
+	{
+	}
+
+	uint64_t Next()
+	{
+		state ^= state << 13;
+		state ^= state >> 7;
+		state ^= state << 17;
+		return state;
+	}
+
+	size_t Range(size_t from, size_t to)
+	{
+		return from + static_cast<size_t>(Next() % (to - from + 1));
+	}
+
+private:
+
+	uint64_t state;
+};
+
+// COMMENT: source-like text compresses about as well as class files do.
+void FillCompressible(Random& random, uint8_t* data, size_t size)
+{
+	static const char* const Words[] = { "public ", "static ", "final ", "void ", "return ", "this.", "new ", "String ", "int ",
+		"java/lang/Object", "java/util/List", "getValue", "setValue", "(Ljava/lang/String;)V", "\n", "    ", "{", "}", ";", "(", ")" };
+	const size_t wordCount = sizeof(Words) / sizeof(Words[0]);
+
+	size_t offset = 0;
+	while (offset < size)
+	{
+		const char* word = Words[random.Next() % wordCount];
+		const size_t len = std::min(strlen(word), size - offset);
+		memcpy(data + offset, word, len);
+		offset += len;
+	}
+}
+
+void FillRandom(Random& random, uint8_t* data, size_t size)
+{
+	size_t offset = 0;
+	for (; offset + sizeof(uint64_t) <= size; offset += sizeof(uint64_t))
+	{
+		const uint64_t value = random.Next();
+		memcpy(data + offset, &value, sizeof(value));
+	}
+	for (; offset < size; offset++)
+	{
+		data[offset] = static_cast<uint8_t>(random.Next());
+	}
+}
+
+class ArchiveBuilder
+{
+public:
+
+	Error Create(const std::wstring& path)
+	{
+		std::string pathUtf8;
+		Error err = ConvertUtf16ToUtf8(path, pathUtf8);
+		if (!err.Succeeded())
+		{
+			return err;
+		}
+
+		int zipErr = 0;
+		archive = zip_open(pathUtf8.c_str(), ZIP_CREATE | ZIP_TRUNCATE, &zipErr);
+		if (archive == nullptr)
+		{
+			std::wstring msg(L"can not create zip archive, zip error = ");
+			msg.append(std::to_wstring(zipErr));
+			return Error(std::move(msg));
+		}
+
+		return Error();
+	}
+
+	// COMMENT: the extractor needs a directory entry before the files in it, like the archives of the build have.
+	Error AddFile(const std::string& name, size_t size, bool compressible, bool deflate, Random& random)
+	{
+		for (size_t separator = name.find('/'); separator != std::string::npos; separator = name.find('/', separator + 1))
+		{
+			const std::string dir = name.substr(0, separator + 1);
+			if (dirs.insert(dir).second && zip_dir_add(archive, dir.c_str(), ZIP_FL_ENC_UTF_8) < 0)
+			{
+				return MakeError(L"can not add directory");
+			}
+		}
+
+		uint8_t* data = static_cast<uint8_t*>(malloc(size == 0 ? 1 : size));
+		if (data == nullptr)
+		{
+			return Error::makeByErrno(ENOMEM);
+		}
+
+		if (compressible)
+		{
+			FillCompressible(random, data, size);
+		}
+		else
+		{
+			FillRandom(random, data, size);
+		}
+
+		// COMMENT: libzip frees the data when the archive is written.
+		zip_source_t* source = zip_source_buffer(archive, data, size, 1);
+		if (source == nullptr)
+		{
+			free(data);
+			return MakeError(L"can not create source");
+		}
+
+		const zip_int64_t index = zip_file_add(archive, name.c_str(), source, ZIP_FL_ENC_UTF_8);
+		if (index < 0)
+		{
+			zip_source_free(source);
+			return MakeError(L"can not add file");
+		}
+
+		zip_set_file_compression(archive, index, deflate ? ZIP_CM_DEFLATE : ZIP_CM_STORE, 0);
+
+		entries++;
+		bytes += size;
+		return Error();
+	}
+
+	Error Close()
+	{
+		if (zip_close(archive) != 0)
+		{
+			Error err = MakeError(L"can not write zip archive");
+			zip_discard(archive);
+			archive = nullptr;
+			return err;
+		}
+
+		archive = nullptr;
+		return Error();
+	}
+
+	uint64_t entries = 0;
+	uint64_t bytes = 0;
+
+private:
+
+	Error MakeError(const wchar_t* msg)
+	{
+		std::wstring message(msg);
+		message.append(L", zip error = ").append(std::to_wstring(zip_error_code_zip(zip_get_error(archive))));
+		return Error(std::move(message));
+	}
+
+	zip_t* archive = nullptr;
+	std::set<std::string> dirs;
+};
+
+size_t Scaled(double scale, size_t value)
+{
+	const size_t scaled = static_cast<size_t>(value * scale);
+	return scaled == 0 ? 1 : scaled;
+}
+
+// COMMENT: a jar-heavy payload, many small deflated class files in package directories.
+Error BuildClasses(ArchiveBuilder& builder, double scale, Random& random)
+{
+	const size_t count = Scaled(scale, 20000);
+	for (size_t i = 0; i < count; i++)
+	{
+		std::string name("classes/com/infomaximum/module");
+		name.append(std::to_string(i % 40)).append("/pkg").append(std::to_string(i % 200)).append("/Class").append(std::to_string(i)).append(".class");
+
+		Error err = builder.AddFile(name, random.Range(1024, 8 * 1024), true, true, random);
+		if (!err.Succeeded())
+		{
+			return err;
+		}
+	}
+	return Error();
+}
+
+// COMMENT: a JRE module image or a database, a few large incompressible files stored as is.
+Error BuildBlobs(ArchiveBuilder& builder, double scale, Random& random)
+{
+	for (size_t i = 0; i < 3; i++)
+	{
+		Error err = builder.AddFile(std::string("blobs/blob").append(std::to_string(i)).append(".bin"), Scaled(scale, 200 * 1024 * 1024), false, false, random);
+		if (!err.Succeeded())
+		{
+			return err;
+		}
+	}
+	return Error();
+}
+
+// COMMENT: medium files, stored and deflated, compressible and not.
+Error BuildMixed(ArchiveBuilder& builder, double scale, Random& random)
+{
+	const size_t count = Scaled(scale, 2000);
+	for (size_t i = 0; i < count; i++)
+	{
+		const bool compressible = (i % 2) == 0;
+		const bool deflate = (i % 3) != 0;
+		Error err = builder.AddFile(std::string("mixed/dir").append(std::to_string(i % 16)).append("/file").append(std::to_string(i)),
+			random.Range(16 * 1024, 1024 * 1024), compressible, deflate, random);
+		if (!err.Succeeded())
+		{
+			return err;
+		}
+	}
+	return Error();
+}
+
+// COMMENT: node_modules-like nesting, directory creation dominates.
+Error BuildDeep(ArchiveBuilder& builder, double scale, Random& random)
+{
+	const size_t count = Scaled(scale, 5000);
+	for (size_t i = 0; i < count; i++)
+	{
+		std::string name("deep");
+		const size_t depth = 8 + i % 24;
+		for (size_t level = 0; level < depth; level++)
+		{
+			name.append("/d").append(std::to_string((i >> (level % 8)) % 4));
+		}
+		name.append("/f").append(std::to_string(i)).append(".txt");
+
+		Error err = builder.AddFile(name, random.Range(64, 4 * 1024), true, true, random);
+		if (!err.Succeeded())
+		{
+			return err;
+		}
+	}
+	return Error();
+}
+
+struct Shape
+{
+	const char* name;
+	std::function<Error(ArchiveBuilder&, double, Random&)> build;
+};
+
+const Shape Shapes[] = {
+	{ "classes", BuildClasses },
+	{ "blobs", BuildBlobs },
+	{ "mixed", BuildMixed },
+	{ "deep", BuildDeep }
+};
+
+Error ReadFile(const std::wstring& path, std::vector<uint8_t>& content)
+{
+	File file;
+	Error err = file.OpenRead(path);
+	if (err.Succeeded())
+	{
+		err = file.Read(content);
+	}
+	return err;
+}
+
+uint64_t GetPeakRss()
+{
+#ifdef _WIN32
+	PROCESS_MEMORY_COUNTERS counters;
+	counters.cb = sizeof(counters);
+	return GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)) ? counters.PeakWorkingSetSize : 0;
+#else
+	// COMMENT: ru_maxrss is in kilobytes on Linux.
+	rusage usage;
+	return getrusage(RUSAGE_SELF, &usage) == 0 ? static_cast<uint64_t>(usage.ru_maxrss) * 1024 : 0;
+#endif
+}
+
+unsigned long GetProcessId()
+{
+#ifdef _WIN32
+	return GetCurrentProcessId();
+#else
+	return static_cast<unsigned long>(getpid());
+#endif
+}
+
+std::wstring GetTempDir()
+{
+#ifdef _WIN32
+	wchar_t tempPath[MAX_PATH + 1];
+	const DWORD len = GetTempPathW(MAX_PATH + 1, tempPath);
+	return len != 0 && len <= MAX_PATH ? std::wstring(tempPath, len) : std::wstring(L".\\");
+#else
+	const char* tmpDir = getenv("TMPDIR");
+	std::wstring tempPath;
+	ConvertUtf8ToUtf16(std::string(tmpDir != nullptr && tmpDir[0] == '/' ? tmpDir : "/tmp"), tempPath);
+	if (tempPath.back() != Path::Separator)
+	{
+		tempPath.push_back(Path::Separator);
+	}
+	return tempPath;
+#endif
+}
+
+// COMMENT: wall time of threadCount concurrent extractions of the archive, each into its own directory.
+Error RunExtraction(const std::vector<uint8_t>& archive, unsigned threadCount, const zip_archive::UnpackOptions& unpackOptions, double& seconds)
+{
+	std::vector<std::wstring> destDirs(threadCount);
+	for (unsigned i = 0; i < threadCount; i++)
+	{
+		Error err = Path::GetTempDirPath(TmpPrefix, destDirs[i]);
+		if (!err.Succeeded())
+		{
+			return err;
+		}
+	}
+
+	std::vector<Error> results(threadCount);
+	std::vector<std::thread> threads;
+
+	const auto start = std::chrono::steady_clock::now();
+	for (unsigned i = 0; i < threadCount; i++)
+	{
+		threads.emplace_back([&archive, &destDirs, &results, &unpackOptions, i]()
+		{
+			// COMMENT: libzip only reads the buffer, the archives share one copy like executors share the resource.
+			results[i] = zip_archive::UnpackToFolder(const_cast<uint8_t*>(archive.data()), archive.size(), destDirs[i], nullptr, nullptr, unpackOptions);
+		});
+	}
+	for (std::thread& thread : threads)
+	{
+		thread.join();
+	}
+	seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	for (const std::wstring& destDir : destDirs)
+	{
+		Cleanup::RemoveTree(destDir);
+	}
+
+	for (const Error& result : results)
+	{
+		if (!result.Succeeded())
+		{
+			return result;
+		}
+	}
+	return Error();
+}
+
+std::string FormatResult(const char* shape, unsigned threadCount, const zip_archive::UnpackOptions& unpackOptions, const ArchiveBuilder& builder,
+	size_t archiveSize, double seconds)
+{
+	const double totalBytes = static_cast<double>(builder.bytes) * threadCount;
+	const double totalEntries = static_cast<double>(builder.entries) * threadCount;
+
+	char line[512];
+	std::snprintf(line, sizeof(line),
+		"{\"shape\":\"%s\",\"backend\":\"buffer\",\"threads\":%u,\"preallocate\":%s,\"temporary\":%s,\"direct_io_mb\":%llu,\"entries\":%llu,"
+		"\"bytes\":%llu,\"archive_bytes\":%llu,\"seconds\":%.6f,\"mb_per_s\":%.2f,\"entries_per_s\":%.1f,\"peak_rss_mb\":%.1f}",
+		shape, threadCount, unpackOptions.preallocate ? "true" : "false", unpackOptions.temporary ? "true" : "false",
+		static_cast<unsigned long long>(unpackOptions.directIoThreshold / (1024 * 1024)), static_cast<unsigned long long>(builder.entries),
+		static_cast<unsigned long long>(builder.bytes), static_cast<unsigned long long>(archiveSize), seconds, totalBytes / (1024.0 * 1024.0) / seconds, totalEntries / seconds,
+		static_cast<double>(GetPeakRss()) / (1024.0 * 1024.0));
+	return line;
+}
+
+Error RunShape(const Shape& shape, const Options& options, std::ostream& out)
+{
+	const std::wstring archivePath = std::wstring(GetTempDir()).append(TmpPrefix).append(std::to_wstring(GetProcessId())).append(L".zip");
+
+	ArchiveBuilder builder;
+	Random random(0x5EED);
+	Error err = builder.Create(archivePath);
+	if (err.Succeeded())
+	{
+		err = shape.build(builder, options.scale, random);
+	}
+	if (err.Succeeded())
+	{
+		err = builder.Close();
+	}
+
+	std::vector<uint8_t> archive;
+	if (err.Succeeded())
+	{
+		err = ReadFile(archivePath, archive);
+	}
+	File::Delete(archivePath);
+	if (!err.Succeeded())
+	{
+		return err;
+	}
+
+	for (unsigned threadCount : options.threads)
+	{
+		// COMMENT: the fastest repetition is reported, slower ones measure interference rather than the extractor.
+		double best = 0;
+		for (unsigned i = 0; i < options.repeat; i++)
+		{
+			double seconds = 0;
+			err = RunExtraction(archive, threadCount, options.unpackOptions, seconds);
+			if (!err.Succeeded())
+			{
+				return err;
+			}
+			best = i == 0 || seconds < best ? seconds : best;
+		}
+
+		out << FormatResult(shape.name, threadCount, options.unpackOptions, builder, archive.size(), best) << std::endl;
+	}
+
+	return Error();
+}
+
+// COMMENT: the conversion ConvertUtf8ToUtf16 did before, the reference of the check and the baseline of the measurement.
+bool SystemUtf8ToUtf16(const char* src, size_t size, std::wstring& dst)
+{
+	dst.clear();
+	if (size == 0)
+	{
+		return true;
+	}
+
+#ifdef _WIN32
+	const int len = MultiByteToWideChar(CP_UTF8, 0, src, static_cast<int>(size), NULL, 0);
+	if (len <= 0)
+	{
+		return false;
+	}
+
+	dst.resize(len);
+	return MultiByteToWideChar(CP_UTF8, 0, src, static_cast<int>(size), &dst[0], len) == len;
+#else
+	// COMMENT: codecvt_utf8 lets encoded surrogates through, they count as rejected like the other invalid sequences.
+	static const std::codecvt_utf8<wchar_t> codecvt;
+	std::mbstate_t state = std::mbstate_t();
+	const char* srcNext = nullptr;
+	wchar_t* dstNext = nullptr;
+	dst.resize(size);
+	if (codecvt.in(state, src, src + size, srcNext, &dst[0], &dst[0] + size, dstNext) != std::codecvt_base::ok)
+	{
+		return false;
+	}
+
+	dst.resize(static_cast<size_t>(dstNext - &dst[0]));
+	return std::none_of(dst.begin(), dst.end(), [](wchar_t c) { return c >= 0xD800 && c <= 0xDFFF; });
+#endif
+}
+
+class TranscodeCheck
+{
+public:
+
+	void Check(const std::string& input)
+	{
+		checked++;
+		ConvertUtf8ToUtf16(input, actual);
+		const bool converted = SystemUtf8ToUtf16(input.data(), input.size(), expected);
+#ifndef _WIN32
+		if (!converted)
+		{
+			skipped++;
+			return;
+		}
+#endif
+		if (!converted || actual != expected)
+		{
+			if (mismatches++ == 0)
+			{
+				firstMismatch = input;
+			}
+		}
+	}
+
+	// COMMENT: around every length where the 16-byte ASCII loop hands over to the scalar one.
+	void CheckAfterAscii(const std::string& tail)
+	{
+		for (size_t prefix : { 0, 1, 15, 16, 17, 31, 32, 33 })
+		{
+			Check(std::string(prefix, 'a').append(tail).append(17, 'b'));
+		}
+	}
+
+	std::string FormatResult() const
+	{
+		std::string hex;
+		for (char c : firstMismatch)
+		{
+			char byte[4];
+			std::snprintf(byte, sizeof(byte), "%02X", static_cast<uint8_t>(c));
+			hex.append(byte);
+		}
+
+		char line[512];
+		std::snprintf(line, sizeof(line), "{\"transcode\":\"check\",\"inputs\":%llu,\"skipped\":%llu,\"mismatches\":%llu,\"first_mismatch\":\"%s\"}",
+			static_cast<unsigned long long>(checked), static_cast<unsigned long long>(skipped), static_cast<unsigned long long>(mismatches),
+			hex.substr(0, 128).c_str());
+		return line;
+	}
+
+	uint64_t checked = 0;
+	uint64_t skipped = 0;
+	uint64_t mismatches = 0;
+
+private:
+
+	std::wstring actual;
+	std::wstring expected;
+	std::string firstMismatch;
+};
+
+void RunTranscodeCheck(TranscodeCheck& check)
+{
+	// COMMENT: surrogates are encoded too, they must be rejected like the bytes of any other invalid sequence.
+	std::string encoded;
+	for (char32_t codePoint = 0; codePoint <= 0x10FFFF; codePoint++)
+	{
+		encoded.clear();
+		string_converter::AppendUtf8(codePoint, encoded);
+		check.CheckAfterAscii(encoded);
+	}
+
+	std::string bytes(3, '\0');
+	for (uint32_t value = 0; value < 0x1000000; value++)
+	{
+		bytes[0] = static_cast<char>(value >> 16);
+		bytes[1] = static_cast<char>(value >> 8);
+		bytes[2] = static_cast<char>(value);
+		check.Check(bytes);
+		if ((value & 0xFF) == 0)
+		{
+			check.Check(bytes.substr(0, 1));
+		}
+		if (value < 0x10000)
+		{
+			check.Check(bytes.substr(1));
+		}
+	}
+
+	// COMMENT: four byte sequences only with continuation bytes at the edges of the valid ranges.
+	const uint8_t edges[] = { 0x00, 0x7F, 0x80, 0x8F, 0x90, 0x9F, 0xA0, 0xBF, 0xC0, 0xFF };
+	for (uint32_t lead = 0xF0; lead <= 0xFF; lead++)
+	{
+		for (uint32_t second = 0; second <= 0xFF; second++)
+		{
+			for (uint8_t third : edges)
+			{
+				for (uint8_t fourth : edges)
+				{
+					const char sequence[] = { static_cast<char>(lead), static_cast<char>(second), static_cast<char>(third), static_cast<char>(fourth) };
+					check.CheckAfterAscii(std::string(sequence, sizeof(sequence)));
+				}
+			}
+		}
+	}
+}
+
+std::vector<std::string> MakeEntryNames(bool cyrillic)
+{
+	// COMMENT: "документы/отчёт_" in UTF-8, names of user content rather than of classes.
+	const std::string cyrillicDir("\xD0\xB4\xD0\xBE\xD0\xBA\xD1\x83\xD0\xBC\xD0\xB5\xD0\xBD\xD1\x82\xD1\x8B/"
+		"\xD0\xBE\xD1\x82\xD1\x87\xD1\x91\xD1\x82_");
+
+	std::vector<std::string> names;
+	names.reserve(TranscodeNames);
+	for (size_t i = 0; i < TranscodeNames; i++)
+	{
+		if (cyrillic)
+		{
+			names.push_back(std::string(cyrillicDir).append(std::to_string(i)).append(".xlsx"));
+		}
+		else
+		{
+			names.push_back(std::string("com/infomaximum/platform/component/").append(std::to_string(i % 97)).append("/Class").append(std::to_string(i)).append(".class"));
+		}
+	}
+	return names;
+}
+
+template <typename Convert>
+double MeasureTranscode(const std::vector<std::string>& names, unsigned repeat, Convert convert)
+{
+	double best = 0;
+	for (unsigned i = 0; i < repeat; i++)
+	{
+		const auto start = std::chrono::steady_clock::now();
+		for (const std::string& name : names)
+		{
+			convert(name);
+		}
+		const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		best = i == 0 || seconds < best ? seconds : best;
+	}
+	return best;
+}
+
+void RunTranscodeBenchmark(const Options& options, std::ostream& out)
+{
+	for (bool cyrillic : { false, true })
+	{
+		const std::vector<std::string> names = MakeEntryNames(cyrillic);
+		size_t bytes = 0;
+		for (const std::string& name : names)
+		{
+			bytes += name.size();
+		}
+
+		// COMMENT: as in ZipArchive::Unpack, the new conversion reuses one string and the old one allocated per entry.
+		std::wstring name;
+		const double converter = MeasureTranscode(names, options.repeat, [&name](const std::string& src)
+		{
+			ConvertUtf8ToUtf16(src, name);
+		});
+		const double system = MeasureTranscode(names, options.repeat, [](const std::string& src)
+		{
+			std::wstring name;
+			SystemUtf8ToUtf16(src.data(), src.size(), name);
+		});
+
+		char line[512];
+		std::snprintf(line, sizeof(line), "{\"transcode\":\"%s\",\"names\":%llu,\"bytes\":%llu,\"converter_ns_per_name\":%.1f,\"system_ns_per_name\":%.1f}",
+			cyrillic ? "cyrillic" : "ascii", static_cast<unsigned long long>(names.size()), static_cast<unsigned long long>(bytes),
+			converter * 1e9 / names.size(), system * 1e9 / names.size());
+		out << line << std::endl;
+	}
+}
+
+template <typename T>
+bool ParseList(const std::string& value, std::vector<T>& dst, std::function<bool(const std::string&, T&)> parse)
+{
+	dst.clear();
+	std::stringstream stream(value);
+	std::string item;
+	while (std::getline(stream, item, ','))
+	{
+		T parsed;
+		if (!parse(item, parsed))
+		{
+			return false;
+		}
+		dst.push_back(parsed);
+	}
+	return !dst.empty();
+}
+
+bool ParseOptions(int argc, char** argv, Options& options)
+{
+	for (int i = 1; i < argc; i++)
+	{
+		const std::string arg(argv[i]);
+		const size_t separator = arg.find('=');
+		const std::string key = arg.substr(0, separator);
+		const std::string value = separator == std::string::npos ? std::string() : arg.substr(separator + 1);
+
+		bool parsed = true;
+		if (key == "--shapes")
+		{
+			parsed = ParseList<std::string>(value, options.shapes, [](const std::string& item, std::string& dst)
+			{
+				dst = item;
+				return true;
+			});
+		}
+		else if (key == "--threads")
+		{
+			parsed = ParseList<unsigned>(value, options.threads, [](const std::string& item, unsigned& dst)
+			{
+				dst = static_cast<unsigned>(strtoul(item.c_str(), nullptr, 10));
+				return dst != 0;
+			});
+		}
+		else if (key == "--scale")
+		{
+			options.scale = strtod(value.c_str(), nullptr);
+			parsed = options.scale > 0;
+		}
+		else if (key == "--repeat")
+		{
+			options.repeat = static_cast<unsigned>(strtoul(value.c_str(), nullptr, 10));
+			parsed = options.repeat != 0;
+		}
+		else if (key == "--out")
+		{
+			options.out = value;
+			parsed = !value.empty();
+		}
+		else if (key == "--preallocate" || key == "--temporary")
+		{
+			bool& flag = key == "--preallocate" ? options.unpackOptions.preallocate : options.unpackOptions.temporary;
+			flag = value == "1";
+			parsed = value == "0" || value == "1";
+		}
+		else if (key == "--direct-io-mb")
+		{
+			char* end = nullptr;
+			options.unpackOptions.directIoThreshold = static_cast<uint64_t>(strtoull(value.c_str(), &end, 10)) * 1024 * 1024;
+			parsed = !value.empty() && *end == '\0';
+		}
+		else if (key == "--transcode")
+		{
+			options.transcode = true;
+		}
+		else
+		{
+			parsed = false;
+		}
+
+		if (!parsed)
+		{
+			std::cerr << "invalid argument " << arg << std::endl;
+			return false;
+		}
+	}
+
+	return true;
+}
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+	Options options;
+	if (!ParseOptions(argc, argv, options))
+	{
+		return EXIT_FAILURE;
+	}
+
+	std::ofstream outFile;
+	if (!options.out.empty())
+	{
+		outFile.open(options.out, std::ios::out | std::ios::app);
+		if (!outFile)
+		{
+			std::cerr << "can not open " << options.out << std::endl;
+			return EXIT_FAILURE;
+		}
+	}
+	std::ostream& out = options.out.empty() ? std::cout : outFile;
+
+	if (options.transcode)
+	{
+		TranscodeCheck check;
+		RunTranscodeCheck(check);
+		out << check.FormatResult() << std::endl;
+		if (check.mismatches != 0)
+		{
+			return EXIT_FAILURE;
+		}
+
+		RunTranscodeBenchmark(options, out);
+		return EXIT_SUCCESS;
+	}
+
+	for (const std::string& shapeName : options.shapes)
+	{
+		const Shape* shape = nullptr;
+		for (const Shape& candidate : Shapes)
+		{
+			if (shapeName == candidate.name)
+			{
+				shape = &candidate;
+			}
+		}
+
+		if (shape == nullptr)
+		{
+			std::cerr << "unknown shape " << shapeName << std::endl;
+			return EXIT_FAILURE;
+		}
+
+		Error err = RunShape(*shape, options, out);
+		if (!err.Succeeded())
+		{
+			std::wcerr << L"shape " << shapeName.c_str() << L": " << err.getMessage() << std::endl;
+			return EXIT_FAILURE;
+		}
+	}
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <string>
+#include <cwchar>
+
+// COMMENT: x86-64 microarchitecture levels of the psABI. V2 adds SSE4.2 and POPCNT, V3 adds AVX2, BMI2 and FMA,
+// V4 adds AVX-512 (F, BW, CD, DQ, VL).
+enum class CpuLevel
+{
+	Baseline = 1,
+	V2,
+	V3,
+	V4
+};
+
+// COMMENT: the ZIP resource NAME@LEVEL is a variant of the payload NAME built for LEVEL, NAME without a level
+// is its baseline variant.
+const wchar_t CpuLevelSeparator = L'@';
+
+inline const wchar_t* GetCpuLevelName(CpuLevel level)
+{
+	switch (level)
+	{
+	case CpuLevel::V2:
+		return L"X86_64_V2";
+	case CpuLevel::V3:
+		return L"X86_64_V3";
+	case CpuLevel::V4:
+		return L"X86_64_V4";
+	default:
+		return L"X86_64";
+	}
+}
+
+inline bool ParseCpuLevel(const std::wstring& name, CpuLevel& level)
+{
+	for (CpuLevel candidate : { CpuLevel::Baseline, CpuLevel::V2, CpuLevel::V3, CpuLevel::V4 })
+	{
+		if (_wcsicmp(name.c_str(), GetCpuLevelName(candidate)) == 0)
+		{
+			level = candidate;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+// COMMENT: returns false for a malformed level, the resource is then not a payload variant.
+inline bool SplitVariantName(const std::wstring& resName, std::wstring& baseName, CpuLevel& level)
+{
+	const size_t separator = resName.find_last_of(CpuLevelSeparator);
+	if (separator == std::wstring::npos)
+	{
+		baseName = resName;
+		level = CpuLevel::Baseline;
+		return true;
+	}
+
+	baseName = resName.substr(0, separator);
+	return ParseCpuLevel(resName.substr(separator + 1), level);
+}
@@ -3,7 +3,14 @@
 #include <string>
 #include <algorithm>
 #include <cwctype>
+#include <cwchar>
+#include <cstdio>
+#ifdef _WIN32
 #include <Windows.h>
+#else
+#include <cstdlib>
+#include <cstring>
+#endif
 
 class Error
 {
@@ -15,6 +22,7 @@ public:
 
 	Error() = default;
 
+#ifdef _WIN32
 	explicit Error(DWORD code)
 	{
 		if (code != ERROR_SUCCESS) 
@@ -22,6 +30,7 @@ public:
 			message = ToString(code);
 		}
 	}
+#endif
 
 	explicit Error(std::wstring&& msg)
 		: message(std::move(msg))
@@ -38,13 +47,14 @@ public:
 		return message;
 	}
 
-	static Error makeByErrno(errno_t err)
+	static Error makeByErrno(int err)
 	{
 		return Error(ErrnoToString(err));
 	}
 
 private:
 
+#ifdef _WIN32
 	static std::wstring ToString(DWORD errorCode)
 	{
 		const DWORD bufferLen = 2 * 1024;
@@ -68,7 +78,7 @@ private:
 		return result;
 	}
 
-	static std::wstring ErrnoToString(errno_t errorCode)
+	static std::wstring ErrnoToString(int errorCode)
 	{
 		const DWORD bufferLen = 2 * 1024;
 		wchar_t buffer[bufferLen];
@@ -80,4 +90,24 @@ private:
 
 		return std::wstring(buffer);
 	}
+#else
+	// COMMENT: strerror is localized by the C locale, mbstowcs decodes it the same way.
+	static std::wstring ErrnoToString(int errorCode)
+	{
+		const size_t bufferLen = 2 * 1024;
+		wchar_t buffer[bufferLen];
+
+		const size_t len = std::mbstowcs(buffer, std::strerror(errorCode), bufferLen - 1);
+		if (len == static_cast<size_t>(-1) || len == 0)
+		{
+			std::swprintf(buffer, bufferLen, L"errno No. %d", errorCode);
+		}
+		else
+		{
+			buffer[len] = L'\0';
+		}
+
+		return std::wstring(buffer);
+	}
+#endif
 };
\ No newline at end of file
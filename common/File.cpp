@@ -1,6 +1,6 @@
 #include "File.h"
-#include <thread>
 #include <Windows.h>
+#include <winternl.h>
 
 namespace
 {
@@ -33,6 +33,11 @@ Error OpenFile_Read(const std::wstring& path, HANDLE& descriptor)
 	return Create(path.c_str(), GENERIC_READ, FILE_SHARE_READ, OPEN_EXISTING, FILE_ATTRIBUTE_READONLY, descriptor);
 }
 
+Error OpenFile_ReadWrite(const std::wstring& path, HANDLE& descriptor)
+{
+	return Create(path.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, descriptor);
+}
+
 Error GetFileSize(HANDLE hFile, uint64_t& dest)
 {
 	dest = 0;
@@ -55,6 +60,69 @@ Error FileRead(HANDLE file, void* buff, DWORD bytesToRead, DWORD* numOfReadBytes
 	return ReadFile(file, buff, bytesToRead, numOfReadBytes, NULL) != FALSE ? Error() : Error(GetLastError());
 }
 
+// COMMENT: CreateFile takes full paths only, a name relative to an open directory needs NtCreateFile with RootDirectory.
+// ntdll.dll is mapped into every process, so the functions are looked up there instead of linking ntdll.lib.
+class NtApi
+{
+public:
+
+	typedef NTSTATUS (NTAPI *NtCreateFileFn)(PHANDLE, ACCESS_MASK, POBJECT_ATTRIBUTES, PIO_STATUS_BLOCK, PLARGE_INTEGER, ULONG, ULONG, ULONG, ULONG, PVOID, ULONG);
+	typedef ULONG (NTAPI *RtlNtStatusToDosErrorFn)(NTSTATUS);
+
+	static const NtApi& Get()
+	{
+		static const NtApi api;
+		return api;
+	}
+
+	Error CreateAt(HANDLE dir, const std::wstring& name, ACCESS_MASK access, ULONG attributes, ULONG shareMode, ULONG disposition, ULONG options,
+		HANDLE& descriptor) const
+	{
+		descriptor = INVALID_HANDLE_VALUE;
+		if (ntCreateFile == nullptr || rtlNtStatusToDosError == nullptr)
+		{
+			return Error(static_cast<DWORD>(ERROR_PROC_NOT_FOUND));
+		}
+		if (name.size() * sizeof(wchar_t) > 0xFFFF)
+		{
+			return Error(static_cast<DWORD>(ERROR_FILENAME_EXCED_RANGE));
+		}
+
+		UNICODE_STRING nativeName;
+		nativeName.Buffer = const_cast<PWSTR>(name.c_str());
+		nativeName.Length = static_cast<USHORT>(name.size() * sizeof(wchar_t));
+		nativeName.MaximumLength = nativeName.Length;
+
+		OBJECT_ATTRIBUTES objectAttributes;
+		InitializeObjectAttributes(&objectAttributes, &nativeName, OBJ_CASE_INSENSITIVE, dir, NULL);
+
+		IO_STATUS_BLOCK ioStatus;
+		HANDLE handle = NULL;
+		const NTSTATUS status = ntCreateFile(&handle, access | SYNCHRONIZE, &objectAttributes, &ioStatus, NULL, attributes, shareMode, disposition,
+			options | FILE_SYNCHRONOUS_IO_NONALERT, NULL, 0);
+		// COMMENT: NT_SUCCESS is not part of winternl.h, failures are the negative statuses.
+		if (status < 0)
+		{
+			return Error(static_cast<DWORD>(rtlNtStatusToDosError(status)));
+		}
+
+		descriptor = handle;
+		return Error();
+	}
+
+private:
+
+	NtApi()
+	{
+		const HMODULE ntdll = GetModuleHandleW(L"ntdll.dll");
+		ntCreateFile = ntdll != NULL ? reinterpret_cast<NtCreateFileFn>(GetProcAddress(ntdll, "NtCreateFile")) : nullptr;
+		rtlNtStatusToDosError = ntdll != NULL ? reinterpret_cast<RtlNtStatusToDosErrorFn>(GetProcAddress(ntdll, "RtlNtStatusToDosError")) : nullptr;
+	}
+
+	NtCreateFileFn ntCreateFile;
+	RtlNtStatusToDosErrorFn rtlNtStatusToDosError;
+};
+
 
 } // namespace
 
@@ -76,6 +144,18 @@ Error File::OpenWrite(const std::wstring& path)
 	return OpenFile_Write(path, descriptor);
 }
 
+Error File::OpenWrite(const Directory& dir, const std::wstring& name, unsigned flags)
+{
+	Close();
+
+	// COMMENT: the same access and sharing as OpenFile_Write, FILE_OVERWRITE_IF is CREATE_ALWAYS, FILE_SEQUENTIAL_ONLY
+	// is FILE_FLAG_SEQUENTIAL_SCAN and FILE_NO_INTERMEDIATE_BUFFERING is FILE_FLAG_NO_BUFFERING.
+	const ULONG attributes = (flags & WriteTemporary) != 0 ? FILE_ATTRIBUTE_TEMPORARY : FILE_ATTRIBUTE_NORMAL;
+	const ULONG options = FILE_NON_DIRECTORY_FILE | FILE_SEQUENTIAL_ONLY | ((flags & WriteDirect) != 0 ? FILE_NO_INTERMEDIATE_BUFFERING : 0);
+	return NtApi::Get().CreateAt(dir.GetHandle(), name, GENERIC_WRITE | FILE_READ_ATTRIBUTES, attributes, FILE_SHARE_READ, FILE_OVERWRITE_IF, options,
+		descriptor);
+}
+
 Error File::OpenRead(const std::wstring& path)
 {
 	Close();
@@ -83,6 +163,13 @@ Error File::OpenRead(const std::wstring& path)
 	return OpenFile_Read(path, descriptor);
 }
 
+Error File::OpenReadWrite(const std::wstring& path)
+{
+	Close();
+
+	return OpenFile_ReadWrite(path, descriptor);
+}
+
 Error File::Read(std::vector<uint8_t>& dst)
 {
 	uint64_t fileSize = 0;
@@ -93,9 +180,13 @@ Error File::Read(std::vector<uint8_t>& dst)
 	}
 
 	dst.resize(fileSize);
+	if (dst.empty())
+	{
+		return Error();
+	}
 
-	DWORD readCount;
-	err = Read(&dst[0], static_cast<DWORD>(fileSize), readCount);
+	uint32_t readCount;
+	err = Read(&dst[0], static_cast<uint32_t>(fileSize), readCount);
 	if (!err.Succeeded())
 	{
 		return err;
@@ -104,37 +195,148 @@ Error File::Read(std::vector<uint8_t>& dst)
 	return Error();
 }
 
-Error File::Write(const uint8_t* pBuffer, const DWORD dwBytesToWrite)
+Error File::Write(const uint8_t* pBuffer, const uint32_t bytesToWrite)
 {
-	DWORD dwNeed = dwBytesToWrite;
-	DWORD dwWrite = 0;
-	while (dwWrite < dwNeed)
+	DWORD dwNeed = bytesToWrite;
+	while (dwNeed > 0)
 	{
+		DWORD dwWrite = 0;
 		Error error = ::Write(descriptor, pBuffer, dwNeed, &dwWrite);
 		if (!error.Succeeded())
 		{
 			return error;
 		}
 
+		// COMMENT: a synchronous write to a disk file completes in full or fails, nothing written is a fault and not a reason to wait.
 		if (dwWrite == 0)
 		{
-			std::this_thread::sleep_for(std::chrono::milliseconds(1000));
-		}
-		else
-		{
-			pBuffer = pBuffer + dwWrite;
-			dwNeed -= dwWrite;
+			return Error(static_cast<DWORD>(ERROR_WRITE_FAULT));
 		}
+
+		pBuffer = pBuffer + dwWrite;
+		dwNeed -= dwWrite;
 	}
 
 	return Error();
 }
 
+Error File::Seek(uint64_t offset)
+{
+	LARGE_INTEGER position;
+	position.QuadPart = static_cast<LONGLONG>(offset);
+
+	return SetFilePointerEx(descriptor, position, NULL, FILE_BEGIN) != FALSE ? Error() : Error(GetLastError());
+}
+
+Error File::SetModificationTime(time_t time)
+{
+	// COMMENT: FILETIME counts 100-nanosecond intervals since January 1, 1601.
+	const uint64_t ticks = (static_cast<uint64_t>(time) + 11644473600ULL) * 10000000ULL;
+
+	FILETIME ft;
+	ft.dwLowDateTime = static_cast<DWORD>(ticks);
+	ft.dwHighDateTime = static_cast<DWORD>(ticks >> 32);
+
+	return SetFileTime(descriptor, NULL, NULL, &ft) != FALSE ? Error() : Error(GetLastError());
+}
+
+Error File::SetReadOnly(bool readOnly)
+{
+	FILE_BASIC_INFO basicInfo;
+	if (!GetFileInformationByHandleEx(descriptor, FileBasicInfo, &basicInfo, sizeof(basicInfo)))
+	{
+		return Error(GetLastError());
+	}
+
+	// COMMENT: other attributes like FILE_ATTRIBUTE_TEMPORARY are kept. Zero times are left as they are,
+	// so the modification time set before survives.
+	const DWORD attributes = basicInfo.FileAttributes & ~FILE_ATTRIBUTE_NORMAL;
+	basicInfo.FileAttributes = readOnly ? (attributes | FILE_ATTRIBUTE_READONLY) : (attributes & ~FILE_ATTRIBUTE_READONLY);
+	basicInfo.CreationTime.QuadPart = 0;
+	basicInfo.LastAccessTime.QuadPart = 0;
+	basicInfo.LastWriteTime.QuadPart = 0;
+	basicInfo.ChangeTime.QuadPart = 0;
+	if (basicInfo.FileAttributes == 0)
+	{
+		basicInfo.FileAttributes = FILE_ATTRIBUTE_NORMAL;
+	}
+
+	return SetFileInformationByHandle(descriptor, FileBasicInfo, &basicInfo, sizeof(basicInfo)) != FALSE ? Error() : Error(GetLastError());
+}
+
+Error File::SetSize(uint64_t size)
+{
+	FILE_END_OF_FILE_INFO endOfFileInfo;
+	endOfFileInfo.EndOfFile.QuadPart = static_cast<LONGLONG>(size);
+
+	return SetFileInformationByHandle(descriptor, FileEndOfFileInfo, &endOfFileInfo, sizeof(endOfFileInfo)) != FALSE ? Error() : Error(GetLastError());
+}
+
+Error File::Preallocate(uint64_t size)
+{
+	// COMMENT: only the allocation, the end of file stays where the written data ends. A file extended to its final size
+	// up front would pass the size check of the extraction journal while still partly unwritten.
+	FILE_ALLOCATION_INFO allocationInfo;
+	allocationInfo.AllocationSize.QuadPart = static_cast<LONGLONG>(size);
+	if (SetFileInformationByHandle(descriptor, FileAllocationInfo, &allocationInfo, sizeof(allocationInfo)))
+	{
+		return Error();
+	}
+
+	const DWORD lastError = GetLastError();
+	return lastError == ERROR_INVALID_PARAMETER || lastError == ERROR_NOT_SUPPORTED || lastError == ERROR_INVALID_FUNCTION ? Error() : Error(lastError);
+}
+
 Error File::Delete(const std::wstring& file)
 {
 	return DeleteFile(file.c_str()) != FALSE ? Error() : Error(GetLastError());
 }
 
+Error File::Move(const std::wstring& from, const std::wstring& to)
+{
+	return MoveFileExW(from.c_str(), to.c_str(), MOVEFILE_REPLACE_EXISTING) != FALSE ? Error() : Error(GetLastError());
+}
+
+Error File::SetReadOnly(const std::wstring& path, bool readOnly)
+{
+	const DWORD oldAttributes = GetFileAttributesW(path.c_str());
+	if (oldAttributes == INVALID_FILE_ATTRIBUTES)
+	{
+		return Error(GetLastError());
+	}
+
+	// COMMENT: only the read-only bit changes, FILE_ATTRIBUTE_NORMAL is valid only alone.
+	const DWORD attributes = oldAttributes & ~FILE_ATTRIBUTE_NORMAL;
+	const DWORD newAttributes = readOnly ? (attributes | FILE_ATTRIBUTE_READONLY) : (attributes & ~FILE_ATTRIBUTE_READONLY);
+	if (newAttributes == oldAttributes)
+	{
+		return Error();
+	}
+
+	return SetFileAttributesW(path.c_str(), newAttributes != 0 ? newAttributes : FILE_ATTRIBUTE_NORMAL) != FALSE ? Error() : Error(GetLastError());
+}
+
+bool File::Exists(const std::wstring& path)
+{
+	return GetFileAttributesW(path.c_str()) != INVALID_FILE_ATTRIBUTES;
+}
+
+Error File::GetSize(const std::wstring& path, uint64_t& size)
+{
+	WIN32_FILE_ATTRIBUTE_DATA data;
+	if (!GetFileAttributesExW(path.c_str(), GetFileExInfoStandard, &data))
+	{
+		return Error(GetLastError());
+	}
+	if ((data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) != 0)
+	{
+		return Error(static_cast<DWORD>(ERROR_DIRECTORY));
+	}
+
+	size = (static_cast<uint64_t>(data.nFileSizeHigh) << 32) | data.nFileSizeLow;
+	return Error();
+}
+
 void File::Close()
 {
 	if (descriptor != INVALID_HANDLE_VALUE)
@@ -144,7 +346,27 @@ void File::Close()
 	}
 }
 
-Error File::Read(BYTE* pBuffer, const DWORD bufferSize, DWORD& readCount) const
+File::NativeHandle File::GetHandle() const
+{
+	return descriptor;
+}
+
+File::NativeHandle File::Detach()
+{
+	const NativeHandle handle = descriptor;
+	descriptor = INVALID_HANDLE_VALUE;
+	return handle;
+}
+
+void File::CloseNative(NativeHandle handle)
+{
+	if (handle != INVALID_HANDLE_VALUE)
+	{
+		CloseHandle(handle);
+	}
+}
+
+Error File::Read(uint8_t* pBuffer, const uint32_t bufferSize, uint32_t& readCount) const
 {
 	readCount = 0;
 	while (readCount < bufferSize)
@@ -165,4 +387,45 @@ Error File::Read(BYTE* pBuffer, const DWORD bufferSize, DWORD& readCount) const
 	}
 
 	return Error();
+}
+
+Directory::Directory()
+{
+	descriptor = INVALID_HANDLE_VALUE;
+}
+
+Directory::~Directory()
+{
+	Close();
+}
+
+Error Directory::Open(const std::wstring& path)
+{
+	Close();
+
+	// COMMENT: FILE_FLAG_BACKUP_SEMANTICS is required to open a directory, sharing delete lets the tree be renamed or removed later.
+	return ::Create(path.c_str(), FILE_LIST_DIRECTORY | FILE_TRAVERSE, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, OPEN_EXISTING,
+		FILE_FLAG_BACKUP_SEMANTICS, descriptor);
+}
+
+Error Directory::Create(const Directory& parent, const std::wstring& name)
+{
+	Close();
+
+	return NtApi::Get().CreateAt(parent.GetHandle(), name, FILE_LIST_DIRECTORY | FILE_TRAVERSE, FILE_ATTRIBUTE_NORMAL,
+		FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, FILE_OPEN_IF, FILE_DIRECTORY_FILE, descriptor);
+}
+
+File::NativeHandle Directory::GetHandle() const
+{
+	return descriptor;
+}
+
+void Directory::Close()
+{
+	if (descriptor != INVALID_HANDLE_VALUE)
+	{
+		CloseHandle(descriptor);
+		descriptor = INVALID_HANDLE_VALUE;
+	}
 }
\ No newline at end of file
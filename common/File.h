@@ -3,12 +3,36 @@
 #include "Error.hpp"
 #include <string>
 #include <vector>
+#include <ctime>
+#include <cstdint>
+#ifdef _WIN32
 #include <Windows.h>
+#endif
+
+class Directory;
 
 class File
 {
 public:
 
+#ifdef _WIN32
+	typedef HANDLE NativeHandle;
+#else
+	typedef int NativeHandle;
+#endif
+
+	enum WriteFlags
+	{
+		// COMMENT: kept in the cache rather than flushed early on Windows, the file must be removed when the run ends.
+		WriteTemporary = 1,
+		// COMMENT: bypasses the page cache. Buffers, offsets and sizes of writes must be multiples of DirectIoAlignment,
+		// a padded tail is cut off with SetSize.
+		WriteDirect = 2
+	};
+
+	// COMMENT: the largest sector size in use, 4K native disks.
+	static const uint32_t DirectIoAlignment = 4096;
+
 	File();
 	~File();
 
@@ -18,18 +42,63 @@ public:
 	File& operator=(File&& source) noexcept = delete;
 
 	Error OpenWrite(const std::wstring& path);
+	// COMMENT: name is a single path component, it is resolved from the open directory and not from the root.
+	// The file is opened for sequential writing, flags are WriteFlags.
+	Error OpenWrite(const Directory& dir, const std::wstring& name, unsigned flags = 0);
 	Error OpenRead(const std::wstring& path);
-	Error Write(const uint8_t* pBuffer, const DWORD dwBytesToWrite);
+	// COMMENT: opens the file for reading and writing from its start, creating an empty one when it does not exist.
+	Error OpenReadWrite(const std::wstring& path);
+	Error Write(const uint8_t* pBuffer, const uint32_t bytesToWrite);
 	Error Read(std::vector<uint8_t>& dst);
+	// COMMENT: reads from the current position, readCount is less than bufferSize only at the end of the file.
+	Error Read(uint8_t* pBuffer, const uint32_t bufferSize, uint32_t& readCount) const;
+	Error Seek(uint64_t offset);
+	Error SetModificationTime(time_t time);
+	Error SetReadOnly(bool readOnly);
+	Error SetSize(uint64_t size);
+	// COMMENT: reserves disk space for size bytes without changing the file size, so a large file is not fragmented
+	// by growing it write by write. Unsupported file systems are not an error.
+	Error Preallocate(uint64_t size);
 	static Error Delete(const std::wstring& path);
+	static Error Move(const std::wstring& from, const std::wstring& to);
+	static Error SetReadOnly(const std::wstring& path, bool readOnly);
+	static bool Exists(const std::wstring& path);
+	// COMMENT: the size by path without opening the file, fails for directories.
+	static Error GetSize(const std::wstring& path, uint64_t& size);
+	void Close();
+
+	// COMMENT: the handle stays owned by the file, for I/O the file has no method for.
+	NativeHandle GetHandle() const;
+	// COMMENT: the handle is handed over to the caller, who must close it with CloseNative.
+	NativeHandle Detach();
+	static void CloseNative(NativeHandle handle);
 
 private:
 
-	Error Read(BYTE* pBuffer, const DWORD bufferSize, DWORD& readCount) const;
+	NativeHandle	descriptor;
+};
+
+// COMMENT: an open directory to create files and subdirectories in without resolving its path again.
+class Directory
+{
+public:
+
+	Directory();
+	~Directory();
+
+	Directory(Directory&& other) = delete;
+	Directory(const Directory& other) = delete;
+	Directory& operator=(const Directory* pSource) = delete;
+	Directory& operator=(Directory&& source) noexcept = delete;
+
+	Error Open(const std::wstring& path);
+	// COMMENT: opens the subdirectory name of parent, creating it when it does not exist.
+	Error Create(const Directory& parent, const std::wstring& name);
+	File::NativeHandle GetHandle() const;
 	void Close();
 
 private:
 
-	HANDLE	descriptor;
+	File::NativeHandle	descriptor;
 };
 
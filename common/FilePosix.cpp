@@ -0,0 +1,376 @@
+#include "File.h"
+#include "StringConverter.hpp"
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+namespace
+{
+
+const int InvalidDescriptor = -1;
+
+// COMMENT: not every POSIX system has O_DIRECT, there WriteDirect writes through the cache with the same padding.
+#ifdef O_DIRECT
+const int DirectFlag = O_DIRECT;
+#else
+const int DirectFlag = 0;
+#endif
+
+Error ToNativePath(const std::wstring& path, std::string& nativePath)
+{
+	return ConvertUtf16ToUtf8(path, nativePath);
+}
+
+Error Open(const std::wstring& path, int flags, int& descriptor)
+{
+	std::string nativePath;
+	Error err = ToNativePath(path, nativePath);
+	if (!err.Succeeded())
+	{
+		return err;
+	}
+
+	descriptor = open(nativePath.c_str(), flags | O_CLOEXEC, 0644);
+	return descriptor >= 0 ? Error() : Error::makeByErrno(errno);
+}
+
+Error OpenAt(int dir, const std::string& nativeName, int flags, int& descriptor)
+{
+	descriptor = openat(dir, nativeName.c_str(), flags | O_CLOEXEC, 0644);
+	return descriptor >= 0 ? Error() : Error::makeByErrno(errno);
+}
+
+} // namespace
+
+
+File::File()
+{
+	descriptor = InvalidDescriptor;
+}
+
+File::~File()
+{
+	Close();
+}
+
+Error File::OpenWrite(const std::wstring& path)
+{
+	Close();
+
+	return Open(path, O_WRONLY | O_CREAT | O_TRUNC, descriptor);
+}
+
+Error File::OpenWrite(const Directory& dir, const std::wstring& name, unsigned flags)
+{
+	Close();
+
+	std::string nativeName;
+	Error err = ToNativePath(name, nativeName);
+	if (!err.Succeeded())
+	{
+		return err;
+	}
+
+	// COMMENT: there is no temporary attribute, dirty pages are written back by the kernel on its own schedule anyway.
+	return OpenAt(dir.GetHandle(), nativeName, O_WRONLY | O_CREAT | O_TRUNC | ((flags & WriteDirect) != 0 ? DirectFlag : 0), descriptor);
+}
+
+Error File::OpenRead(const std::wstring& path)
+{
+	Close();
+
+	return Open(path, O_RDONLY, descriptor);
+}
+
+Error File::OpenReadWrite(const std::wstring& path)
+{
+	Close();
+
+	return Open(path, O_RDWR | O_CREAT, descriptor);
+}
+
+Error File::Read(std::vector<uint8_t>& dst)
+{
+	struct stat sb;
+	if (fstat(descriptor, &sb) != 0)
+	{
+		return Error::makeByErrno(errno);
+	}
+
+	dst.resize(static_cast<size_t>(sb.st_size));
+	if (dst.empty())
+	{
+		return Error();
+	}
+
+	uint32_t readCount;
+	Error err = Read(&dst[0], static_cast<uint32_t>(dst.size()), readCount);
+	if (!err.Succeeded())
+	{
+		return err;
+	}
+
+	dst.resize(readCount);
+	return Error();
+}
+
+Error File::Write(const uint8_t* pBuffer, const uint32_t bytesToWrite)
+{
+	uint32_t written = 0;
+	while (written < bytesToWrite)
+	{
+		const ssize_t res = write(descriptor, pBuffer + written, bytesToWrite - written);
+		if (res < 0 && errno == EINTR)
+		{
+			continue;
+		}
+		if (res < 0)
+		{
+			return Error::makeByErrno(errno);
+		}
+
+		// COMMENT: a write of a nonzero count that writes nothing would do so again, it is a fault like on Windows.
+		if (res == 0)
+		{
+			return Error::makeByErrno(EIO);
+		}
+
+		written += static_cast<uint32_t>(res);
+	}
+
+	return Error();
+}
+
+Error File::Seek(uint64_t offset)
+{
+	return lseek(descriptor, static_cast<off_t>(offset), SEEK_SET) != static_cast<off_t>(-1) ? Error() : Error::makeByErrno(errno);
+}
+
+Error File::SetModificationTime(time_t time)
+{
+	// COMMENT: the access time is left as is, as SetFileTime does with a NULL pointer.
+	timespec times[2];
+	times[0].tv_sec = 0;
+	times[0].tv_nsec = UTIME_OMIT;
+	times[1].tv_sec = time;
+	times[1].tv_nsec = 0;
+
+	return futimens(descriptor, times) == 0 ? Error() : Error::makeByErrno(errno);
+}
+
+Error File::SetReadOnly(bool readOnly)
+{
+	struct stat sb;
+	if (fstat(descriptor, &sb) != 0)
+	{
+		return Error::makeByErrno(errno);
+	}
+
+	const mode_t mode = readOnly ? (sb.st_mode & ~(S_IWUSR | S_IWGRP | S_IWOTH)) : (sb.st_mode | S_IWUSR);
+	return fchmod(descriptor, mode & 07777) == 0 ? Error() : Error::makeByErrno(errno);
+}
+
+Error File::SetSize(uint64_t size)
+{
+	return ftruncate(descriptor, static_cast<off_t>(size)) == 0 ? Error() : Error::makeByErrno(errno);
+}
+
+Error File::Preallocate(uint64_t size)
+{
+#ifdef __linux__
+	// COMMENT: FALLOC_FL_KEEP_SIZE reserves the blocks without moving the end of file, see the Windows version.
+	if (fallocate(descriptor, FALLOC_FL_KEEP_SIZE, 0, static_cast<off_t>(size)) != 0 && errno != EOPNOTSUPP && errno != ENOSYS)
+	{
+		return Error::makeByErrno(errno);
+	}
+#else
+	(void)size;
+#endif
+
+	return Error();
+}
+
+Error File::Delete(const std::wstring& file)
+{
+	std::string nativePath;
+	Error err = ToNativePath(file, nativePath);
+	if (!err.Succeeded())
+	{
+		return err;
+	}
+
+	return unlink(nativePath.c_str()) == 0 ? Error() : Error::makeByErrno(errno);
+}
+
+Error File::Move(const std::wstring& from, const std::wstring& to)
+{
+	std::string nativeFrom;
+	std::string nativeTo;
+	Error err = ToNativePath(from, nativeFrom);
+	if (err.Succeeded())
+	{
+		err = ToNativePath(to, nativeTo);
+	}
+	if (!err.Succeeded())
+	{
+		return err;
+	}
+
+	return rename(nativeFrom.c_str(), nativeTo.c_str()) == 0 ? Error() : Error::makeByErrno(errno);
+}
+
+Error File::SetReadOnly(const std::wstring& path, bool readOnly)
+{
+	std::string nativePath;
+	Error err = ToNativePath(path, nativePath);
+	if (!err.Succeeded())
+	{
+		return err;
+	}
+
+	struct stat sb;
+	if (stat(nativePath.c_str(), &sb) != 0)
+	{
+		return Error::makeByErrno(errno);
+	}
+
+	// COMMENT: the read-only attribute of Windows maps to the write bits, clearing it restores write for the owner only.
+	const mode_t mode = readOnly ? (sb.st_mode & ~(S_IWUSR | S_IWGRP | S_IWOTH)) : (sb.st_mode | S_IWUSR);
+	return chmod(nativePath.c_str(), mode & 07777) == 0 ? Error() : Error::makeByErrno(errno);
+}
+
+bool File::Exists(const std::wstring& path)
+{
+	std::string nativePath;
+	struct stat sb;
+	return ToNativePath(path, nativePath).Succeeded() && stat(nativePath.c_str(), &sb) == 0;
+}
+
+Error File::GetSize(const std::wstring& path, uint64_t& size)
+{
+	std::string nativePath;
+	Error err = ToNativePath(path, nativePath);
+	if (!err.Succeeded())
+	{
+		return err;
+	}
+
+	struct stat sb;
+	if (stat(nativePath.c_str(), &sb) != 0)
+	{
+		return Error::makeByErrno(errno);
+	}
+	if (S_ISDIR(sb.st_mode))
+	{
+		return Error::makeByErrno(EISDIR);
+	}
+
+	size = static_cast<uint64_t>(sb.st_size);
+	return Error();
+}
+
+void File::Close()
+{
+	if (descriptor != InvalidDescriptor)
+	{
+		close(descriptor);
+		descriptor = InvalidDescriptor;
+	}
+}
+
+File::NativeHandle File::GetHandle() const
+{
+	return descriptor;
+}
+
+File::NativeHandle File::Detach()
+{
+	const NativeHandle handle = descriptor;
+	descriptor = InvalidDescriptor;
+	return handle;
+}
+
+void File::CloseNative(NativeHandle handle)
+{
+	if (handle != InvalidDescriptor)
+	{
+		close(handle);
+	}
+}
+
+Error File::Read(uint8_t* pBuffer, const uint32_t bufferSize, uint32_t& readCount) const
+{
+	readCount = 0;
+	while (readCount < bufferSize)
+	{
+		const ssize_t res = read(descriptor, pBuffer + readCount, bufferSize - readCount);
+		if (res < 0 && errno == EINTR)
+		{
+			continue;
+		}
+		if (res < 0)
+		{
+			return Error::makeByErrno(errno);
+		}
+
+		if (res == 0)
+		{
+			break;
+		}
+
+		readCount += static_cast<uint32_t>(res);
+	}
+
+	return Error();
+}
+
+Directory::Directory()
+{
+	descriptor = InvalidDescriptor;
+}
+
+Directory::~Directory()
+{
+	Close();
+}
+
+Error Directory::Open(const std::wstring& path)
+{
+	Close();
+
+	return ::Open(path, O_RDONLY | O_DIRECTORY, descriptor);
+}
+
+Error Directory::Create(const Directory& parent, const std::wstring& name)
+{
+	Close();
+
+	std::string nativeName;
+	Error err = ToNativePath(name, nativeName);
+	if (!err.Succeeded())
+	{
+		return err;
+	}
+
+	if (mkdirat(parent.GetHandle(), nativeName.c_str(), 0755) != 0 && errno != EEXIST)
+	{
+		return Error::makeByErrno(errno);
+	}
+
+	return OpenAt(parent.GetHandle(), nativeName, O_RDONLY | O_DIRECTORY, descriptor);
+}
+
+File::NativeHandle Directory::GetHandle() const
+{
+	return descriptor;
+}
+
+void Directory::Close()
+{
+	if (descriptor != InvalidDescriptor)
+	{
+		close(descriptor);
+		descriptor = InvalidDescriptor;
+	}
+}
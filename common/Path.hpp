@@ -3,17 +3,47 @@
 #include "Error.hpp"
 #include <string>
 #include <random>
+#include <initializer_list>
+#ifdef _WIN32
 #include <Windows.h>
+#else
+#include "StringConverter.hpp"
+#include <vector>
+#include <cerrno>
+#include <cstdlib>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
 
 struct Path
 {
+#ifdef _WIN32
+	static const wchar_t Separator = L'\\';
+#else
+	static const wchar_t Separator = L'/';
+#endif
+
 	static Error CreateDir(const std::wstring& dirPath)
 	{
+#ifdef _WIN32
 		if (!CreateDirectory(dirPath.c_str(), NULL))
 		{
 			const DWORD err = GetLastError();
 			return err == ERROR_ALREADY_EXISTS ? Error() : Error(err);
 		}
+#else
+		std::string nativePath;
+		Error err = ConvertUtf16ToUtf8(dirPath, nativePath);
+		if (!err.Succeeded())
+		{
+			return err;
+		}
+
+		if (mkdir(nativePath.c_str(), 0755) != 0 && errno != EEXIST)
+		{
+			return Error::makeByErrno(errno);
+		}
+#endif
 
 		return Error();
 	}
@@ -22,6 +52,7 @@ struct Path
 	{
 		destination.clear();
 
+#ifdef _WIN32
 		wchar_t tempPath[MAX_PATH + 1];
 		DWORD len = GetTempPathW(MAX_PATH + 1, tempPath);
 		if (len == 0)
@@ -50,6 +81,101 @@ struct Path
 			dirPath.resize(prevSize);
 		}
 
+		destination = std::move(dirPath);
+		return Error();
+#else
+		std::string nativePrefix;
+		Error err = ConvertUtf16ToUtf8(prefix, nativePrefix);
+		if (!err.Succeeded())
+		{
+			return err;
+		}
+
+		std::string pattern = GetNativeTempDir();
+		pattern.append(nativePrefix).append("XXXXXX");
+		if (mkdtemp(&pattern[0]) == nullptr)
+		{
+			return Error::makeByErrno(errno);
+		}
+
+		return ConvertUtf8ToUtf16(pattern, destination);
+#endif
+	}
+
+	// COMMENT: persistent per-user directory %LOCALAPPDATA%\Infomaximum\executor\<subDir>, created if missing,
+	// $XDG_CACHE_HOME/Infomaximum/executor/<subDir> (~/.cache by default) on Linux.
+	static Error GetCacheDirPath(const std::wstring& subDir, std::wstring& destination)
+	{
+		destination.clear();
+
+#ifdef _WIN32
+		wchar_t localAppData[MAX_PATH + 1];
+		DWORD len = GetEnvironmentVariableW(L"LOCALAPPDATA", localAppData, MAX_PATH + 1);
+		if (len == 0 || len > MAX_PATH)
+		{
+			len = GetTempPathW(MAX_PATH + 1, localAppData);
+			if (len == 0)
+			{
+				return Error(GetLastError());
+			}
+		}
+
+		std::wstring dirPath(localAppData, len);
+#else
+		std::string nativeRoot;
+		const char* cacheHome = getenv("XDG_CACHE_HOME");
+		const char* home = getenv("HOME");
+		if (cacheHome != nullptr && cacheHome[0] == '/')
+		{
+			nativeRoot.assign(cacheHome);
+		}
+		else if (home != nullptr && home[0] == '/')
+		{
+			nativeRoot.assign(home).append("/.cache");
+		}
+		else
+		{
+			nativeRoot = GetNativeTempDir();
+		}
+
+		std::wstring dirPath;
+		Error rootErr = ConvertUtf8ToUtf16(nativeRoot, dirPath);
+		if (!rootErr.Succeeded())
+		{
+			return rootErr;
+		}
+
+		rootErr = CreateDir(dirPath);
+		if (!rootErr.Succeeded())
+		{
+			return rootErr;
+		}
+#endif
+		if (dirPath.back() == Separator)
+		{
+			dirPath.pop_back();
+		}
+
+		for (const wchar_t* part : { L"Infomaximum", L"executor" })
+		{
+			dirPath.append(1, Separator).append(part);
+			Error err = CreateDir(dirPath);
+			if (!err.Succeeded())
+			{
+				return err;
+			}
+		}
+
+		if (!subDir.empty())
+		{
+			dirPath.append(1, Separator).append(subDir);
+			Error err = CreateDir(dirPath);
+			if (!err.Succeeded())
+			{
+				return err;
+			}
+		}
+
 		destination = std::move(dirPath);
 		return Error();
 	}
@@ -60,6 +186,7 @@ struct Path
 
 		destination.clear();
 
+#ifdef _WIN32
 		for (;;)
 		{
 			destination.resize(destination.capacity() + CAPACITY_INCREMENT);
@@ -79,11 +206,35 @@ struct Path
 		}
 
 		return Error();
+#else
+		std::vector<char> buffer(CAPACITY_INCREMENT);
+		for (;;)
+		{
+			const ssize_t len = readlink("/proc/self/exe", &buffer[0], buffer.size());
+			if (len < 0)
+			{
+				return Error::makeByErrno(errno);
+			}
+
+			// COMMENT: readlink truncates silently, a full buffer may hold a truncated path.
+			if (static_cast<size_t>(len) == buffer.size())
+			{
+				buffer.resize(buffer.size() + CAPACITY_INCREMENT);
+				continue;
+			}
+
+			return ConvertUtf8ToUtf16(&buffer[0], static_cast<size_t>(len), destination);
+		}
+#endif
 	}
 
 	static std::wstring GetDumpDir()
 	{
+#ifdef _WIN32
 		const std::wstring defaultDir(L"C:");
+#else
+		const std::wstring defaultDir(L"/tmp");
+#endif
 
 		std::wstring dir;
 		Error err = GetApplicationFilePath(dir);
@@ -92,7 +243,7 @@ struct Path
 			return defaultDir;
 		}
 
-		size_t pos = dir.find_last_of(L'\\');
+		size_t pos = dir.find_last_of(Separator);
 		if (pos == std::wstring::npos)
 		{
 			return defaultDir;
@@ -105,6 +256,7 @@ struct Path
 	static std::wstring GetStdoutFilePath(const std::wstring& filename)
 	{
 		std::wstring tempDir;
+#ifdef _WIN32
 		wchar_t tempPath[MAX_PATH + 1];
 		DWORD len = GetTempPathW(MAX_PATH + 1, tempPath);
 		if (len == 0)
@@ -115,8 +267,27 @@ struct Path
 		{
 			tempDir.assign(tempPath, len);
 		}
+#else
+		ConvertUtf8ToUtf16(GetNativeTempDir(), tempDir);
+#endif
 
 		tempDir.append(filename);
 		return tempDir;
 	}
+
+#ifndef _WIN32
+private:
+
+	// COMMENT: $TMPDIR or /tmp with a trailing separator, like GetTempPath returns it.
+	static std::string GetNativeTempDir()
+	{
+		const char* tmpDir = getenv("TMPDIR");
+		std::string dir(tmpDir != nullptr && tmpDir[0] == '/' ? tmpDir : "/tmp");
+		if (dir.back() != '/')
+		{
+			dir.push_back('/');
+		}
+		return dir;
+	}
+#endif
 };
\ No newline at end of file
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <atomic>
+
+// COMMENT: lock-free hand-over of the latest value from exactly one producer thread to exactly one consumer thread.
+// A triple buffer: the producer fills its own slot and swaps it with the shared middle one, the consumer swaps
+// its own slot with the middle one when that holds a value it has not taken yet. Both sides are wait-free,
+// a value is never torn, and intermediate values the consumer was too slow for are overwritten, never the last one.
+template<typename T>
+class SnapshotSlot
+{
+public:
+
+	SnapshotSlot() = default;
+
+	SnapshotSlot(const SnapshotSlot&) = delete;
+	SnapshotSlot& operator=(const SnapshotSlot&) = delete;
+
+	// COMMENT: producer thread only.
+	void Publish(const T& value)
+	{
+		slots[back] = value;
+		back = middle.exchange(back | FreshFlag, std::memory_order_acq_rel) & IndexMask;
+	}
+
+	// COMMENT: consumer thread only. Gives the latest value published since the previous call, if any.
+	bool TryTake(T& value)
+	{
+		if ((middle.load(std::memory_order_relaxed) & FreshFlag) == 0)
+		{
+			return false;
+		}
+
+		front = middle.exchange(front, std::memory_order_acq_rel) & IndexMask;
+		value = slots[front];
+		return true;
+	}
+
+private:
+
+	enum : unsigned
+	{
+		IndexMask = 3,
+		FreshFlag = 4
+	};
+
+	// COMMENT: the shared index lives on its own cache line, back and front are each touched by one thread only.
+	alignas(64) T slots[3];
+	alignas(64) std::atomic<unsigned> middle{ 1 };
+	alignas(64) unsigned back = 0;
+	alignas(64) unsigned front = 2;
+};
@@ -2,40 +2,246 @@
 
 #include "Error.hpp"
 #include <string>
+#include <cstdint>
+#ifdef _WIN32
 #include <Windows.h>
+#endif
 
-inline Error ConvertUtf8ToUtf16(const char* src, size_t srcSize,  std::wstring& dst)
+// COMMENT: SSE2 is part of x86-64, other targets take the scalar path only.
+#if defined(_M_X64) || defined(__SSE2__)
+#define STRING_CONVERTER_SSE2
+#include <emmintrin.h>
+#endif
+
+// COMMENT: UTF-8 <-> wchar_t transcoding without the OS. wchar_t strings hold UTF-16 where wchar_t is 16 bits wide (Windows)
+// and UTF-32 elsewhere. Malformed input becomes U+FFFD once per maximal subpart of an invalid sequence, the way
+// MultiByteToWideChar replaces it without MB_ERR_INVALID_CHARS.
+namespace string_converter
 {
-	dst.clear();
 
-	const int dstLen = MultiByteToWideChar(CP_UTF8, 0, src, static_cast<int>(srcSize), NULL, 0);
-	if (dstLen <= 0)
+const char32_t ReplacementChar = 0xFFFD;
+
+inline bool IsSurrogate(char32_t codePoint)
+{
+	return codePoint >= 0xD800 && codePoint <= 0xDFFF;
+}
+
+// COMMENT: the byte that breaks a sequence is not consumed, decoding resynchronizes on it. The range of the second byte
+// depends on the lead byte, which rules out overlong forms, surrogates and values past U+10FFFF without decoding them.
+inline char32_t DecodeUtf8(const char* src, size_t size, size_t& pos)
+{
+	const uint8_t lead = static_cast<uint8_t>(src[pos++]);
+	if (lead < 0x80)
 	{
-		return Error(GetLastError());
+		return lead;
 	}
 
-	dst.resize(dstLen);
-	int res = MultiByteToWideChar(CP_UTF8, 0, src, static_cast<int>(srcSize), &dst[0], dstLen);
-	if (res <= 0)
+	size_t continuationCount = 0;
+	uint8_t secondMin = 0x80;
+	uint8_t secondMax = 0xBF;
+	char32_t codePoint = 0;
+	if (lead >= 0xC2 && lead <= 0xDF)
 	{
-		return Error(GetLastError());
+		continuationCount = 1;
+		codePoint = lead & 0x1F;
+	}
+	else if (lead >= 0xE0 && lead <= 0xEF)
+	{
+		continuationCount = 2;
+		codePoint = lead & 0x0F;
+		secondMin = lead == 0xE0 ? 0xA0 : 0x80;
+		secondMax = lead == 0xED ? 0x9F : 0xBF;
+	}
+	else if (lead >= 0xF0 && lead <= 0xF4)
+	{
+		continuationCount = 3;
+		codePoint = lead & 0x07;
+		secondMin = lead == 0xF0 ? 0x90 : 0x80;
+		secondMax = lead == 0xF4 ? 0x8F : 0xBF;
+	}
+	else
+	{
+		return ReplacementChar;
 	}
 
-	return Error();
+	for (size_t i = 0; i < continuationCount; i++)
+	{
+		if (pos >= size)
+		{
+			return ReplacementChar;
+		}
+
+		const uint8_t byte = static_cast<uint8_t>(src[pos]);
+		if (byte < (i == 0 ? secondMin : 0x80) || byte > (i == 0 ? secondMax : 0xBF))
+		{
+			return ReplacementChar;
+		}
+
+		codePoint = (codePoint << 6) | (byte & 0x3F);
+		pos++;
+	}
+
+	return codePoint;
 }
 
-inline Error ConvertUtf8ToUtf16(const std::string& utf8Src, std::wstring& dst)
+// COMMENT: returns the number of wchar_t written, 2 only for a surrogate pair.
+inline size_t EncodeWide(char32_t codePoint, wchar_t* dst)
+{
+	if (sizeof(wchar_t) == 2 && codePoint >= 0x10000)
+	{
+		codePoint -= 0x10000;
+		dst[0] = static_cast<wchar_t>(0xD800 + (codePoint >> 10));
+		dst[1] = static_cast<wchar_t>(0xDC00 + (codePoint & 0x3FF));
+		return 2;
+	}
+
+	dst[0] = static_cast<wchar_t>(codePoint);
+	return 1;
+}
+
+inline char32_t DecodeWide(const wchar_t* src, size_t size, size_t& pos)
+{
+	const char32_t unit = static_cast<char32_t>(src[pos++]);
+	if (sizeof(wchar_t) == 2 && unit >= 0xD800 && unit <= 0xDBFF && pos < size)
+	{
+		const char32_t trail = static_cast<char32_t>(src[pos]);
+		if (trail >= 0xDC00 && trail <= 0xDFFF)
+		{
+			pos++;
+			return 0x10000 + ((unit - 0xD800) << 10) + (trail - 0xDC00);
+		}
+	}
+
+	return IsSurrogate(unit) || unit > 0x10FFFF ? ReplacementChar : unit;
+}
+
+inline void AppendUtf8(char32_t codePoint, std::string& dst)
+{
+	if (codePoint < 0x80)
+	{
+		dst.push_back(static_cast<char>(codePoint));
+	}
+	else if (codePoint < 0x800)
+	{
+		dst.push_back(static_cast<char>(0xC0 | (codePoint >> 6)));
+		dst.push_back(static_cast<char>(0x80 | (codePoint & 0x3F)));
+	}
+	else if (codePoint < 0x10000)
+	{
+		dst.push_back(static_cast<char>(0xE0 | (codePoint >> 12)));
+		dst.push_back(static_cast<char>(0x80 | ((codePoint >> 6) & 0x3F)));
+		dst.push_back(static_cast<char>(0x80 | (codePoint & 0x3F)));
+	}
+	else
+	{
+		dst.push_back(static_cast<char>(0xF0 | (codePoint >> 18)));
+		dst.push_back(static_cast<char>(0x80 | ((codePoint >> 12) & 0x3F)));
+		dst.push_back(static_cast<char>(0x80 | ((codePoint >> 6) & 0x3F)));
+		dst.push_back(static_cast<char>(0x80 | (codePoint & 0x3F)));
+	}
+}
+
+#ifdef STRING_CONVERTER_SSE2
+// COMMENT: widens 16 ASCII bytes by interleaving them with zero bytes, twice when wchar_t is 32 bits wide.
+inline void WidenAscii16(__m128i chunk, wchar_t* dst)
+{
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i low = _mm_unpacklo_epi8(chunk, zero);
+	const __m128i high = _mm_unpackhi_epi8(chunk, zero);
+	if (sizeof(wchar_t) == 2)
+	{
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(dst), low);
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + 8), high);
+	}
+	else
+	{
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(dst), _mm_unpacklo_epi16(low, zero));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + 4), _mm_unpackhi_epi16(low, zero));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + 8), _mm_unpacklo_epi16(high, zero));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + 12), _mm_unpackhi_epi16(high, zero));
+	}
+}
+#endif
+
+// COMMENT: one pass into a buffer sized for the worst case of one wchar_t per byte, which holds because a surrogate
+// pair comes from four bytes and every replacement consumes at least one. dst keeps its capacity between calls.
+// ASCII runs are copied 16 bytes at a time, validation is needed only for the bytes from 0x80 on.
+inline void Utf8ToWide(const char* src, size_t size, std::wstring& dst)
+{
+	dst.resize(size);
+	if (size == 0)
+	{
+		return;
+	}
+
+	wchar_t* out = &dst[0];
+	size_t pos = 0;
+	size_t outPos = 0;
+	while (pos < size)
+	{
+#ifdef STRING_CONVERTER_SSE2
+		while (pos + 16 <= size)
+		{
+			const __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + pos));
+			if (_mm_movemask_epi8(chunk) != 0)
+			{
+				break;
+			}
+
+			WidenAscii16(chunk, out + outPos);
+			pos += 16;
+			outPos += 16;
+		}
+
+		if (pos >= size)
+		{
+			break;
+		}
+#endif
+
+		const uint8_t byte = static_cast<uint8_t>(src[pos]);
+		if (byte < 0x80)
+		{
+			out[outPos++] = static_cast<wchar_t>(byte);
+			pos++;
+		}
+		else
+		{
+			outPos += EncodeWide(DecodeUtf8(src, size, pos), out + outPos);
+		}
+	}
+
+	dst.resize(outPos);
+}
+
+inline void WideToUtf8(const wchar_t* src, size_t size, std::string& dst)
 {
 	dst.clear();
+	dst.reserve(size);
 
-	if (utf8Src.empty())
+	size_t pos = 0;
+	while (pos < size)
 	{
-		return Error();
+		AppendUtf8(DecodeWide(src, size, pos), dst);
 	}
+}
 
-	return ConvertUtf8ToUtf16(utf8Src.c_str(), utf8Src.size(), dst);
 }
 
+inline Error ConvertUtf8ToUtf16(const char* src, size_t srcSize, std::wstring& dst)
+{
+	string_converter::Utf8ToWide(src, srcSize, dst);
+	return Error();
+}
+
+inline Error ConvertUtf8ToUtf16(const std::string& utf8Src, std::wstring& dst)
+{
+	string_converter::Utf8ToWide(utf8Src.data(), utf8Src.size(), dst);
+	return Error();
+}
+
+#ifdef _WIN32
+
 inline Error ConvertUtf16ToUtf8(const std::wstring& src, std::string& dst)
 {
 	dst.clear();
@@ -53,4 +259,14 @@ inline Error ConvertUtf16ToUtf8(const std::wstring& src, std::string& dst)
 	}
 
 	return Error();
-}
\ No newline at end of file
+}
+
+#else
+
+inline Error ConvertUtf16ToUtf8(const std::wstring& src, std::string& dst)
+{
+	string_converter::WideToUtf8(src.data(), src.size(), dst);
+	return Error();
+}
+
+#endif
\ No newline at end of file
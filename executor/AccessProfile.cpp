@@ -0,0 +1,56 @@
+#include "AccessProfile.h"
+#include <Windows.h>
+
+// COMMENT: Windows reports file opens only through the kernel ETW providers, which need administrator rights.
+
+const wchar_t* const AccessProfile::PathVariable = L"INFOMAXIMUM_ACCESS_PROFILE";
+
+AccessProfile::AccessProfile()
+	: notifyFd(-1)
+{
+	stopFds[0] = -1;
+	stopFds[1] = -1;
+}
+
+AccessProfile::~AccessProfile()
+{
+}
+
+std::wstring AccessProfile::GetRequestedPath()
+{
+	wchar_t buffer[MAX_PATH + 1];
+	const DWORD len = GetEnvironmentVariableW(PathVariable, buffer, MAX_PATH + 1);
+	if (len == 0 || len > MAX_PATH)
+	{
+		return std::wstring();
+	}
+
+	return std::wstring(buffer, len);
+}
+
+Error AccessProfile::Start(const std::wstring& /*rootDir*/)
+{
+	return Error(L"access profile capture is supported on Linux only");
+}
+
+Error AccessProfile::Stop(const std::wstring& /*profilePath*/)
+{
+	return Error(L"access profile capture is supported on Linux only");
+}
+
+Error AccessProfile::Watch(const std::string& /*dir*/, const std::string& /*relativeDir*/)
+{
+	return Error();
+}
+
+void AccessProfile::Record()
+{
+}
+
+void AccessProfile::ReadEvents()
+{
+}
+
+void AccessProfile::Shutdown()
+{
+}
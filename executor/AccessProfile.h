@@ -0,0 +1,49 @@
+#pragma once
+
+#include "Error.hpp"
+#include <string>
+#include <vector>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+
+// COMMENT: records which files of the installation directory the child opens, in the order of the first open.
+// A profiling run is requested by PathVariable=<profile path>. The profile is UTF-8 text with one path relative
+// to the installation directory per line, '/' separated like ZIP entry names, and the patcher reorders
+// ZIP payloads by it (--access-profile), so the entries needed at start up come first in the archive.
+// Captured with inotify on Linux, on Windows an unprivileged process has no access trace and Start fails.
+class AccessProfile
+{
+public:
+
+	static const wchar_t* const PathVariable;
+
+	AccessProfile();
+	~AccessProfile();
+
+	AccessProfile(const AccessProfile&) = delete;
+	AccessProfile& operator=(const AccessProfile&) = delete;
+
+	// COMMENT: empty when no profiling run was requested.
+	static std::wstring GetRequestedPath();
+
+	Error Start(const std::wstring& rootDir);
+	// COMMENT: stops recording and writes the profile.
+	Error Stop(const std::wstring& profilePath);
+
+private:
+
+	Error Watch(const std::string& dir, const std::string& relativeDir);
+	void Record();
+	void ReadEvents();
+	void Shutdown();
+
+private:
+
+	int notifyFd;
+	int stopFds[2];
+	std::thread reader;
+	std::unordered_map<int, std::string> watchedDirs;
+	std::unordered_set<std::string> seen;
+	std::vector<std::string> order;
+};
@@ -0,0 +1,246 @@
+#include "AccessProfile.h"
+#include "StringConverter.hpp"
+#include <fstream>
+#include <cerrno>
+#include <cstdlib>
+#include <dirent.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+
+namespace
+{
+
+const size_t EventBufferSize = 64 * 1024;
+
+} // namespace
+
+const wchar_t* const AccessProfile::PathVariable = L"INFOMAXIMUM_ACCESS_PROFILE";
+
+AccessProfile::AccessProfile()
+	: notifyFd(-1)
+{
+	stopFds[0] = -1;
+	stopFds[1] = -1;
+}
+
+AccessProfile::~AccessProfile()
+{
+	Shutdown();
+}
+
+std::wstring AccessProfile::GetRequestedPath()
+{
+	std::string name;
+	ConvertUtf16ToUtf8(PathVariable, name);
+
+	const char* path = getenv(name.c_str());
+	std::wstring result;
+	if (path != nullptr)
+	{
+		ConvertUtf8ToUtf16(path, result);
+	}
+	return result;
+}
+
+Error AccessProfile::Start(const std::wstring& rootDir)
+{
+	Shutdown();
+	watchedDirs.clear();
+	seen.clear();
+	order.clear();
+
+	std::string nativeRootDir;
+	Error err = ConvertUtf16ToUtf8(rootDir, nativeRootDir);
+	if (!err.Succeeded())
+	{
+		return err;
+	}
+
+	notifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if (notifyFd < 0 || pipe2(stopFds, O_CLOEXEC) != 0)
+	{
+		err = Error::makeByErrno(errno);
+		Shutdown();
+		return err;
+	}
+
+	// COMMENT: inotify watches are not recursive, every directory of the tree gets its own watch.
+	err = Watch(nativeRootDir, std::string());
+	if (!err.Succeeded())
+	{
+		Shutdown();
+		return err;
+	}
+
+	reader = std::thread(&AccessProfile::Record, this);
+	return Error();
+}
+
+Error AccessProfile::Stop(const std::wstring& profilePath)
+{
+	Shutdown();
+
+	std::string nativePath;
+	Error err = ConvertUtf16ToUtf8(profilePath, nativePath);
+	if (!err.Succeeded())
+	{
+		return err;
+	}
+
+	std::ofstream profile(nativePath, std::ios::out | std::ios::trunc | std::ios::binary);
+	for (const std::string& path : order)
+	{
+		profile << path << '\n';
+	}
+
+	profile.close();
+	if (!profile)
+	{
+		std::wstring msg;
+		msg.append(L"can not write access profile '").append(profilePath).append(L"'");
+		return Error(std::move(msg));
+	}
+
+	return Error();
+}
+
+Error AccessProfile::Watch(const std::string& dir, const std::string& relativeDir)
+{
+	const int wd = inotify_add_watch(notifyFd, dir.c_str(), IN_OPEN | IN_ONLYDIR);
+	if (wd < 0)
+	{
+		// COMMENT: ENOSPC means fs.inotify.max_user_watches is lower than the number of directories.
+		return Error::makeByErrno(errno);
+	}
+	watchedDirs[wd] = relativeDir;
+
+	DIR* pDir = opendir(dir.c_str());
+	if (pDir == nullptr)
+	{
+		return Error::makeByErrno(errno);
+	}
+
+	std::vector<std::string> subDirs;
+	while (const dirent* entry = readdir(pDir))
+	{
+		const std::string name(entry->d_name);
+		if (name == "." || name == "..")
+		{
+			continue;
+		}
+
+		struct stat sb;
+		const std::string path = std::string(dir).append("/").append(name);
+		if (lstat(path.c_str(), &sb) == 0 && S_ISDIR(sb.st_mode))
+		{
+			subDirs.push_back(name);
+		}
+	}
+	closedir(pDir);
+
+	for (const std::string& name : subDirs)
+	{
+		Error err = Watch(std::string(dir).append("/").append(name), std::string(relativeDir).append(name).append("/"));
+		if (!err.Succeeded())
+		{
+			return err;
+		}
+	}
+
+	return Error();
+}
+
+void AccessProfile::Record()
+{
+	pollfd fds[2];
+	fds[0].fd = notifyFd;
+	fds[0].events = POLLIN;
+	fds[1].fd = stopFds[0];
+	fds[1].events = POLLIN;
+
+	for (;;)
+	{
+		fds[0].revents = 0;
+		fds[1].revents = 0;
+		if (poll(fds, 2, -1) < 0)
+		{
+			if (errno == EINTR)
+			{
+				continue;
+			}
+			return;
+		}
+
+		// COMMENT: events queued before the stop request still belong to the run.
+		ReadEvents();
+		if (fds[1].revents != 0)
+		{
+			return;
+		}
+	}
+}
+
+void AccessProfile::ReadEvents()
+{
+	alignas(inotify_event) char buffer[EventBufferSize];
+	for (;;)
+	{
+		const ssize_t readCount = read(notifyFd, buffer, sizeof(buffer));
+		if (readCount < 0 && errno == EINTR)
+		{
+			continue;
+		}
+		if (readCount <= 0)
+		{
+			return;
+		}
+
+		for (ssize_t offset = 0; offset < readCount;)
+		{
+			const inotify_event* event = reinterpret_cast<const inotify_event*>(buffer + offset);
+			offset += sizeof(inotify_event) + event->len;
+
+			// COMMENT: opens of the watched directories themselves come without a name.
+			if (event->len == 0 || (event->mask & IN_ISDIR) != 0)
+			{
+				continue;
+			}
+
+			const auto dir = watchedDirs.find(event->wd);
+			if (dir == watchedDirs.end())
+			{
+				continue;
+			}
+
+			std::string path = std::string(dir->second).append(event->name);
+			if (seen.insert(path).second)
+			{
+				order.push_back(std::move(path));
+			}
+		}
+	}
+}
+
+void AccessProfile::Shutdown()
+{
+	if (reader.joinable())
+	{
+		const char stop = 0;
+		while (write(stopFds[1], &stop, 1) < 0 && errno == EINTR)
+		{
+		}
+		reader.join();
+	}
+
+	for (int* fd : { &notifyFd, &stopFds[0], &stopFds[1] })
+	{
+		if (*fd >= 0)
+		{
+			close(*fd);
+			*fd = -1;
+		}
+	}
+}
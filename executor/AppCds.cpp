@@ -0,0 +1,308 @@
+#include "AppCds.h"
+#include <cwchar>
+#include <vector>
+#include <shellapi.h>
+#include <winioctl.h>
+
+namespace
+{
+
+// COMMENT: REPARSE_DATA_BUFFER is declared only in the driver kit.
+struct MountPointReparseBuffer
+{
+	DWORD ReparseTag;
+	WORD ReparseDataLength;
+	WORD Reserved;
+	WORD SubstituteNameOffset;
+	WORD SubstituteNameLength;
+	WORD PrintNameOffset;
+	WORD PrintNameLength;
+	WCHAR PathBuffer[1];
+};
+
+Error CreateJunction(const std::wstring& linkPath, const std::wstring& targetPath)
+{
+	// COMMENT: removes the junction of a previous run, never the directory it pointed to.
+	RemoveDirectoryW(linkPath.c_str());
+
+	if (!CreateDirectoryW(linkPath.c_str(), NULL))
+	{
+		return Error(GetLastError());
+	}
+
+	HANDLE hLink = CreateFileW(linkPath.c_str(), GENERIC_WRITE, 0, NULL, OPEN_EXISTING, FILE_FLAG_BACKUP_SEMANTICS | FILE_FLAG_OPEN_REPARSE_POINT, NULL);
+	if (hLink == INVALID_HANDLE_VALUE)
+	{
+		const DWORD err = GetLastError();
+		RemoveDirectoryW(linkPath.c_str());
+		return Error(err);
+	}
+
+	const std::wstring substituteName = std::wstring(L"\\??\\").append(targetPath);
+	const size_t substituteBytes = substituteName.size() * sizeof(WCHAR);
+	const size_t printBytes = targetPath.size() * sizeof(WCHAR);
+	const size_t pathBytes = substituteBytes + sizeof(WCHAR) + printBytes + sizeof(WCHAR);
+
+	std::vector<uint8_t> buffer(FIELD_OFFSET(MountPointReparseBuffer, PathBuffer) + pathBytes, 0);
+	MountPointReparseBuffer* reparse = reinterpret_cast<MountPointReparseBuffer*>(&buffer[0]);
+	reparse->ReparseTag = IO_REPARSE_TAG_MOUNT_POINT;
+	reparse->ReparseDataLength = static_cast<WORD>(buffer.size() - FIELD_OFFSET(MountPointReparseBuffer, SubstituteNameOffset));
+	reparse->SubstituteNameOffset = 0;
+	reparse->SubstituteNameLength = static_cast<WORD>(substituteBytes);
+	reparse->PrintNameOffset = static_cast<WORD>(substituteBytes + sizeof(WCHAR));
+	reparse->PrintNameLength = static_cast<WORD>(printBytes);
+
+	uint8_t* pathBuffer = reinterpret_cast<uint8_t*>(reparse->PathBuffer);
+	memcpy(pathBuffer, substituteName.c_str(), substituteBytes);
+	memcpy(pathBuffer + reparse->PrintNameOffset, targetPath.c_str(), printBytes);
+
+	DWORD returned = 0;
+	const BOOL res = DeviceIoControl(hLink, FSCTL_SET_REPARSE_POINT, &buffer[0], static_cast<DWORD>(buffer.size()), NULL, 0, &returned, NULL);
+	const DWORD err = GetLastError();
+	CloseHandle(hLink);
+
+	if (!res)
+	{
+		RemoveDirectoryW(linkPath.c_str());
+		return Error(err);
+	}
+
+	return Error();
+}
+
+bool IsNonEmptyFile(const std::wstring& path)
+{
+	WIN32_FILE_ATTRIBUTE_DATA data;
+	if (!GetFileAttributesExW(path.c_str(), GetFileExInfoStandard, &data))
+	{
+		return false;
+	}
+
+	return (data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) == 0 && (data.nFileSizeHigh != 0 || data.nFileSizeLow != 0);
+}
+
+bool IsPathOption(const std::wstring& arg)
+{
+	return arg == L"-cp" || arg == L"-classpath" || arg == L"--class-path" || arg == L"-p" || arg == L"--module-path" || arg == L"-jar";
+}
+
+bool HasPrefix(const std::wstring& value, const wchar_t* prefix)
+{
+	return value.compare(0, wcslen(prefix), prefix) == 0;
+}
+
+// COMMENT: an archive is bound to the java binary and to the class and module path it was dumped with, other options
+// may differ between runs, as the heap size does with <mem_pct>.
+std::wstring MakeFingerprint(const std::wstring& cmdLine)
+{
+	int count = 0;
+	wchar_t** argv = CommandLineToArgvW(cmdLine.c_str(), &count);
+	if (argv == NULL)
+	{
+		return cmdLine;
+	}
+
+	std::wstring fingerprint;
+	if (count > 0)
+	{
+		wchar_t executable[MAX_PATH];
+		const DWORD len = SearchPathW(NULL, argv[0], L".exe", MAX_PATH, executable, NULL);
+		fingerprint.append(len != 0 && len < MAX_PATH ? executable : argv[0]).append(L"\n");
+
+		WIN32_FILE_ATTRIBUTE_DATA data;
+		if (len != 0 && len < MAX_PATH && GetFileAttributesExW(executable, GetFileExInfoStandard, &data))
+		{
+			fingerprint.append(std::to_wstring(data.nFileSizeHigh)).append(L" ").append(std::to_wstring(data.nFileSizeLow)).append(L" ")
+				.append(std::to_wstring(data.ftLastWriteTime.dwHighDateTime)).append(L" ").append(std::to_wstring(data.ftLastWriteTime.dwLowDateTime)).append(L"\n");
+		}
+	}
+
+	// COMMENT: the arguments after the main class or the jar belong to the application.
+	for (int i = 1; i < count; i++)
+	{
+		const std::wstring arg = argv[i];
+		if (IsPathOption(arg) && i + 1 < count)
+		{
+			fingerprint.append(arg).append(L" ").append(argv[i + 1]).append(L"\n");
+			i++;
+			if (arg == L"-jar")
+			{
+				break;
+			}
+		}
+		else if (HasPrefix(arg, L"--class-path=") || HasPrefix(arg, L"--module-path="))
+		{
+			fingerprint.append(arg).append(L"\n");
+		}
+		else if (arg.empty() || arg[0] != L'-')
+		{
+			break;
+		}
+	}
+
+	LocalFree(argv);
+	return fingerprint;
+}
+
+std::wstring HashFingerprint(const std::wstring& fingerprint)
+{
+	const uint64_t FnvOffsetBasis = 14695981039346656037ULL;
+	const uint64_t FnvPrime = 1099511628211ULL;
+
+	uint64_t hash = FnvOffsetBasis;
+	const uint8_t* bytes = reinterpret_cast<const uint8_t*>(fingerprint.data());
+	for (size_t i = 0; i < fingerprint.size() * sizeof(wchar_t); i++)
+	{
+		hash = (hash ^ bytes[i]) * FnvPrime;
+	}
+
+	wchar_t buffer[17];
+	std::swprintf(buffer, sizeof(buffer) / sizeof(buffer[0]), L"%016llx", static_cast<unsigned long long>(hash));
+	return buffer;
+}
+
+} // namespace
+
+AppCds::AppCds()
+	: dumping(false)
+	, hSlotLock(INVALID_HANDLE_VALUE)
+{
+}
+
+AppCds::~AppCds()
+{
+	Release();
+}
+
+Error AppCds::Prepare(const std::wstring& payloadDir, const std::wstring& installationDir)
+{
+	Release();
+
+	Error lastError(L"all class data sharing slots are busy");
+	for (unsigned slot = 0; slot < MaxSlots; slot++)
+	{
+		const std::wstring slotName = std::wstring(payloadDir).append(L"\\slot").append(std::to_wstring(slot));
+
+		// COMMENT: the lock file is opened without sharing and is held until the child exits.
+		HANDLE hLock = CreateFileW(std::wstring(slotName).append(L".lock").c_str(), GENERIC_WRITE, 0, NULL, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+		if (hLock == INVALID_HANDLE_VALUE)
+		{
+			lastError = Error(GetLastError());
+			continue;
+		}
+
+		Error err = CreateJunction(slotName, installationDir);
+		if (!err.Succeeded())
+		{
+			CloseHandle(hLock);
+			lastError = err;
+			continue;
+		}
+
+		hSlotLock = hLock;
+		slotDir = slotName;
+		logPath = std::wstring(slotName).append(L".cds.log");
+		return Error();
+	}
+
+	return lastError;
+}
+
+const std::wstring& AppCds::GetInstallationDir() const
+{
+	return slotDir;
+}
+
+std::wstring AppCds::GetJvmOptions(const std::wstring& cmdLine)
+{
+	std::wstring options;
+	if (slotDir.empty())
+	{
+		return options;
+	}
+
+	archivePath = std::wstring(slotDir).append(L".").append(HashFingerprint(MakeFingerprint(cmdLine))).append(L".jsa");
+	dumpPath = std::wstring(archivePath).append(L".tmp");
+	DeleteFileW(logPath.c_str());
+
+	// COMMENT: the JVM only warns about an archive it can not map and starts without it. The warnings go to a log
+	// of their own, the quotes are escaped so the JVM sees them and takes the ':' of the drive for part of the path.
+	dumping = !IsNonEmptyFile(archivePath);
+	if (dumping)
+	{
+		DeleteFileW(dumpPath.c_str());
+		options.append(L"-XX:ArchiveClassesAtExit=\"").append(dumpPath).append(L"\"");
+	}
+	else
+	{
+		options.append(L"-XX:SharedArchiveFile=\"").append(archivePath).append(L"\" ");
+		options.append(L"\"-Xlog:cds*=warning:file=\\\"").append(logPath).append(L"\\\"\"");
+	}
+
+	return options;
+}
+
+void AppCds::Finish()
+{
+	if (archivePath.empty())
+	{
+		return;
+	}
+
+	if (dumping)
+	{
+		// COMMENT: a JVM killed while dumping leaves no archive under the name the next run maps.
+		if (IsNonEmptyFile(dumpPath))
+		{
+			RemoveOtherArchives();
+			MoveFileExW(dumpPath.c_str(), archivePath.c_str(), MOVEFILE_REPLACE_EXISTING);
+		}
+		DeleteFileW(dumpPath.c_str());
+	}
+	else if (IsNonEmptyFile(logPath))
+	{
+		DeleteFileW(archivePath.c_str());
+	}
+
+	DeleteFileW(logPath.c_str());
+}
+
+// COMMENT: archives of a previous java binary or class path are never mapped again.
+void AppCds::RemoveOtherArchives() const
+{
+	const size_t dirEnd = slotDir.find_last_of(L'\\');
+	const std::wstring dir = dirEnd == std::wstring::npos ? std::wstring() : slotDir.substr(0, dirEnd + 1);
+
+	WIN32_FIND_DATAW data;
+	HANDLE hFind = FindFirstFileW(std::wstring(slotDir).append(L".*.jsa").c_str(), &data);
+	if (hFind == INVALID_HANDLE_VALUE)
+	{
+		return;
+	}
+
+	do
+	{
+		const std::wstring path = std::wstring(dir).append(data.cFileName);
+		if (path != archivePath)
+		{
+			DeleteFileW(path.c_str());
+		}
+	} while (FindNextFileW(hFind, &data));
+
+	FindClose(hFind);
+}
+
+void AppCds::Release()
+{
+	if (hSlotLock != INVALID_HANDLE_VALUE)
+	{
+		CloseHandle(hSlotLock);
+		hSlotLock = INVALID_HANDLE_VALUE;
+	}
+
+	slotDir.clear();
+	archivePath.clear();
+	dumpPath.clear();
+	logPath.clear();
+	dumping = false;
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include "Error.hpp"
+#include <string>
+#include <Windows.h>
+
+// COMMENT: manages a dynamic class data sharing archive of the application classes (JDK 13+).
+// The JVM accepts an archive only when the class path is the same as at dump time, so the per-run extraction
+// directory is exposed through a junction <payload dir>\slotN with a stable path. Every slot has its own archives
+// and is held by one executor at a time, concurrent launches take the next free slot. An archive is named by
+// a hash of the java binary and the class path it was dumped with, dumped under a temporary name and renamed when
+// the JVM has exited. An archive the JVM reports it can not map is discarded, the next run dumps it again.
+class AppCds
+{
+public:
+
+	static const unsigned MaxSlots = 4;
+
+	AppCds();
+	~AppCds();
+
+	AppCds(const AppCds&) = delete;
+	AppCds& operator=(const AppCds&) = delete;
+
+	Error Prepare(const std::wstring& payloadDir, const std::wstring& installationDir);
+
+	// COMMENT: path to substitute for <dir_path>, it points to installationDir.
+	const std::wstring& GetInstallationDir() const;
+
+	// COMMENT: dumps the archive at JVM exit on the first run and maps it on the following runs. cmdLine is the expanded
+	// command line the options are inserted into.
+	std::wstring GetJvmOptions(const std::wstring& cmdLine);
+
+	// COMMENT: called when the JVM has exited, publishes a dumped archive or discards a refused one.
+	void Finish();
+
+private:
+
+	void RemoveOtherArchives() const;
+	void Release();
+
+private:
+
+	std::wstring slotDir;
+	std::wstring archivePath;
+	std::wstring dumpPath;
+	std::wstring logPath;
+	bool dumping;
+	HANDLE hSlotLock;
+};
@@ -0,0 +1,371 @@
+#include "AsyncWriter.h"
+#include "Trace.h"
+#include <cerrno>
+
+static_assert(AsyncWriter::BufferSize % File::DirectIoAlignment == 0, "every chunk but the last must keep direct writes aligned");
+
+AsyncWriter::AsyncWriter(CloseQueue& closeQueue, bool batchWrites)
+	: closeQueue(closeQueue)
+	, pool(BufferSize * BufferCount + File::DirectIoAlignment)
+	, buffers(nullptr)
+	, batched(false)
+	, ringWrites(BufferCount, RingWrite{ nullptr, nullptr, 0, 0, 0 })
+{
+	const uintptr_t address = reinterpret_cast<uintptr_t>(&pool[0]);
+	buffers = &pool[0] + (File::DirectIoAlignment - address % File::DirectIoAlignment) % File::DirectIoAlignment;
+	for (size_t i = 0; i < BufferCount; i++)
+	{
+		freeBuffers.push_back(buffers + i * BufferSize);
+	}
+
+	// COMMENT: a buffer is in at most one write, so the ring never has more writes than buffers.
+	if (batchWrites)
+	{
+		batched = ring.Open(static_cast<unsigned>(BufferCount), buffers, BufferSize, static_cast<unsigned>(BufferCount)).Succeeded();
+	}
+	Trace::Instant(batched ? "batched writer" : "synchronous writer");
+
+	thread = std::thread(&AsyncWriter::Work, this);
+}
+
+AsyncWriter::~AsyncWriter()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	taskAdded.notify_all();
+	thread.join();
+
+	for (const auto& file : files)
+	{
+		delete file.first;
+	}
+}
+
+File* AsyncWriter::Add(std::unique_ptr<File> file, uint64_t tag)
+{
+	// COMMENT: an empty file takes no buffer, without the limit a run of them would keep any number of handles open.
+	std::unique_lock<std::mutex> lock(mutex);
+	taskDone.wait(lock, [this]() { return files.size() < MaxPendingFiles; });
+
+	File* pFile = file.release();
+	files[pFile] = tag;
+	return pFile;
+}
+
+uint8_t* AsyncWriter::AcquireBuffer()
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	taskDone.wait(lock, [this]() { return !freeBuffers.empty(); });
+
+	uint8_t* buffer = freeBuffers.back();
+	freeBuffers.pop_back();
+	return buffer;
+}
+
+void AsyncWriter::Write(File* file, uint8_t* buffer, uint32_t size)
+{
+	Push(Task{ Operation::Write, file, buffer, size, 0, 0, false });
+}
+
+void AsyncWriter::Finish(File* file, uint64_t size, time_t modificationTime, bool readOnly)
+{
+	Push(Task{ Operation::Finish, file, nullptr, 0, size, modificationTime, readOnly });
+}
+
+bool AsyncWriter::IsBatched() const
+{
+	return batched;
+}
+
+bool AsyncWriter::Failed() const
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return !failure.Succeeded();
+}
+
+void AsyncWriter::TakeFinished(std::vector<uint64_t>& tags)
+{
+	tags.clear();
+	std::lock_guard<std::mutex> lock(mutex);
+	tags.swap(finished);
+}
+
+Error AsyncWriter::Wait(uint64_t& tag)
+{
+	Trace::Scope traceScope("AsyncWriter::Wait");
+
+	std::unique_lock<std::mutex> lock(mutex);
+	taskDone.wait(lock, [this]() { return tasks.empty() && !busy && writesInFlight == 0; });
+
+	tag = failedTag;
+	return failure;
+}
+
+void AsyncWriter::Push(const Task& task)
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		tasks.push_back(task);
+	}
+	taskAdded.notify_one();
+}
+
+void AsyncWriter::Work()
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	for (;;)
+	{
+		taskAdded.wait(lock, [this]() { return !tasks.empty() || stopping || writesInFlight != 0; });
+		if (tasks.empty() && writesInFlight == 0)
+		{
+			return;
+		}
+
+		if (tasks.empty())
+		{
+			// COMMENT: nothing left to submit, the thread sleeps in the kernel until a write completes.
+			lock.unlock();
+			Reap(1);
+			lock.lock();
+			continue;
+		}
+
+		const Task task = tasks.front();
+		tasks.pop_front();
+		const bool skip = !failure.Succeeded();
+		const bool queueEmpty = tasks.empty();
+		busy = true;
+
+		lock.unlock();
+		const bool inFlight = Run(task, skip);
+
+		// COMMENT: writes queued while the caller keeps up are handed to the kernel together.
+		if (queueEmpty && ring.IsOpen())
+		{
+			Reap(0);
+		}
+		lock.lock();
+
+		busy = false;
+		if (task.operation == Operation::Write && !inFlight)
+		{
+			freeBuffers.push_back(task.buffer);
+		}
+		taskDone.notify_all();
+	}
+}
+
+// COMMENT: returns true when the buffer of a write went into the ring and comes back with its completion.
+bool AsyncWriter::Run(const Task& task, bool skip)
+{
+	if (task.operation == Operation::Write)
+	{
+		if (skip || task.size == 0)
+		{
+			return false;
+		}
+
+		if (ring.IsOpen())
+		{
+			return SubmitWrite(task);
+		}
+
+		Error err = task.file->Write(task.buffer, task.size);
+		if (!err.Succeeded())
+		{
+			Fail(task.file, std::move(err));
+		}
+		return false;
+	}
+
+	// COMMENT: the size, time and attributes are set only when every write of the file has completed.
+	const auto ringFile = ringFiles.find(task.file);
+	if (ringFile != ringFiles.end())
+	{
+		if (ringFile->second.writesInFlight != 0)
+		{
+			ringFile->second.finishPending = true;
+			ringFile->second.finish = task;
+			return false;
+		}
+		ringFiles.erase(ringFile);
+	}
+
+	RunFinish(task);
+	return false;
+}
+
+bool AsyncWriter::SubmitWrite(const Task& task)
+{
+	const unsigned bufferIndex = static_cast<unsigned>((task.buffer - buffers) / BufferSize);
+	RingFile& ringFile = ringFiles[task.file];
+	ringWrites[bufferIndex] = RingWrite{ task.file, task.buffer, task.size, 0, ringFile.offset };
+	if (!PrepareWrite(bufferIndex))
+	{
+		ringWrites[bufferIndex].file = nullptr;
+		Fail(task.file, Error::makeByErrno(EBUSY));
+		return false;
+	}
+
+	ringFile.offset += task.size;
+	ringFile.writesInFlight++;
+
+	std::lock_guard<std::mutex> lock(mutex);
+	writesInFlight++;
+	return true;
+}
+
+bool AsyncWriter::PrepareWrite(unsigned bufferIndex)
+{
+	const RingWrite& write = ringWrites[bufferIndex];
+	return ring.PrepareWrite(write.file->GetHandle(), bufferIndex, write.buffer + write.written, write.size - write.written,
+		write.offset + write.written, bufferIndex);
+}
+
+void AsyncWriter::Reap(unsigned waitCount)
+{
+	Error err = ring.Submit(waitCount);
+	if (!err.Succeeded())
+	{
+		AbandonRing(std::move(err));
+		return;
+	}
+
+	bool resubmit = false;
+	WriteRing::Completion completion;
+	while (ring.PopCompletion(completion))
+	{
+		const unsigned bufferIndex = static_cast<unsigned>(completion.userData);
+		RingWrite& write = ringWrites[bufferIndex];
+		if (completion.result > 0 && write.written + static_cast<uint32_t>(completion.result) < write.size)
+		{
+			// COMMENT: a short write, the rest is written like the next chunk.
+			write.written += static_cast<uint32_t>(completion.result);
+			if (PrepareWrite(bufferIndex))
+			{
+				resubmit = true;
+				continue;
+			}
+			completion.result = -EBUSY;
+		}
+
+		if (completion.result < 0)
+		{
+			Fail(write.file, Error::makeByErrno(-completion.result));
+		}
+		else if (completion.result == 0)
+		{
+			Fail(write.file, Error::makeByErrno(EIO));
+		}
+
+		CompleteWrite(bufferIndex);
+	}
+
+	if (resubmit)
+	{
+		Reap(0);
+	}
+}
+
+void AsyncWriter::CompleteWrite(unsigned bufferIndex)
+{
+	RingWrite& write = ringWrites[bufferIndex];
+	const auto ringFile = ringFiles.find(write.file);
+	if (ringFile != ringFiles.end() && --ringFile->second.writesInFlight == 0 && ringFile->second.finishPending)
+	{
+		const Task finish = ringFile->second.finish;
+		ringFiles.erase(ringFile);
+		RunFinish(finish);
+	}
+	write.file = nullptr;
+
+	// COMMENT: counted down after the finish, so Wait does not return while the file is still being finished.
+	std::lock_guard<std::mutex> lock(mutex);
+	freeBuffers.push_back(write.buffer);
+	writesInFlight--;
+	taskDone.notify_all();
+}
+
+// COMMENT: the ring itself failed, what it still holds will never be reported. The writes count as failed and the
+// writer goes on synchronously, which after the failure skips everything but closing the files.
+void AsyncWriter::AbandonRing(Error&& err)
+{
+	ring.Close();
+
+	for (unsigned bufferIndex = 0; bufferIndex < BufferCount; bufferIndex++)
+	{
+		const RingWrite& write = ringWrites[bufferIndex];
+		if (write.file != nullptr)
+		{
+			Fail(write.file, Error(err));
+			CompleteWrite(bufferIndex);
+		}
+	}
+}
+
+void AsyncWriter::RunFinish(const Task& task)
+{
+	if (Failed())
+	{
+		Drop(task.file);
+		return;
+	}
+
+	if (task.fileSize != 0)
+	{
+		Error err = task.file->SetSize(task.fileSize);
+		if (!err.Succeeded())
+		{
+			Fail(task.file, std::move(err));
+		}
+	}
+
+	// COMMENT: the time is set after the last write, which would update it again.
+	if (task.modificationTime != 0)
+	{
+		Error err = task.file->SetModificationTime(task.modificationTime);
+		if (!err.Succeeded())
+		{
+			Fail(task.file, std::move(err));
+		}
+	}
+
+	// COMMENT: set through the open handle, which keeps its write access.
+	if (task.readOnly)
+	{
+		Error err = task.file->SetReadOnly(true);
+		if (!err.Succeeded())
+		{
+			Fail(task.file, std::move(err));
+		}
+	}
+
+	closeQueue.Push(*task.file);
+
+	std::lock_guard<std::mutex> lock(mutex);
+	if (failure.Succeeded())
+	{
+		finished.push_back(files[task.file]);
+	}
+	files.erase(task.file);
+	delete task.file;
+}
+
+void AsyncWriter::Drop(File* file)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	files.erase(file);
+	delete file;
+}
+
+void AsyncWriter::Fail(File* file, Error&& err)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	if (failure.Succeeded())
+	{
+		failure = std::move(err);
+		failedTag = files[file];
+	}
+}
@@ -0,0 +1,135 @@
+#pragma once
+
+#include "Error.hpp"
+#include "File.h"
+#include "CloseQueue.h"
+#include "WriteRing.h"
+#include <condition_variable>
+#include <cstdint>
+#include <ctime>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+// COMMENT: writes unpacked files on a background thread, so the caller inflates the next chunk while the previous ones
+// are written. Chunks are filled in buffers from a fixed pool of BufferCount, AcquireBuffer blocks while all of them
+// are in flight. The buffers are aligned for direct I/O. Where WriteRing is available the thread submits the writes
+// in batches and keeps all buffers in flight at once, otherwise it writes one buffer after another.
+// Operations run in submission order: the writes of a file, then Finish sets its time and attributes
+// and hands it to the close queue. At most MaxPendingFiles files wait for their Finish, Add blocks beyond that.
+// The tags of finished files are collected for TakeFinished. After the first failure the remaining writes are skipped, the failure is reported
+// by Failed and Wait together with the tag of the file it happened on. Files not finished when the writer is destroyed,
+// because unpacking failed, are closed by the destructor.
+class AsyncWriter
+{
+public:
+
+	static const uint32_t BufferSize = 64 * 1024;
+	static const size_t BufferCount = 8;
+	static const size_t MaxPendingFiles = 64;
+
+	// COMMENT: batchWrites false always writes synchronously, for comparison.
+	explicit AsyncWriter(CloseQueue& closeQueue, bool batchWrites = true);
+	~AsyncWriter();
+
+	AsyncWriter(const AsyncWriter&) = delete;
+	AsyncWriter& operator=(const AsyncWriter&) = delete;
+
+	// COMMENT: the file belongs to the writer from now on, the pointer is valid until it is passed to Finish.
+	// Waits while MaxPendingFiles files are not finished yet.
+	File* Add(std::unique_ptr<File> file, uint64_t tag);
+	uint8_t* AcquireBuffer();
+	// COMMENT: the buffer goes back to the pool when it is written, size may be 0 to return it unused.
+	void Write(File* file, uint8_t* buffer, uint32_t size);
+	// COMMENT: modificationTime 0 keeps the time of the last write. A non-zero size cuts off the padding
+	// of the last direct write.
+	void Finish(File* file, uint64_t size, time_t modificationTime, bool readOnly);
+
+	// COMMENT: true when the writes go through WriteRing, decided by the constructor.
+	bool IsBatched() const;
+	bool Failed() const;
+	// COMMENT: moves the tags of the files finished since the last call into tags, in the order they were finished.
+	void TakeFinished(std::vector<uint64_t>& tags);
+	// COMMENT: returns when all submitted operations are done, with the first failure if there was one.
+	Error Wait(uint64_t& failedTag);
+
+private:
+
+	enum class Operation
+	{
+		Write,
+		Finish
+	};
+
+	struct Task
+	{
+		Operation operation;
+		File* file;
+		uint8_t* buffer;
+		uint32_t size;
+		uint64_t fileSize;
+		time_t modificationTime;
+		bool readOnly;
+	};
+
+	// COMMENT: a write in the ring, by the index of its buffer. file is null while the buffer is not in the ring.
+	struct RingWrite
+	{
+		File* file;
+		uint8_t* buffer;
+		uint32_t size;
+		uint32_t written;
+		uint64_t offset;
+	};
+
+	// COMMENT: the next offset of a file and its writes in the ring, Finish waits for them to complete.
+	struct RingFile
+	{
+		uint64_t offset = 0;
+		unsigned writesInFlight = 0;
+		bool finishPending = false;
+		Task finish;
+	};
+
+	void Push(const Task& task);
+	void Work();
+	bool Run(const Task& task, bool skip);
+	bool SubmitWrite(const Task& task);
+	bool PrepareWrite(unsigned bufferIndex);
+	void Reap(unsigned waitCount);
+	void CompleteWrite(unsigned bufferIndex);
+	void AbandonRing(Error&& err);
+	void RunFinish(const Task& task);
+	void Drop(File* file);
+	void Fail(File* file, Error&& err);
+
+private:
+
+	CloseQueue& closeQueue;
+	std::vector<uint8_t> pool;
+	uint8_t* buffers;
+	std::vector<uint8_t*> freeBuffers;
+	bool batched;
+
+	// COMMENT: used by the writer thread only.
+	WriteRing ring;
+	std::vector<RingWrite> ringWrites;
+	std::unordered_map<File*, RingFile> ringFiles;
+
+	std::unordered_map<File*, uint64_t> files;
+	std::vector<uint64_t> finished;
+
+	mutable std::mutex mutex;
+	std::condition_variable taskAdded;
+	std::condition_variable taskDone;
+	std::deque<Task> tasks;
+	bool busy = false;
+	unsigned writesInFlight = 0;
+	bool stopping = false;
+	Error failure;
+	uint64_t failedTag = 0;
+	std::thread thread;
+};
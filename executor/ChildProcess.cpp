@@ -0,0 +1,289 @@
+#include "ChildProcess.h"
+#include <algorithm>
+#include <atomic>
+#include <Windows.h>
+
+namespace
+{
+
+// COMMENT: WinEvent callbacks are delivered to the thread that installed the hook, while it pumps messages.
+thread_local bool visibleWindowShown = false;
+
+void CALLBACK WinEventCallback(HWINEVENTHOOK /*hook*/, DWORD /*event*/, HWND hwnd, LONG idObject, LONG idChild, DWORD /*idEventThread*/, DWORD /*time*/)
+{
+	if (idObject != OBJID_WINDOW || idChild != CHILDID_SELF || hwnd == NULL)
+	{
+		return;
+	}
+
+	if (GetAncestor(hwnd, GA_ROOT) == hwnd && IsWindowVisible(hwnd))
+	{
+		visibleWindowShown = true;
+	}
+}
+
+std::wstring MakeReadyPipeName()
+{
+	static std::atomic<unsigned> counter(0);
+
+	std::wstring name(L"\\\\.\\pipe\\infomaximum_ready_");
+	name.append(std::to_wstring(GetCurrentProcessId())).append(L"_").append(std::to_wstring(counter++));
+	return name;
+}
+
+// COMMENT: the part before the first '=' not at the start, entries like "=C:=C:\dir" hold the current directory of a drive.
+std::wstring GetVariableName(const std::wstring& entry)
+{
+	return entry.substr(0, entry.find(L'=', 1));
+}
+
+bool IsSameName(const std::wstring& left, const std::wstring& right)
+{
+	return CompareStringOrdinal(left.c_str(), static_cast<int>(left.size()), right.c_str(), static_cast<int>(right.size()), TRUE) == CSTR_EQUAL;
+}
+
+// COMMENT: the inherited environment with the variables replaced or added, as a block for CreateProcessW.
+// Entries are sorted by name ignoring case, as CreateProcessW expects them.
+std::wstring MakeEnvironmentBlock(const ChildProcess::Environment& environment)
+{
+	std::vector<std::wstring> entries;
+	wchar_t* inherited = GetEnvironmentStringsW();
+	if (inherited != NULL)
+	{
+		for (const wchar_t* entry = inherited; *entry != L'\0'; entry += wcslen(entry) + 1)
+		{
+			entries.push_back(entry);
+		}
+		FreeEnvironmentStringsW(inherited);
+	}
+
+	for (const auto& variable : environment)
+	{
+		entries.erase(std::remove_if(entries.begin(), entries.end(), [&variable](const std::wstring& entry)
+		{
+			return IsSameName(GetVariableName(entry), variable.first);
+		}), entries.end());
+		entries.push_back(std::wstring(variable.first).append(L"=").append(variable.second));
+	}
+
+	std::stable_sort(entries.begin(), entries.end(), [](const std::wstring& left, const std::wstring& right)
+	{
+		const std::wstring leftName = GetVariableName(left);
+		const std::wstring rightName = GetVariableName(right);
+		return CompareStringOrdinal(leftName.c_str(), static_cast<int>(leftName.size()), rightName.c_str(), static_cast<int>(rightName.size()), TRUE) == CSTR_LESS_THAN;
+	});
+
+	std::wstring block;
+	for (const std::wstring& entry : entries)
+	{
+		block.append(entry).push_back(L'\0');
+	}
+	block.push_back(L'\0');
+	return block;
+}
+
+void PumpMessages()
+{
+	MSG msg;
+	while (PeekMessageW(&msg, NULL, 0, 0, PM_REMOVE))
+	{
+		TranslateMessage(&msg);
+		DispatchMessageW(&msg);
+	}
+}
+
+} // namespace
+
+const wchar_t* const ChildProcess::ReadyPipeVariable = L"INFOMAXIMUM_READY_PIPE";
+
+ChildProcess::ChildProcess()
+{
+	ZeroMemory(&processInfo, sizeof(processInfo));
+	ZeroMemory(&readyOverlapped, sizeof(readyOverlapped));
+}
+
+ChildProcess::~ChildProcess()
+{
+	Close();
+}
+
+Error ChildProcess::Start(const std::wstring& cmd, const std::wstring& workingDir, HANDLE stdoutHandle, const Environment& environment)
+{
+	Close();
+
+	Error err = CreateReadyPipe();
+	if (!err.Succeeded())
+	{
+		return err;
+	}
+
+	STARTUPINFOW sInfo = {0};
+	sInfo.cb = sizeof(sInfo);
+	sInfo.dwFlags |= STARTF_USESTDHANDLES;
+	sInfo.hStdInput = NULL;
+	sInfo.hStdError = stdoutHandle;
+	sInfo.hStdOutput = stdoutHandle;
+
+	// COMMENT: the variables go into a block of the child's own, the environment of this process is shared by all its threads.
+	Environment childEnvironment(environment);
+	childEnvironment.emplace_back(ReadyPipeVariable, readyPipeName);
+	std::wstring environmentBlock = MakeEnvironmentBlock(childEnvironment);
+
+	if (!CreateProcessW(NULL, const_cast<wchar_t*>(cmd.c_str()), NULL, NULL, TRUE, CREATE_NO_WINDOW | CREATE_SUSPENDED | CREATE_UNICODE_ENVIRONMENT,
+		&environmentBlock[0], workingDir.c_str(), &sInfo, &processInfo))
+	{
+		const DWORD createError = GetLastError();
+		ZeroMemory(&processInfo, sizeof(processInfo));
+		return Error(createError);
+	}
+
+	// COMMENT: the hook is installed while the child is suspended, so its first window can not be missed.
+	visibleWindowShown = false;
+	hWinEventHook = SetWinEventHook(EVENT_OBJECT_SHOW, EVENT_OBJECT_SHOW, NULL, WinEventCallback, processInfo.dwProcessId, 0, WINEVENT_OUTOFCONTEXT | WINEVENT_SKIPOWNPROCESS);
+
+	ResumeThread(processInfo.hThread);
+	return Error();
+}
+
+Error ChildProcess::WaitReady(State& state)
+{
+	state = State::Exited;
+	if (exited)
+	{
+		return Error();
+	}
+
+	const HANDLE handles[] = { processInfo.hProcess, hReadyEvent };
+	const DWORD count = hReadyEvent != NULL ? 2 : 1;
+	for (;;)
+	{
+		if (visibleWindowShown)
+		{
+			state = State::Ready;
+			break;
+		}
+
+		const DWORD res = MsgWaitForMultipleObjects(count, handles, FALSE, INFINITE, QS_ALLINPUT);
+		if (res == WAIT_OBJECT_0)
+		{
+			exited = true;
+			state = State::Exited;
+			break;
+		}
+		else if (res == WAIT_OBJECT_0 + 1 && count == 2)
+		{
+			state = State::Ready;
+			break;
+		}
+		else if (res == WAIT_OBJECT_0 + count)
+		{
+			PumpMessages();
+		}
+		else
+		{
+			return Error(GetLastError());
+		}
+	}
+
+	if (hWinEventHook != NULL)
+	{
+		UnhookWinEvent(hWinEventHook);
+		hWinEventHook = NULL;
+	}
+
+	return Error();
+}
+
+Error ChildProcess::WaitExit(uint32_t& exitCode)
+{
+	exitCode = ERROR_SUCCESS;
+
+	if (WaitForSingleObject(processInfo.hProcess, INFINITE) == WAIT_FAILED)
+	{
+		return Error(GetLastError());
+	}
+	exited = true;
+
+	DWORD code = ERROR_SUCCESS;
+	if (!GetExitCodeProcess(processInfo.hProcess, &code))
+	{
+		return Error(GetLastError());
+	}
+
+	exitCode = code;
+	return Error();
+}
+
+Error ChildProcess::CreateReadyPipe()
+{
+	readyPipeName = MakeReadyPipeName();
+
+	hReadyEvent = CreateEventW(NULL, TRUE, FALSE, NULL);
+	if (hReadyEvent == NULL)
+	{
+		return Error(GetLastError());
+	}
+
+	hReadyPipe = CreateNamedPipeW(readyPipeName.c_str(), PIPE_ACCESS_INBOUND | FILE_FLAG_OVERLAPPED | FILE_FLAG_FIRST_PIPE_INSTANCE,
+		PIPE_TYPE_BYTE | PIPE_REJECT_REMOTE_CLIENTS, 1, 0, 64, 0, NULL);
+	if (hReadyPipe == INVALID_HANDLE_VALUE)
+	{
+		return Error(GetLastError());
+	}
+
+	readyOverlapped.hEvent = hReadyEvent;
+	if (!ConnectNamedPipe(hReadyPipe, &readyOverlapped))
+	{
+		const DWORD err = GetLastError();
+		if (err == ERROR_PIPE_CONNECTED)
+		{
+			SetEvent(hReadyEvent);
+		}
+		else if (err != ERROR_IO_PENDING)
+		{
+			return Error(err);
+		}
+	}
+
+	return Error();
+}
+
+void ChildProcess::Close()
+{
+	if (hWinEventHook != NULL)
+	{
+		UnhookWinEvent(hWinEventHook);
+		hWinEventHook = NULL;
+	}
+
+	if (hReadyPipe != INVALID_HANDLE_VALUE)
+	{
+		// COMMENT: readyOverlapped must stay untouched until the pending connect is cancelled.
+		DWORD transferred = 0;
+		CancelIo(hReadyPipe);
+		GetOverlappedResult(hReadyPipe, &readyOverlapped, &transferred, TRUE);
+		CloseHandle(hReadyPipe);
+		hReadyPipe = INVALID_HANDLE_VALUE;
+	}
+
+	if (hReadyEvent != NULL)
+	{
+		CloseHandle(hReadyEvent);
+		hReadyEvent = NULL;
+	}
+
+	if (processInfo.hProcess != NULL)
+	{
+		CloseHandle(processInfo.hProcess);
+	}
+
+	if (processInfo.hThread != NULL)
+	{
+		CloseHandle(processInfo.hThread);
+	}
+
+	ZeroMemory(&processInfo, sizeof(processInfo));
+	ZeroMemory(&readyOverlapped, sizeof(readyOverlapped));
+	readyPipeName.clear();
+	exited = false;
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+#include "Error.hpp"
+#include <string>
+#include <utility>
+#include <vector>
+#include <cstdint>
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <sys/types.h>
+#endif
+
+// COMMENT: launches the java process and reports when it is ready to replace the splash.
+// The child is ready when it connects to the pipe passed in ReadyPipeVariable or, on Windows, when it shows
+// its first top-level window. Process exit ends the wait as a fallback. Start, WaitReady and WaitExit
+// must be called from the same thread.
+class ChildProcess
+{
+public:
+
+#ifdef _WIN32
+	typedef HANDLE NativeHandle;
+#else
+	typedef int NativeHandle;
+#endif
+
+	enum class State
+	{
+		Ready,
+		Exited
+	};
+
+	// COMMENT: name and value pairs set for the child only, on top of the inherited environment.
+	typedef std::vector<std::pair<std::wstring, std::wstring>> Environment;
+
+	static const wchar_t* const ReadyPipeVariable;
+
+	ChildProcess();
+	~ChildProcess();
+
+	ChildProcess(const ChildProcess&) = delete;
+	ChildProcess& operator=(const ChildProcess&) = delete;
+
+	// COMMENT: stdoutHandle receives both stdout and stderr of the child, it may be invalid.
+	Error Start(const std::wstring& cmd, const std::wstring& workingDir, NativeHandle stdoutHandle, const Environment& environment = Environment());
+	Error WaitReady(State& state);
+	Error WaitExit(uint32_t& exitCode);
+
+private:
+
+	Error CreateReadyPipe();
+	void Close();
+
+private:
+
+	std::wstring readyPipeName;
+	bool exited = false;
+
+#ifdef _WIN32
+	PROCESS_INFORMATION processInfo;
+	HANDLE hReadyPipe = INVALID_HANDLE_VALUE;
+	HANDLE hReadyEvent = NULL;
+	OVERLAPPED readyOverlapped;
+	HWINEVENTHOOK hWinEventHook = NULL;
+#else
+	pid_t pid = -1;
+	int pidFd = -1;
+	int readyFd = -1;
+	int status = 0;
+#endif
+};
@@ -0,0 +1,296 @@
+#include "ChildProcess.h"
+#include "StringConverter.hpp"
+#include <atomic>
+#include <vector>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+
+extern char** environ;
+
+namespace
+{
+
+const int ExitPollIntervalMs = 100;
+
+std::string MakeReadyPipePath()
+{
+	static std::atomic<unsigned> counter(0);
+
+	const char* tmpDir = getenv("TMPDIR");
+	std::string path(tmpDir != nullptr && *tmpDir != '\0' ? tmpDir : "/tmp");
+	path.append("/infomaximum_ready_").append(std::to_string(getpid())).append("_").append(std::to_string(counter++));
+	return path;
+}
+
+int OpenPidFd(pid_t pid)
+{
+#ifdef SYS_pidfd_open
+	return static_cast<int>(syscall(SYS_pidfd_open, pid, 0));
+#else
+	(void)pid;
+	errno = ENOSYS;
+	return -1;
+#endif
+}
+
+// COMMENT: the inherited environment with the variables replaced or added, the strings must outlive the returned pointers.
+std::vector<char*> MakeEnvironment(std::vector<std::string>& variables)
+{
+	std::vector<char*> envp;
+	for (char** env = environ; *env != nullptr; env++)
+	{
+		bool replaced = false;
+		for (const std::string& variable : variables)
+		{
+			const size_t nameSize = variable.find('=') + 1;
+			replaced = replaced || strncmp(*env, variable.c_str(), nameSize) == 0;
+		}
+
+		if (!replaced)
+		{
+			envp.push_back(*env);
+		}
+	}
+
+	for (std::string& variable : variables)
+	{
+		envp.push_back(&variable[0]);
+	}
+	envp.push_back(nullptr);
+	return envp;
+}
+
+uint32_t ToExitCode(int status)
+{
+	if (WIFEXITED(status))
+	{
+		return static_cast<uint32_t>(WEXITSTATUS(status));
+	}
+
+	if (WIFSIGNALED(status))
+	{
+		return static_cast<uint32_t>(128 + WTERMSIG(status));
+	}
+
+	return static_cast<uint32_t>(-1);
+}
+
+} // namespace
+
+const wchar_t* const ChildProcess::ReadyPipeVariable = L"INFOMAXIMUM_READY_PIPE";
+
+ChildProcess::ChildProcess()
+{
+}
+
+ChildProcess::~ChildProcess()
+{
+	Close();
+}
+
+Error ChildProcess::Start(const std::wstring& cmd, const std::wstring& workingDir, int stdoutHandle, const Environment& environment)
+{
+	Close();
+
+	std::string cmdUtf8;
+	Error err = ConvertUtf16ToUtf8(cmd, cmdUtf8);
+	if (!err.Succeeded())
+	{
+		return err;
+	}
+
+	std::string workingDirUtf8;
+	if (!workingDir.empty())
+	{
+		err = ConvertUtf16ToUtf8(workingDir, workingDirUtf8);
+		if (!err.Succeeded())
+		{
+			return err;
+		}
+	}
+
+	err = CreateReadyPipe();
+	if (!err.Succeeded())
+	{
+		return err;
+	}
+
+	Environment childEnvironment(environment);
+	childEnvironment.emplace_back(ReadyPipeVariable, readyPipeName);
+
+	std::vector<std::string> variables;
+	for (const auto& variable : childEnvironment)
+	{
+		std::string name;
+		std::string value;
+		ConvertUtf16ToUtf8(variable.first, name);
+		ConvertUtf16ToUtf8(variable.second, value);
+		variables.push_back(name.append("=").append(value));
+	}
+
+	// COMMENT: everything the child needs is prepared before fork, only async-signal-safe calls are made after it.
+	const std::vector<char*> envp = MakeEnvironment(variables);
+
+	pid = fork();
+	if (pid < 0)
+	{
+		pid = -1;
+		return Error::makeByErrno(errno);
+	}
+
+	if (pid == 0)
+	{
+		if (!workingDirUtf8.empty() && chdir(workingDirUtf8.c_str()) != 0)
+		{
+			_exit(127);
+		}
+
+		const int devNull = open("/dev/null", O_RDWR);
+		dup2(devNull, STDIN_FILENO);
+		dup2(stdoutHandle >= 0 ? stdoutHandle : devNull, STDOUT_FILENO);
+		dup2(stdoutHandle >= 0 ? stdoutHandle : devNull, STDERR_FILENO);
+
+		execle("/bin/sh", "sh", "-c", cmdUtf8.c_str(), static_cast<char*>(nullptr), envp.data());
+		_exit(127);
+	}
+
+	pidFd = OpenPidFd(pid);
+	return Error();
+}
+
+Error ChildProcess::WaitReady(State& state)
+{
+	state = State::Exited;
+	if (exited)
+	{
+		return Error();
+	}
+
+	for (;;)
+	{
+		pollfd fds[2];
+		nfds_t count = 0;
+
+		fds[count].fd = readyFd;
+		fds[count].events = POLLIN;
+		fds[count].revents = 0;
+		count++;
+
+		// COMMENT: without pidfd (kernels before 5.3) process exit is checked periodically.
+		if (pidFd >= 0)
+		{
+			fds[count].fd = pidFd;
+			fds[count].events = POLLIN;
+			fds[count].revents = 0;
+			count++;
+		}
+
+		const int res = poll(fds, count, pidFd >= 0 ? -1 : ExitPollIntervalMs);
+		if (res < 0)
+		{
+			if (errno == EINTR)
+			{
+				continue;
+			}
+			return Error::makeByErrno(errno);
+		}
+
+		if ((fds[0].revents & (POLLIN | POLLHUP)) != 0)
+		{
+			state = State::Ready;
+			return Error();
+		}
+
+		if (pidFd < 0 || (fds[1].revents & POLLIN) != 0)
+		{
+			const pid_t waited = waitpid(pid, &status, WNOHANG);
+			if (waited == pid)
+			{
+				exited = true;
+				state = State::Exited;
+				return Error();
+			}
+			else if (waited < 0 && errno != EINTR)
+			{
+				return Error::makeByErrno(errno);
+			}
+		}
+	}
+}
+
+Error ChildProcess::WaitExit(uint32_t& exitCode)
+{
+	exitCode = 0;
+
+	if (!exited)
+	{
+		while (waitpid(pid, &status, 0) < 0)
+		{
+			if (errno != EINTR)
+			{
+				return Error::makeByErrno(errno);
+			}
+		}
+		exited = true;
+	}
+
+	exitCode = ToExitCode(status);
+	return Error();
+}
+
+Error ChildProcess::CreateReadyPipe()
+{
+	const std::string path = MakeReadyPipePath();
+	if (mkfifo(path.c_str(), S_IRUSR | S_IWUSR) != 0)
+	{
+		return Error::makeByErrno(errno);
+	}
+
+	// COMMENT: a non-blocking reader does not wait for a writer, poll reports POLLIN/POLLHUP once the child writes or closes the pipe.
+	readyFd = open(path.c_str(), O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+	if (readyFd < 0)
+	{
+		const int err = errno;
+		unlink(path.c_str());
+		return Error::makeByErrno(err);
+	}
+
+	return ConvertUtf8ToUtf16(path, readyPipeName);
+}
+
+void ChildProcess::Close()
+{
+	if (readyFd >= 0)
+	{
+		close(readyFd);
+		readyFd = -1;
+	}
+
+	if (!readyPipeName.empty())
+	{
+		std::string path;
+		if (ConvertUtf16ToUtf8(readyPipeName, path).Succeeded())
+		{
+			unlink(path.c_str());
+		}
+		readyPipeName.clear();
+	}
+
+	if (pidFd >= 0)
+	{
+		close(pidFd);
+		pidFd = -1;
+	}
+
+	pid = -1;
+	status = 0;
+	exited = false;
+}
@@ -0,0 +1,266 @@
+#include "Cleanup.h"
+#include "FileLock.h"
+#include "Path.hpp"
+#include "Trace.h"
+#include "TreeRemover.h"
+#include <atomic>
+#include <vector>
+#include <Windows.h>
+
+namespace
+{
+
+const std::wstring TombstonePrefix(L"infomaximum_tombstone_");
+const std::wstring SweepLockName(L"infomaximum_sweeper.lock");
+
+struct RemovePrimitives
+{
+	typedef std::wstring Path;
+
+	static void RemoveEntries(const std::wstring& dirPath, std::vector<std::wstring>& subDirs)
+	{
+		WIN32_FIND_DATAW findData;
+		HANDLE hFind = FindFirstFileExW(std::wstring(dirPath).append(L"\\*").c_str(), FindExInfoBasic, &findData,
+			FindExSearchNameMatch, NULL, FIND_FIRST_EX_LARGE_FETCH);
+		if (hFind == INVALID_HANDLE_VALUE)
+		{
+			return;
+		}
+
+		do
+		{
+			const std::wstring name(findData.cFileName);
+			if (name == L"." || name == L"..")
+			{
+				continue;
+			}
+
+			const std::wstring path = std::wstring(dirPath).append(L"\\").append(name);
+			if ((findData.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) == 0)
+			{
+				RemoveFile(path, findData.dwFileAttributes);
+			}
+			else if ((findData.dwFileAttributes & FILE_ATTRIBUTE_REPARSE_POINT) != 0)
+			{
+				// COMMENT: only the junction itself is removed, never the directory it points to.
+				RemoveEmptyDir(path);
+			}
+			else
+			{
+				subDirs.push_back(path);
+			}
+		} while (FindNextFileW(hFind, &findData));
+
+		FindClose(hFind);
+	}
+
+	static void RemoveFile(const std::wstring& path, DWORD attributes)
+	{
+		if (DeleteFileW(path.c_str()) || (attributes & FILE_ATTRIBUTE_READONLY) == 0)
+		{
+			return;
+		}
+
+		// COMMENT: the file may be a hardlink into the payload cache and attributes are shared by all links,
+		// so read-only is cleared only for the time it takes to mark the file for deletion.
+		HANDLE hFile = CreateFileW(path.c_str(), DELETE | FILE_WRITE_ATTRIBUTES, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, NULL,
+			OPEN_EXISTING, FILE_FLAG_OPEN_REPARSE_POINT, NULL);
+		if (hFile == INVALID_HANDLE_VALUE)
+		{
+			return;
+		}
+
+		FILE_BASIC_INFO basicInfo;
+		ZeroMemory(&basicInfo, sizeof(basicInfo));
+		basicInfo.FileAttributes = FILE_ATTRIBUTE_NORMAL;
+		if (SetFileInformationByHandle(hFile, FileBasicInfo, &basicInfo, sizeof(basicInfo)))
+		{
+			FILE_DISPOSITION_INFO dispositionInfo;
+			dispositionInfo.DeleteFile = TRUE;
+			SetFileInformationByHandle(hFile, FileDispositionInfo, &dispositionInfo, sizeof(dispositionInfo));
+
+			basicInfo.FileAttributes = attributes;
+			SetFileInformationByHandle(hFile, FileBasicInfo, &basicInfo, sizeof(basicInfo));
+		}
+
+		CloseHandle(hFile);
+	}
+
+	static void RemoveEmptyDir(const std::wstring& path)
+	{
+		if (!RemoveDirectoryW(path.c_str()) && GetLastError() == ERROR_ACCESS_DENIED)
+		{
+			SetFileAttributesW(path.c_str(), FILE_ATTRIBUTE_DIRECTORY);
+			RemoveDirectoryW(path.c_str());
+		}
+	}
+};
+
+std::vector<std::wstring> GetTombstoneRoots()
+{
+	std::vector<std::wstring> roots;
+
+	wchar_t tempPath[MAX_PATH + 1];
+	const DWORD len = GetTempPathW(MAX_PATH + 1, tempPath);
+	if (len != 0 && len <= MAX_PATH)
+	{
+		std::wstring root(tempPath, len);
+		if (root.back() == L'\\')
+		{
+			root.pop_back();
+		}
+		roots.push_back(root);
+	}
+
+	std::wstring cacheRoot;
+	if (Path::GetCacheDirPath(std::wstring(), cacheRoot).Succeeded())
+	{
+		roots.push_back(cacheRoot);
+	}
+
+	return roots;
+}
+
+std::vector<std::wstring> FindTombstones()
+{
+	std::vector<std::wstring> tombstones;
+	for (const std::wstring& root : GetTombstoneRoots())
+	{
+		WIN32_FIND_DATAW findData;
+		HANDLE hFind = FindFirstFileExW(std::wstring(root).append(L"\\").append(TombstonePrefix).append(L"*").c_str(), FindExInfoBasic, &findData,
+			FindExSearchNameMatch, NULL, 0);
+		if (hFind == INVALID_HANDLE_VALUE)
+		{
+			continue;
+		}
+
+		do
+		{
+			if ((findData.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) != 0)
+			{
+				tombstones.push_back(std::wstring(root).append(L"\\").append(findData.cFileName));
+			}
+		} while (FindNextFileW(hFind, &findData));
+
+		FindClose(hFind);
+	}
+
+	return tombstones;
+}
+
+bool StartSweeper()
+{
+	std::wstring exeFullPath;
+	if (!Path::GetApplicationFilePath(exeFullPath).Succeeded())
+	{
+		return false;
+	}
+
+	std::wstring cmd;
+	cmd.append(L"\"").append(exeFullPath).append(L"\" ");
+	for (const char* arg = Cleanup::SweepArg; *arg != '\0'; arg++)
+	{
+		cmd.push_back(static_cast<wchar_t>(*arg));
+	}
+
+	// COMMENT: the sweeper must not hold the current directory of the caller or any of its handles.
+	wchar_t tempPath[MAX_PATH + 1];
+	const DWORD len = GetTempPathW(MAX_PATH + 1, tempPath);
+
+	STARTUPINFOW sInfo = {0};
+	sInfo.cb = sizeof(sInfo);
+	PROCESS_INFORMATION processInfo;
+	ZeroMemory(&processInfo, sizeof(processInfo));
+
+	if (!CreateProcessW(NULL, &cmd[0], NULL, NULL, FALSE, CREATE_NO_WINDOW | DETACHED_PROCESS | BELOW_NORMAL_PRIORITY_CLASS, NULL,
+		len != 0 && len <= MAX_PATH ? tempPath : NULL, &sInfo, &processInfo))
+	{
+		return false;
+	}
+
+	CloseHandle(processInfo.hThread);
+	CloseHandle(processInfo.hProcess);
+	return true;
+}
+
+} // namespace
+
+const char* const Cleanup::SweepArg = "--cleanup";
+
+void Cleanup::Remove(const std::wstring& dirPath)
+{
+	static std::atomic<unsigned> counter(0);
+	Trace::Scope traceScope("Cleanup::Remove");
+
+	const size_t separator = dirPath.find_last_of(L'\\');
+	if (separator == std::wstring::npos)
+	{
+		RemoveTree(dirPath);
+		return;
+	}
+
+	// COMMENT: the tombstone stays on the same volume, so the rename is atomic and does not move any data.
+	std::wstring tombstone = dirPath.substr(0, separator + 1);
+	tombstone.append(TombstonePrefix).append(std::to_wstring(GetCurrentProcessId())).append(L"_").append(std::to_wstring(counter++));
+
+	if (!MoveFileExW(dirPath.c_str(), tombstone.c_str(), 0))
+	{
+		RemoveTree(dirPath);
+		return;
+	}
+
+	if (!StartSweeper())
+	{
+		RemoveTree(tombstone);
+	}
+}
+
+void Cleanup::SweepInBackground()
+{
+	if (!FindTombstones().empty())
+	{
+		StartSweeper();
+	}
+}
+
+void Cleanup::Sweep()
+{
+	// COMMENT: sweepers of concurrent runs take turns and each lists the tombstones only when its turn comes,
+	// so two of them never remove the same tree.
+	const std::vector<std::wstring> roots = GetTombstoneRoots();
+	if (roots.empty())
+	{
+		return;
+	}
+
+	FileLock lock;
+	if (!lock.Lock(std::wstring(roots.front()).append(L"\\").append(SweepLockName)).Succeeded())
+	{
+		return;
+	}
+
+	for (const std::wstring& tombstone : FindTombstones())
+	{
+		RemoveTree(tombstone);
+	}
+}
+
+void Cleanup::RemoveTree(const std::wstring& dirPath)
+{
+	Trace::Scope traceScope("Cleanup::RemoveTree");
+
+	const DWORD attributes = GetFileAttributesW(dirPath.c_str());
+	if (attributes == INVALID_FILE_ATTRIBUTES || (attributes & FILE_ATTRIBUTE_DIRECTORY) == 0)
+	{
+		return;
+	}
+
+	if ((attributes & FILE_ATTRIBUTE_REPARSE_POINT) != 0)
+	{
+		RemoveDirectoryW(dirPath.c_str());
+		return;
+	}
+
+	TreeRemover<RemovePrimitives> remover;
+	remover.Run(dirPath);
+}
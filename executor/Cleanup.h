@@ -0,0 +1,27 @@
+#pragma once
+
+#include "Error.hpp"
+#include <string>
+
+// COMMENT: removes directories without keeping the executor alive. A directory is renamed to a tombstone
+// <parent>\infomaximum_tombstone_<pid>_<n> and deleted by a detached executor started with SweepArg.
+// Tombstones left by crashed runs in the temp and cache directories are swept the same way on the next launch.
+// Sweepers of concurrent runs take turns under a lock file in the temp directory.
+class Cleanup
+{
+public:
+
+	static const char* const SweepArg;
+
+	// COMMENT: falls back to removing in place when the directory can not be renamed or handed off.
+	static void Remove(const std::wstring& dirPath);
+
+	// COMMENT: starts the sweeper if tombstones were left by previous runs.
+	static void SweepInBackground();
+
+	// COMMENT: entry point of the sweeper process, removes all tombstones.
+	static void Sweep();
+
+	// COMMENT: removes the tree in place, walking and deleting directories on several threads.
+	static void RemoveTree(const std::wstring& dirPath);
+};
@@ -0,0 +1,270 @@
+#include "Cleanup.h"
+#include "FileLock.h"
+#include "Path.hpp"
+#include "StringConverter.hpp"
+#include "Trace.h"
+#include "TreeRemover.h"
+#include <atomic>
+#include <vector>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+namespace
+{
+
+const std::string TombstonePrefix("infomaximum_tombstone_");
+const std::string SweepLockName("infomaximum_sweeper.lock");
+
+struct RemovePrimitives
+{
+	typedef std::string Path;
+
+	static void RemoveEntries(const std::string& dirPath, std::vector<std::string>& subDirs)
+	{
+		const int dirFd = open(dirPath.c_str(), O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+		DIR* dir = dirFd >= 0 ? fdopendir(dirFd) : nullptr;
+		if (dir == nullptr)
+		{
+			if (dirFd >= 0)
+			{
+				close(dirFd);
+			}
+			return;
+		}
+
+		while (const dirent* entry = readdir(dir))
+		{
+			if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0)
+			{
+				continue;
+			}
+
+			// COMMENT: a symbolic link is never followed, unlinkat removes the link itself like any file.
+			bool isDir = entry->d_type == DT_DIR;
+			if (entry->d_type == DT_UNKNOWN)
+			{
+				struct stat sb;
+				isDir = fstatat(dirFd, entry->d_name, &sb, AT_SYMLINK_NOFOLLOW) == 0 && S_ISDIR(sb.st_mode);
+			}
+
+			if (!isDir)
+			{
+				unlinkat(dirFd, entry->d_name, 0);
+			}
+			else
+			{
+				subDirs.push_back(std::string(dirPath).append("/").append(entry->d_name));
+			}
+		}
+
+		closedir(dir);
+	}
+
+	static void RemoveEmptyDir(const std::string& dirPath)
+	{
+		rmdir(dirPath.c_str());
+	}
+};
+
+std::vector<std::string> GetTombstoneRoots()
+{
+	std::vector<std::string> roots;
+
+	const char* tmpDir = getenv("TMPDIR");
+	std::string tempRoot(tmpDir != nullptr && tmpDir[0] == '/' ? tmpDir : "/tmp");
+	if (tempRoot.size() > 1 && tempRoot.back() == '/')
+	{
+		tempRoot.pop_back();
+	}
+	roots.push_back(tempRoot);
+
+	std::wstring cacheRoot;
+	std::string nativeCacheRoot;
+	if (Path::GetCacheDirPath(std::wstring(), cacheRoot).Succeeded() && ConvertUtf16ToUtf8(cacheRoot, nativeCacheRoot).Succeeded())
+	{
+		roots.push_back(nativeCacheRoot);
+	}
+
+	return roots;
+}
+
+std::vector<std::string> FindTombstones()
+{
+	std::vector<std::string> tombstones;
+	for (const std::string& root : GetTombstoneRoots())
+	{
+		DIR* dir = opendir(root.c_str());
+		if (dir == nullptr)
+		{
+			continue;
+		}
+
+		while (const dirent* entry = readdir(dir))
+		{
+			if (strncmp(entry->d_name, TombstonePrefix.c_str(), TombstonePrefix.size()) != 0)
+			{
+				continue;
+			}
+
+			const std::string path = std::string(root).append("/").append(entry->d_name);
+			struct stat sb;
+			if (lstat(path.c_str(), &sb) == 0 && S_ISDIR(sb.st_mode))
+			{
+				tombstones.push_back(path);
+			}
+		}
+
+		closedir(dir);
+	}
+
+	return tombstones;
+}
+
+bool StartSweeper()
+{
+	std::wstring exeFullPath;
+	std::string nativeExePath;
+	if (!Path::GetApplicationFilePath(exeFullPath).Succeeded() || !ConvertUtf16ToUtf8(exeFullPath, nativeExePath).Succeeded())
+	{
+		return false;
+	}
+
+	// COMMENT: the sweeper is the grandchild in a session of its own, so it is not reaped by the caller and
+	// survives the terminal being closed. Only async-signal-safe calls are made after fork.
+	const pid_t pid = fork();
+	if (pid < 0)
+	{
+		return false;
+	}
+
+	if (pid == 0)
+	{
+		if (setsid() < 0 || fork() != 0)
+		{
+			_exit(0);
+		}
+
+		if (chdir("/") != 0)
+		{
+			_exit(1);
+		}
+		setpriority(PRIO_PROCESS, 0, 10);
+		execl(nativeExePath.c_str(), nativeExePath.c_str(), Cleanup::SweepArg, static_cast<char*>(nullptr));
+		_exit(127);
+	}
+
+	int status = 0;
+	while (waitpid(pid, &status, 0) < 0 && errno == EINTR)
+	{
+	}
+
+	return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+void RemoveTree(const std::string& dirPath)
+{
+	struct stat sb;
+	if (lstat(dirPath.c_str(), &sb) != 0)
+	{
+		return;
+	}
+
+	if (!S_ISDIR(sb.st_mode))
+	{
+		// COMMENT: only a link to a directory is removed, never the directory it points to.
+		if (S_ISLNK(sb.st_mode))
+		{
+			unlink(dirPath.c_str());
+		}
+		return;
+	}
+
+	TreeRemover<RemovePrimitives> remover;
+	remover.Run(dirPath);
+}
+
+} // namespace
+
+const char* const Cleanup::SweepArg = "--cleanup";
+
+void Cleanup::Remove(const std::wstring& dirPath)
+{
+	static std::atomic<unsigned> counter(0);
+	Trace::Scope traceScope("Cleanup::Remove");
+
+	std::string nativePath;
+	if (!ConvertUtf16ToUtf8(dirPath, nativePath).Succeeded())
+	{
+		return;
+	}
+
+	const size_t separator = nativePath.find_last_of('/');
+	if (separator == std::string::npos)
+	{
+		::RemoveTree(nativePath);
+		return;
+	}
+
+	// COMMENT: the tombstone stays in the same file system, so the rename is atomic and does not move any data.
+	std::string tombstone = nativePath.substr(0, separator + 1);
+	tombstone.append(TombstonePrefix).append(std::to_string(getpid())).append("_").append(std::to_string(counter++));
+
+	if (rename(nativePath.c_str(), tombstone.c_str()) != 0)
+	{
+		::RemoveTree(nativePath);
+		return;
+	}
+
+	if (!StartSweeper())
+	{
+		::RemoveTree(tombstone);
+	}
+}
+
+void Cleanup::SweepInBackground()
+{
+	if (!FindTombstones().empty())
+	{
+		StartSweeper();
+	}
+}
+
+void Cleanup::Sweep()
+{
+	// COMMENT: sweepers of concurrent runs take turns and each lists the tombstones only when its turn comes,
+	// so two of them never remove the same tree.
+	std::wstring lockPath;
+	if (!ConvertUtf8ToUtf16(std::string(GetTombstoneRoots().front()).append("/").append(SweepLockName), lockPath).Succeeded())
+	{
+		return;
+	}
+
+	FileLock lock;
+	if (!lock.Lock(lockPath).Succeeded())
+	{
+		return;
+	}
+
+	for (const std::string& tombstone : FindTombstones())
+	{
+		::RemoveTree(tombstone);
+	}
+}
+
+void Cleanup::RemoveTree(const std::wstring& dirPath)
+{
+	Trace::Scope traceScope("Cleanup::RemoveTree");
+
+	std::string nativePath;
+	if (ConvertUtf16ToUtf8(dirPath, nativePath).Succeeded())
+	{
+		::RemoveTree(nativePath);
+	}
+}
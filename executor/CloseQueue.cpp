@@ -0,0 +1,72 @@
+#include "CloseQueue.h"
+#include "Trace.h"
+
+CloseQueue::CloseQueue()
+{
+	const unsigned hardwareThreads = std::thread::hardware_concurrency();
+	const unsigned threadCount = hardwareThreads == 0 ? 1 : (hardwareThreads < MaxThreads ? hardwareThreads : MaxThreads);
+	for (unsigned i = 0; i < threadCount; i++)
+	{
+		threads.emplace_back(&CloseQueue::Work, this);
+	}
+}
+
+CloseQueue::~CloseQueue()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	queueChanged.notify_all();
+
+	// COMMENT: the workers drain the queue before they exit.
+	for (std::thread& thread : threads)
+	{
+		thread.join();
+	}
+}
+
+void CloseQueue::Push(File& file)
+{
+	const File::NativeHandle handle = file.Detach();
+
+	std::unique_lock<std::mutex> lock(mutex);
+	closed.wait(lock, [this]() { return pending.size() < MaxPending; });
+	pending.push_back(handle);
+	queueChanged.notify_one();
+}
+
+void CloseQueue::Wait()
+{
+	Trace::Scope traceScope("CloseQueue::Wait");
+
+	std::unique_lock<std::mutex> lock(mutex);
+	closed.wait(lock, [this]() { return pending.empty() && closing == 0; });
+}
+
+void CloseQueue::Work()
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	for (;;)
+	{
+		queueChanged.wait(lock, [this]() { return !pending.empty() || stopping; });
+		if (pending.empty())
+		{
+			return;
+		}
+
+		const File::NativeHandle handle = pending.front();
+		pending.pop_front();
+		closing++;
+
+		lock.unlock();
+		{
+			Trace::Scope traceScope("CloseFile");
+			File::CloseNative(handle);
+		}
+		lock.lock();
+
+		closing--;
+		closed.notify_all();
+	}
+}
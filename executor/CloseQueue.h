@@ -0,0 +1,45 @@
+#pragma once
+
+#include "File.h"
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// COMMENT: closes written files on background threads. An on-access scanner checks a new executable or jar when its
+// handle is closed, which blocks the closing thread for milliseconds, so the unpack loop hands the handle over and
+// moves on to the next entry. At most MaxPending handles wait, Push blocks beyond that.
+// Wait is the barrier before the files are used, a handle still open for writing makes loading an executable fail.
+class CloseQueue
+{
+public:
+
+	static const unsigned MaxThreads = 4;
+	static const size_t MaxPending = 256;
+
+	CloseQueue();
+	~CloseQueue();
+
+	CloseQueue(const CloseQueue&) = delete;
+	CloseQueue& operator=(const CloseQueue&) = delete;
+
+	void Push(File& file);
+
+	// COMMENT: returns when every pushed file is closed.
+	void Wait();
+
+private:
+
+	void Work();
+
+private:
+
+	std::mutex mutex;
+	std::condition_variable queueChanged;
+	std::condition_variable closed;
+	std::deque<File::NativeHandle> pending;
+	unsigned closing = 0;
+	bool stopping = false;
+	std::vector<std::thread> threads;
+};
@@ -0,0 +1,118 @@
+#include "CommandTemplate.h"
+
+namespace
+{
+
+bool IsNameChar(wchar_t ch)
+{
+	return (ch >= L'a' && ch <= L'z') || (ch >= L'A' && ch <= L'Z') || (ch >= L'0' && ch <= L'9') || ch == L'_';
+}
+
+} // namespace
+
+CommandTemplate::Variable CommandTemplate::MakeConstant(const std::wstring& value)
+{
+	return [value](const std::wstring& /*argument*/, std::wstring& result)
+	{
+		result = value;
+		return Error();
+	};
+}
+
+void CommandTemplate::Compile(const std::wstring& text)
+{
+	segments.clear();
+
+	Segment literal;
+	size_t pos = 0;
+	while (pos < text.size())
+	{
+		const size_t open = text.find(L'<', pos);
+		if (open == std::wstring::npos)
+		{
+			literal.text.append(text, pos, std::wstring::npos);
+			break;
+		}
+
+		literal.text.append(text, pos, open - pos);
+
+		if (open + 1 < text.size() && text[open + 1] == L'<')
+		{
+			literal.text.push_back(L'<');
+			pos = open + 2;
+			continue;
+		}
+
+		size_t nameEnd = open + 1;
+		while (nameEnd < text.size() && IsNameChar(text[nameEnd]))
+		{
+			nameEnd++;
+		}
+
+		const size_t close = text.find_first_of(L"<>", nameEnd);
+		const bool validEnd = nameEnd < text.size() && (text[nameEnd] == L'>' || text[nameEnd] == L':');
+		if (nameEnd == open + 1 || !validEnd || close == std::wstring::npos || text[close] != L'>')
+		{
+			literal.text.push_back(L'<');
+			pos = open + 1;
+			continue;
+		}
+
+		if (!literal.text.empty())
+		{
+			segments.push_back(std::move(literal));
+			literal = Segment();
+		}
+
+		Segment placeholder;
+		placeholder.placeholder = true;
+		placeholder.text = text.substr(open, close - open + 1);
+		placeholder.name = text.substr(open + 1, nameEnd - open - 1);
+		if (text[nameEnd] == L':')
+		{
+			placeholder.argument = text.substr(nameEnd + 1, close - nameEnd - 1);
+		}
+		segments.push_back(std::move(placeholder));
+
+		pos = close + 1;
+	}
+
+	if (!literal.text.empty())
+	{
+		segments.push_back(std::move(literal));
+	}
+}
+
+Error CommandTemplate::Expand(const Variables& variables, std::wstring& result) const
+{
+	result.clear();
+
+	std::wstring value;
+	for (const Segment& segment : segments)
+	{
+		if (!segment.placeholder)
+		{
+			result.append(segment.text);
+			continue;
+		}
+
+		auto it = variables.find(segment.name);
+		if (it == variables.end())
+		{
+			result.append(segment.text);
+			continue;
+		}
+
+		Error err = it->second(segment.argument, value);
+		if (!err.Succeeded())
+		{
+			std::wstring msg;
+			msg.append(L"can not expand '").append(segment.text).append(L"'. ").append(err.getMessage());
+			return Error(std::move(msg));
+		}
+
+		result.append(value);
+	}
+
+	return Error();
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include "Error.hpp"
+#include <string>
+#include <vector>
+#include <map>
+#include <functional>
+
+// COMMENT: compiled form of a command line template. Placeholders are written as <name> or <name:argument>,
+// text in angle brackets that does not look like a placeholder or names an unknown variable is kept as is.
+// "<<" stands for a literal '<', so <<name> is kept as <name> even when name is known.
+class CommandTemplate
+{
+public:
+
+	typedef std::function<Error(const std::wstring& argument, std::wstring& value)> Variable;
+	typedef std::map<std::wstring, Variable> Variables;
+
+	static Variable MakeConstant(const std::wstring& value);
+
+	void Compile(const std::wstring& text);
+	Error Expand(const Variables& variables, std::wstring& result) const;
+
+private:
+
+	struct Segment
+	{
+		// COMMENT: for a placeholder text holds its source form, used when the variable is unknown.
+		std::wstring text;
+		std::wstring name;
+		std::wstring argument;
+		bool placeholder = false;
+	};
+
+	std::vector<Segment> segments;
+};
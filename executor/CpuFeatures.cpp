@@ -0,0 +1,79 @@
+#include "CpuFeatures.h"
+#include <intrin.h>
+
+namespace
+{
+
+// COMMENT: XCR0 bits of the register state the OS saves on context switches.
+const unsigned long long XcrSse = 1ULL << 1;
+const unsigned long long XcrAvx = 1ULL << 2;
+const unsigned long long XcrAvx512 = (1ULL << 5) | (1ULL << 6) | (1ULL << 7);
+
+struct CpuidRegs
+{
+	int eax = 0;
+	int ebx = 0;
+	int ecx = 0;
+	int edx = 0;
+};
+
+CpuidRegs Cpuid(unsigned leaf, unsigned subLeaf)
+{
+	int regs[4];
+	__cpuidex(regs, static_cast<int>(leaf), static_cast<int>(subLeaf));
+
+	CpuidRegs result;
+	result.eax = regs[0];
+	result.ebx = regs[1];
+	result.ecx = regs[2];
+	result.edx = regs[3];
+	return result;
+}
+
+bool HasBits(int reg, unsigned mask)
+{
+	return (static_cast<unsigned>(reg) & mask) == mask;
+}
+
+} // namespace
+
+CpuLevel CpuFeatures::DetectLevel()
+{
+	const int maxLeaf = Cpuid(0, 0).eax;
+	const unsigned maxExtendedLeaf = static_cast<unsigned>(Cpuid(0x80000000U, 0).eax);
+	if (maxLeaf < 1)
+	{
+		return CpuLevel::Baseline;
+	}
+
+	const CpuidRegs leaf1 = Cpuid(1, 0);
+	const CpuidRegs leaf7 = maxLeaf >= 7 ? Cpuid(7, 0) : CpuidRegs();
+	const CpuidRegs extLeaf1 = maxExtendedLeaf >= 0x80000001U ? Cpuid(0x80000001U, 0) : CpuidRegs();
+
+	// COMMENT: SSE3, SSSE3, CMPXCHG16B, SSE4.1, SSE4.2, POPCNT and LAHF/SAHF.
+	const bool v2 = HasBits(leaf1.ecx, (1U << 0) | (1U << 9) | (1U << 13) | (1U << 19) | (1U << 20) | (1U << 23))
+		&& HasBits(extLeaf1.ecx, 1U << 0);
+	if (!v2)
+	{
+		return CpuLevel::Baseline;
+	}
+
+	// COMMENT: OSXSAVE is required before XGETBV may be executed.
+	const bool osXsave = HasBits(leaf1.ecx, 1U << 27);
+	const unsigned long long xcr0 = osXsave ? _xgetbv(0) : 0;
+
+	// COMMENT: FMA, MOVBE, AVX, F16C; AVX2, BMI1, BMI2; LZCNT.
+	const bool v3 = HasBits(leaf1.ecx, (1U << 12) | (1U << 22) | (1U << 28) | (1U << 29))
+		&& HasBits(leaf7.ebx, (1U << 3) | (1U << 5) | (1U << 8))
+		&& HasBits(extLeaf1.ecx, 1U << 5)
+		&& (xcr0 & (XcrSse | XcrAvx)) == (XcrSse | XcrAvx);
+	if (!v3)
+	{
+		return CpuLevel::V2;
+	}
+
+	// COMMENT: AVX512F, AVX512DQ, AVX512CD, AVX512BW and AVX512VL.
+	const bool v4 = HasBits(leaf7.ebx, (1U << 16) | (1U << 17) | (1U << 28) | (1U << 30) | (1U << 31))
+		&& (xcr0 & XcrAvx512) == XcrAvx512;
+	return v4 ? CpuLevel::V4 : CpuLevel::V3;
+}
@@ -0,0 +1,12 @@
+#pragma once
+
+#include "CpuLevel.hpp"
+
+class CpuFeatures
+{
+public:
+
+	// COMMENT: the highest x86-64 level supported by both the processor and the operating system,
+	// AVX and AVX-512 registers must also be saved by the OS, which is checked through XGETBV.
+	static CpuLevel DetectLevel();
+};
@@ -0,0 +1,39 @@
+#include "Crac.h"
+
+// COMMENT: checkpoint/restore is implemented only by Linux JDKs, on Windows the JVM always starts cold.
+
+Crac::Crac()
+	: mode(Mode::Cold)
+	, freshImage(false)
+{
+}
+
+bool Crac::IsSupported()
+{
+	return false;
+}
+
+Error Crac::Prepare(const std::wstring& /*payloadDir*/, const std::wstring& /*cmdLine*/)
+{
+	mode = Mode::Cold;
+	return Error(L"checkpoint/restore is supported on Linux only");
+}
+
+std::wstring Crac::GetJvmOptions() const
+{
+	return std::wstring();
+}
+
+bool Crac::Continue(ChildProcess::State /*state*/, uint32_t /*exitCode*/)
+{
+	return false;
+}
+
+void Crac::StartCheckpoint()
+{
+}
+
+bool Crac::PublishCheckpoint()
+{
+	return false;
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include "Error.hpp"
+#include "ChildProcess.h"
+#include <string>
+#include <cstdint>
+
+// COMMENT: launches the JVM from a Coordinated Restore at Checkpoint image (CRaC JDK, Linux only).
+// The image lives in <payload dir>/crac/image and is valid for one command line, kernel and java binary.
+// Without a valid image the JVM is started with a checkpoint directory, when the application checkpoints itself
+// the JVM exits and the run continues by restoring the new image. A restore counts as rejected when the process
+// exits with an error before it signals readiness, the run then falls back to a cold start.
+class Crac
+{
+public:
+
+	Crac();
+
+	Crac(const Crac&) = delete;
+	Crac& operator=(const Crac&) = delete;
+
+	// COMMENT: false when the platform has no checkpoint/restore and Prepare always fails.
+	static bool IsSupported();
+
+	Error Prepare(const std::wstring& payloadDir, const std::wstring& cmdLine);
+
+	// COMMENT: options to insert after the java executable for the next launch.
+	std::wstring GetJvmOptions() const;
+
+	// COMMENT: called when the child exited, returns true when the run must be continued by another launch.
+	bool Continue(ChildProcess::State state, uint32_t exitCode);
+
+private:
+
+	enum class Mode
+	{
+		Cold,
+		Checkpoint,
+		Restore
+	};
+
+	void StartCheckpoint();
+	bool PublishCheckpoint();
+
+private:
+
+	Mode mode;
+	bool freshImage;
+	std::wstring imageDir;
+	std::wstring stagingDir;
+	std::wstring fingerprint;
+};
@@ -0,0 +1,267 @@
+#include "Crac.h"
+#include "StringConverter.hpp"
+#include <fstream>
+#include <sstream>
+#include <cerrno>
+#include <cstdio>
+#include <csignal>
+#include <dirent.h>
+#include <ftw.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/utsname.h>
+
+namespace
+{
+
+const int MaxOpenDescriptors = 16;
+
+// COMMENT: CRIU kills the JVM once the image is dumped, ChildProcess reports the signal as 128 + SIGKILL.
+const uint32_t CheckpointExitCode = 128 + SIGKILL;
+
+// COMMENT: CRIU writes the inventory last, after every other part of the image, so a failed dump never has one.
+const wchar_t* const ImageCompleteMarker = L"/inventory.img";
+
+std::string ToNative(const std::wstring& path)
+{
+	std::string nativePath;
+	ConvertUtf16ToUtf8(path, nativePath);
+	return nativePath;
+}
+
+int RemoveEntry(const char* path, const struct stat* /*sb*/, int /*typeflag*/, struct FTW* /*ftwbuf*/)
+{
+	remove(path);
+	return 0;
+}
+
+void RemoveTree(const std::wstring& path)
+{
+	const std::string nativePath = ToNative(path);
+	nftw(nativePath.c_str(), RemoveEntry, MaxOpenDescriptors, FTW_DEPTH | FTW_PHYS);
+}
+
+bool IsFile(const std::wstring& path)
+{
+	struct stat sb;
+	return stat(ToNative(path).c_str(), &sb) == 0 && S_ISREG(sb.st_mode);
+}
+
+bool IsNonEmptyDir(const std::wstring& path)
+{
+	DIR* dir = opendir(ToNative(path).c_str());
+	if (dir == nullptr)
+	{
+		return false;
+	}
+
+	bool hasEntries = false;
+	while (dirent* entry = readdir(dir))
+	{
+		const std::string name(entry->d_name);
+		if (name != "." && name != "..")
+		{
+			hasEntries = true;
+			break;
+		}
+	}
+
+	closedir(dir);
+	return hasEntries;
+}
+
+std::string GetExecutable(const std::string& cmdLine)
+{
+	if (!cmdLine.empty() && cmdLine[0] == '"')
+	{
+		const size_t end = cmdLine.find('"', 1);
+		return cmdLine.substr(1, end == std::string::npos ? std::string::npos : end - 1);
+	}
+
+	return cmdLine.substr(0, cmdLine.find(' '));
+}
+
+// COMMENT: an image is bound to the command line, the kernel and the java binary that created it.
+std::wstring MakeFingerprint(const std::wstring& cmdLine)
+{
+	const std::string nativeCmdLine = ToNative(cmdLine);
+
+	std::ostringstream stream;
+	stream << nativeCmdLine << '\n';
+
+	utsname name;
+	if (uname(&name) == 0)
+	{
+		stream << name.sysname << ' ' << name.release << ' ' << name.version << ' ' << name.machine << '\n';
+	}
+
+	const std::string executable = GetExecutable(nativeCmdLine);
+	struct stat sb;
+	if (stat(executable.c_str(), &sb) == 0)
+	{
+		stream << executable << ' ' << sb.st_size << ' ' << sb.st_mtime << '\n';
+	}
+
+	std::wstring fingerprint;
+	ConvertUtf8ToUtf16(stream.str(), fingerprint);
+	return fingerprint;
+}
+
+std::wstring ReadFingerprint(const std::wstring& path)
+{
+	std::ifstream file(ToNative(path), std::ios::binary);
+	std::ostringstream content;
+	content << file.rdbuf();
+
+	std::wstring fingerprint;
+	ConvertUtf8ToUtf16(content.str(), fingerprint);
+	return fingerprint;
+}
+
+bool WriteFingerprint(const std::wstring& path, const std::wstring& fingerprint)
+{
+	std::ofstream file(ToNative(path), std::ios::binary | std::ios::trunc);
+	file << ToNative(fingerprint);
+	return static_cast<bool>(file.flush());
+}
+
+std::wstring GetFingerprintPath(const std::wstring& imageDir)
+{
+	return std::wstring(imageDir).append(L"/fingerprint");
+}
+
+// COMMENT: the image is renamed away first, so concurrent launches never restore a half removed image.
+void DiscardImage(const std::wstring& imageDir)
+{
+	const std::wstring discardedDir = std::wstring(imageDir).append(L".discarded.").append(std::to_wstring(getpid()));
+	if (rename(ToNative(imageDir).c_str(), ToNative(discardedDir).c_str()) == 0)
+	{
+		RemoveTree(discardedDir);
+	}
+}
+
+} // namespace
+
+Crac::Crac()
+	: mode(Mode::Cold)
+	, freshImage(false)
+{
+}
+
+Error Crac::Prepare(const std::wstring& payloadDir, const std::wstring& cmdLine)
+{
+	mode = Mode::Cold;
+	freshImage = false;
+
+	const std::wstring cracDir = std::wstring(payloadDir).append(L"/crac");
+	if (mkdir(ToNative(cracDir).c_str(), 0700) != 0 && errno != EEXIST)
+	{
+		return Error::makeByErrno(errno);
+	}
+
+	imageDir = std::wstring(cracDir).append(L"/image");
+	stagingDir = std::wstring(cracDir).append(L"/image.").append(std::to_wstring(getpid()));
+	fingerprint = MakeFingerprint(cmdLine);
+
+	if (IsNonEmptyDir(imageDir))
+	{
+		if (ReadFingerprint(GetFingerprintPath(imageDir)) == fingerprint)
+		{
+			mode = Mode::Restore;
+			return Error();
+		}
+
+		DiscardImage(imageDir);
+	}
+
+	StartCheckpoint();
+	return Error();
+}
+
+std::wstring Crac::GetJvmOptions() const
+{
+	std::wstring options;
+	if (mode == Mode::Restore)
+	{
+		options.append(L"-XX:CRaCRestoreFrom=\"").append(imageDir).append(L"\"");
+	}
+	else if (mode == Mode::Checkpoint)
+	{
+		options.append(L"-XX:CRaCCheckpointTo=\"").append(stagingDir).append(L"\"");
+	}
+
+	return options;
+}
+
+bool Crac::IsSupported()
+{
+	return true;
+}
+
+bool Crac::Continue(ChildProcess::State state, uint32_t exitCode)
+{
+	if (mode == Mode::Checkpoint)
+	{
+		// COMMENT: the JVM is killed after a successful checkpoint, the application continues in the restored process.
+		// Any other exit, a normal one included, ends the run: the application was closed or the dump failed.
+		if (state != ChildProcess::State::Exited || exitCode != CheckpointExitCode || !PublishCheckpoint())
+		{
+			RemoveTree(stagingDir);
+			mode = Mode::Cold;
+			return false;
+		}
+
+		mode = Mode::Restore;
+		freshImage = true;
+		return true;
+	}
+
+	if (mode == Mode::Restore && state == ChildProcess::State::Exited && exitCode != 0)
+	{
+		DiscardImage(imageDir);
+
+		// COMMENT: an image rejected right after it was created will be rejected again, so the JVM starts without checkpointing.
+		if (freshImage)
+		{
+			mode = Mode::Cold;
+		}
+		else
+		{
+			StartCheckpoint();
+		}
+		return true;
+	}
+
+	mode = Mode::Cold;
+	return false;
+}
+
+void Crac::StartCheckpoint()
+{
+	RemoveTree(stagingDir);
+	mode = Mode::Checkpoint;
+}
+
+bool Crac::PublishCheckpoint()
+{
+	if (!IsFile(std::wstring(stagingDir).append(ImageCompleteMarker)))
+	{
+		RemoveTree(stagingDir);
+		return false;
+	}
+
+	if (!WriteFingerprint(GetFingerprintPath(stagingDir), fingerprint))
+	{
+		RemoveTree(stagingDir);
+		return false;
+	}
+
+	// COMMENT: a concurrent launch may have published its image first, it is as good as ours.
+	if (rename(ToNative(stagingDir).c_str(), ToNative(imageDir).c_str()) != 0)
+	{
+		RemoveTree(stagingDir);
+		return IsNonEmptyDir(imageDir);
+	}
+
+	return true;
+}
@@ -0,0 +1,567 @@
+#include "DaemonClient.h"
+#include "StringConverter.hpp"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cwchar>
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#else
+#include <cerrno>
+#include <cstring>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+extern char** environ;
+#endif
+
+namespace
+{
+
+const size_t HeaderSize = 5;
+const size_t StdinChunkSize = 16 * 1024;
+const uint32_t MaxFrameSize = 16 * 1024 * 1024;
+// COMMENT: the invocation ends only after the stdin forwarder leaves, so it is checked often.
+const unsigned CancelPollIntervalMs = 10;
+
+#ifdef _WIN32
+const ChildProcess::NativeHandle InvalidNativeHandle = INVALID_HANDLE_VALUE;
+const DWORD BusyWaitMs = 2000;
+
+Error CompleteOverlapped(HANDLE handle, OVERLAPPED& overlapped, BOOL started, size_t& transferred)
+{
+	transferred = 0;
+	if (!started)
+	{
+		const DWORD err = GetLastError();
+		if (err != ERROR_IO_PENDING)
+		{
+			return Error(err);
+		}
+	}
+
+	DWORD count = 0;
+	if (!GetOverlappedResult(handle, &overlapped, &count, TRUE))
+	{
+		return Error(GetLastError());
+	}
+
+	transferred = count;
+	return Error();
+}
+#else
+const ChildProcess::NativeHandle InvalidNativeHandle = -1;
+
+// COMMENT: returns false when the wait was cancelled or failed.
+bool WaitDescriptor(int fd, short events, const std::atomic<bool>& cancelRequested)
+{
+	while (!cancelRequested)
+	{
+		pollfd pfd;
+		pfd.fd = fd;
+		pfd.events = events;
+		pfd.revents = 0;
+
+		const int ready = poll(&pfd, 1, CancelPollIntervalMs);
+		if (ready < 0 && errno != EINTR)
+		{
+			return false;
+		}
+		if (ready > 0)
+		{
+			return true;
+		}
+	}
+	return false;
+}
+#endif
+
+void WriteUInt32(uint8_t* dest, uint32_t value)
+{
+	dest[0] = static_cast<uint8_t>(value >> 24);
+	dest[1] = static_cast<uint8_t>(value >> 16);
+	dest[2] = static_cast<uint8_t>(value >> 8);
+	dest[3] = static_cast<uint8_t>(value);
+}
+
+uint32_t ReadUInt32(const uint8_t* src)
+{
+	return (static_cast<uint32_t>(src[0]) << 24) | (static_cast<uint32_t>(src[1]) << 16) | (static_cast<uint32_t>(src[2]) << 8) | src[3];
+}
+
+void WriteStream(FILE* stream, const std::vector<uint8_t>& data)
+{
+	if (!data.empty())
+	{
+		fwrite(data.data(), 1, data.size(), stream);
+		fflush(stream);
+	}
+}
+
+} // namespace
+
+const wchar_t* const DaemonClient::PipeVariable = L"INFOMAXIMUM_DAEMON_PIPE";
+const wchar_t* const DaemonClient::IdleTimeoutVariable = L"INFOMAXIMUM_DAEMON_IDLE_SECONDS";
+
+std::wstring DaemonClient::MakePipeName(const std::wstring& payloadHash)
+{
+#ifdef _WIN32
+	DWORD sessionId = 0;
+	ProcessIdToSessionId(GetCurrentProcessId(), &sessionId);
+
+	std::wstring name(L"\\\\.\\pipe\\infomaximum_daemon_");
+	name.append(std::to_wstring(sessionId)).append(L"_").append(payloadHash);
+	return name;
+#else
+	const char* tmpDir = getenv("TMPDIR");
+	std::wstring name;
+	ConvertUtf8ToUtf16(tmpDir != nullptr && *tmpDir != '\0' ? tmpDir : "/tmp", name);
+	name.append(L"/infomaximum_daemon_").append(std::to_wstring(getuid())).append(L"_").append(payloadHash).append(L".sock");
+	return name;
+#endif
+}
+
+DaemonClient::DaemonClient()
+	: connection(InvalidNativeHandle)
+	, cancelRequested(false)
+	, stdinFinished(false)
+{
+}
+
+DaemonClient::~DaemonClient()
+{
+	Close();
+}
+
+Error DaemonClient::Connect(const std::wstring& pipeName, bool& connected)
+{
+	Close();
+	connected = false;
+
+#ifdef _WIN32
+	for (;;)
+	{
+		connection = CreateFileW(pipeName.c_str(), GENERIC_READ | GENERIC_WRITE, 0, NULL, OPEN_EXISTING,
+			FILE_FLAG_OVERLAPPED | SECURITY_SQOS_PRESENT | SECURITY_IDENTIFICATION, NULL);
+		if (connection != INVALID_HANDLE_VALUE)
+		{
+			break;
+		}
+
+		const DWORD err = GetLastError();
+		if (err == ERROR_FILE_NOT_FOUND)
+		{
+			return Error();
+		}
+
+		// COMMENT: all instances are serving other invocations, the host creates a new one for every accepted connection.
+		if (err != ERROR_PIPE_BUSY || !WaitNamedPipeW(pipeName.c_str(), BusyWaitMs))
+		{
+			return Error(err);
+		}
+	}
+
+	hReadEvent = CreateEventW(NULL, TRUE, FALSE, NULL);
+	hWriteEvent = CreateEventW(NULL, TRUE, FALSE, NULL);
+	if (hReadEvent == NULL || hWriteEvent == NULL)
+	{
+		const DWORD err = GetLastError();
+		Close();
+		return Error(err);
+	}
+#else
+	std::string path;
+	Error err = ConvertUtf16ToUtf8(pipeName, path);
+	if (!err.Succeeded())
+	{
+		return err;
+	}
+
+	sockaddr_un address;
+	memset(&address, 0, sizeof(address));
+	address.sun_family = AF_UNIX;
+	if (path.size() >= sizeof(address.sun_path))
+	{
+		return Error::makeByErrno(ENAMETOOLONG);
+	}
+	memcpy(address.sun_path, path.c_str(), path.size());
+
+	connection = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (connection < 0)
+	{
+		connection = InvalidNativeHandle;
+		return Error::makeByErrno(errno);
+	}
+
+	if (connect(connection, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0)
+	{
+		const int connectError = errno;
+		Close();
+
+		// COMMENT: a stale socket file of an exited host refuses connections.
+		if (connectError == ENOENT || connectError == ECONNREFUSED)
+		{
+			return Error();
+		}
+		return Error::makeByErrno(connectError);
+	}
+#endif
+
+	connected = true;
+	return Error();
+}
+
+Error DaemonClient::Run(const std::vector<std::wstring>& arguments, const std::wstring& workingDir, uint32_t& exitCode)
+{
+	exitCode = 0;
+	cancelRequested = false;
+	stdinFinished = false;
+
+	for (const std::wstring& argument : arguments)
+	{
+		Error err = WriteString(FrameType::Argument, argument);
+		if (!err.Succeeded())
+		{
+			return err;
+		}
+	}
+
+	Error err = WriteString(FrameType::WorkingDir, workingDir);
+	if (!err.Succeeded())
+	{
+		return err;
+	}
+
+	err = WriteEnvironment();
+	if (!err.Succeeded())
+	{
+		return err;
+	}
+
+	err = WriteFrame(FrameType::Run, nullptr, 0);
+	if (!err.Succeeded())
+	{
+		return err;
+	}
+
+#ifdef _WIN32
+	// COMMENT: the host output is passed through byte for byte.
+	_setmode(_fileno(stdout), _O_BINARY);
+	_setmode(_fileno(stderr), _O_BINARY);
+#endif
+
+	stdinThread = std::thread(&DaemonClient::ForwardStdin, this);
+
+	FrameType type;
+	std::vector<uint8_t> payload;
+	for (;;)
+	{
+		err = ReadFrame(type, payload);
+		if (!err.Succeeded())
+		{
+			break;
+		}
+
+		if (type == FrameType::Stdout)
+		{
+			WriteStream(stdout, payload);
+		}
+		else if (type == FrameType::Stderr)
+		{
+			WriteStream(stderr, payload);
+		}
+		else if (type == FrameType::Exit && payload.size() == sizeof(uint32_t))
+		{
+			exitCode = ReadUInt32(payload.data());
+			break;
+		}
+		else
+		{
+			err = Error(L"unexpected frame from the daemon");
+			break;
+		}
+	}
+
+	CancelStdin();
+	return err;
+}
+
+Error DaemonClient::WriteString(FrameType type, const std::wstring& value)
+{
+	std::string utf8Value;
+	if (!value.empty())
+	{
+		Error err = ConvertUtf16ToUtf8(value, utf8Value);
+		if (!err.Succeeded())
+		{
+			return err;
+		}
+	}
+
+	return WriteFrame(type, reinterpret_cast<const uint8_t*>(utf8Value.data()), utf8Value.size());
+}
+
+Error DaemonClient::WriteFrame(FrameType type, const uint8_t* data, size_t size)
+{
+	uint8_t header[HeaderSize];
+	WriteUInt32(header, static_cast<uint32_t>(size));
+	header[4] = static_cast<uint8_t>(type);
+
+	Error err = WriteAll(header, sizeof(header));
+	if (!err.Succeeded() || size == 0)
+	{
+		return err;
+	}
+
+	return WriteAll(data, size);
+}
+
+Error DaemonClient::ReadFrame(FrameType& type, std::vector<uint8_t>& payload)
+{
+	uint8_t header[HeaderSize];
+	Error err = ReadAll(header, sizeof(header));
+	if (!err.Succeeded())
+	{
+		return err;
+	}
+
+	const uint32_t size = ReadUInt32(header);
+	if (size > MaxFrameSize)
+	{
+		return Error(L"daemon frame is too large");
+	}
+
+	type = static_cast<FrameType>(header[4]);
+	payload.resize(size);
+	return size > 0 ? ReadAll(payload.data(), size) : Error();
+}
+
+Error DaemonClient::WriteAll(const uint8_t* data, size_t size)
+{
+	while (size > 0)
+	{
+#ifdef _WIN32
+		OVERLAPPED overlapped;
+		ZeroMemory(&overlapped, sizeof(overlapped));
+		overlapped.hEvent = hWriteEvent;
+
+		size_t count = 0;
+		const BOOL started = WriteFile(connection, data, static_cast<DWORD>(size), NULL, &overlapped);
+		Error err = CompleteOverlapped(connection, overlapped, started, count);
+		if (!err.Succeeded())
+		{
+			return err;
+		}
+#else
+		if (!WaitDescriptor(connection, POLLOUT, cancelRequested))
+		{
+			return Error::makeByErrno(ECANCELED);
+		}
+
+		const ssize_t res = send(connection, data, size, MSG_NOSIGNAL);
+		if (res < 0 && (errno == EINTR || errno == EAGAIN))
+		{
+			continue;
+		}
+		if (res < 0)
+		{
+			return Error::makeByErrno(errno);
+		}
+		const size_t count = static_cast<size_t>(res);
+#endif
+		data += count;
+		size -= count;
+	}
+
+	return Error();
+}
+
+Error DaemonClient::ReadAll(uint8_t* data, size_t size)
+{
+	while (size > 0)
+	{
+#ifdef _WIN32
+		OVERLAPPED overlapped;
+		ZeroMemory(&overlapped, sizeof(overlapped));
+		overlapped.hEvent = hReadEvent;
+
+		size_t count = 0;
+		const BOOL started = ReadFile(connection, data, static_cast<DWORD>(size), NULL, &overlapped);
+		Error err = CompleteOverlapped(connection, overlapped, started, count);
+		if (!err.Succeeded())
+		{
+			return err;
+		}
+#else
+		const ssize_t res = recv(connection, data, size, 0);
+		if (res < 0 && errno == EINTR)
+		{
+			continue;
+		}
+		if (res < 0)
+		{
+			return Error::makeByErrno(errno);
+		}
+		const size_t count = static_cast<size_t>(res);
+#endif
+		if (count == 0)
+		{
+			return Error(L"daemon closed the connection");
+		}
+
+		data += count;
+		size -= count;
+	}
+
+	return Error();
+}
+
+Error DaemonClient::WriteEnvironment()
+{
+#ifdef _WIN32
+	wchar_t* block = GetEnvironmentStringsW();
+	if (block == NULL)
+	{
+		return Error(GetLastError());
+	}
+
+	Error err;
+	for (const wchar_t* entry = block; *entry != L'\0' && err.Succeeded(); entry += wcslen(entry) + 1)
+	{
+		// COMMENT: entries starting with '=' hold per-drive current directories, they are not variables.
+		if (*entry != L'=')
+		{
+			err = WriteString(FrameType::Environment, entry);
+		}
+	}
+
+	FreeEnvironmentStringsW(block);
+	return err;
+#else
+	for (char** entry = environ; *entry != nullptr; entry++)
+	{
+		Error err = WriteFrame(FrameType::Environment, reinterpret_cast<const uint8_t*>(*entry), strlen(*entry));
+		if (!err.Succeeded())
+		{
+			return err;
+		}
+	}
+	return Error();
+#endif
+}
+
+void DaemonClient::ForwardStdin()
+{
+	std::vector<uint8_t> buffer(StdinChunkSize);
+	size_t readCount = 0;
+	while (!cancelRequested && ReadStdin(buffer.data(), buffer.size(), readCount) && readCount > 0)
+	{
+		if (!WriteFrame(FrameType::Stdin, buffer.data(), readCount).Succeeded())
+		{
+			stdinFinished = true;
+			return;
+		}
+	}
+
+	if (!cancelRequested)
+	{
+		WriteFrame(FrameType::StdinEnd, nullptr, 0);
+	}
+	stdinFinished = true;
+}
+
+bool DaemonClient::ReadStdin(uint8_t* buffer, size_t size, size_t& readCount)
+{
+	readCount = 0;
+#ifdef _WIN32
+	// COMMENT: a GUI subsystem process without redirected input has no stdin, which is the same as empty input.
+	const HANDLE hStdin = GetStdHandle(STD_INPUT_HANDLE);
+	if (hStdin == NULL || hStdin == INVALID_HANDLE_VALUE)
+	{
+		return false;
+	}
+
+	DWORD dwRead = 0;
+	if (!ReadFile(hStdin, buffer, static_cast<DWORD>(size), &dwRead, NULL))
+	{
+		return false;
+	}
+	readCount = dwRead;
+	return true;
+#else
+	for (;;)
+	{
+		if (!WaitDescriptor(STDIN_FILENO, POLLIN, cancelRequested))
+		{
+			return false;
+		}
+
+		const ssize_t res = read(STDIN_FILENO, buffer, size);
+		if (res < 0 && (errno == EINTR || errno == EAGAIN))
+		{
+			continue;
+		}
+		if (res < 0)
+		{
+			return false;
+		}
+		readCount = static_cast<size_t>(res);
+		return true;
+	}
+#endif
+}
+
+void DaemonClient::CancelStdin()
+{
+	if (!stdinThread.joinable())
+	{
+		return;
+	}
+
+	cancelRequested = true;
+
+	// COMMENT: the forwarder may block in a stdin read or in a pipe write the host no longer serves.
+	// It may also be just about to start one, so cancellation is repeated until it leaves.
+	while (!stdinFinished)
+	{
+#ifdef _WIN32
+		CancelSynchronousIo(stdinThread.native_handle());
+		CancelIoEx(connection, NULL);
+#endif
+		std::this_thread::sleep_for(std::chrono::milliseconds(CancelPollIntervalMs));
+	}
+
+	stdinThread.join();
+}
+
+void DaemonClient::Close()
+{
+	CancelStdin();
+
+	if (connection != InvalidNativeHandle)
+	{
+#ifdef _WIN32
+		CloseHandle(connection);
+#else
+		close(connection);
+#endif
+		connection = InvalidNativeHandle;
+	}
+
+#ifdef _WIN32
+	if (hReadEvent != NULL)
+	{
+		CloseHandle(hReadEvent);
+		hReadEvent = NULL;
+	}
+
+	if (hWriteEvent != NULL)
+	{
+		CloseHandle(hWriteEvent);
+		hWriteEvent = NULL;
+	}
+#endif
+}
@@ -0,0 +1,78 @@
+#pragma once
+
+#include "Error.hpp"
+#include "ChildProcess.h"
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <cstdint>
+#ifdef _WIN32
+#include <Windows.h>
+#endif
+
+// COMMENT: client of a warm java host started in daemon mode. The host gets the endpoint name in PipeVariable,
+// listens on it (a named pipe on Windows, a unix socket elsewhere) and exits after IdleTimeoutVariable seconds
+// without connections. Every connection runs one invocation, messages are frames of
+// <payload length: uint32 big endian><type: uint8><payload>. The client sends Argument frames, one WorkingDir
+// frame, Environment frames ("NAME=VALUE") and Run, all strings in UTF-8, then streams its stdin as Stdin frames
+// terminated by StdinEnd. The host answers with Stdout and Stderr frames and finally Exit with the exit code
+// as int32 big endian.
+class DaemonClient
+{
+public:
+
+	enum class FrameType : uint8_t
+	{
+		Argument = 'A',
+		WorkingDir = 'D',
+		Environment = 'E',
+		Run = 'R',
+		Stdin = '0',
+		StdinEnd = '.',
+		Stdout = '1',
+		Stderr = '2',
+		Exit = 'X'
+	};
+
+	static const wchar_t* const PipeVariable;
+	static const wchar_t* const IdleTimeoutVariable;
+
+	// COMMENT: the endpoint is per user session and per payload, so hosts of different payloads never mix.
+	static std::wstring MakePipeName(const std::wstring& payloadHash);
+
+	DaemonClient();
+	~DaemonClient();
+
+	DaemonClient(const DaemonClient&) = delete;
+	DaemonClient& operator=(const DaemonClient&) = delete;
+
+	// COMMENT: connected is false when no host listens on the endpoint.
+	Error Connect(const std::wstring& pipeName, bool& connected);
+	Error Run(const std::vector<std::wstring>& arguments, const std::wstring& workingDir, uint32_t& exitCode);
+
+private:
+
+	Error WriteString(FrameType type, const std::wstring& value);
+	Error WriteFrame(FrameType type, const uint8_t* data, size_t size);
+	Error ReadFrame(FrameType& type, std::vector<uint8_t>& payload);
+	Error WriteAll(const uint8_t* data, size_t size);
+	Error ReadAll(uint8_t* data, size_t size);
+	Error WriteEnvironment();
+	void ForwardStdin();
+	bool ReadStdin(uint8_t* buffer, size_t size, size_t& readCount);
+	void CancelStdin();
+	void Close();
+
+private:
+
+	ChildProcess::NativeHandle connection;
+	std::thread stdinThread;
+	std::atomic<bool> cancelRequested;
+	std::atomic<bool> stdinFinished;
+
+#ifdef _WIN32
+	HANDLE hReadEvent = NULL;
+	HANDLE hWriteEvent = NULL;
+#endif
+};
@@ -0,0 +1,481 @@
+#include "Diagnostics.h"
+#include "PackageManager.h"
+#include "HardwareInfo.h"
+#include "CpuFeatures.h"
+#include "Cleanup.h"
+#include "File.h"
+#include "Path.hpp"
+#include "StringConverter.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdarg>
+#include <cstdio>
+#include <random>
+#include <vector>
+#include <Windows.h>
+
+namespace
+{
+
+const std::wstring ScratchPrefix(L"infomaximum_diag_");
+const uint64_t SequentialWriteSize = 256ULL * 1024 * 1024;
+const DWORD SequentialChunkSize = 1024 * 1024;
+const unsigned SmallFileCount = 300;
+const DWORD SmallFileSize = 4 * 1024;
+
+// COMMENT: thresholds of the hints, well below what a healthy SSD without filters shows.
+const double SlowCloseMs = 1.0;
+const double ScannerCloseRatio = 4.0;
+const double SlowCreateMs = 1.0;
+const double SlowDiskMbPerSecond = 50.0;
+const double SlowCpuMbPerSecond = 100.0;
+const double FileSystemBoundRatio = 0.5;
+const double ColdRunRatio = 1.5;
+
+class Stopwatch
+{
+public:
+
+	Stopwatch()
+		: start(std::chrono::steady_clock::now())
+	{
+	}
+
+	double Seconds() const
+	{
+		return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	}
+
+	double Milliseconds() const
+	{
+		return Seconds() * 1000.0;
+	}
+
+private:
+
+	std::chrono::steady_clock::time_point start;
+};
+
+class Latency
+{
+public:
+
+	void Add(double ms)
+	{
+		samples.push_back(ms);
+	}
+
+	double Percentile(double fraction) const
+	{
+		if (samples.empty())
+		{
+			return 0;
+		}
+
+		std::vector<double> sorted(samples);
+		std::sort(sorted.begin(), sorted.end());
+		const size_t index = static_cast<size_t>(fraction * (sorted.size() - 1) + 0.5);
+		return sorted[index];
+	}
+
+private:
+
+	std::vector<double> samples;
+};
+
+double MbPerSecond(uint64_t bytes, double seconds)
+{
+	return seconds > 0 ? static_cast<double>(bytes) / (1024.0 * 1024.0) / seconds : 0;
+}
+
+class Report
+{
+public:
+
+	void Line(const wchar_t* format, ...)
+	{
+		wchar_t buffer[1024];
+		va_list args;
+		va_start(args, format);
+		const int len = std::vswprintf(buffer, sizeof(buffer) / sizeof(buffer[0]), format, args);
+		va_end(args);
+
+		if (len > 0)
+		{
+			text.append(buffer, static_cast<size_t>(len));
+		}
+		text.append(L"\r\n");
+	}
+
+	void Section(const wchar_t* name)
+	{
+		if (!text.empty())
+		{
+			text.append(L"\r\n");
+		}
+		text.append(L"[").append(name).append(L"]\r\n");
+	}
+
+	std::wstring text;
+};
+
+struct UnpackRun
+{
+	double unpackSeconds = 0;
+	double removeSeconds = 0;
+};
+
+struct SequentialWrite
+{
+	bool measured = false;
+	double writeSeconds = 0;
+	double flushSeconds = 0;
+};
+
+// COMMENT: scanners pick files by content as well as by name, so every kind gets a matching header.
+struct SmallFileKind
+{
+	const wchar_t* name;
+	const wchar_t* extension;
+	std::vector<uint8_t> header;
+	Latency create;
+	Latency write;
+	Latency close;
+	Latency remove;
+};
+
+std::vector<uint8_t> MakePeHeader()
+{
+	std::vector<uint8_t> header(0x84, 0);
+	header[0] = 'M';
+	header[1] = 'Z';
+	header[0x3C] = 0x80;
+	header[0x80] = 'P';
+	header[0x81] = 'E';
+	return header;
+}
+
+Error MeasureUnpack(UnpackRun& run)
+{
+	std::wstring scratchDir;
+	Error err = Path::GetTempDirPath(ScratchPrefix, scratchDir);
+	if (!err.Succeeded())
+	{
+		return err;
+	}
+
+	Stopwatch unpack;
+	err = PackageManager::UnpackZipResource(scratchDir);
+	run.unpackSeconds = unpack.Seconds();
+
+	Stopwatch remove;
+	Cleanup::RemoveTree(scratchDir);
+	run.removeSeconds = remove.Seconds();
+
+	return err;
+}
+
+Error MeasureSequentialWrite(const std::wstring& scratchDir, SequentialWrite& result)
+{
+	ULARGE_INTEGER freeBytes;
+	if (!GetDiskFreeSpaceExW(scratchDir.c_str(), &freeBytes, NULL, NULL) || freeBytes.QuadPart < 2 * SequentialWriteSize)
+	{
+		return Error();
+	}
+
+	const std::wstring path = std::wstring(scratchDir).append(L"\\sequential.bin");
+	HANDLE hFile = CreateFileW(path.c_str(), GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	if (hFile == INVALID_HANDLE_VALUE)
+	{
+		return Error(GetLastError());
+	}
+
+	// COMMENT: random data, so a compressing or deduplicating volume does not flatter the result.
+	std::vector<uint8_t> chunk(SequentialChunkSize);
+	std::mt19937 gen(0x5EED);
+	std::generate(chunk.begin(), chunk.end(), [&gen]() { return static_cast<uint8_t>(gen()); });
+
+	Error err;
+	Stopwatch write;
+	for (uint64_t written = 0; written < SequentialWriteSize && err.Succeeded(); written += SequentialChunkSize)
+	{
+		DWORD chunkWritten = 0;
+		if (!WriteFile(hFile, &chunk[0], SequentialChunkSize, &chunkWritten, NULL))
+		{
+			err = Error(GetLastError());
+		}
+	}
+	result.writeSeconds = write.Seconds();
+
+	if (err.Succeeded())
+	{
+		Stopwatch flush;
+		if (!FlushFileBuffers(hFile))
+		{
+			err = Error(GetLastError());
+		}
+		result.flushSeconds = flush.Seconds();
+	}
+
+	CloseHandle(hFile);
+	DeleteFileW(path.c_str());
+
+	result.measured = err.Succeeded();
+	return err;
+}
+
+Error MeasureSmallFiles(const std::wstring& scratchDir, std::vector<SmallFileKind>& kinds)
+{
+	std::mt19937 gen(0x5EED);
+	std::vector<uint8_t> content(SmallFileSize);
+	std::vector<std::wstring> paths;
+
+	// COMMENT: kinds are interleaved, so background activity of the machine affects all of them alike.
+	for (unsigned i = 0; i < SmallFileCount; i++)
+	{
+		for (SmallFileKind& kind : kinds)
+		{
+			std::generate(content.begin(), content.end(), [&gen]() { return static_cast<uint8_t>(gen()); });
+			std::copy(kind.header.begin(), kind.header.end(), content.begin());
+
+			const std::wstring path = std::wstring(scratchDir).append(L"\\").append(kind.name).append(std::to_wstring(i)).append(kind.extension);
+
+			Stopwatch create;
+			HANDLE hFile = CreateFileW(path.c_str(), GENERIC_WRITE, 0, NULL, CREATE_NEW, FILE_ATTRIBUTE_NORMAL, NULL);
+			kind.create.Add(create.Milliseconds());
+			if (hFile == INVALID_HANDLE_VALUE)
+			{
+				return Error(GetLastError());
+			}
+			paths.push_back(path);
+
+			Stopwatch write;
+			DWORD written = 0;
+			const BOOL writeSucceeded = WriteFile(hFile, &content[0], SmallFileSize, &written, NULL);
+			kind.write.Add(write.Milliseconds());
+
+			// COMMENT: on-access scanners inspect a written file when its last handle is closed, the caller waits for it.
+			Stopwatch close;
+			CloseHandle(hFile);
+			kind.close.Add(close.Milliseconds());
+
+			if (!writeSucceeded)
+			{
+				return Error(GetLastError());
+			}
+		}
+	}
+
+	for (size_t i = 0; i < paths.size(); i++)
+	{
+		Stopwatch remove;
+		DeleteFileW(paths[i].c_str());
+		kinds[i % kinds.size()].remove.Add(remove.Milliseconds());
+	}
+
+	return Error();
+}
+
+std::wstring GetFileSystemName(const std::wstring& path)
+{
+	wchar_t volumePath[MAX_PATH + 1];
+	wchar_t fileSystem[MAX_PATH + 1];
+	if (!GetVolumePathNameW(path.c_str(), volumePath, MAX_PATH + 1)
+		|| !GetVolumeInformationW(volumePath, NULL, 0, NULL, NULL, NULL, fileSystem, MAX_PATH + 1))
+	{
+		return L"unknown";
+	}
+
+	return std::wstring(fileSystem).append(L" on ").append(volumePath);
+}
+
+void AddLatencyLine(Report& report, const wchar_t* operation, const Latency& latency)
+{
+	report.Line(L"  %-7ls p50 %8.3f  p99 %8.3f  max %8.3f", operation, latency.Percentile(0.5), latency.Percentile(0.99), latency.Percentile(1.0));
+}
+
+} // namespace
+
+const char* const Diagnostics::Arg = "--diagnose";
+
+Error Diagnostics::Run(const std::wstring& reportPath, std::wstring& reportText)
+{
+	Report report;
+
+	std::wstring exePath;
+	Path::GetApplicationFilePath(exePath);
+	const HardwareInfo hardware = HardwareInfo::Query();
+
+	wchar_t tempPath[MAX_PATH + 1];
+	const DWORD tempLen = GetTempPathW(MAX_PATH + 1, tempPath);
+	const std::wstring tempDir = tempLen != 0 && tempLen <= MAX_PATH ? std::wstring(tempPath, tempLen) : std::wstring();
+
+	report.Section(L"system");
+	report.Line(L"executor: %ls", exePath.c_str());
+	report.Line(L"cpu level: %ls", GetCpuLevelName(CpuFeatures::DetectLevel()));
+	report.Line(L"cpus: %u logical, %u physical, limit %u", hardware.logicalCpus, hardware.physicalCpus, hardware.cpuLimit);
+	report.Line(L"memory: %llu MB total, %llu MB available", static_cast<unsigned long long>(hardware.physicalMemory >> 20),
+		static_cast<unsigned long long>(hardware.availableMemory >> 20));
+	report.Line(L"scratch: %ls, %ls", tempDir.c_str(), GetFileSystemName(tempDir).c_str());
+
+	// COMMENT: the first run reads the payload from the executable and meets a cold file system cache,
+	// the following ones show the speed the disk and the filters allow.
+	std::vector<UnpackRun> unpackRuns(UnpackRuns);
+	for (UnpackRun& run : unpackRuns)
+	{
+		Error err = MeasureUnpack(run);
+		if (!err.Succeeded())
+		{
+			return err;
+		}
+	}
+
+	uint64_t entries = 0;
+	uint64_t bytes = 0;
+	Stopwatch decompress;
+	Error err = PackageManager::DecompressZipResource(entries, bytes);
+	if (!err.Succeeded())
+	{
+		return err;
+	}
+	const double decompressSeconds = decompress.Seconds();
+
+	std::wstring scratchDir;
+	err = Path::GetTempDirPath(ScratchPrefix, scratchDir);
+	if (!err.Succeeded())
+	{
+		return err;
+	}
+
+	SequentialWrite sequentialWrite;
+	err = MeasureSequentialWrite(scratchDir, sequentialWrite);
+
+	std::vector<SmallFileKind> kinds(3);
+	kinds[0].name = L"data";
+	kinds[0].extension = L".dat";
+	kinds[1].name = L"library";
+	kinds[1].extension = L".dll";
+	kinds[1].header = MakePeHeader();
+	kinds[2].name = L"class";
+	kinds[2].extension = L".class";
+	kinds[2].header = { 0xCA, 0xFE, 0xBA, 0xBE };
+	if (err.Succeeded())
+	{
+		err = MeasureSmallFiles(scratchDir, kinds);
+	}
+
+	Cleanup::RemoveTree(scratchDir);
+	if (!err.Succeeded())
+	{
+		return err;
+	}
+
+	report.Section(L"unpack");
+	report.Line(L"payload: %llu entries, %llu MB", static_cast<unsigned long long>(entries), static_cast<unsigned long long>(bytes >> 20));
+	double bestWarmSeconds = 0;
+	for (size_t i = 0; i < unpackRuns.size(); i++)
+	{
+		const UnpackRun& run = unpackRuns[i];
+		report.Line(L"run %u (%ls): %.2f s, %.1f MB/s, %.0f entries/s, remove %.2f s", static_cast<unsigned>(i + 1), i == 0 ? L"cold" : L"warm",
+			run.unpackSeconds, MbPerSecond(bytes, run.unpackSeconds), run.unpackSeconds > 0 ? entries / run.unpackSeconds : 0.0, run.removeSeconds);
+
+		if (i != 0 && (bestWarmSeconds == 0 || run.unpackSeconds < bestWarmSeconds))
+		{
+			bestWarmSeconds = run.unpackSeconds;
+		}
+	}
+
+	report.Section(L"decompress");
+	report.Line(L"in memory: %.2f s, %.1f MB/s", decompressSeconds, MbPerSecond(bytes, decompressSeconds));
+
+	report.Section(L"sequential write");
+	if (sequentialWrite.measured)
+	{
+		report.Line(L"%llu MB: write %.2f s (%.1f MB/s cached), flush %.2f s, %.1f MB/s to disk",
+			static_cast<unsigned long long>(SequentialWriteSize >> 20), sequentialWrite.writeSeconds, MbPerSecond(SequentialWriteSize, sequentialWrite.writeSeconds),
+			sequentialWrite.flushSeconds, MbPerSecond(SequentialWriteSize, sequentialWrite.writeSeconds + sequentialWrite.flushSeconds));
+	}
+	else
+	{
+		report.Line(L"skipped, not enough free space");
+	}
+
+	report.Section(L"small files");
+	report.Line(L"%u files of %u KB per kind, milliseconds", SmallFileCount, static_cast<unsigned>(SmallFileSize / 1024));
+	for (const SmallFileKind& kind : kinds)
+	{
+		report.Line(L"%ls (%ls):", kind.name, kind.extension);
+		AddLatencyLine(report, L"create", kind.create);
+		AddLatencyLine(report, L"write", kind.write);
+		AddLatencyLine(report, L"close", kind.close);
+		AddLatencyLine(report, L"delete", kind.remove);
+	}
+
+	report.Section(L"hints");
+	const size_t hintsStart = report.text.size();
+
+	const double dataClose = kinds[0].close.Percentile(0.5);
+	const double executableClose = std::max(kinds[1].close.Percentile(0.5), kinds[2].close.Percentile(0.5));
+	if (executableClose > SlowCloseMs && executableClose > ScannerCloseRatio * dataClose)
+	{
+		report.Line(L"closing executable content takes %.2f ms against %.2f ms for data: an on-access scanner inspects written files,"
+			L" excluding the scratch and installation directories from scanning should help", executableClose, dataClose);
+	}
+	else if (dataClose > SlowCloseMs)
+	{
+		report.Line(L"closing any file takes %.2f ms: a file system filter (antivirus, backup, encryption) processes every written file", dataClose);
+	}
+
+	const double dataCreate = kinds[0].create.Percentile(0.5);
+	if (dataCreate > SlowCreateMs)
+	{
+		report.Line(L"creating a file takes %.2f ms: the file system or a filter on it is slow with metadata", dataCreate);
+	}
+
+	const double diskMbPerSecond = MbPerSecond(SequentialWriteSize, sequentialWrite.writeSeconds + sequentialWrite.flushSeconds);
+	if (sequentialWrite.measured && diskMbPerSecond < SlowDiskMbPerSecond)
+	{
+		report.Line(L"the disk writes %.1f MB/s: the disk is slow", diskMbPerSecond);
+	}
+
+	const double decompressMbPerSecond = MbPerSecond(bytes, decompressSeconds);
+	if (bytes != 0 && decompressMbPerSecond < SlowCpuMbPerSecond)
+	{
+		report.Line(L"decompression runs at %.1f MB/s without any disk access: the CPU is slow or throttled", decompressMbPerSecond);
+	}
+
+	const double warmMbPerSecond = MbPerSecond(bytes, bestWarmSeconds);
+	if (bytes != 0 && bestWarmSeconds > 0 && warmMbPerSecond < FileSystemBoundRatio * decompressMbPerSecond)
+	{
+		report.Line(L"unpacking reaches %.0f%% of the decompression speed: the extraction is bound by writing files, not by the CPU",
+			100.0 * warmMbPerSecond / decompressMbPerSecond);
+	}
+
+	if (bestWarmSeconds > 0 && unpackRuns[0].unpackSeconds > ColdRunRatio * bestWarmSeconds)
+	{
+		report.Line(L"the cold run is %.1f times slower than the warm ones: reading the executable and a cold cache dominate the first start",
+			unpackRuns[0].unpackSeconds / bestWarmSeconds);
+	}
+
+	if (report.text.size() == hintsStart)
+	{
+		report.Line(L"nothing unusual found");
+	}
+
+	reportText = report.text;
+
+	std::string reportUtf8;
+	err = ConvertUtf16ToUtf8(report.text, reportUtf8);
+	if (!err.Succeeded())
+	{
+		return err;
+	}
+
+	File reportFile;
+	err = reportFile.OpenWrite(reportPath);
+	if (err.Succeeded())
+	{
+		err = reportFile.Write(reinterpret_cast<const uint8_t*>(reportUtf8.data()), static_cast<DWORD>(reportUtf8.size()));
+	}
+	return err;
+}
@@ -0,0 +1,19 @@
+#pragma once
+
+#include "Error.hpp"
+#include <string>
+
+// COMMENT: field diagnostics of a slow start, run by executor --diagnose instead of the java application.
+// The embedded payload is unpacked for real into scratch directories several times, the first run with a cold cache
+// and the following ones warm, then it is decompressed in memory only, and the disk is measured by a sequential write
+// and by creating small files, where close latency that depends on the file content points to an on-access scanner.
+// The report is plain text, so a customer can read it before sending it.
+class Diagnostics
+{
+public:
+
+	static const char* const Arg;
+	static const unsigned UnpackRuns = 3;
+
+	static Error Run(const std::wstring& reportPath, std::wstring& report);
+};
@@ -0,0 +1,53 @@
+#include "DirectoryCache.h"
+
+Error DirectoryCache::Open(const std::wstring& rootPath)
+{
+	index.clear();
+	entries.clear();
+
+	return root.Open(rootPath);
+}
+
+Error DirectoryCache::Get(const std::wstring& relativePath, const Directory*& dir)
+{
+	if (relativePath.empty())
+	{
+		dir = &root;
+		return Error();
+	}
+
+	const auto it = index.find(relativePath);
+	if (it != index.end())
+	{
+		entries.splice(entries.begin(), entries, it->second);
+		dir = it->second->dir.get();
+		return Error();
+	}
+
+	// COMMENT: the parent is usually cached already, otherwise the recursion stops at the nearest cached ancestor.
+	const size_t separator = relativePath.find_last_of(L'/');
+	const Directory* parent = nullptr;
+	Error err = Get(separator == std::wstring::npos ? std::wstring() : relativePath.substr(0, separator), parent);
+	if (!err.Succeeded())
+	{
+		return err;
+	}
+
+	std::unique_ptr<Directory> child(new Directory());
+	err = child->Create(*parent, separator == std::wstring::npos ? relativePath : relativePath.substr(separator + 1));
+	if (!err.Succeeded())
+	{
+		return err;
+	}
+
+	if (entries.size() >= Capacity)
+	{
+		index.erase(entries.back().relativePath);
+		entries.pop_back();
+	}
+
+	entries.push_front(Entry{ relativePath, std::move(child) });
+	index[relativePath] = entries.begin();
+	dir = entries.front().dir.get();
+	return Error();
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include "Error.hpp"
+#include "File.h"
+#include <string>
+#include <list>
+#include <memory>
+#include <unordered_map>
+
+// COMMENT: open handles of the directories of an extraction, keyed by their path relative to the root with '/' separators,
+// as in zip entry names. Files and subdirectories are created relative to a cached handle, so the OS resolves only
+// the last path component. At most Capacity handles stay open, the least recently used one is closed first.
+class DirectoryCache
+{
+public:
+
+	static const size_t Capacity = 64;
+
+	DirectoryCache() = default;
+
+	DirectoryCache(const DirectoryCache&) = delete;
+	DirectoryCache& operator=(const DirectoryCache&) = delete;
+
+	Error Open(const std::wstring& rootPath);
+
+	// COMMENT: creates the directory and any missing parents. The pointer stays valid until the next call.
+	Error Get(const std::wstring& relativePath, const Directory*& dir);
+
+private:
+
+	struct Entry
+	{
+		std::wstring relativePath;
+		std::unique_ptr<Directory> dir;
+	};
+
+private:
+
+	Directory root;
+	std::list<Entry> entries;
+	std::unordered_map<std::wstring, std::list<Entry>::iterator> index;
+};
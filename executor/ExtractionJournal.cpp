@@ -0,0 +1,293 @@
+#include "ExtractionJournal.h"
+#include "Path.hpp"
+#include "StringConverter.hpp"
+#include <atomic>
+#include <thread>
+#include <cstring>
+
+namespace
+{
+
+const char JournalMagic[8] = { 'I', 'M', 'J', 'R', 'N', 'L', '0', '1' };
+const size_t ReadBufferSize = 256 * 1024;
+const unsigned MaxVerifyThreads = 8;
+
+// COMMENT: record layout, little endian: <uint16 name length><name><uint64 size><uint32 crc><uint32 checksum of the preceding fields>.
+const size_t RecordFixedSize = sizeof(uint16_t) + sizeof(uint64_t) + sizeof(uint32_t) + sizeof(uint32_t);
+
+uint32_t Checksum(const char* data, size_t size)
+{
+	uint32_t hash = 2166136261U;
+	for (size_t i = 0; i < size; i++)
+	{
+		hash = (hash ^ static_cast<uint8_t>(data[i])) * 16777619U;
+	}
+	return hash;
+}
+
+// COMMENT: the CRC-32 of zip entries, zlib headers are not among the include paths.
+class Crc32
+{
+public:
+
+	Crc32()
+	{
+		for (uint32_t i = 0; i < 256; i++)
+		{
+			uint32_t value = i;
+			for (int bit = 0; bit < 8; bit++)
+			{
+				value = (value & 1) != 0 ? (value >> 1) ^ 0xEDB88320U : value >> 1;
+			}
+			table[i] = value;
+		}
+	}
+
+	uint32_t Update(uint32_t crc, const uint8_t* data, size_t size) const
+	{
+		crc = ~crc;
+		for (size_t i = 0; i < size; i++)
+		{
+			crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+		}
+		return ~crc;
+	}
+
+private:
+
+	uint32_t table[256];
+};
+
+template <typename T>
+void AppendValue(std::string& dst, T value)
+{
+	for (size_t i = 0; i < sizeof(T); i++)
+	{
+		dst.push_back(static_cast<char>((value >> (8 * i)) & 0xFF));
+	}
+}
+
+template <typename T>
+T ReadValue(const char* src)
+{
+	T value = 0;
+	for (size_t i = 0; i < sizeof(T); i++)
+	{
+		value |= static_cast<T>(static_cast<uint8_t>(src[i])) << (8 * i);
+	}
+	return value;
+}
+
+bool GetEntryPath(const std::wstring& destDir, const std::string& entryName, std::wstring& path)
+{
+	std::wstring name;
+	if (!ConvertUtf8ToUtf16(entryName, name).Succeeded() || name.empty())
+	{
+		return false;
+	}
+
+	path.assign(destDir).push_back(Path::Separator);
+	path.append(name);
+	return true;
+}
+
+bool HasSize(const std::wstring& path, uint64_t size)
+{
+	uint64_t actual = 0;
+	return File::GetSize(path, actual).Succeeded() && actual == size;
+}
+
+bool HasCrc(const std::wstring& path, uint32_t crc)
+{
+	static const Crc32 crc32;
+
+	File file;
+	if (!file.OpenRead(path).Succeeded())
+	{
+		return false;
+	}
+
+	std::vector<uint8_t> buffer(ReadBufferSize);
+	uint32_t actual = 0;
+	uint32_t readCount = 0;
+	do
+	{
+		if (!file.Read(&buffer[0], static_cast<uint32_t>(buffer.size()), readCount).Succeeded())
+		{
+			return false;
+		}
+		actual = crc32.Update(actual, &buffer[0], readCount);
+	} while (readCount == buffer.size());
+
+	return actual == crc;
+}
+
+} // namespace
+
+bool ExtractionJournal::Exists(const std::wstring& journalPath)
+{
+	return File::Exists(journalPath);
+}
+
+Error ExtractionJournal::Open(const std::wstring& journalPath, const std::wstring& dir)
+{
+	completed.clear();
+	path = journalPath;
+	destDir = dir;
+
+	Error err = journal.OpenReadWrite(path);
+	if (!err.Succeeded())
+	{
+		return err;
+	}
+
+	std::vector<uint8_t> data;
+	err = journal.Read(data);
+	if (!err.Succeeded())
+	{
+		return err;
+	}
+
+	const std::string content(data.begin(), data.end());
+
+	std::vector<std::pair<std::string, Record>> records;
+	size_t validEnd = 0;
+	if (content.size() >= sizeof(JournalMagic) && memcmp(content.data(), JournalMagic, sizeof(JournalMagic)) == 0)
+	{
+		validEnd = sizeof(JournalMagic);
+		for (;;)
+		{
+			const char* pRecord = content.data() + validEnd;
+			const size_t left = content.size() - validEnd;
+			if (left < RecordFixedSize)
+			{
+				break;
+			}
+
+			const size_t nameSize = ReadValue<uint16_t>(pRecord);
+			const size_t recordSize = RecordFixedSize + nameSize;
+			if (left < recordSize || ReadValue<uint32_t>(pRecord + recordSize - sizeof(uint32_t)) != Checksum(pRecord, recordSize - sizeof(uint32_t)))
+			{
+				break;
+			}
+
+			Record record;
+			record.size = ReadValue<uint64_t>(pRecord + sizeof(uint16_t) + nameSize);
+			record.crc = ReadValue<uint32_t>(pRecord + sizeof(uint16_t) + nameSize + sizeof(uint64_t));
+			records.emplace_back(std::string(pRecord + sizeof(uint16_t), nameSize), record);
+			validEnd += recordSize;
+		}
+	}
+
+	Verify(records);
+
+	// COMMENT: a record torn by the interruption is cut off, new records follow the last complete one.
+	err = journal.SetSize(validEnd);
+	if (err.Succeeded())
+	{
+		err = journal.Seek(validEnd);
+	}
+	if (err.Succeeded() && validEnd == 0)
+	{
+		err = journal.Write(reinterpret_cast<const uint8_t*>(JournalMagic), sizeof(JournalMagic));
+	}
+
+	return err;
+}
+
+bool ExtractionJournal::IsCompleted(const std::string& entryName, uint64_t size, uint32_t crc) const
+{
+	const auto it = completed.find(entryName);
+	return it != completed.end() && it->second.size == size && it->second.crc == crc;
+}
+
+Error ExtractionJournal::Append(const std::string& entryName, uint64_t size, uint32_t crc)
+{
+	// COMMENT: such an entry is not journaled and simply unpacked again on resume.
+	if (entryName.size() > 0xFFFF)
+	{
+		return Error();
+	}
+
+	std::string record;
+	record.reserve(RecordFixedSize + entryName.size());
+	AppendValue<uint16_t>(record, static_cast<uint16_t>(entryName.size()));
+	record.append(entryName);
+	AppendValue<uint64_t>(record, size);
+	AppendValue<uint32_t>(record, crc);
+	AppendValue<uint32_t>(record, Checksum(record.data(), record.size()));
+
+	// COMMENT: one write per record, an interruption leaves at most the last record torn.
+	Error err = journal.Write(reinterpret_cast<const uint8_t*>(record.data()), static_cast<uint32_t>(record.size()));
+	if (!err.Succeeded())
+	{
+		return err;
+	}
+
+	completed[entryName] = Record{ size, crc };
+	return Error();
+}
+
+Error ExtractionJournal::Remove()
+{
+	journal.Close();
+	completed.clear();
+
+	return File::Exists(path) ? File::Delete(path) : Error();
+}
+
+void ExtractionJournal::Verify(const std::vector<std::pair<std::string, Record>>& records)
+{
+	// COMMENT: an entry may be journaled several times when an earlier resume rewrote it, the last record wins.
+	std::map<std::string, Record> lastRecords;
+	for (const auto& record : records)
+	{
+		lastRecords[record.first] = record.second;
+	}
+
+	std::vector<std::pair<const std::string*, const Record*>> candidates;
+	std::vector<std::wstring> entryPaths;
+	for (const auto& entry : lastRecords)
+	{
+		std::wstring entryPath;
+		if (GetEntryPath(destDir, entry.first, entryPath) && HasSize(entryPath, entry.second.size))
+		{
+			candidates.emplace_back(&entry.first, &entry.second);
+			entryPaths.push_back(std::move(entryPath));
+		}
+	}
+
+	// COMMENT: neither the files nor the journal are flushed, after a power loss any file may have its size but not its data.
+	// Reading the files back is still much cheaper than inflating and writing them again.
+	std::vector<uint8_t> valid(candidates.size(), 0);
+	std::atomic<size_t> next(0);
+	auto work = [&]()
+	{
+		for (size_t i = next++; i < candidates.size(); i = next++)
+		{
+			valid[i] = HasCrc(entryPaths[i], candidates[i].second->crc) ? 1 : 0;
+		}
+	};
+
+	const unsigned hardwareThreads = std::thread::hardware_concurrency();
+	const size_t maxThreads = hardwareThreads == 0 ? 1 : (hardwareThreads < MaxVerifyThreads ? hardwareThreads : MaxVerifyThreads);
+	const size_t threadCount = candidates.size() < maxThreads ? candidates.size() : maxThreads;
+	std::vector<std::thread> threads;
+	for (size_t i = 1; i < threadCount; i++)
+	{
+		threads.emplace_back(work);
+	}
+	work();
+	for (std::thread& thread : threads)
+	{
+		thread.join();
+	}
+
+	for (size_t i = 0; i < candidates.size(); i++)
+	{
+		if (valid[i] != 0)
+		{
+			completed[*candidates[i].first] = *candidates[i].second;
+		}
+	}
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include "Error.hpp"
+#include "File.h"
+#include <string>
+#include <map>
+#include <vector>
+#include <cstdint>
+
+// COMMENT: append-only record of the entries completely written into a persistent extraction directory,
+// so an interrupted extraction continues from the first incomplete entry instead of starting over.
+// A record holds the entry name, size and CRC and is appended only after the file is written. A torn last record
+// is cut off on open, and since records may reach the disk before the data they describe, every journaled file
+// is read back and checked for its size and CRC.
+class ExtractionJournal
+{
+public:
+
+	ExtractionJournal() = default;
+
+	ExtractionJournal(const ExtractionJournal&) = delete;
+	ExtractionJournal& operator=(const ExtractionJournal&) = delete;
+
+	static bool Exists(const std::wstring& journalPath);
+
+	// COMMENT: loads the records of a previous extraction into destDir, if any, and opens the journal for appending.
+	Error Open(const std::wstring& journalPath, const std::wstring& destDir);
+
+	// COMMENT: entryName is the UTF-8 name from the archive.
+	bool IsCompleted(const std::string& entryName, uint64_t size, uint32_t crc) const;
+	Error Append(const std::string& entryName, uint64_t size, uint32_t crc);
+
+	// COMMENT: the extraction is finished, the journal is not needed anymore.
+	Error Remove();
+
+private:
+
+	struct Record
+	{
+		uint64_t size;
+		uint32_t crc;
+	};
+
+	void Verify(const std::vector<std::pair<std::string, Record>>& records);
+
+private:
+
+	std::wstring path;
+	std::wstring destDir;
+	File journal;
+	std::map<std::string, Record> completed;
+};
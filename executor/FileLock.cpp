@@ -0,0 +1,47 @@
+#include "FileLock.h"
+
+FileLock::FileLock()
+	: hLock(INVALID_HANDLE_VALUE)
+{
+}
+
+FileLock::~FileLock()
+{
+	Unlock();
+}
+
+Error FileLock::Lock(const std::wstring& lockPath)
+{
+	Unlock();
+
+	hLock = CreateFileW(lockPath.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, NULL,
+		OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (hLock == INVALID_HANDLE_VALUE)
+	{
+		return Error(GetLastError());
+	}
+
+	OVERLAPPED overlapped;
+	ZeroMemory(&overlapped, sizeof(overlapped));
+	if (!LockFileEx(hLock, LOCKFILE_EXCLUSIVE_LOCK, 0, 1, 0, &overlapped))
+	{
+		const DWORD err = GetLastError();
+		CloseHandle(hLock);
+		hLock = INVALID_HANDLE_VALUE;
+		return Error(err);
+	}
+
+	return Error();
+}
+
+void FileLock::Unlock()
+{
+	if (hLock != INVALID_HANDLE_VALUE)
+	{
+		OVERLAPPED overlapped;
+		ZeroMemory(&overlapped, sizeof(overlapped));
+		UnlockFileEx(hLock, 0, 1, 0, &overlapped);
+		CloseHandle(hLock);
+		hLock = INVALID_HANDLE_VALUE;
+	}
+}
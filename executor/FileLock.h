@@ -0,0 +1,26 @@
+#pragma once
+
+#include "Error.hpp"
+#include "File.h"
+#include <string>
+
+// COMMENT: exclusive lock on a lock file, held until Unlock or destruction. The system releases it
+// when the owning process dies, so a crashed instance never blocks the others.
+class FileLock
+{
+public:
+
+	FileLock();
+	~FileLock();
+
+	FileLock(const FileLock&) = delete;
+	FileLock& operator=(const FileLock&) = delete;
+
+	// COMMENT: waits while another instance holds the lock.
+	Error Lock(const std::wstring& lockPath);
+	void Unlock();
+
+private:
+
+	File::NativeHandle hLock;
+};
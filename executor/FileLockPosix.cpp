@@ -0,0 +1,67 @@
+#include "FileLock.h"
+#include "StringConverter.hpp"
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/file.h>
+
+namespace
+{
+
+const int InvalidDescriptor = -1;
+
+} // namespace
+
+FileLock::FileLock()
+	: hLock(InvalidDescriptor)
+{
+}
+
+FileLock::~FileLock()
+{
+	Unlock();
+}
+
+Error FileLock::Lock(const std::wstring& lockPath)
+{
+	Unlock();
+
+	std::string nativePath;
+	Error err = ConvertUtf16ToUtf8(lockPath, nativePath);
+	if (!err.Succeeded())
+	{
+		return err;
+	}
+
+	hLock = open(nativePath.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+	if (hLock < 0)
+	{
+		hLock = InvalidDescriptor;
+		return Error::makeByErrno(errno);
+	}
+
+	// COMMENT: flock belongs to the open file description and not to the process as fcntl locks do,
+	// so two locks in one process exclude each other like LockFileEx on two handles.
+	while (flock(hLock, LOCK_EX) != 0)
+	{
+		if (errno != EINTR)
+		{
+			const int lockErr = errno;
+			close(hLock);
+			hLock = InvalidDescriptor;
+			return Error::makeByErrno(lockErr);
+		}
+	}
+
+	return Error();
+}
+
+void FileLock::Unlock()
+{
+	if (hLock != InvalidDescriptor)
+	{
+		flock(hLock, LOCK_UN);
+		close(hLock);
+		hLock = InvalidDescriptor;
+	}
+}
@@ -0,0 +1,106 @@
+#include "HardwareInfo.h"
+#include <vector>
+#include <Windows.h>
+
+namespace
+{
+
+unsigned CountBits(ULONG_PTR mask)
+{
+	unsigned count = 0;
+	for (; mask != 0; mask &= mask - 1)
+	{
+		count++;
+	}
+	return count;
+}
+
+void QueryMemory(HardwareInfo& info)
+{
+	MEMORYSTATUSEX status;
+	status.dwLength = sizeof(status);
+	if (GlobalMemoryStatusEx(&status))
+	{
+		info.physicalMemory = status.ullTotalPhys;
+		info.availableMemory = status.ullAvailPhys;
+	}
+}
+
+void QueryCpus(HardwareInfo& info)
+{
+	info.logicalCpus = GetActiveProcessorCount(ALL_PROCESSOR_GROUPS);
+
+	DWORD_PTR processMask = 0, systemMask = 0;
+	if (GetProcessAffinityMask(GetCurrentProcess(), &processMask, &systemMask) && processMask != systemMask)
+	{
+		const unsigned affinityCpus = CountBits(processMask);
+		if (affinityCpus != 0 && affinityCpus < info.logicalCpus)
+		{
+			info.logicalCpus = affinityCpus;
+		}
+	}
+
+	DWORD length = 0;
+	GetLogicalProcessorInformationEx(RelationProcessorCore, NULL, &length);
+	if (GetLastError() != ERROR_INSUFFICIENT_BUFFER || length == 0)
+	{
+		return;
+	}
+
+	std::vector<uint8_t> buffer(length);
+	if (!GetLogicalProcessorInformationEx(RelationProcessorCore, reinterpret_cast<PSYSTEM_LOGICAL_PROCESSOR_INFORMATION_EX>(&buffer[0]), &length))
+	{
+		return;
+	}
+
+	for (DWORD offset = 0; offset < length;)
+	{
+		const PSYSTEM_LOGICAL_PROCESSOR_INFORMATION_EX entry = reinterpret_cast<PSYSTEM_LOGICAL_PROCESSOR_INFORMATION_EX>(&buffer[offset]);
+		if (entry->Relationship == RelationProcessorCore)
+		{
+			info.physicalCpus++;
+		}
+		offset += entry->Size;
+	}
+}
+
+void QueryJobLimits(HardwareInfo& info)
+{
+	// COMMENT: a NULL handle queries the job of the calling process, the calls fail when the process is not in a job.
+	JOBOBJECT_EXTENDED_LIMIT_INFORMATION limits;
+	if (QueryInformationJobObject(NULL, JobObjectExtendedLimitInformation, &limits, sizeof(limits), NULL))
+	{
+		const DWORD flags = limits.BasicLimitInformation.LimitFlags;
+		if ((flags & JOB_OBJECT_LIMIT_JOB_MEMORY) != 0)
+		{
+			info.memoryLimit = limits.JobMemoryLimit;
+		}
+		if ((flags & JOB_OBJECT_LIMIT_PROCESS_MEMORY) != 0 && (info.memoryLimit == 0 || limits.ProcessMemoryLimit < info.memoryLimit))
+		{
+			info.memoryLimit = limits.ProcessMemoryLimit;
+		}
+	}
+
+	JOBOBJECT_CPU_RATE_CONTROL_INFORMATION cpuRate;
+	if (QueryInformationJobObject(NULL, JobObjectCpuRateControlInformation, &cpuRate, sizeof(cpuRate), NULL))
+	{
+		const DWORD hardCap = JOB_OBJECT_CPU_RATE_CONTROL_ENABLE | JOB_OBJECT_CPU_RATE_CONTROL_HARD_CAP;
+		if ((cpuRate.ControlFlags & hardCap) == hardCap && cpuRate.CpuRate != 0 && info.logicalCpus != 0)
+		{
+			// COMMENT: CpuRate is the share of all processors in 1/100 of a percent.
+			const uint64_t rate = static_cast<uint64_t>(cpuRate.CpuRate) * info.logicalCpus;
+			info.cpuLimit = static_cast<unsigned>((rate + 9999) / 10000);
+		}
+	}
+}
+
+} // namespace
+
+HardwareInfo HardwareInfo::Query()
+{
+	HardwareInfo info;
+	QueryMemory(info);
+	QueryCpus(info);
+	QueryJobLimits(info);
+	return info;
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <cstdint>
+
+// COMMENT: machine resources visible to the executor, limits come from the job object on Windows and from cgroups on Linux.
+// Values that can not be determined are 0.
+struct HardwareInfo
+{
+	uint64_t physicalMemory = 0;
+	uint64_t availableMemory = 0;
+	// COMMENT: 0 means no limit.
+	uint64_t memoryLimit = 0;
+
+	unsigned logicalCpus = 0;
+	unsigned physicalCpus = 0;
+	// COMMENT: CPU quota expressed in whole CPUs rounded up, 0 means no limit.
+	unsigned cpuLimit = 0;
+
+	static HardwareInfo Query();
+
+	uint64_t GetEffectiveMemory() const
+	{
+		return memoryLimit != 0 && (physicalMemory == 0 || memoryLimit < physicalMemory) ? memoryLimit : physicalMemory;
+	}
+
+	unsigned GetEffectiveCpus() const
+	{
+		return cpuLimit != 0 && (logicalCpus == 0 || cpuLimit < logicalCpus) ? cpuLimit : logicalCpus;
+	}
+};
@@ -0,0 +1,142 @@
+#include "HardwareInfo.h"
+#include <fstream>
+#include <sstream>
+#include <set>
+#include <string>
+#include <utility>
+#include <sched.h>
+#include <unistd.h>
+
+namespace
+{
+
+bool ReadFirstLine(const char* path, std::string& line)
+{
+	std::ifstream stream(path);
+	return static_cast<bool>(std::getline(stream, line));
+}
+
+// COMMENT: false unless text is a whole number, the files are read from a kernel that may format them differently.
+bool ParseInteger(const std::string& text, long long& value)
+{
+	std::istringstream stream(text);
+	return (stream >> value) && (stream >> std::ws).eof();
+}
+
+void QueryMemory(HardwareInfo& info)
+{
+	const long pageSize = sysconf(_SC_PAGESIZE);
+	const long pages = sysconf(_SC_PHYS_PAGES);
+	if (pageSize > 0 && pages > 0)
+	{
+		info.physicalMemory = static_cast<uint64_t>(pages) * static_cast<uint64_t>(pageSize);
+	}
+
+	// COMMENT: MemAvailable accounts for reclaimable page cache, unlike _SC_AVPHYS_PAGES.
+	std::ifstream meminfo("/proc/meminfo");
+	std::string key;
+	uint64_t valueKb = 0;
+	std::string unit;
+	while (meminfo >> key >> valueKb >> unit)
+	{
+		if (key == "MemAvailable:")
+		{
+			info.availableMemory = valueKb * 1024;
+			break;
+		}
+	}
+}
+
+void QueryCpus(HardwareInfo& info)
+{
+	cpu_set_t cpuSet;
+	CPU_ZERO(&cpuSet);
+	if (sched_getaffinity(0, sizeof(cpuSet), &cpuSet) == 0)
+	{
+		info.logicalCpus = static_cast<unsigned>(CPU_COUNT(&cpuSet));
+	}
+	else
+	{
+		const long online = sysconf(_SC_NPROCESSORS_ONLN);
+		info.logicalCpus = online > 0 ? static_cast<unsigned>(online) : 0;
+	}
+
+	std::ifstream cpuinfo("/proc/cpuinfo");
+	std::set<std::pair<std::string, std::string>> cores;
+	std::string line, physicalId;
+	while (std::getline(cpuinfo, line))
+	{
+		const size_t colon = line.find(':');
+		if (colon == std::string::npos)
+		{
+			continue;
+		}
+
+		const std::string value = colon + 2 <= line.size() ? line.substr(colon + 2) : std::string();
+		if (line.compare(0, 11, "physical id") == 0)
+		{
+			physicalId = value;
+		}
+		else if (line.compare(0, 7, "core id") == 0)
+		{
+			cores.insert(std::make_pair(physicalId, value));
+		}
+	}
+
+	info.physicalCpus = static_cast<unsigned>(cores.size());
+}
+
+void QueryCgroupLimits(HardwareInfo& info)
+{
+	std::string line;
+
+	// COMMENT: cgroup v2 first, then v1. "max" and -1 mean no limit.
+	if (ReadFirstLine("/sys/fs/cgroup/memory.max", line) || ReadFirstLine("/sys/fs/cgroup/memory/memory.limit_in_bytes", line))
+	{
+		std::istringstream stream(line);
+		uint64_t limit = 0;
+		if (line != "max" && (stream >> limit) && (info.physicalMemory == 0 || limit < info.physicalMemory))
+		{
+			info.memoryLimit = limit;
+		}
+	}
+
+	long long quota = -1;
+	long long period = 0;
+	if (ReadFirstLine("/sys/fs/cgroup/cpu.max", line))
+	{
+		std::istringstream stream(line);
+		std::string quotaStr;
+		if (!(stream >> quotaStr >> period) || quotaStr == "max" || !ParseInteger(quotaStr, quota))
+		{
+			quota = -1;
+		}
+	}
+	else
+	{
+		std::string periodLine;
+		if (ReadFirstLine("/sys/fs/cgroup/cpu/cpu.cfs_quota_us", line) && ReadFirstLine("/sys/fs/cgroup/cpu/cpu.cfs_period_us", periodLine))
+		{
+			if (!ParseInteger(line, quota) || !ParseInteger(periodLine, period))
+			{
+				quota = -1;
+			}
+		}
+	}
+
+	if (quota > 0 && period > 0)
+	{
+		info.cpuLimit = static_cast<unsigned>((quota + period - 1) / period);
+	}
+}
+
+} // namespace
+
+HardwareInfo HardwareInfo::Query()
+{
+	HardwareInfo info;
+	QueryMemory(info);
+	QueryCpus(info);
+	QueryCgroupLimits(info);
+	return info;
+}
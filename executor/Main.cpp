@@ -1,7 +1,26 @@
 ﻿#include "PackageManager.h"
 #include "Path.hpp"
 #include "File.h"
+#include "StringConverter.hpp"
 #include "ResourceParam.h"
+#include "SplashScheduler.h"
+#include "ProgressChannel.h"
+#include "ChildProcess.h"
+#include "OutputCapture.h"
+#include "ZipArchive.h"
+#include "PayloadCache.h"
+#include "AppCds.h"
+#include "CommandTemplate.h"
+#include "HardwareInfo.h"
+#include "DaemonClient.h"
+#include "Crac.h"
+#include "Cleanup.h"
+#include "SharedExtraction.h"
+#include "TreeClone.h"
+#include "FileLock.h"
+#include "AccessProfile.h"
+#include "Trace.h"
+#include "Diagnostics.h"
 #include <nana/gui/widgets/widget.hpp>
 #include <nana/gui/widgets/label.hpp>
 #include <nana/gui/wvl.hpp>
@@ -10,18 +29,34 @@
 #include <nana/gui/widgets/progress.hpp>
 #include <nana/gui/timer.hpp>
 #include <nana/gui/animation.hpp>
-#include <boost/algorithm/string/replace.hpp>
 #include <boost/scope_exit.hpp>
 #include <thread>
+#include <cstdio>
+#include <vector>
+#include <shellapi.h>
 
 #pragma warning(push)
 #pragma warning(disable:4091)
 #include <client/windows/handler/exception_handler.h>
 #pragma warning(pop)
 
-const std::wstring DirPath(L"<dir_path>");
-const std::wstring CurrentAppPath(L"<current_app_path>");
+const std::wstring DirPathVariable(L"dir_path");
+const std::wstring CurrentAppPathVariable(L"current_app_path");
+const std::wstring MemTotalVariable(L"mem_total_mb");
+const std::wstring MemAvailableVariable(L"mem_avail_mb");
+const std::wstring MemPercentVariable(L"mem_pct");
+const std::wstring CpusVariable(L"cpus");
+const std::wstring LogicalCpusVariable(L"logical_cpus");
+const std::wstring PhysicalCpusVariable(L"physical_cpus");
+const std::wstring JobCpuLimitVariable(L"job_cpu_limit");
+const std::wstring JobMemLimitVariable(L"job_mem_limit_mb");
 const std::wstring TmpPrefix(L"infomaximum_");
+const std::string HeadlessArg("--headless");
+const std::wstring InstalledDirName(L"installed");
+const std::wstring DefaultDaemonIdleSeconds(L"600");
+
+const unsigned ProgressAmount = 1000;
+const unsigned ProgressIntervalMs = 100;
 
 google_breakpad::ExceptionHandler	handler(Path::GetDumpDir(), nullptr, [](const wchar_t* /*dump_path*/, const wchar_t* /*id*/, void* /*context*/,
 	EXCEPTION_POINTERS* /*pExcPtr*/,
@@ -30,143 +65,337 @@ google_breakpad::ExceptionHandler	handler(Path::GetDumpDir(), nullptr, [](const
 	return succeeded;
 }, nullptr, google_breakpad::ExceptionHandler::HANDLER_ALL);
 
-void ShowError(const Error& err)
+struct LaunchContext
+{
+	// COMMENT: headless mode never touches nana, progress and errors go to stdout/stderr.
+	bool headless = false;
+	// COMMENT: in daemon mode stdout and stderr carry the output of the java application only.
+	bool daemon = false;
+	SplashScheduler* splashScheduler = nullptr;
+	ProgressChannel* progressChannel = nullptr;
+	// COMMENT: set when the splash has already shown the error to the user.
+	bool errorShown = false;
+};
+
+void AttachStdStreams()
 {
-	MessageBoxW(NULL, err.getMessage().c_str(), L"Error", MB_OK | MB_ICONERROR);
+	// COMMENT: the executor is a GUI subsystem application, so stdout is only usable when the caller redirected it
+	// or when we attach to the console of the parent process.
+	const HANDLE hStdout = GetStdHandle(STD_OUTPUT_HANDLE);
+	if (hStdout != NULL && hStdout != INVALID_HANDLE_VALUE)
+	{
+		return;
+	}
+
+	if (AttachConsole(ATTACH_PARENT_PROCESS))
+	{
+		FILE* stream = nullptr;
+		freopen_s(&stream, "CONOUT$", "w", stdout);
+		freopen_s(&stream, "CONOUT$", "w", stderr);
+	}
 }
 
-struct EnumParam
+void WriteLine(FILE* stream, const std::wstring& msg)
 {
-	DWORD pid = 0;
-	bool visibleWindowExist = false;
-};
+	std::string utf8Msg;
+	if (msg.empty() || !ConvertUtf16ToUtf8(msg, utf8Msg).Succeeded())
+	{
+		return;
+	}
+
+	utf8Msg.push_back('\n');
+	fwrite(utf8Msg.data(), 1, utf8Msg.size(), stream);
+	fflush(stream);
+}
 
-BOOL CALLBACK EnumWindowsCallback(HWND hwnd, LPARAM lParam)
+void ReportProgress(const LaunchContext& context, const std::wstring& msg)
 {
-	EnumParam* param = (EnumParam*)lParam;
+	if (context.headless && !context.daemon)
+	{
+		WriteLine(stdout, msg);
+	}
+}
 
-	DWORD lpdwProcessId;
-	GetWindowThreadProcessId(hwnd, &lpdwProcessId);
-	if (lpdwProcessId == param->pid)
+void PublishPhase(const LaunchContext& context, ProgressEvent::Phase phase)
+{
+	if (context.progressChannel != nullptr)
 	{
-		if (IsWindowVisible(hwnd))
-		{
-			param->visibleWindowExist = true;
-			return FALSE;
-		}
+		ProgressEvent event;
+		event.phase = phase;
+		context.progressChannel->Publish(event);
+	}
+}
+
+// COMMENT: the splash shows the message and closes itself, so it is not closed under the error box.
+void PublishFailure(const LaunchContext& context, const Error& err)
+{
+	if (context.progressChannel != nullptr && context.splashScheduler != nullptr)
+	{
+		ProgressEvent event;
+		event.phase = ProgressEvent::Phase::Failed;
+		event.message = err.getMessage();
+		context.splashScheduler->SetPhase(SplashScheduler::Phase::Failed);
+		context.progressChannel->Publish(event);
+	}
+}
+
+void CloseSplash(const LaunchContext& context)
+{
+	if (!context.headless)
+	{
+		nana::API::exit_all();
 	}
-	return TRUE;
 }
 
-Error ExecuteProcess(const std::wstring& cmd, const std::wstring& workingDir, DWORD& exitCode)
+void ShowError(const LaunchContext& context, const Error& err)
 {
+	if (context.headless)
+	{
+		WriteLine(stderr, err.getMessage());
+	}
+	else
+	{
+		MessageBoxW(NULL, err.getMessage().c_str(), L"Error", MB_OK | MB_ICONERROR);
+	}
+}
+
+Error ExecuteProcess(const LaunchContext& context, const std::wstring& cmd, const std::wstring& workingDir, ChildProcess::State& state, DWORD& exitCode)
+{
+	Trace::Scope traceScope("ExecuteProcess");
 	exitCode = ERROR_SUCCESS;
+	state = ChildProcess::State::Exited;
 
 	const std::wstring stdoutFilePath = Path::GetStdoutFilePath(std::wstring(TmpPrefix).append(L"stdout.log"));
-	File::Delete(stdoutFilePath);
 
-	SECURITY_ATTRIBUTES sa;
-	sa.nLength = sizeof(sa);
-	sa.lpSecurityDescriptor = NULL;
-	sa.bInheritHandle = TRUE;
+	OutputCapture::Options captureOptions;
+	if (PackageManager::GetFlagResource(ParamType, StdoutCompressName))
+	{
+		captureOptions.compressSegment = zip_archive::CompressFile;
+	}
 
-	HANDLE hStdout = CreateFile(stdoutFilePath.c_str(),
-		GENERIC_READ | GENERIC_WRITE,
-		FILE_SHARE_WRITE | FILE_SHARE_READ,
-		&sa,
-		CREATE_ALWAYS,
-		FILE_ATTRIBUTE_NORMAL,
-		NULL);
+	// COMMENT: the child still runs if the log can not be captured, as it did with an unopenable log file.
+	OutputCapture capture;
+	const bool captured = capture.Start(stdoutFilePath, captureOptions).Succeeded();
 
-	if (hStdout == INVALID_HANDLE_VALUE)
+	ChildProcess child;
+	Error err = child.Start(cmd, workingDir, captured ? capture.GetChildHandle() : NULL);
+	capture.OnChildStarted();
+	if (!err.Succeeded())
 	{
-		hStdout = NULL;
+		return err;
 	}
 
-	PROCESS_INFORMATION pInfo = {0};
-	STARTUPINFOW sInfo = {0};
+	// COMMENT: a failed readiness wait only means the splash is closed earlier than usual.
+	child.WaitReady(state);
+	Trace::Instant(state == ChildProcess::State::Ready ? "child ready" : "child exited before ready");
+	CloseSplash(context);
+
+	uint32_t childExitCode = ERROR_SUCCESS;
+	err = child.WaitExit(childExitCode);
+	exitCode = childExitCode;
 
-	sInfo.cb = sizeof(sInfo);
-	sInfo.dwFlags |= STARTF_USESTDHANDLES;
-	sInfo.hStdInput = NULL;
-	sInfo.hStdError = hStdout;
-	sInfo.hStdOutput = hStdout;
+	capture.Stop();
+
+	return err;
+}
 
-	if (!CreateProcessW(NULL, const_cast<wchar_t*>(cmd.c_str()), NULL, NULL, TRUE, CREATE_NO_WINDOW, NULL, workingDir.c_str(), &sInfo, &pInfo))
+void InsertJvmOptions(std::wstring& cmdLine, const std::wstring& options)
+{
+	// COMMENT: options go right after the java executable, which is the first, possibly quoted, token.
+	size_t pos = 0;
+	if (!cmdLine.empty() && cmdLine[0] == L'"')
 	{
-		CloseHandle(hStdout);
-		return Error(GetLastError());
+		pos = cmdLine.find(L'"', 1);
+		pos = pos == std::wstring::npos ? cmdLine.size() : pos + 1;
+	}
+	else
+	{
+		pos = cmdLine.find(L' ');
+		pos = pos == std::wstring::npos ? cmdLine.size() : pos;
 	}
 
-	DWORD timeoutMs = 100;
-	for (;;)
+	cmdLine.insert(pos, std::wstring(L" ").append(options));
+}
+
+CommandTemplate::Variables MakeCommandVariables(const std::wstring& dirPath, const std::wstring& exeFullPath)
+{
+	const uint64_t MegaByte = 1024 * 1024;
+	const HardwareInfo hardware = HardwareInfo::Query();
+
+	CommandTemplate::Variables variables;
+	variables[DirPathVariable] = CommandTemplate::MakeConstant(dirPath);
+	variables[CurrentAppPathVariable] = CommandTemplate::MakeConstant(exeFullPath);
+	variables[MemTotalVariable] = CommandTemplate::MakeConstant(std::to_wstring(hardware.GetEffectiveMemory() / MegaByte));
+	variables[MemAvailableVariable] = CommandTemplate::MakeConstant(std::to_wstring(hardware.availableMemory / MegaByte));
+	variables[CpusVariable] = CommandTemplate::MakeConstant(std::to_wstring(hardware.GetEffectiveCpus()));
+	variables[LogicalCpusVariable] = CommandTemplate::MakeConstant(std::to_wstring(hardware.logicalCpus));
+	variables[PhysicalCpusVariable] = CommandTemplate::MakeConstant(std::to_wstring(hardware.physicalCpus));
+	variables[JobCpuLimitVariable] = CommandTemplate::MakeConstant(std::to_wstring(hardware.cpuLimit));
+	variables[JobMemLimitVariable] = CommandTemplate::MakeConstant(std::to_wstring(hardware.memoryLimit / MegaByte));
+
+	// COMMENT: <mem_pct:N> is N percent of the memory available to the job, in the JVM size format, for example 2048m.
+	const uint64_t effectiveMemory = hardware.GetEffectiveMemory();
+	variables[MemPercentVariable] = [effectiveMemory](const std::wstring& argument, std::wstring& value)
 	{
-		EnumParam param;
-		param.pid = pInfo.dwProcessId;
-		EnumWindows(EnumWindowsCallback, (LONG_PTR)&param);
-		if (param.visibleWindowExist)
+		value.clear();
+
+		unsigned long percent = 0;
+		try
 		{
-			nana::API::exit_all();
-			WaitForSingleObject(pInfo.hProcess, INFINITE);
-			break;
+			size_t pos = 0;
+			percent = std::stoul(argument, &pos);
+			if (pos != argument.size())
+			{
+				percent = 0;
+			}
+		}
+		catch (const std::exception&)
+		{
+			percent = 0;
 		}
 
-		if (WaitForSingleObject(pInfo.hProcess, timeoutMs) != WAIT_TIMEOUT)
+		if (percent == 0 || percent > 100)
 		{
-			nana::API::exit_all();
-			break;
+			return Error(L"percent must be a number from 1 to 100");
 		}
-	}
 
-	GetExitCodeProcess(pInfo.hProcess, &exitCode);
+		if (effectiveMemory == 0)
+		{
+			return Error(L"can not determine memory size");
+		}
 
-	CloseHandle(pInfo.hProcess);
-	CloseHandle(pInfo.hThread);
-	CloseHandle(hStdout);
+		value = std::to_wstring(effectiveMemory * percent / 100 / MegaByte).append(L"m");
+		return Error();
+	};
 
-	return Error();
+	return variables;
 }
 
-Error RunJavaInstaller(const std::wstring& installationDir, const std::wstring& exeFullPath, DWORD& exitCode)
+// COMMENT: appCds is optional, when it is set the command line uses its stable installation path and archive options.
+Error PrepareCommand(const std::wstring& installationDir, const std::wstring& exeFullPath, AppCds* appCds, std::wstring& cmdLine, std::wstring& workingDir)
 {
-	std::wstring cmdLine = PackageManager::GetStringResource(ParamType, CmdLineName);
-	std::wstring workingDir = PackageManager::GetStringResource(ParamType, WorkingDirName);
+	cmdLine.clear();
+	workingDir.clear();
+
+	const std::wstring cmdLineTemplate = PackageManager::GetStringResource(ParamType, CmdLineName);
+	const std::wstring workingDirTemplate = PackageManager::GetStringResource(ParamType, WorkingDirName);
 
-	if (cmdLine.empty())
+	if (cmdLineTemplate.empty())
 	{
 		return Error(L"cmd_line not found in resource");
 	}
 
-	boost::replace_all(cmdLine, DirPath, installationDir);
-	boost::replace_all(cmdLine, CurrentAppPath, exeFullPath);
+	std::wstring dirPath = installationDir;
+
+	if (appCds != nullptr)
+	{
+		// COMMENT: without a class data sharing archive the JVM just starts slower, so errors are not fatal.
+		std::wstring payloadDir;
+		if (PayloadCache::GetPayloadDir(payloadDir).Succeeded() && appCds->Prepare(payloadDir, installationDir).Succeeded())
+		{
+			dirPath = appCds->GetInstallationDir();
+		}
+	}
+
+	const CommandTemplate::Variables variables = MakeCommandVariables(dirPath, exeFullPath);
+
+	CommandTemplate compiledTemplate;
+	compiledTemplate.Compile(cmdLineTemplate);
+
+	Error err = compiledTemplate.Expand(variables, cmdLine);
+	if (!err.Succeeded())
+	{
+		return err;
+	}
 
-	boost::replace_all(workingDir, DirPath, installationDir);
+	compiledTemplate.Compile(workingDirTemplate);
 
-	return ExecuteProcess(cmdLine, workingDir, exitCode);
+	err = compiledTemplate.Expand(variables, workingDir);
+	if (!err.Succeeded())
+	{
+		return err;
+	}
+
+	// COMMENT: the archive is chosen by the expanded command line, which names the java binary and the class path.
+	const std::wstring jvmOptions = appCds != nullptr ? appCds->GetJvmOptions(cmdLine) : std::wstring();
+	if (!jvmOptions.empty())
+	{
+		InsertJvmOptions(cmdLine, jvmOptions);
+	}
+
+	return Error();
 }
 
-void RemoveFolder(const std::wstring& dir_)
+Error RunJavaInstaller(const LaunchContext& context, const std::wstring& installationDir, const std::wstring& exeFullPath, DWORD& exitCode)
 {
-	// COMMENT:  Path must be double-null terminated.
-	std::wstring dir(dir_);
-	dir.push_back(L'\0');
-
-	_SHFILEOPSTRUCTW	param = {
-		NULL,
-		FO_DELETE,
-		dir.c_str(),
-		NULL,
-		FOF_SILENT | FOF_NOCONFIRMATION | FOF_NOERRORUI,
-		FALSE,
-		NULL,
-		NULL
-	};
+	exitCode = ERROR_SUCCESS;
+
+	AppCds appCds;
+	const bool useAppCds = PackageManager::GetFlagResource(ParamType, AppCdsName);
 
-	SHFileOperationW(&param);
+	std::wstring cmdLine;
+	std::wstring workingDir;
+	Error err = PrepareCommand(installationDir, exeFullPath, useAppCds ? &appCds : nullptr, cmdLine, workingDir);
+	if (!err.Succeeded())
+	{
+		return err;
+	}
+
+	// COMMENT: like class data sharing, checkpoint/restore only speeds the start up, so errors are not fatal.
+	Crac crac;
+	std::wstring payloadDir;
+	const bool useCrac = Crac::IsSupported() && PackageManager::GetFlagResource(ParamType, CracName) && PayloadCache::GetPayloadDir(payloadDir).Succeeded()
+		&& crac.Prepare(payloadDir, cmdLine).Succeeded();
+
+	// COMMENT: a profiling run for the patcher, a failed capture does not stop the application.
+	AccessProfile accessProfile;
+	const std::wstring profilePath = AccessProfile::GetRequestedPath();
+	bool profiling = false;
+	if (!profilePath.empty())
+	{
+		const Error profileErr = accessProfile.Start(installationDir);
+		profiling = profileErr.Succeeded();
+		if (!profiling)
+		{
+			ReportProgress(context, std::wstring(L"can not capture access profile: ").append(profileErr.getMessage()));
+		}
+	}
+
+	for (;;)
+	{
+		std::wstring launchCmdLine = cmdLine;
+		const std::wstring cracOptions = useCrac ? crac.GetJvmOptions() : std::wstring();
+		if (!cracOptions.empty())
+		{
+			InsertJvmOptions(launchCmdLine, cracOptions);
+		}
+
+		ReportProgress(context, std::wstring(L"starting ").append(launchCmdLine));
+
+		ChildProcess::State state;
+		err = ExecuteProcess(context, launchCmdLine, workingDir, state, exitCode);
+		if (!err.Succeeded() || !useCrac || !crac.Continue(state, exitCode))
+		{
+			break;
+		}
+	}
+
+	appCds.Finish();
+
+	if (profiling)
+	{
+		const Error profileErr = accessProfile.Stop(profilePath);
+		ReportProgress(context, profileErr.Succeeded() ? std::wstring(L"access profile written to ").append(profilePath)
+			: std::wstring(L"can not write access profile: ").append(profileErr.getMessage()));
+	}
+
+	return err;
 }
 
-void ShowSplashWindow(HANDLE& hSplashInitializedEvent)
+void ShowSplashWindow(HANDLE& hSplashInitializedEvent, SplashScheduler& scheduler, ProgressChannel& progressChannel)
 {
+	Trace::Scope traceScope("ShowSplashWindow");
+
 	using namespace nana;
 
 	// appearance(bool has_decoration, bool taskbar, bool floating, bool no_activate, bool min, bool max, bool sizable)
@@ -183,12 +412,57 @@ void ShowSplashWindow(HANDLE& hSplashInitializedEvent)
 		fset.push_back(std::move(img));
 	}
 
-	animation ani(30);
+	animation ani(SplashScheduler::FullFps);
 	ani.push_back(fset);
 	ani.output(fm, nana::point(282, 242));
 	ani.looped(true);
 	ani.play();
 
+	timer fpsTimer;
+	fpsTimer.interval(SplashScheduler::SampleIntervalMs);
+	fpsTimer.elapse([&ani, &scheduler]()
+	{
+		const size_t fps = scheduler.NextFps();
+		if (fps != ani.fps())
+		{
+			ani.fps(fps);
+		}
+	});
+	fpsTimer.start();
+
+	progress progressBar(fm, rectangle{ 0, 396, 600, 4 });
+	progressBar.amount(ProgressAmount);
+
+	timer progressTimer;
+	progressTimer.interval(ProgressIntervalMs);
+	progressTimer.elapse([&fm, &ani, &fpsTimer, &progressTimer, &progressBar, &progressChannel]()
+	{
+		ProgressEvent event;
+		if (!progressChannel.TryTake(event))
+		{
+			return;
+		}
+
+		if (event.phase == ProgressEvent::Phase::Failed)
+		{
+			// COMMENT: the box is modal, the timers are stopped first so they do not fire under it.
+			progressTimer.stop();
+			fpsTimer.stop();
+			ani.pause();
+			MessageBoxW(reinterpret_cast<HWND>(fm.native_handle()), event.message.c_str(), L"Error", MB_OK | MB_ICONERROR);
+			API::exit_all();
+		}
+		else if (event.phase == ProgressEvent::Phase::Launching)
+		{
+			progressBar.value(ProgressAmount);
+		}
+		else if (event.phase == ProgressEvent::Phase::Unpacking && event.bytesTotal > 0)
+		{
+			progressBar.value(static_cast<unsigned>(event.bytesDone * ProgressAmount / event.bytesTotal));
+		}
+	});
+	progressTimer.start();
+
 	nana::paint::image img;
 	img.open(&background[0], background.size());
 	drawing dw(fm);
@@ -208,83 +482,521 @@ void ShowSplashWindow(HANDLE& hSplashInitializedEvent)
 	fm.collocate();
 	fm.show();
 
+	Trace::Instant("splash shown");
 	SetEvent(hSplashInitializedEvent);
 	nana::exec();
 }
 
-void ExecuteChildProcess(Error& result, DWORD& exitCode, HANDLE& hSplashInitializedEvent)
+bool IsDirectory(const std::wstring& path)
+{
+	const DWORD attributes = GetFileAttributesW(path.c_str());
+	return attributes != INVALID_FILE_ATTRIBUTES && (attributes & FILE_ATTRIBUTE_DIRECTORY) != 0;
+}
+
+// COMMENT: unpacks the payload once into the persistent cache, for launches that need the same installation path every run.
+Error InstallCachedPayload(ProgressChannel* progressChannel, std::wstring& installationDir)
+{
+	installationDir.clear();
+
+	std::wstring payloadDir;
+	Error err = PayloadCache::GetPayloadDir(payloadDir);
+	if (!err.Succeeded())
+	{
+		return err;
+	}
+
+	const std::wstring installedDir = std::wstring(payloadDir).append(L"\\").append(InstalledDirName);
+	if (IsDirectory(installedDir))
+	{
+		installationDir = installedDir;
+		return Error();
+	}
+
+	// COMMENT: concurrent executors install one after another, the later ones find the installed directory.
+	FileLock lock;
+	err = lock.Lock(std::wstring(installedDir).append(L".lock"));
+	if (!err.Succeeded())
+	{
+		return err;
+	}
+
+	if (IsDirectory(installedDir))
+	{
+		installationDir = installedDir;
+		return Error();
+	}
+
+	// COMMENT: the payload is unpacked next to its final place and renamed, so a half unpacked directory is never used.
+	// An interrupted extraction is continued by the next launch from its journal.
+	const std::wstring stagingDir = std::wstring(installedDir).append(L".partial");
+	err = PackageManager::ResumeZipResource(stagingDir, progressChannel);
+	if (!err.Succeeded())
+	{
+		return err;
+	}
+
+	err = File::Move(stagingDir, installedDir);
+	if (!err.Succeeded())
+	{
+		return err;
+	}
+
+	installationDir = installedDir;
+	return Error();
+}
+
+enum class InstallationMode
+{
+	// COMMENT: a fresh temp directory per run.
+	PerRun,
+	// COMMENT: one temp directory for concurrent runs of the same payload.
+	Shared,
+	// COMMENT: the persistent cache, the same path every run.
+	Cached,
+	// COMMENT: a private per-run copy of the persistent cache.
+	Cloned
+};
+
+InstallationMode GetInstallationMode()
+{
+	// COMMENT: a restored process reopens its files by the paths they had at checkpoint, so checkpoint/restore
+	// needs the persistent cache. Where it is not supported the flag is ignored.
+	if (Crac::IsSupported() && PackageManager::GetFlagResource(ParamType, CracName))
+	{
+		return InstallationMode::Cached;
+	}
+
+	if (PackageManager::GetFlagResource(ParamType, CloneName))
+	{
+		return InstallationMode::Cloned;
+	}
+
+	if (PackageManager::GetFlagResource(ParamType, SharedExtractionName))
+	{
+		return InstallationMode::Shared;
+	}
+
+	return InstallationMode::PerRun;
+}
+
+Error CloneCachedPayload(const LaunchContext& context, std::wstring& installationDir)
+{
+	installationDir.clear();
+
+	std::wstring cachedDir;
+	Error err = InstallCachedPayload(context.progressChannel, cachedDir);
+	if (!err.Succeeded())
+	{
+		return err;
+	}
+
+	std::wstring cloneDir;
+	err = Error(Path::GetTempDirPath(TmpPrefix, cloneDir));
+	if (!err.Succeeded())
+	{
+		return err;
+	}
+
+	TreeClone::Stats stats;
+	err = TreeClone::Clone(cachedDir, cloneDir, stats);
+	if (!err.Succeeded())
+	{
+		Cleanup::Remove(cloneDir);
+		return err;
+	}
+
+	std::wstring msg;
+	msg.append(L"cloned to ").append(cloneDir).append(L": ").append(std::to_wstring(stats.cloned)).append(L" cloned, ")
+		.append(std::to_wstring(stats.hardlinked)).append(L" hardlinked, ").append(std::to_wstring(stats.copied)).append(L" copied");
+	ReportProgress(context, msg);
+
+	installationDir = std::move(cloneDir);
+	return Error();
+}
+
+Error UnpackAndRun(const LaunchContext& context, DWORD& exitCode)
+{
+	exitCode = ERROR_SUCCESS;
+
+	std::wstring exeFullPath;
+	Error err = Path::GetApplicationFilePath(exeFullPath);
+	if (!err.Succeeded())
+	{
+		return err;
+	}
+
+	const InstallationMode mode = GetInstallationMode();
+
+	std::wstring installationDir;
+	SharedExtraction sharedExtraction;
+	switch (mode)
+	{
+	case InstallationMode::Cached:
+		ReportProgress(context, L"unpacking to the payload cache");
+		err = InstallCachedPayload(context.progressChannel, installationDir);
+		break;
+	case InstallationMode::Cloned:
+		ReportProgress(context, L"cloning the payload cache");
+		err = CloneCachedPayload(context, installationDir);
+		break;
+	case InstallationMode::Shared:
+		ReportProgress(context, L"waiting for the shared extraction");
+		err = sharedExtraction.Acquire(context.progressChannel, installationDir);
+		break;
+	case InstallationMode::PerRun:
+		err = Error(Path::GetTempDirPath(TmpPrefix, installationDir));
+		if (!err.Succeeded())
+		{
+			return err;
+		}
+
+		ReportProgress(context, std::wstring(L"unpacking to ").append(installationDir));
+		err = PackageManager::UnpackZipResource(installationDir, context.progressChannel);
+		break;
+	}
+
+	if (!err.Succeeded())
+	{
+		PublishFailure(context, err);
+		return err;
+	}
+
+	PublishPhase(context, ProgressEvent::Phase::Launching);
+
+	if (context.splashScheduler != nullptr)
+	{
+		context.splashScheduler->SetPhase(SplashScheduler::Phase::Launching);
+	}
+
+	err = RunJavaInstaller(context, installationDir, exeFullPath, exitCode);
+
+	if (mode == InstallationMode::Shared)
+	{
+		sharedExtraction.Release();
+	}
+	else if (mode == InstallationMode::PerRun || mode == InstallationMode::Cloned)
+	{
+		// COMMENT: the directory is deleted in the background, so the executor exits as soon as the child does.
+		ReportProgress(context, std::wstring(L"removing ").append(installationDir));
+		Cleanup::Remove(installationDir);
+	}
+
+	return err;
+}
+
+void ExecuteChildProcess(Error& result, DWORD& exitCode, HANDLE& hSplashInitializedEvent, const LaunchContext& context)
 {
+	Trace::Scope traceScope("ExecuteChildProcess");
+
 	result = Error();
 	exitCode = ERROR_SUCCESS;
 
 	WaitForSingleObject(hSplashInitializedEvent, INFINITE);
 
-	BOOST_SCOPE_EXIT(void)
+	// COMMENT: after a failed unpacking the splash closes itself once the user has seen the error.
+	BOOST_SCOPE_EXIT(&context)
 	{
-		nana::API::exit_all();
+		if (context.splashScheduler->GetPhase() != SplashScheduler::Phase::Failed)
+		{
+			nana::API::exit_all();
+		}
 	} BOOST_SCOPE_EXIT_END
 
+	result = UnpackAndRun(context, exitCode);
+}
+
+Error RunWithSplash(LaunchContext& context, DWORD& exitCode)
+{
+	exitCode = ERROR_SUCCESS;
+
+	HANDLE hSplashInitializedEvent = CreateEvent(NULL, FALSE, FALSE, NULL);
+	if (hSplashInitializedEvent == NULL)
+	{
+		return Error(GetLastError());
+	}
+
+	Error error;
+	SplashScheduler scheduler;
+	ProgressChannel progressChannel;
+	context.splashScheduler = &scheduler;
+	context.progressChannel = &progressChannel;
+	std::thread executeThread(ExecuteChildProcess, std::ref(error), std::ref(exitCode), std::ref(hSplashInitializedEvent), std::cref(context));
+
+	ShowSplashWindow(hSplashInitializedEvent, scheduler, progressChannel);
+
+	if (executeThread.joinable())
+	{
+		executeThread.join();
+	}
+
+	context.errorShown = scheduler.GetPhase() == SplashScheduler::Phase::Failed;
+	context.splashScheduler = nullptr;
+	context.progressChannel = nullptr;
+	CloseHandle(hSplashInitializedEvent);
+
+	return error;
+}
+
+Error StartDaemon(const std::wstring& pipeName)
+{
 	std::wstring exeFullPath;
 	Error err = Path::GetApplicationFilePath(exeFullPath);
 	if (!err.Succeeded())
 	{
-		result = err;
-		return;
+		return err;
 	}
 
-	std::wstring tempDir;
-	err = Error(Path::GetTempDirPath(TmpPrefix, tempDir));
+	std::wstring installationDir;
+	err = InstallCachedPayload(nullptr, installationDir);
 	if (!err.Succeeded())
 	{
-		result = err;
-		return;
+		return err;
 	}
 
-	err = PackageManager::UnpackZipResource(tempDir);
+	// COMMENT: the host outlives the executor, so the class data sharing slots that are held per run are not used.
+	std::wstring cmdLine;
+	std::wstring workingDir;
+	err = PrepareCommand(installationDir, exeFullPath, nullptr, cmdLine, workingDir);
 	if (!err.Succeeded())
 	{
-		result = err;
+		return err;
+	}
+
+	std::wstring idleSeconds = PackageManager::GetStringResource(ParamType, DaemonIdleName);
+	if (idleSeconds.empty())
+	{
+		idleSeconds = DefaultDaemonIdleSeconds;
+	}
+
+	// COMMENT: an inherited copy of our stdout would keep the caller waiting for end of output until the host exits.
+	const DWORD stdHandles[] = { STD_INPUT_HANDLE, STD_OUTPUT_HANDLE, STD_ERROR_HANDLE };
+	for (const DWORD stdHandle : stdHandles)
+	{
+		const HANDLE handle = GetStdHandle(stdHandle);
+		if (handle != NULL && handle != INVALID_HANDLE_VALUE)
+		{
+			SetHandleInformation(handle, HANDLE_FLAG_INHERIT, 0);
+		}
+	}
+
+	ChildProcess::Environment environment;
+	environment.emplace_back(DaemonClient::PipeVariable, pipeName);
+	environment.emplace_back(DaemonClient::IdleTimeoutVariable, idleSeconds);
+
+	ChildProcess host;
+	err = host.Start(cmdLine, workingDir, NULL, environment);
+	if (!err.Succeeded())
+	{
+		return err;
+	}
+
+	// COMMENT: the host signals readiness once it listens on the pipe. If it exits instead, another host
+	// may have taken the pipe first, so the caller just tries to connect.
+	ChildProcess::State state;
+	return host.WaitReady(state);
+}
+
+void GetForwardedArguments(std::vector<std::wstring>& arguments)
+{
+	arguments.clear();
+
+	// COMMENT: main receives arguments in the ANSI code page, the wide command line keeps them intact.
+	int count = 0;
+	wchar_t** argv = CommandLineToArgvW(GetCommandLineW(), &count);
+	if (argv == NULL)
+	{
 		return;
 	}
 
-	result = RunJavaInstaller(tempDir, exeFullPath, exitCode);
-	RemoveFolder(tempDir);
+	const std::wstring headlessArg(HeadlessArg.begin(), HeadlessArg.end());
+	for (int i = 1; i < count; i++)
+	{
+		if (headlessArg != argv[i])
+		{
+			arguments.push_back(argv[i]);
+		}
+	}
+
+	LocalFree(argv);
 }
 
-int main(int /*argc*/, char** /*argv*/)
+Error RunDaemon(DWORD& exitCode)
 {
-	HANDLE hSplashInitializedEvent = CreateEvent(NULL, FALSE, FALSE, NULL);
-	if (hSplashInitializedEvent == NULL)
+	exitCode = ERROR_SUCCESS;
+
+	std::wstring payloadHash;
+	Error err = PackageManager::GetPayloadHash(payloadHash);
+	if (!err.Succeeded())
+	{
+		return err;
+	}
+
+	const std::wstring pipeName = DaemonClient::MakePipeName(payloadHash);
+
+	DaemonClient client;
+	bool connected = false;
+	err = client.Connect(pipeName, connected);
+	if (err.Succeeded() && !connected)
+	{
+		err = StartDaemon(pipeName);
+		if (err.Succeeded())
+		{
+			err = client.Connect(pipeName, connected);
+		}
+
+		if (err.Succeeded() && !connected)
+		{
+			err = Error(L"daemon exited before accepting connections");
+		}
+	}
+
+	if (!err.Succeeded())
+	{
+		return err;
+	}
+
+	std::vector<std::wstring> arguments;
+	GetForwardedArguments(arguments);
+
+	wchar_t currentDir[MAX_PATH + 1];
+	const DWORD currentDirLen = GetCurrentDirectoryW(MAX_PATH + 1, currentDir);
+	if (currentDirLen == 0 || currentDirLen > MAX_PATH)
 	{
-		ShowError(Error(GetLastError()));
+		return Error(GetLastError());
+	}
+
+	uint32_t daemonExitCode = ERROR_SUCCESS;
+	err = client.Run(arguments, currentDir, daemonExitCode);
+	exitCode = daemonExitCode;
+
+	return err;
+}
+
+bool HasArgument(int argc, char** argv, const std::string& arg)
+{
+	for (int i = 1; i < argc; i++)
+	{
+		if (arg == argv[i])
+		{
+			return true;
+		}
+	}
+
+	return false;
+}
+
+bool IsHeadless(int argc, char** argv)
+{
+	return HasArgument(argc, argv, HeadlessArg) || PackageManager::GetFlagResource(ParamType, HeadlessName);
+}
+
+bool IsTraceRequested()
+{
+	wchar_t value[2];
+	const DWORD len = GetEnvironmentVariableW(Trace::EnableVariable, value, 2);
+	return (len == 1 && value[0] != L'0') || PackageManager::GetFlagResource(ParamType, TraceName);
+}
+
+// COMMENT: the trace is written next to the stdout log when main returns, after the span of main is closed.
+struct TraceSession
+{
+	TraceSession()
+	{
+		if (IsTraceRequested())
+		{
+			Trace::Enable();
+		}
+	}
+
+	~TraceSession()
+	{
+		if (Trace::IsEnabled())
+		{
+			Trace::Write(Path::GetStdoutFilePath(std::wstring(TmpPrefix).append(L"trace.json")));
+		}
+	}
+};
+
+// COMMENT: the report is written next to the stdout log and printed, a customer can run it from a console or a shortcut.
+int RunDiagnostics()
+{
+	AttachStdStreams();
+
+	const std::wstring reportPath = Path::GetStdoutFilePath(std::wstring(TmpPrefix).append(L"diagnostics.txt"));
+	std::wstring report;
+	Error err = Diagnostics::Run(reportPath, report);
+	if (!err.Succeeded())
+	{
+		WriteLine(stderr, err.getMessage());
 		return EXIT_FAILURE;
 	}
 
-	Error error;
-	DWORD exitCode = ERROR_SUCCESS;
-	std::thread executeThread(ExecuteChildProcess, std::ref(error), std::ref(exitCode), std::ref(hSplashInitializedEvent));
+	WriteLine(stdout, report);
+	WriteLine(stdout, std::wstring(L"report saved to ").append(reportPath));
+	return EXIT_SUCCESS;
+}
+
+int main(int argc, char** argv)
+{
+	if (HasArgument(argc, argv, Cleanup::SweepArg))
+	{
+		Cleanup::Sweep();
+		return EXIT_SUCCESS;
+	}
 
-	ShowSplashWindow(hSplashInitializedEvent);
+	Cleanup::SweepInBackground();
 
-	if (executeThread.joinable())
+	TraceSession traceSession;
+	Trace::Scope traceScope("main");
+
+	if (HasArgument(argc, argv, Diagnostics::Arg))
 	{
-		executeThread.join();
+		return RunDiagnostics();
 	}
 
-	CloseHandle(hSplashInitializedEvent);
+	LaunchContext context;
+	context.headless = IsHeadless(argc, argv);
+	context.daemon = PackageManager::GetFlagResource(ParamType, DaemonName);
+
+	Error error;
+	DWORD exitCode = ERROR_SUCCESS;
+	if (context.daemon)
+	{
+		// COMMENT: repeated invocations are served by a warm host, there is nothing to show a splash for.
+		context.headless = true;
+		AttachStdStreams();
+		error = RunDaemon(exitCode);
+	}
+	else if (context.headless)
+	{
+		AttachStdStreams();
+		error = UnpackAndRun(context, exitCode);
+	}
+	else
+	{
+		error = RunWithSplash(context, exitCode);
+	}
 
 	if (!error.Succeeded())
 	{
-		ShowError(error);
+		if (!context.errorShown)
+		{
+			ShowError(context, error);
+		}
 		return EXIT_FAILURE;
 	}
 	else if (exitCode != ERROR_SUCCESS)
 	{
-		std::wstring msg;
-		msg.append(L"child process failed, error = ").append(Error(exitCode).getMessage());
-		ShowError(Error(std::move(msg)));
+		// COMMENT: a script or a daemon client gets the exit code of java as is, the failure is on java's own output.
+		if (!context.headless)
+		{
+			std::wstring msg;
+			msg.append(L"child process failed, error = ").append(Error(exitCode).getMessage());
+			ShowError(context, Error(std::move(msg)));
+		}
 		return exitCode;
 	}
 
+	ReportProgress(context, L"done");
 	return EXIT_SUCCESS;
 }
\ No newline at end of file
@@ -0,0 +1,411 @@
+#include "OutputCapture.h"
+#include <algorithm>
+#include <chrono>
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <cerrno>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+
+const size_t ReadChunkSize = 16 * 1024;
+const unsigned CancelPollIntervalMs = 100;
+
+#ifdef _WIN32
+const ChildProcess::NativeHandle InvalidNativeHandle = NULL;
+#else
+const ChildProcess::NativeHandle InvalidNativeHandle = -1;
+#endif
+
+Error CreatePipe(ChildProcess::NativeHandle& readHandle, ChildProcess::NativeHandle& writeHandle)
+{
+#ifdef _WIN32
+	SECURITY_ATTRIBUTES sa;
+	sa.nLength = sizeof(sa);
+	sa.lpSecurityDescriptor = NULL;
+	sa.bInheritHandle = TRUE;
+
+	if (!::CreatePipe(&readHandle, &writeHandle, &sa, 0))
+	{
+		readHandle = writeHandle = NULL;
+		return Error(GetLastError());
+	}
+
+	// COMMENT: only the write end is inherited by the child.
+	SetHandleInformation(readHandle, HANDLE_FLAG_INHERIT, 0);
+	return Error();
+#else
+	int fds[2];
+	if (pipe2(fds, O_CLOEXEC) != 0)
+	{
+		readHandle = writeHandle = -1;
+		return Error::makeByErrno(errno);
+	}
+
+	// COMMENT: the child gets the write end through dup2, which clears O_CLOEXEC.
+	readHandle = fds[0];
+	writeHandle = fds[1];
+	return Error();
+#endif
+}
+
+void CloseNativeHandle(ChildProcess::NativeHandle& handle)
+{
+	if (handle != InvalidNativeHandle)
+	{
+#ifdef _WIN32
+		CloseHandle(handle);
+#else
+		close(handle);
+#endif
+		handle = InvalidNativeHandle;
+	}
+}
+
+} // namespace
+
+OutputCapture::OutputCapture()
+	: readHandle(InvalidNativeHandle)
+	, writeHandle(InvalidNativeHandle)
+	, cancelRequested(false)
+{
+}
+
+OutputCapture::~OutputCapture()
+{
+	Stop();
+}
+
+Error OutputCapture::Start(const std::wstring& logPath_, const Options& options_)
+{
+	Stop();
+
+	options = options_;
+	logPath = logPath_;
+	ring.assign(options.bufferSize, 0);
+	ringHead = 0;
+	ringSize = 0;
+	endOfStream = false;
+	cancelRequested = false;
+	writeError = Error();
+	logFileOpened = false;
+	segmentSize = 0;
+
+	RemoveSegments();
+
+	Error err = CreatePipe(readHandle, writeHandle);
+	if (!err.Succeeded())
+	{
+		return err;
+	}
+
+	readerThread = std::thread(&OutputCapture::ReadLoop, this);
+	writerThread = std::thread(&OutputCapture::WriteLoop, this);
+	return Error();
+}
+
+ChildProcess::NativeHandle OutputCapture::GetChildHandle() const
+{
+	return writeHandle;
+}
+
+void OutputCapture::OnChildStarted()
+{
+	CloseNativeHandle(writeHandle);
+}
+
+Error OutputCapture::Stop()
+{
+	// COMMENT: if the child was never started the write end is still open and the reader would never see end of stream.
+	CloseNativeHandle(writeHandle);
+
+	if (readerThread.joinable())
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		if (!streamClosed.wait_for(lock, std::chrono::milliseconds(options.drainTimeoutMs), [this]() { return endOfStream; }))
+		{
+			lock.unlock();
+			CancelRead();
+		}
+		else
+		{
+			lock.unlock();
+		}
+
+		readerThread.join();
+	}
+
+	if (writerThread.joinable())
+	{
+		writerThread.join();
+	}
+
+	if (compressorThread.joinable())
+	{
+		compressorThread.join();
+	}
+
+	CloseNativeHandle(readHandle);
+	logFile.Close();
+	logFileOpened = false;
+
+	return writeError;
+}
+
+void OutputCapture::ReadLoop()
+{
+	std::vector<uint8_t> chunk(ReadChunkSize);
+	while (!cancelRequested)
+	{
+		size_t readCount = 0;
+		if (!ReadPipe(&chunk[0], chunk.size(), readCount) || readCount == 0)
+		{
+			break;
+		}
+
+		// COMMENT: the ring is bounded, when the disk falls behind the reader waits and the pipe applies backpressure to the child.
+		size_t offset = 0;
+		while (offset < readCount)
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			spaceAvailable.wait(lock, [this]() { return ringSize < ring.size(); });
+
+			const size_t tail = (ringHead + ringSize) % ring.size();
+			const size_t space = ring.size() - tail < ring.size() - ringSize ? ring.size() - tail : ring.size() - ringSize;
+			const size_t count = readCount - offset < space ? readCount - offset : space;
+			std::copy(chunk.begin() + offset, chunk.begin() + offset + count, ring.begin() + tail);
+			ringSize += count;
+			offset += count;
+
+			if (ringSize >= options.batchSize)
+			{
+				dataAvailable.notify_one();
+			}
+		}
+	}
+
+	std::lock_guard<std::mutex> lock(mutex);
+	endOfStream = true;
+	dataAvailable.notify_one();
+	streamClosed.notify_all();
+}
+
+void OutputCapture::WriteLoop()
+{
+	std::vector<uint8_t> batch;
+	batch.reserve(options.batchSize);
+
+	for (;;)
+	{
+		bool finished = false;
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			dataAvailable.wait_for(lock, std::chrono::milliseconds(options.flushIntervalMs), [this]()
+			{
+				return endOfStream || ringSize >= options.batchSize;
+			});
+
+			const size_t count = ringSize < options.batchSize ? ringSize : options.batchSize;
+			const size_t firstPart = count < ring.size() - ringHead ? count : ring.size() - ringHead;
+			batch.assign(ring.begin() + ringHead, ring.begin() + ringHead + firstPart);
+			batch.insert(batch.end(), ring.begin(), ring.begin() + (count - firstPart));
+			ringHead = (ringHead + count) % ring.size();
+			ringSize -= count;
+
+			finished = endOfStream && ringSize == 0;
+		}
+		spaceAvailable.notify_one();
+
+		if (!batch.empty() && writeError.Succeeded())
+		{
+			writeError = WriteBatch(batch);
+		}
+
+		if (finished)
+		{
+			break;
+		}
+	}
+}
+
+Error OutputCapture::WriteBatch(const std::vector<uint8_t>& batch)
+{
+	if (segmentSize > 0 && segmentSize + batch.size() > options.maxSegmentSize)
+	{
+		Error err = Rotate();
+		if (!err.Succeeded())
+		{
+			return err;
+		}
+	}
+
+	if (!logFileOpened)
+	{
+		Error err = logFile.OpenWrite(logPath);
+		if (!err.Succeeded())
+		{
+			return err;
+		}
+		logFileOpened = true;
+	}
+
+	Error err = logFile.Write(&batch[0], static_cast<uint32_t>(batch.size()));
+	if (!err.Succeeded())
+	{
+		return err;
+	}
+
+	segmentSize += batch.size();
+	return Error();
+}
+
+Error OutputCapture::Rotate()
+{
+	logFile.Close();
+	logFileOpened = false;
+
+	if (compressorThread.joinable())
+	{
+		compressorThread.join();
+	}
+
+	if (options.maxSegments > 0)
+	{
+		File::Delete(GetSegmentPath(options.maxSegments, false));
+		File::Delete(GetSegmentPath(options.maxSegments, true));
+
+		for (unsigned index = options.maxSegments; index > 1; index--)
+		{
+			File::Move(GetSegmentPath(index - 1, false), GetSegmentPath(index, false));
+			File::Move(GetSegmentPath(index - 1, true), GetSegmentPath(index, true));
+		}
+
+		const std::wstring rotatedPath = GetSegmentPath(1, false);
+		Error err = File::Move(logPath, rotatedPath);
+		if (!err.Succeeded())
+		{
+			return err;
+		}
+
+		if (options.compressSegment)
+		{
+			compressorThread = std::thread(&OutputCapture::CompressSegment, this, rotatedPath);
+		}
+	}
+	else
+	{
+		File::Delete(logPath);
+	}
+
+	segmentSize = 0;
+	return Error();
+}
+
+void OutputCapture::CompressSegment(const std::wstring& segmentPath)
+{
+	const size_t namePos = logPath.find_last_of(L"\\/");
+	const std::wstring entryName = namePos == std::wstring::npos ? logPath : logPath.substr(namePos + 1);
+	if (options.compressSegment(segmentPath, entryName, GetSegmentPath(1, true)).Succeeded())
+	{
+		File::Delete(segmentPath);
+	}
+}
+
+std::wstring OutputCapture::GetSegmentPath(unsigned index, bool compressed) const
+{
+	const size_t namePos = logPath.find_last_of(L"\\/");
+	const size_t extPos = logPath.find_last_of(L'.');
+
+	std::wstring path;
+	if (extPos == std::wstring::npos || (namePos != std::wstring::npos && extPos < namePos))
+	{
+		path = std::wstring(logPath).append(L".").append(std::to_wstring(index));
+	}
+	else
+	{
+		path = logPath.substr(0, extPos).append(L".").append(std::to_wstring(index)).append(logPath.substr(extPos));
+	}
+
+	if (compressed)
+	{
+		path.append(L".zip");
+	}
+
+	return path;
+}
+
+void OutputCapture::RemoveSegments()
+{
+	File::Delete(logPath);
+	for (unsigned index = 1; index <= options.maxSegments; index++)
+	{
+		File::Delete(GetSegmentPath(index, false));
+		File::Delete(GetSegmentPath(index, true));
+	}
+}
+
+void OutputCapture::CancelRead()
+{
+	cancelRequested = true;
+
+	// COMMENT: the reader may be just about to enter ReadFile, so cancellation is repeated until it leaves.
+	std::unique_lock<std::mutex> lock(mutex);
+	while (!endOfStream)
+	{
+#ifdef _WIN32
+		CancelSynchronousIo(readerThread.native_handle());
+#endif
+		streamClosed.wait_for(lock, std::chrono::milliseconds(CancelPollIntervalMs));
+	}
+}
+
+bool OutputCapture::ReadPipe(uint8_t* buffer, size_t size, size_t& readCount)
+{
+	readCount = 0;
+#ifdef _WIN32
+	DWORD dwRead = 0;
+	if (!ReadFile(readHandle, buffer, static_cast<DWORD>(size), &dwRead, NULL))
+	{
+		// COMMENT: ERROR_BROKEN_PIPE means all writers are closed.
+		return false;
+	}
+	readCount = dwRead;
+	return true;
+#else
+	while (!cancelRequested)
+	{
+		pollfd fd;
+		fd.fd = readHandle;
+		fd.events = POLLIN;
+		fd.revents = 0;
+
+		const int ready = poll(&fd, 1, CancelPollIntervalMs);
+		if (ready < 0 && errno != EINTR)
+		{
+			return false;
+		}
+		if (ready <= 0)
+		{
+			continue;
+		}
+
+		const ssize_t res = read(readHandle, buffer, size);
+		if (res < 0 && errno == EINTR)
+		{
+			continue;
+		}
+		if (res < 0)
+		{
+			return false;
+		}
+		readCount = static_cast<size_t>(res);
+		return true;
+	}
+	return false;
+#endif
+}
@@ -0,0 +1,94 @@
+#pragma once
+
+#include "Error.hpp"
+#include "ChildProcess.h"
+#include "File.h"
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+
+// COMMENT: owns the pipe that receives stdout/stderr of the child. A reader thread drains the pipe into a bounded
+// ring buffer, a writer thread flushes the buffer to the log file in batches and rotates the log by size.
+// Rotated segments are named <name>.1.<ext>, <name>.2.<ext>, ... and optionally zipped on a thread of their own,
+// so the writer goes on draining the pipe meanwhile. It waits for the previous segment only when segments fill
+// faster than they are compressed, as the segments are renamed on rotation.
+class OutputCapture
+{
+public:
+
+	struct Options
+	{
+		size_t bufferSize = 4 * 1024 * 1024;
+		size_t batchSize = 64 * 1024;
+		unsigned flushIntervalMs = 1000;
+		uint64_t maxSegmentSize = 16 * 1024 * 1024;
+		unsigned maxSegments = 4;
+		// COMMENT: compresses srcPath into zipPath, segments stay uncompressed when empty.
+		typedef std::function<Error(const std::wstring& srcPath, const std::wstring& entryName, const std::wstring& zipPath)> Compressor;
+		Compressor compressSegment;
+		// COMMENT: grandchildren may inherit the pipe and keep it open after the child exits.
+		unsigned drainTimeoutMs = 2000;
+	};
+
+	OutputCapture();
+	~OutputCapture();
+
+	OutputCapture(const OutputCapture&) = delete;
+	OutputCapture& operator=(const OutputCapture&) = delete;
+
+	Error Start(const std::wstring& logPath, const Options& options);
+
+	// COMMENT: inheritable write end of the pipe, valid between Start and OnChildStarted.
+	ChildProcess::NativeHandle GetChildHandle() const;
+
+	// COMMENT: closes the parent copy of the write end, so the reader sees end of stream when the child exits.
+	void OnChildStarted();
+
+	// COMMENT: waits until the child output is drained and written, returns the first write error.
+	// Reading is abandoned when the pipe stays open for drainTimeoutMs after the call.
+	Error Stop();
+
+private:
+
+	void ReadLoop();
+	void WriteLoop();
+	bool ReadPipe(uint8_t* buffer, size_t size, size_t& readCount);
+	void CancelRead();
+	Error WriteBatch(const std::vector<uint8_t>& batch);
+	Error Rotate();
+	void CompressSegment(const std::wstring& segmentPath);
+	std::wstring GetSegmentPath(unsigned index, bool compressed) const;
+	void RemoveSegments();
+
+private:
+
+	Options options;
+	std::wstring logPath;
+
+	ChildProcess::NativeHandle readHandle;
+	ChildProcess::NativeHandle writeHandle;
+
+	std::thread readerThread;
+	std::thread writerThread;
+	std::thread compressorThread;
+
+	std::mutex mutex;
+	std::condition_variable dataAvailable;
+	std::condition_variable spaceAvailable;
+	std::condition_variable streamClosed;
+	std::atomic<bool> cancelRequested;
+	std::vector<uint8_t> ring;
+	size_t ringHead = 0;
+	size_t ringSize = 0;
+	bool endOfStream = false;
+
+	File logFile;
+	bool logFileOpened = false;
+	uint64_t segmentSize = 0;
+	Error writeError;
+};
@@ -1,8 +1,15 @@
 #include "PackageManager.h"
 #include "Path.hpp"
 #include "ZipArchive.h"
+#include "ExtractionJournal.h"
+#include "Cleanup.h"
+#include "CpuFeatures.h"
+#include "Trace.h"
 #include"StringConverter.hpp"
 #include "ResourceParam.h"
+#include <cwchar>
+#include <map>
+#include <mutex>
 #include <Windows.h>
 
 #define DEF_LANG_NEUTRAL	L"0000"
@@ -68,6 +75,9 @@ struct UnpackParam
 {
 	Error err;
 	std::wstring destDir;
+	ProgressChannel* progressChannel = nullptr;
+	ExtractionJournal* journal = nullptr;
+	zip_archive::UnpackOptions options;
 };
 
 BOOL WINAPI UnpackZip(HMODULE hModule, const WCHAR* type, WCHAR* resName, LONG_PTR param)
@@ -100,7 +110,8 @@ BOOL WINAPI UnpackZip(HMODULE hModule, const WCHAR* type, WCHAR* resName, LONG_P
 	else
 	{
 		DWORD resSize = SizeofResource(NULL, hResource);
-		unpackParam->err = zip_archive::UnpackToFolder(static_cast<uint8_t*>(pResFile), resSize, unpackParam->destDir);
+		unpackParam->err = zip_archive::UnpackToFolder(static_cast<uint8_t*>(pResFile), resSize, unpackParam->destDir, unpackParam->progressChannel,
+			unpackParam->journal, unpackParam->options);
 		UnlockResource(pResFile);
 	}
 	FreeResource(hFileResource);
@@ -108,6 +119,87 @@ BOOL WINAPI UnpackZip(HMODULE hModule, const WCHAR* type, WCHAR* resName, LONG_P
 	return unpackParam->err.Succeeded() ? TRUE : FALSE;
 }
 
+struct HashParam
+{
+	Error err;
+	uint64_t hash = 14695981039346656037ULL;
+};
+
+BOOL WINAPI HashZip(HMODULE hModule, const WCHAR* type, WCHAR* resName, LONG_PTR param)
+{
+	HashParam* hashParam = (HashParam*)param;
+
+	HRSRC hResource = FindResourceW(NULL, resName, type);
+	if (hResource == NULL)
+	{
+		hashParam->err = Error(GetLastError());
+		return FALSE;
+	}
+
+	HGLOBAL hFileResource = LoadResource(NULL, hResource);
+	if (hFileResource == NULL)
+	{
+		hashParam->err = Error(GetLastError());
+		return FALSE;
+	}
+
+	void* pResFile = LockResource(hFileResource);
+	if (pResFile == NULL)
+	{
+		hashParam->err = Error(GetLastError());
+	}
+	else
+	{
+		DWORD resSize = SizeofResource(NULL, hResource);
+		hashParam->err = zip_archive::ComputeContentHash(static_cast<uint8_t*>(pResFile), resSize, hashParam->hash);
+		UnlockResource(pResFile);
+	}
+	FreeResource(hFileResource);
+
+	return hashParam->err.Succeeded() ? TRUE : FALSE;
+}
+
+struct DecompressParam
+{
+	Error err;
+	uint64_t entries = 0;
+	uint64_t bytes = 0;
+};
+
+BOOL WINAPI DecompressZip(HMODULE hModule, const WCHAR* type, WCHAR* resName, LONG_PTR param)
+{
+	DecompressParam* decompressParam = (DecompressParam*)param;
+
+	HRSRC hResource = FindResourceW(NULL, resName, type);
+	if (hResource == NULL)
+	{
+		decompressParam->err = Error(GetLastError());
+		return FALSE;
+	}
+
+	HGLOBAL hFileResource = LoadResource(NULL, hResource);
+	if (hFileResource == NULL)
+	{
+		decompressParam->err = Error(GetLastError());
+		return FALSE;
+	}
+
+	void* pResFile = LockResource(hFileResource);
+	if (pResFile == NULL)
+	{
+		decompressParam->err = Error(GetLastError());
+	}
+	else
+	{
+		DWORD resSize = SizeofResource(NULL, hResource);
+		decompressParam->err = zip_archive::Decompress(static_cast<uint8_t*>(pResFile), resSize, decompressParam->entries, decompressParam->bytes);
+		UnlockResource(pResFile);
+	}
+	FreeResource(hFileResource);
+
+	return decompressParam->err.Succeeded() ? TRUE : FALSE;
+}
+
 BOOL WINAPI ExtractBinary(HMODULE hModule, const WCHAR* type, WCHAR* resName, LONG_PTR param)
 {
 	std::list<std::vector<uint8_t>>* dst = (std::list<std::vector<uint8_t>>*)param;
@@ -142,6 +234,111 @@ BOOL WINAPI ExtractBinary(HMODULE hModule, const WCHAR* type, WCHAR* resName, LO
 	return TRUE;
 }
 
+BOOL WINAPI CollectName(HMODULE hModule, const WCHAR* type, WCHAR* resName, LONG_PTR param)
+{
+	std::vector<std::wstring>* names = (std::vector<std::wstring>*)param;
+
+	// COMMENT: "#<id>" is accepted by FindResource for a numeric resource id.
+	if (IS_INTRESOURCE(resName))
+	{
+		names->push_back(std::wstring(L"#").append(std::to_wstring(reinterpret_cast<ULONG_PTR>(resName))));
+	}
+	else
+	{
+		names->push_back(resName);
+	}
+
+	return TRUE;
+}
+
+// COMMENT: of the variants of every payload the one with the highest CPU level this machine supports, in resource order.
+Error SelectZipResources(std::vector<std::wstring>& selected)
+{
+	selected.clear();
+
+	std::vector<std::wstring> names;
+	EnumResourceNamesW(NULL, ZipType.c_str(), CollectName, (LONG_PTR)&names);
+
+	const CpuLevel machineLevel = CpuFeatures::DetectLevel();
+	std::map<std::wstring, size_t> best;
+	std::map<std::wstring, CpuLevel> unsupported;
+	std::vector<CpuLevel> levels(names.size(), CpuLevel::Baseline);
+	for (size_t i = 0; i < names.size(); i++)
+	{
+		std::wstring baseName;
+		if (!SplitVariantName(names[i], baseName, levels[i]))
+		{
+			std::wstring msg;
+			msg.append(L"unknown CPU level in ZIP resource name '").append(names[i]).append(L"'");
+			return Error(std::move(msg));
+		}
+
+		if (levels[i] > machineLevel)
+		{
+			unsupported.emplace(baseName, levels[i]);
+			continue;
+		}
+
+		auto it = best.find(baseName);
+		if (it == best.end())
+		{
+			best.emplace(baseName, i);
+		}
+		else if (levels[it->second] < levels[i])
+		{
+			it->second = i;
+		}
+	}
+
+	for (const auto& payload : unsupported)
+	{
+		if (best.find(payload.first) == best.end())
+		{
+			std::wstring msg;
+			msg.append(L"ZIP resource '").append(payload.first).append(L"' requires CPU level ").append(GetCpuLevelName(payload.second))
+				.append(L", this machine supports ").append(GetCpuLevelName(machineLevel));
+			return Error(std::move(msg));
+		}
+	}
+
+	std::vector<bool> chosen(names.size(), false);
+	for (const auto& payload : best)
+	{
+		chosen[payload.second] = true;
+	}
+
+	for (size_t i = 0; i < names.size(); i++)
+	{
+		if (chosen[i])
+		{
+			selected.push_back(names[i]);
+		}
+	}
+
+	return Error();
+}
+
+// COMMENT: calls proc for the selected ZIP resources the way EnumResourceNames would, until it returns FALSE.
+Error EnumZipResources(ENUMRESNAMEPROCW proc, LONG_PTR param)
+{
+	std::vector<std::wstring> names;
+	Error err = SelectZipResources(names);
+	if (!err.Succeeded())
+	{
+		return err;
+	}
+
+	for (std::wstring& name : names)
+	{
+		if (!proc(NULL, ZipType.c_str(), &name[0], param))
+		{
+			break;
+		}
+	}
+
+	return Error();
+}
+
 std::wstring QueryStringFileInfo(LPCVOID pVersionInfoBlock, const std::wstring& subName)
 {
 	void* pValue = NULL;
@@ -167,6 +364,14 @@ std::wstring QueryStringFileInfo(LPCVOID pVersionInfoBlock, const std::wstring&
 	return std::wstring((WCHAR*)pValue, len);
 }
 
+zip_archive::UnpackOptions GetUnpackOptions()
+{
+	zip_archive::UnpackOptions options;
+	const std::wstring directIoMb = PackageManager::GetStringResource(ParamType, DirectIoName);
+	options.directIoThreshold = static_cast<uint64_t>(wcstoull(directIoMb.c_str(), nullptr, 10)) * 1024 * 1024;
+	return options;
+}
+
 } // namespace
 
 std::wstring PackageManager::GetStringResource(const std::wstring& type, const std::wstring& name)
@@ -174,6 +379,12 @@ std::wstring PackageManager::GetStringResource(const std::wstring& type, const s
 	return FindStringFromBinaryResourceEx(NULL, type.c_str(), name.c_str(), MAKELANGID(LANG_NEUTRAL, SUBLANG_NEUTRAL));
 }
 
+bool PackageManager::GetFlagResource(const std::wstring& type, const std::wstring& name)
+{
+	const std::wstring value = GetStringResource(type, name);
+	return _wcsicmp(value.c_str(), L"true") == 0;
+}
+
 std::wstring PackageManager::GetStringFileInfo(const std::wstring& subName)
 {
 	HRSRC hVersion = FindResource(NULL, MAKEINTRESOURCE(VS_VERSION_INFO), RT_VERSION);
@@ -238,11 +449,117 @@ std::list<std::vector<uint8_t>> PackageManager::GetAllBinaryResources(const std:
 	return result;
 }
 
-Error PackageManager::UnpackZipResource(const std::wstring& destDir)
+Error PackageManager::GetPayloadHash(std::wstring& hash)
+{
+	// COMMENT: hashing reads every ZIP resource, and the resources do not change while the process runs.
+	static std::mutex mutex;
+	static bool computed = false;
+	static Error result;
+	static std::wstring payloadHash;
+
+	std::lock_guard<std::mutex> lock(mutex);
+	if (!computed)
+	{
+		computed = true;
+
+		HashParam param;
+		result = EnumZipResources(HashZip, (LONG_PTR)&param);
+		if (result.Succeeded())
+		{
+			result = param.err;
+		}
+
+		if (result.Succeeded())
+		{
+			wchar_t buffer[17];
+			std::swprintf(buffer, sizeof(buffer) / sizeof(buffer[0]), L"%016llx", static_cast<unsigned long long>(param.hash));
+			payloadHash.assign(buffer);
+		}
+	}
+
+	hash = payloadHash;
+	return result;
+}
+
+Error PackageManager::UnpackZipResource(const std::wstring& destDir, ProgressChannel* progressChannel)
 {
+	Trace::Scope traceScope("UnpackZipResource");
+
+	UnpackParam param;
+	param.destDir = destDir;
+	param.progressChannel = progressChannel;
+	param.options = GetUnpackOptions();
+	param.options.temporary = true;
+	Error err = EnumZipResources(UnpackZip, (LONG_PTR)&param);
+	if (!err.Succeeded())
+	{
+		return err;
+	}
+
+	return param.err;
+}
+
+Error PackageManager::ResumeZipResource(const std::wstring& destDir, ProgressChannel* progressChannel)
+{
+	Trace::Scope traceScope("ResumeZipResource");
+
+	const std::wstring journalPath = std::wstring(destDir).append(L".journal");
+
+	// COMMENT: without a journal the directory content is unknown, it is unpacked from scratch.
+	if (!ExtractionJournal::Exists(journalPath))
+	{
+		Cleanup::RemoveTree(destDir);
+	}
+
+	Error err = Path::CreateDir(destDir);
+	if (!err.Succeeded())
+	{
+		return err;
+	}
+
+	ExtractionJournal journal;
+	err = journal.Open(journalPath, destDir);
+	if (!err.Succeeded())
+	{
+		return err;
+	}
+
 	UnpackParam param;
 	param.destDir = destDir;
-	EnumResourceNamesW(NULL, ZipType.c_str(), UnpackZip, (LONG_PTR)&param);
+	param.progressChannel = progressChannel;
+	param.journal = &journal;
+	param.options = GetUnpackOptions();
+	// COMMENT: the cached, shared and cloned modes keep the directory between runs.
+	param.options.readOnly = true;
+	err = EnumZipResources(UnpackZip, (LONG_PTR)&param);
+	if (!err.Succeeded())
+	{
+		return err;
+	}
+
+	if (!param.err.Succeeded())
+	{
+		return param.err;
+	}
+
+	return journal.Remove();
+}
+
+Error PackageManager::DecompressZipResource(uint64_t& entries, uint64_t& bytes)
+{
+	Trace::Scope traceScope("DecompressZipResource");
+
+	entries = 0;
+	bytes = 0;
+
+	DecompressParam param;
+	Error err = EnumZipResources(DecompressZip, (LONG_PTR)&param);
+	if (!err.Succeeded())
+	{
+		return err;
+	}
 
+	entries = param.entries;
+	bytes = param.bytes;
 	return param.err;
 }
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "Error.hpp"
+#include "ProgressChannel.h"
 #include <string>
 #include <vector>
 #include <list>
@@ -10,8 +11,17 @@ class PackageManager
 public:
 
 	static std::wstring GetStringResource(const std::wstring& type, const std::wstring& name);
+	static bool GetFlagResource(const std::wstring& type, const std::wstring& name);
 	static std::wstring GetStringFileInfo(const std::wstring& subName);
 	static std::vector<uint8_t> GetBinaryResource(const std::wstring& subName);
 	static std::list<std::vector<uint8_t>> GetAllBinaryResources(const std::wstring& id);
-	static Error UnpackZipResource(const std::wstring& destDir);
+	// COMMENT: identifies the content of all ZIP resources, hex encoded. Computed on the first call only.
+	static Error GetPayloadHash(std::wstring& hash);
+	// COMMENT: unpacks into a per-run directory, the files are created temporary and must be removed after the run.
+	static Error UnpackZipResource(const std::wstring& destDir, ProgressChannel* progressChannel = nullptr);
+	// COMMENT: unpacks into a persistent directory keeping the journal <destDir>.journal, so a call interrupted
+	// by a crash or a kill is continued by the next one. The caller must keep concurrent calls out.
+	static Error ResumeZipResource(const std::wstring& destDir, ProgressChannel* progressChannel = nullptr);
+	// COMMENT: decompresses the selected ZIP resources in memory without writing anything.
+	static Error DecompressZipResource(uint64_t& entries, uint64_t& bytes);
 };
\ No newline at end of file
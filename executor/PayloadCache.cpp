@@ -0,0 +1,128 @@
+#include "PayloadCache.h"
+#include "PackageManager.h"
+#include "Cleanup.h"
+#include "Path.hpp"
+#include "File.h"
+#include <mutex>
+#include <vector>
+#include <Windows.h>
+
+namespace
+{
+
+const std::wstring LastUsedName(L"last_used");
+
+uint64_t ToUInt64(const FILETIME& ft)
+{
+	return (static_cast<uint64_t>(ft.dwHighDateTime) << 32) | ft.dwLowDateTime;
+}
+
+void TouchLastUsed(const std::wstring& dir)
+{
+	File file;
+	file.OpenWrite(std::wstring(dir).append(L"\\").append(LastUsedName));
+}
+
+bool IsStale(const std::wstring& dir, uint64_t now)
+{
+	const uint64_t StaleTicks = static_cast<uint64_t>(PayloadCache::StaleDays) * 24 * 60 * 60 * 10000000ULL;
+
+	WIN32_FILE_ATTRIBUTE_DATA data;
+	if (!GetFileAttributesExW(std::wstring(dir).append(L"\\").append(LastUsedName).c_str(), GetFileExInfoStandard, &data))
+	{
+		// COMMENT: a directory without the marker is left alone, it may be being created right now.
+		return false;
+	}
+
+	const uint64_t lastUsed = ToUInt64(data.ftLastWriteTime);
+	return now > lastUsed && now - lastUsed > StaleTicks;
+}
+
+void RemoveStaleDirs(const std::wstring& rootDir, const std::wstring& currentName)
+{
+	FILETIME nowFt;
+	GetSystemTimeAsFileTime(&nowFt);
+	const uint64_t now = ToUInt64(nowFt);
+
+	std::vector<std::wstring> staleDirs;
+
+	WIN32_FIND_DATAW findData;
+	HANDLE hFind = FindFirstFileW(std::wstring(rootDir).append(L"\\*").c_str(), &findData);
+	if (hFind == INVALID_HANDLE_VALUE)
+	{
+		return;
+	}
+
+	do
+	{
+		const std::wstring name(findData.cFileName);
+		if ((findData.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) == 0 || name == L"." || name == L".." || name == currentName)
+		{
+			continue;
+		}
+
+		const std::wstring dir = std::wstring(rootDir).append(L"\\").append(name);
+		if (IsStale(dir, now))
+		{
+			staleDirs.push_back(dir);
+		}
+	} while (FindNextFileW(hFind, &findData));
+
+	FindClose(hFind);
+
+	for (const std::wstring& dir : staleDirs)
+	{
+		Cleanup::Remove(dir);
+	}
+}
+
+Error OpenPayloadDir(std::wstring& dir)
+{
+	std::wstring hash;
+	Error err = PackageManager::GetPayloadHash(hash);
+	if (!err.Succeeded())
+	{
+		return err;
+	}
+
+	std::wstring rootDir;
+	err = Path::GetCacheDirPath(std::wstring(), rootDir);
+	if (!err.Succeeded())
+	{
+		return err;
+	}
+
+	std::wstring payloadDir = std::wstring(rootDir).append(L"\\").append(hash);
+	err = Path::CreateDir(payloadDir);
+	if (!err.Succeeded())
+	{
+		return err;
+	}
+
+	TouchLastUsed(payloadDir);
+	RemoveStaleDirs(rootDir, hash);
+
+	dir = std::move(payloadDir);
+	return Error();
+}
+
+} // namespace
+
+Error PayloadCache::GetPayloadDir(std::wstring& dir)
+{
+	// COMMENT: AppCDS, CRaC and the cached installation all ask for the directory, it is opened and swept once per run.
+	static std::mutex mutex;
+	static bool opened = false;
+	static Error result;
+	static std::wstring payloadDir;
+
+	std::lock_guard<std::mutex> lock(mutex);
+	if (!opened)
+	{
+		opened = true;
+		result = OpenPayloadDir(payloadDir);
+	}
+
+	dir = result.Succeeded() ? payloadDir : std::wstring();
+	return result;
+}
@@ -0,0 +1,17 @@
+#pragma once
+
+#include "Error.hpp"
+#include <string>
+
+// COMMENT: persistent per-payload storage. Every payload gets its own directory named by the hash of its ZIP
+// resources, so data derived from a payload is invalidated automatically when the payload changes.
+class PayloadCache
+{
+public:
+
+	static const unsigned StaleDays = 30;
+
+	// COMMENT: returns the directory of the embedded payload and removes directories of other payloads unused for StaleDays.
+	// Only the first call of a run does the work, the following ones return its result.
+	static Error GetPayloadDir(std::wstring& dir);
+};
@@ -0,0 +1,27 @@
+#pragma once
+
+#include "SnapshotSlot.hpp"
+#include <cstdint>
+#include <string>
+
+// COMMENT: every event is a full snapshot of the startup state, so the channel keeps only the latest one.
+// Publishing never waits for the UI, and the last event, the final progress or the Launching or Failed phase, always arrives.
+struct ProgressEvent
+{
+	enum class Phase : uint8_t
+	{
+		Unpacking,
+		Launching,
+		Failed
+	};
+
+	Phase phase = Phase::Unpacking;
+	uint32_t entriesDone = 0;
+	uint32_t entriesTotal = 0;
+	uint64_t bytesDone = 0;
+	uint64_t bytesTotal = 0;
+	// COMMENT: set with the Failed phase only, the splash shows it instead of the error box of main.
+	std::wstring message;
+};
+
+typedef SnapshotSlot<ProgressEvent> ProgressChannel;
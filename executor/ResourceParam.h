@@ -6,6 +6,16 @@
 const std::wstring ParamType(L"PARAM");
 const std::wstring CmdLineName(L"CMD_LINE");
 const std::wstring WorkingDirName(L"WORKING_DIR");
+const std::wstring HeadlessName(L"HEADLESS");
+const std::wstring StdoutCompressName(L"STDOUT_COMPRESS");
+const std::wstring AppCdsName(L"APP_CDS");
+const std::wstring DaemonName(L"DAEMON");
+const std::wstring DaemonIdleName(L"DAEMON_IDLE_SECONDS");
+const std::wstring CracName(L"CRAC");
+const std::wstring SharedExtractionName(L"SHARED_EXTRACTION");
+const std::wstring CloneName(L"CLONE");
+const std::wstring TraceName(L"TRACE");
+const std::wstring DirectIoName(L"DIRECT_IO_MB");
 
 const std::wstring ZipType(L"ZIP");
 const std::wstring ZipName(L"DATA.ZIP");
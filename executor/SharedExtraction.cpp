@@ -0,0 +1,167 @@
+#include "SharedExtraction.h"
+#include "PackageManager.h"
+#include "Cleanup.h"
+#include "Path.hpp"
+#include "File.h"
+
+namespace
+{
+
+const std::wstring SharedPrefix(L"infomaximum_shared_");
+
+bool Exists(const std::wstring& path)
+{
+	return GetFileAttributesW(path.c_str()) != INVALID_FILE_ATTRIBUTES;
+}
+
+bool HasFiles(const std::wstring& dirPath)
+{
+	WIN32_FIND_DATAW findData;
+	HANDLE hFind = FindFirstFileExW(std::wstring(dirPath).append(L"\\*").c_str(), FindExInfoBasic, &findData, FindExSearchNameMatch, NULL, 0);
+	if (hFind == INVALID_HANDLE_VALUE)
+	{
+		return false;
+	}
+
+	bool found = false;
+	do
+	{
+		if ((findData.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) == 0)
+		{
+			found = true;
+			break;
+		}
+	} while (FindNextFileW(hFind, &findData));
+
+	FindClose(hFind);
+	return found;
+}
+
+} // namespace
+
+SharedExtraction::SharedExtraction()
+	: hUser(INVALID_HANDLE_VALUE)
+{
+}
+
+SharedExtraction::~SharedExtraction()
+{
+	Release();
+}
+
+Error SharedExtraction::Acquire(ProgressChannel* progressChannel, std::wstring& dir)
+{
+	Release();
+	dir.clear();
+
+	std::wstring hash;
+	Error err = PackageManager::GetPayloadHash(hash);
+	if (!err.Succeeded())
+	{
+		return err;
+	}
+
+	wchar_t tempPath[MAX_PATH + 1];
+	const DWORD len = GetTempPathW(MAX_PATH + 1, tempPath);
+	if (len == 0 || len > MAX_PATH)
+	{
+		return Error(GetLastError());
+	}
+
+	sharedDir.assign(tempPath, len).append(SharedPrefix).append(hash);
+
+	// COMMENT: waits while another instance unpacks.
+	err = lock.Lock(GetLockPath());
+	if (!err.Succeeded())
+	{
+		return err;
+	}
+
+	// COMMENT: without the marker the directory is missing or was left half unpacked, nobody can be using it.
+	// An interrupted extraction is continued from its journal.
+	if (!Exists(std::wstring(sharedDir).append(L".ready")))
+	{
+		err = Unpack(progressChannel);
+	}
+
+	if (err.Succeeded())
+	{
+		err = Register();
+	}
+
+	lock.Unlock();
+
+	if (!err.Succeeded())
+	{
+		sharedDir.clear();
+		return err;
+	}
+
+	dir = sharedDir;
+	return Error();
+}
+
+void SharedExtraction::Release()
+{
+	if (hUser == INVALID_HANDLE_VALUE)
+	{
+		return;
+	}
+
+	// COMMENT: the lock keeps a new user from registering between the check and the removal.
+	const bool locked = lock.Lock(GetLockPath()).Succeeded();
+
+	CloseHandle(hUser);
+	hUser = INVALID_HANDLE_VALUE;
+
+	const std::wstring usersDir = std::wstring(sharedDir).append(L".users");
+	if (locked && !HasFiles(usersDir))
+	{
+		// COMMENT: the marker goes first, so the next instance unpacks again instead of using a directory being removed.
+		File::Delete(std::wstring(sharedDir).append(L".ready"));
+		RemoveDirectoryW(usersDir.c_str());
+		Cleanup::Remove(sharedDir);
+	}
+
+	lock.Unlock();
+
+	sharedDir.clear();
+}
+
+Error SharedExtraction::Register()
+{
+	const std::wstring usersDir = std::wstring(sharedDir).append(L".users");
+	Error err = Path::CreateDir(usersDir);
+	if (!err.Succeeded())
+	{
+		return err;
+	}
+
+	// COMMENT: the file disappears when the handle is closed, including when the process crashes.
+	const std::wstring userPath = std::wstring(usersDir).append(L"\\").append(std::to_wstring(GetCurrentProcessId()));
+	hUser = CreateFileW(userPath.c_str(), GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_DELETE, NULL, CREATE_ALWAYS,
+		FILE_ATTRIBUTE_TEMPORARY | FILE_FLAG_DELETE_ON_CLOSE, NULL);
+	if (hUser == INVALID_HANDLE_VALUE)
+	{
+		return Error(GetLastError());
+	}
+
+	return Error();
+}
+
+Error SharedExtraction::Unpack(ProgressChannel* progressChannel)
+{
+	Error err = PackageManager::ResumeZipResource(sharedDir, progressChannel);
+	if (err.Succeeded())
+	{
+		File marker;
+		err = marker.OpenWrite(std::wstring(sharedDir).append(L".ready"));
+	}
+
+	return err;
+}
+
+std::wstring SharedExtraction::GetLockPath() const
+{
+	return std::wstring(sharedDir).append(L".lock");
+}
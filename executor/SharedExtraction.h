@@ -0,0 +1,37 @@
+#pragma once
+
+#include "Error.hpp"
+#include "ProgressChannel.h"
+#include "FileLock.h"
+#include <string>
+#include <Windows.h>
+
+// COMMENT: one extraction of the payload shared by concurrent executors, %TEMP%\infomaximum_shared_<payload hash>.
+// Instances coordinate through a lock on <dir>.lock: the first one unpacks and creates the <dir>.ready marker,
+// the others wait for the lock and reuse the directory. Every user holds a delete-on-close file in <dir>.users,
+// so users that crashed are not counted, and the last user removes the directory.
+class SharedExtraction
+{
+public:
+
+	SharedExtraction();
+	~SharedExtraction();
+
+	SharedExtraction(const SharedExtraction&) = delete;
+	SharedExtraction& operator=(const SharedExtraction&) = delete;
+
+	Error Acquire(ProgressChannel* progressChannel, std::wstring& dir);
+	void Release();
+
+private:
+
+	Error Register();
+	Error Unpack(ProgressChannel* progressChannel);
+	std::wstring GetLockPath() const;
+
+private:
+
+	std::wstring sharedDir;
+	FileLock lock;
+	HANDLE hUser;
+};
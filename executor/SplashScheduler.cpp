@@ -0,0 +1,137 @@
+#include "SplashScheduler.h"
+#include "Trace.h"
+#include <string>
+#include <Windows.h>
+
+namespace
+{
+
+// COMMENT: load thresholds in percent, the gap between them prevents the frame rate from flapping.
+const uint32_t HighLoad = 90;
+const uint32_t MediumLoad = 70;
+const uint32_t LowLoad = 50;
+
+uint64_t ToUInt64(const FILETIME& ft)
+{
+	return (static_cast<uint64_t>(ft.dwHighDateTime) << 32) | ft.dwLowDateTime;
+}
+
+const char* ToString(SplashScheduler::Phase phase)
+{
+	switch (phase)
+	{
+	case SplashScheduler::Phase::Extracting:
+		return "extracting";
+	case SplashScheduler::Phase::Launching:
+		return "launching";
+	case SplashScheduler::Phase::Failed:
+		return "failed";
+	}
+	return "unknown";
+}
+
+void TraceDecision(SplashScheduler::Phase phase, uint32_t loadPercent, size_t prevFps, size_t newFps)
+{
+	if (!Trace::IsEnabled())
+	{
+		return;
+	}
+
+	std::string msg;
+	msg.append("phase=").append(ToString(phase));
+	msg.append(", cpu=").append(std::to_string(loadPercent)).append("%");
+	msg.append(", fps ").append(std::to_string(prevFps)).append(" -> ").append(std::to_string(newFps));
+
+	Trace::Instant("splash fps", msg);
+}
+
+} // namespace
+
+SplashScheduler::SplashScheduler()
+	: phase(Phase::Extracting)
+{
+	uint32_t loadPercent;
+	SampleCpuLoad(loadPercent);
+}
+
+void SplashScheduler::SetPhase(Phase value)
+{
+	phase.store(value, std::memory_order_relaxed);
+}
+
+SplashScheduler::Phase SplashScheduler::GetPhase() const
+{
+	return phase.load(std::memory_order_relaxed);
+}
+
+size_t SplashScheduler::NextFps()
+{
+	const Phase currentPhase = phase.load(std::memory_order_relaxed);
+
+	uint32_t loadPercent = 0;
+	const bool hasSample = SampleCpuLoad(loadPercent);
+
+	size_t newFps = fps;
+	if (currentPhase == Phase::Launching)
+	{
+		newFps = FullFps;
+	}
+	else if (currentPhase == Phase::Failed)
+	{
+		// COMMENT: the animation is stopped while the error is shown.
+		newFps = MinimalFps;
+	}
+	else if (hasSample)
+	{
+		if (loadPercent >= HighLoad)
+		{
+			newFps = MinimalFps;
+		}
+		else if (loadPercent >= MediumLoad)
+		{
+			newFps = ReducedFps;
+		}
+		else if (loadPercent < LowLoad)
+		{
+			newFps = FullFps;
+		}
+	}
+
+	if (newFps != fps)
+	{
+		TraceDecision(currentPhase, loadPercent, fps, newFps);
+		fps = newFps;
+	}
+
+	return fps;
+}
+
+bool SplashScheduler::SampleCpuLoad(uint32_t& loadPercent)
+{
+	loadPercent = 0;
+
+	FILETIME idleTime, kernelTime, userTime;
+	if (!GetSystemTimes(&idleTime, &kernelTime, &userTime))
+	{
+		return false;
+	}
+
+	// COMMENT: kernel time includes idle time.
+	const uint64_t idle = ToUInt64(idleTime);
+	const uint64_t total = ToUInt64(kernelTime) + ToUInt64(userTime);
+
+	const uint64_t idleDelta = idle - prevIdleTime;
+	const uint64_t totalDelta = total - prevTotalTime;
+	const bool hasPrevSample = prevTotalTime != 0;
+
+	prevIdleTime = idle;
+	prevTotalTime = total;
+
+	if (!hasPrevSample || totalDelta == 0 || idleDelta > totalDelta)
+	{
+		return false;
+	}
+
+	loadPercent = static_cast<uint32_t>((totalDelta - idleDelta) * 100 / totalDelta);
+	return true;
+}
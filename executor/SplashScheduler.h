@@ -0,0 +1,47 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+
+// COMMENT: chooses the splash animation frame rate from the startup phase and the measured system CPU load,
+// so the animation does not compete with the unpack thread on machines with few cores.
+class SplashScheduler
+{
+public:
+
+	enum class Phase
+	{
+		Extracting,
+		Launching,
+		Failed
+	};
+
+	static const size_t FullFps = 30;
+	static const size_t ReducedFps = 12;
+	static const size_t MinimalFps = 4;
+	static const unsigned SampleIntervalMs = 500;
+
+	SplashScheduler();
+
+	SplashScheduler(const SplashScheduler&) = delete;
+	SplashScheduler& operator=(const SplashScheduler&) = delete;
+
+	// COMMENT: can be called from any thread.
+	void SetPhase(Phase value);
+	Phase GetPhase() const;
+
+	// COMMENT: must be called from the UI thread every SampleIntervalMs.
+	size_t NextFps();
+
+private:
+
+	bool SampleCpuLoad(uint32_t& loadPercent);
+
+private:
+
+	std::atomic<Phase> phase;
+	uint64_t prevIdleTime = 0;
+	uint64_t prevTotalTime = 0;
+	size_t fps = FullFps;
+};
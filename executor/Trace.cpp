@@ -0,0 +1,240 @@
+#include "Trace.h"
+#include "StringConverter.hpp"
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <vector>
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <unistd.h>
+#endif
+
+namespace
+{
+
+const uint64_t NoBytes = ~0ULL;
+
+struct Event
+{
+	const char* name;
+	char phase;
+	uint64_t start;
+	uint64_t duration;
+	uint64_t bytes;
+	std::string detail;
+};
+
+// COMMENT: the owning thread appends, Write reads; the mutex is uncontended except while writing the trace.
+struct ThreadBuffer
+{
+	std::mutex mutex;
+	std::vector<Event> events;
+	unsigned threadId = 0;
+};
+
+std::atomic<bool> enabled(false);
+std::chrono::steady_clock::time_point origin;
+
+// COMMENT: buffers outlive their threads, spans of finished threads are written too.
+std::mutex registryMutex;
+std::vector<std::shared_ptr<ThreadBuffer>> registry;
+
+uint64_t Now()
+{
+	return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - origin).count());
+}
+
+ThreadBuffer& GetThreadBuffer()
+{
+	thread_local std::shared_ptr<ThreadBuffer> buffer;
+	if (!buffer)
+	{
+		buffer = std::make_shared<ThreadBuffer>();
+		std::lock_guard<std::mutex> lock(registryMutex);
+		buffer->threadId = static_cast<unsigned>(registry.size() + 1);
+		registry.push_back(buffer);
+	}
+	return *buffer;
+}
+
+void Record(Event&& event)
+{
+	ThreadBuffer& buffer = GetThreadBuffer();
+	std::lock_guard<std::mutex> lock(buffer.mutex);
+	buffer.events.push_back(std::move(event));
+}
+
+unsigned long GetProcessId()
+{
+#ifdef _WIN32
+	return GetCurrentProcessId();
+#else
+	return static_cast<unsigned long>(getpid());
+#endif
+}
+
+void AppendEscaped(std::string& dst, const std::string& text)
+{
+	for (char c : text)
+	{
+		if (c == '"' || c == '\\')
+		{
+			dst.push_back('\\');
+			dst.push_back(c);
+		}
+		else if (static_cast<unsigned char>(c) < 0x20)
+		{
+			char code[8];
+			std::snprintf(code, sizeof(code), "\\u%04x", static_cast<unsigned>(c));
+			dst.append(code);
+		}
+		else
+		{
+			dst.push_back(c);
+		}
+	}
+}
+
+// COMMENT: timestamps of the format are microseconds.
+void AppendMicroseconds(std::string& dst, uint64_t ns)
+{
+	char value[32];
+	std::snprintf(value, sizeof(value), "%llu.%03u", static_cast<unsigned long long>(ns / 1000), static_cast<unsigned>(ns % 1000));
+	dst.append(value);
+}
+
+void AppendEvent(std::string& dst, const Event& event, unsigned long pid, unsigned tid)
+{
+	dst.append("{\"name\":\"");
+	AppendEscaped(dst, event.name);
+	dst.append("\",\"cat\":\"executor\",\"ph\":\"").push_back(event.phase);
+	dst.append("\",\"ts\":");
+	AppendMicroseconds(dst, event.start);
+	if (event.phase == 'X')
+	{
+		dst.append(",\"dur\":");
+		AppendMicroseconds(dst, event.duration);
+	}
+	else
+	{
+		dst.append(",\"s\":\"t\"");
+	}
+	dst.append(",\"pid\":").append(std::to_string(pid)).append(",\"tid\":").append(std::to_string(tid));
+
+	if (event.bytes != NoBytes || !event.detail.empty())
+	{
+		dst.append(",\"args\":{");
+		if (event.bytes != NoBytes)
+		{
+			dst.append("\"bytes\":").append(std::to_string(event.bytes));
+		}
+		if (!event.detail.empty())
+		{
+			dst.append(event.bytes != NoBytes ? ",\"detail\":\"" : "\"detail\":\"");
+			AppendEscaped(dst, event.detail);
+			dst.push_back('"');
+		}
+		dst.push_back('}');
+	}
+	dst.push_back('}');
+}
+
+} // namespace
+
+const wchar_t* const Trace::EnableVariable = L"INFOMAXIMUM_TRACE";
+
+Trace::Scope::Scope(const char* name)
+	: name(name)
+	, active(enabled.load(std::memory_order_relaxed))
+	, start(active ? Now() : 0)
+	, bytes(NoBytes)
+{
+}
+
+Trace::Scope::~Scope()
+{
+	if (active)
+	{
+		const uint64_t end = Now();
+		Record(Event{ name, 'X', start, end - start, bytes, std::move(detail) });
+	}
+}
+
+void Trace::Scope::SetDetail(const std::string& text)
+{
+	if (active)
+	{
+		detail = text;
+	}
+}
+
+void Trace::Scope::SetBytes(uint64_t value)
+{
+	bytes = value;
+}
+
+void Trace::Enable()
+{
+	origin = std::chrono::steady_clock::now();
+	enabled.store(true, std::memory_order_release);
+}
+
+bool Trace::IsEnabled()
+{
+	return enabled.load(std::memory_order_relaxed);
+}
+
+void Trace::Instant(const char* name, const std::string& detail)
+{
+	if (IsEnabled())
+	{
+		Record(Event{ name, 'i', Now(), 0, NoBytes, detail });
+	}
+}
+
+Error Trace::Write(const std::wstring& path)
+{
+	const unsigned long pid = GetProcessId();
+
+	std::string json("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[");
+	bool first = true;
+	{
+		std::lock_guard<std::mutex> registryLock(registryMutex);
+		for (const std::shared_ptr<ThreadBuffer>& buffer : registry)
+		{
+			std::lock_guard<std::mutex> lock(buffer->mutex);
+			for (const Event& event : buffer->events)
+			{
+				if (!first)
+				{
+					json.append(",\n");
+				}
+				first = false;
+				AppendEvent(json, event, pid, buffer->threadId);
+			}
+		}
+	}
+	json.append("]}\n");
+
+#ifdef _WIN32
+	std::ofstream file(path, std::ios::out | std::ios::trunc | std::ios::binary);
+#else
+	std::string nativePath;
+	ConvertUtf16ToUtf8(path, nativePath);
+	std::ofstream file(nativePath, std::ios::out | std::ios::trunc | std::ios::binary);
+#endif
+	file.write(json.data(), static_cast<std::streamsize>(json.size()));
+	file.close();
+	if (!file)
+	{
+		std::wstring msg;
+		msg.append(L"can not write trace '").append(path).append(L"'");
+		return Error(std::move(msg));
+	}
+
+	return Error();
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include "Error.hpp"
+#include <string>
+#include <cstdint>
+
+// COMMENT: startup tracing. Spans are appended to per-thread buffers with steady clock timestamps and written
+// by Write as Chrome trace event JSON, which chrome://tracing and ui.perfetto.dev open. Disabled tracing costs
+// one relaxed load per span. Names must be string literals, they are stored as pointers.
+class Trace
+{
+public:
+
+	static const wchar_t* const EnableVariable;
+
+	class Scope
+	{
+	public:
+
+		explicit Scope(const char* name);
+		~Scope();
+
+		Scope(const Scope&) = delete;
+		Scope& operator=(const Scope&) = delete;
+
+		// COMMENT: shown in the arguments of the span.
+		void SetDetail(const std::string& text);
+		void SetBytes(uint64_t value);
+
+	private:
+
+		const char* name;
+		bool active;
+		uint64_t start;
+		std::string detail;
+		uint64_t bytes;
+	};
+
+	static void Enable();
+	static bool IsEnabled();
+
+	// COMMENT: a point in time, like the first window of the child.
+	static void Instant(const char* name, const std::string& detail = std::string());
+
+	static Error Write(const std::wstring& path);
+};
@@ -0,0 +1,241 @@
+#include "TreeClone.h"
+#include "Path.hpp"
+#include <vector>
+#include <Windows.h>
+#include <winioctl.h>
+
+// COMMENT: declared only by the Windows 10 SDK.
+#ifndef FSCTL_DUPLICATE_EXTENTS_TO_FILE
+#define FSCTL_DUPLICATE_EXTENTS_TO_FILE CTL_CODE(FILE_DEVICE_FILE_SYSTEM, 209, METHOD_BUFFERED, FILE_WRITE_ACCESS)
+#endif
+
+#ifndef FILE_SUPPORTS_BLOCK_REFCOUNTING
+#define FILE_SUPPORTS_BLOCK_REFCOUNTING 0x08000000
+#endif
+
+namespace
+{
+
+struct DuplicateExtentsData
+{
+	HANDLE FileHandle;
+	LARGE_INTEGER SourceFileOffset;
+	LARGE_INTEGER TargetFileOffset;
+	LARGE_INTEGER ByteCount;
+};
+
+// COMMENT: one request must stay below 4 GB.
+const uint64_t MaxCloneChunk = 1ULL << 31;
+
+bool GetVolumeRoot(const std::wstring& path, std::wstring& root)
+{
+	wchar_t volumePath[MAX_PATH + 1];
+	if (!GetVolumePathNameW(path.c_str(), volumePath, MAX_PATH + 1))
+	{
+		return false;
+	}
+
+	root.assign(volumePath);
+	return true;
+}
+
+// COMMENT: block cloning works only inside one volume whose file system counts block references (ReFS).
+uint64_t GetCloneClusterSize(const std::wstring& sourceDir, const std::wstring& destDir)
+{
+	std::wstring sourceRoot;
+	std::wstring destRoot;
+	if (!GetVolumeRoot(sourceDir, sourceRoot) || !GetVolumeRoot(destDir, destRoot) || _wcsicmp(sourceRoot.c_str(), destRoot.c_str()) != 0)
+	{
+		return 0;
+	}
+
+	DWORD flags = 0;
+	if (!GetVolumeInformationW(destRoot.c_str(), NULL, 0, NULL, NULL, &flags, NULL, 0) || (flags & FILE_SUPPORTS_BLOCK_REFCOUNTING) == 0)
+	{
+		return 0;
+	}
+
+	DWORD sectorsPerCluster = 0;
+	DWORD bytesPerSector = 0;
+	DWORD freeClusters = 0;
+	DWORD totalClusters = 0;
+	if (!GetDiskFreeSpaceW(destRoot.c_str(), &sectorsPerCluster, &bytesPerSector, &freeClusters, &totalClusters))
+	{
+		return 0;
+	}
+
+	return static_cast<uint64_t>(sectorsPerCluster) * bytesPerSector;
+}
+
+bool CopyBasicInfo(HANDLE hSource, HANDLE hDest)
+{
+	FILE_BASIC_INFO basicInfo;
+	return GetFileInformationByHandleEx(hSource, FileBasicInfo, &basicInfo, sizeof(basicInfo))
+		&& SetFileInformationByHandle(hDest, FileBasicInfo, &basicInfo, sizeof(basicInfo));
+}
+
+// COMMENT: supported is cleared only when the volume refuses block cloning as such, a file that can not be opened
+// or a range the file system rejects does not turn cloning off for the rest of the tree.
+bool CloneFile(const std::wstring& sourcePath, const std::wstring& destPath, uint64_t size, uint64_t clusterSize, bool& supported)
+{
+	HANDLE hSource = CreateFileW(sourcePath.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (hSource == INVALID_HANDLE_VALUE)
+	{
+		return false;
+	}
+
+	HANDLE hDest = CreateFileW(destPath.c_str(), GENERIC_READ | GENERIC_WRITE, 0, NULL, CREATE_NEW, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (hDest == INVALID_HANDLE_VALUE)
+	{
+		CloseHandle(hSource);
+		return false;
+	}
+
+	FILE_END_OF_FILE_INFO endOfFile;
+	endOfFile.EndOfFile.QuadPart = static_cast<LONGLONG>(size);
+	bool cloned = SetFileInformationByHandle(hDest, FileEndOfFileInfo, &endOfFile, sizeof(endOfFile)) != FALSE;
+
+	// COMMENT: ranges must be cluster aligned, the last one is rounded up past the end of file.
+	const uint64_t alignedSize = (size + clusterSize - 1) / clusterSize * clusterSize;
+	for (uint64_t offset = 0; cloned && offset < alignedSize; offset += MaxCloneChunk)
+	{
+		DuplicateExtentsData data;
+		data.FileHandle = hSource;
+		data.SourceFileOffset.QuadPart = static_cast<LONGLONG>(offset);
+		data.TargetFileOffset.QuadPart = static_cast<LONGLONG>(offset);
+		data.ByteCount.QuadPart = static_cast<LONGLONG>(alignedSize - offset < MaxCloneChunk ? alignedSize - offset : MaxCloneChunk);
+
+		DWORD returned = 0;
+		cloned = DeviceIoControl(hDest, FSCTL_DUPLICATE_EXTENTS_TO_FILE, &data, sizeof(data), NULL, 0, &returned, NULL) != FALSE;
+		if (!cloned)
+		{
+			const DWORD err = GetLastError();
+			supported = err != ERROR_NOT_SUPPORTED && err != ERROR_INVALID_FUNCTION;
+		}
+	}
+
+	cloned = cloned && CopyBasicInfo(hSource, hDest);
+
+	CloseHandle(hDest);
+	CloseHandle(hSource);
+
+	if (!cloned)
+	{
+		DeleteFileW(destPath.c_str());
+	}
+	return cloned;
+}
+
+class TreeCloner
+{
+public:
+
+	TreeCloner(uint64_t clusterSize, TreeClone::Stats& stats)
+		: clusterSize(clusterSize)
+		, stats(stats)
+	{
+	}
+
+	Error CloneDir(const std::wstring& sourceDir, const std::wstring& destDir)
+	{
+		WIN32_FIND_DATAW findData;
+		HANDLE hFind = FindFirstFileExW(std::wstring(sourceDir).append(L"\\*").c_str(), FindExInfoBasic, &findData,
+			FindExSearchNameMatch, NULL, FIND_FIRST_EX_LARGE_FETCH);
+		if (hFind == INVALID_HANDLE_VALUE)
+		{
+			return Error(GetLastError());
+		}
+
+		std::vector<std::wstring> subDirs;
+		Error err;
+		do
+		{
+			const std::wstring name(findData.cFileName);
+			if (name == L"." || name == L"..")
+			{
+				continue;
+			}
+
+			// COMMENT: junctions are not part of an extraction, they are skipped rather than followed.
+			if ((findData.dwFileAttributes & FILE_ATTRIBUTE_REPARSE_POINT) != 0)
+			{
+				continue;
+			}
+
+			if ((findData.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) != 0)
+			{
+				subDirs.push_back(name);
+				continue;
+			}
+
+			const uint64_t size = (static_cast<uint64_t>(findData.nFileSizeHigh) << 32) | findData.nFileSizeLow;
+			err = CloneEntry(std::wstring(sourceDir).append(L"\\").append(name), std::wstring(destDir).append(L"\\").append(name),
+				size, findData.dwFileAttributes);
+		} while (err.Succeeded() && FindNextFileW(hFind, &findData));
+
+		FindClose(hFind);
+
+		for (size_t i = 0; i < subDirs.size() && err.Succeeded(); i++)
+		{
+			const std::wstring destSubDir = std::wstring(destDir).append(L"\\").append(subDirs[i]);
+			err = Path::CreateDir(destSubDir);
+			if (err.Succeeded())
+			{
+				err = CloneDir(std::wstring(sourceDir).append(L"\\").append(subDirs[i]), destSubDir);
+			}
+		}
+
+		return err;
+	}
+
+private:
+
+	Error CloneEntry(const std::wstring& sourcePath, const std::wstring& destPath, uint64_t size, DWORD attributes)
+	{
+		if (clusterSize != 0)
+		{
+			bool supported = true;
+			if (CloneFile(sourcePath, destPath, size, clusterSize, supported))
+			{
+				stats.cloned++;
+				return Error();
+			}
+
+			// COMMENT: the volume reported support but refused, further attempts would fail the same way.
+			if (!supported)
+			{
+				clusterSize = 0;
+			}
+		}
+
+		// COMMENT: a read-only file can not be changed through the link, so sharing it with the cache is safe.
+		if ((attributes & FILE_ATTRIBUTE_READONLY) != 0 && CreateHardLinkW(destPath.c_str(), sourcePath.c_str(), NULL))
+		{
+			stats.hardlinked++;
+			return Error();
+		}
+
+		if (!CopyFileExW(sourcePath.c_str(), destPath.c_str(), NULL, NULL, NULL, COPY_FILE_FAIL_IF_EXISTS))
+		{
+			return Error(GetLastError());
+		}
+
+		stats.copied++;
+		return Error();
+	}
+
+private:
+
+	uint64_t clusterSize;
+	TreeClone::Stats& stats;
+};
+
+} // namespace
+
+Error TreeClone::Clone(const std::wstring& sourceDir, const std::wstring& destDir, Stats& stats)
+{
+	stats = Stats();
+
+	TreeCloner cloner(GetCloneClusterSize(sourceDir, destDir), stats);
+	return cloner.CloneDir(sourceDir, destDir);
+}
@@ -0,0 +1,24 @@
+#pragma once
+
+#include "Error.hpp"
+#include <string>
+#include <cstdint>
+
+// COMMENT: materializes a private writable copy of a directory tree, normally a cached extraction.
+// Files are cloned by the file system when it shares blocks between files (ReFS block cloning on Windows,
+// FICLONE on btrfs/XFS), read-only files are hardlinked otherwise, and the rest is copied.
+// Timestamps are preserved, class data sharing archives depend on them.
+class TreeClone
+{
+public:
+
+	struct Stats
+	{
+		uint32_t cloned = 0;
+		uint32_t hardlinked = 0;
+		uint32_t copied = 0;
+	};
+
+	// COMMENT: destDir must exist and be empty.
+	static Error Clone(const std::wstring& sourceDir, const std::wstring& destDir, Stats& stats);
+};
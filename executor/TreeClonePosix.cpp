@@ -0,0 +1,274 @@
+#include "TreeClone.h"
+#include "StringConverter.hpp"
+#include <vector>
+#include <cerrno>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <linux/fs.h>
+
+namespace
+{
+
+const size_t CopyBufferSize = 256 * 1024;
+
+class Descriptor
+{
+public:
+
+	explicit Descriptor(int fd)
+		: fd(fd)
+	{
+	}
+
+	~Descriptor()
+	{
+		if (fd >= 0)
+		{
+			close(fd);
+		}
+	}
+
+	Descriptor(const Descriptor&) = delete;
+	Descriptor& operator=(const Descriptor&) = delete;
+
+	int fd;
+};
+
+Error CopyContent(int sourceFd, int destFd, off_t size)
+{
+	// COMMENT: copy_file_range keeps the data in the kernel and may still share blocks on file systems like NFS.
+	off_t copied = 0;
+	while (copied < size)
+	{
+		const ssize_t res = copy_file_range(sourceFd, nullptr, destFd, nullptr, static_cast<size_t>(size - copied), 0);
+		if (res < 0 && errno == EINTR)
+		{
+			continue;
+		}
+		if (res <= 0)
+		{
+			break;
+		}
+		copied += res;
+	}
+
+	if (copied == size)
+	{
+		return Error();
+	}
+
+	if (lseek(sourceFd, copied, SEEK_SET) < 0 || lseek(destFd, copied, SEEK_SET) < 0)
+	{
+		return Error::makeByErrno(errno);
+	}
+
+	std::vector<char> buffer(CopyBufferSize);
+	for (;;)
+	{
+		const ssize_t readCount = read(sourceFd, buffer.data(), buffer.size());
+		if (readCount < 0 && errno == EINTR)
+		{
+			continue;
+		}
+		if (readCount < 0)
+		{
+			return Error::makeByErrno(errno);
+		}
+		if (readCount == 0)
+		{
+			return Error();
+		}
+
+		for (ssize_t written = 0; written < readCount;)
+		{
+			const ssize_t res = write(destFd, buffer.data() + written, static_cast<size_t>(readCount - written));
+			if (res < 0 && errno == EINTR)
+			{
+				continue;
+			}
+			if (res < 0)
+			{
+				return Error::makeByErrno(errno);
+			}
+			written += res;
+		}
+	}
+}
+
+class TreeCloner
+{
+public:
+
+	explicit TreeCloner(TreeClone::Stats& stats)
+		: stats(stats)
+	{
+	}
+
+	Error CloneDir(const std::string& sourceDir, const std::string& destDir)
+	{
+		DIR* dir = opendir(sourceDir.c_str());
+		if (dir == nullptr)
+		{
+			return Error::makeByErrno(errno);
+		}
+
+		std::vector<std::string> subDirs;
+		Error err;
+		while (err.Succeeded())
+		{
+			const dirent* entry = readdir(dir);
+			if (entry == nullptr)
+			{
+				break;
+			}
+
+			const std::string name(entry->d_name);
+			if (name == "." || name == "..")
+			{
+				continue;
+			}
+
+			const std::string sourcePath = std::string(sourceDir).append("/").append(name);
+			struct stat sb;
+			if (lstat(sourcePath.c_str(), &sb) != 0)
+			{
+				err = Error::makeByErrno(errno);
+			}
+			else if (S_ISDIR(sb.st_mode))
+			{
+				subDirs.push_back(name);
+			}
+			else if (S_ISREG(sb.st_mode))
+			{
+				err = CloneEntry(sourcePath, std::string(destDir).append("/").append(name), sb);
+			}
+		}
+
+		closedir(dir);
+
+		for (size_t i = 0; i < subDirs.size() && err.Succeeded(); i++)
+		{
+			const std::string destSubDir = std::string(destDir).append("/").append(subDirs[i]);
+			if (mkdir(destSubDir.c_str(), 0755) != 0 && errno != EEXIST)
+			{
+				return Error::makeByErrno(errno);
+			}
+
+			err = CloneDir(std::string(sourceDir).append("/").append(subDirs[i]), destSubDir);
+		}
+
+		return err;
+	}
+
+private:
+
+	Error CloneEntry(const std::string& sourcePath, const std::string& destPath, const struct stat& sb)
+	{
+		if (cloneSupported && CloneFile(sourcePath, destPath, sb))
+		{
+			stats.cloned++;
+			return Error();
+		}
+
+		// COMMENT: a read-only file can not be changed through the link, so sharing it with the cache is safe.
+		const bool readOnly = (sb.st_mode & (S_IWUSR | S_IWGRP | S_IWOTH)) == 0;
+		if (readOnly && link(sourcePath.c_str(), destPath.c_str()) == 0)
+		{
+			stats.hardlinked++;
+			return Error();
+		}
+
+		Error err = CopyFile(sourcePath, destPath, sb);
+		if (err.Succeeded())
+		{
+			stats.copied++;
+		}
+		return err;
+	}
+
+	bool CloneFile(const std::string& sourcePath, const std::string& destPath, const struct stat& sb)
+	{
+		Descriptor source(open(sourcePath.c_str(), O_RDONLY | O_CLOEXEC));
+		Descriptor dest(source.fd >= 0 ? open(destPath.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, sb.st_mode & 07777) : -1);
+		if (dest.fd < 0)
+		{
+			return false;
+		}
+
+		if (ioctl(dest.fd, FICLONE, source.fd) != 0)
+		{
+			// COMMENT: the file system does not share blocks or the trees are on different file systems,
+			// further attempts would fail the same way.
+			if (errno == EOPNOTSUPP || errno == ENOTTY || errno == EXDEV || errno == EINVAL)
+			{
+				cloneSupported = false;
+			}
+
+			unlink(destPath.c_str());
+			return false;
+		}
+
+		SetTimes(dest.fd, sb);
+		return true;
+	}
+
+	Error CopyFile(const std::string& sourcePath, const std::string& destPath, const struct stat& sb)
+	{
+		Descriptor source(open(sourcePath.c_str(), O_RDONLY | O_CLOEXEC));
+		if (source.fd < 0)
+		{
+			return Error::makeByErrno(errno);
+		}
+
+		Descriptor dest(open(destPath.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, sb.st_mode & 07777));
+		if (dest.fd < 0)
+		{
+			return Error::makeByErrno(errno);
+		}
+
+		Error err = CopyContent(source.fd, dest.fd, sb.st_size);
+		if (err.Succeeded())
+		{
+			SetTimes(dest.fd, sb);
+		}
+		return err;
+	}
+
+	static void SetTimes(int fd, const struct stat& sb)
+	{
+		const timespec times[2] = { sb.st_atim, sb.st_mtim };
+		futimens(fd, times);
+	}
+
+private:
+
+	TreeClone::Stats& stats;
+	bool cloneSupported = true;
+};
+
+} // namespace
+
+Error TreeClone::Clone(const std::wstring& sourceDir, const std::wstring& destDir, Stats& stats)
+{
+	stats = Stats();
+
+	std::string nativeSourceDir;
+	Error err = ConvertUtf16ToUtf8(sourceDir, nativeSourceDir);
+	if (!err.Succeeded())
+	{
+		return err;
+	}
+
+	std::string nativeDestDir;
+	err = ConvertUtf16ToUtf8(destDir, nativeDestDir);
+	if (!err.Succeeded())
+	{
+		return err;
+	}
+
+	TreeCloner cloner(stats);
+	return cloner.CloneDir(nativeSourceDir, nativeDestDir);
+}
@@ -0,0 +1,127 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// COMMENT: removes a directory tree on several threads, the platform only enumerates and deletes. Primitives has
+// a Path type and two static functions: RemoveEntries(dir, subDirs) deletes everything in dir but its subdirectories
+// and appends their paths to subDirs, links and junctions are deleted as entries and never followed.
+// RemoveEmptyDir(dir) deletes the directory once it is empty. Failures are ignored, what can not be removed stays.
+template<typename Primitives>
+class TreeRemover
+{
+public:
+
+	typedef typename Primitives::Path Path;
+
+	void Run(const Path& rootPath)
+	{
+		nodes.emplace_back(new DirNode(rootPath, nullptr));
+		queue.push_back(nodes.back().get());
+
+		const unsigned maxThreads = 8;
+		const unsigned hardwareThreads = std::thread::hardware_concurrency();
+		const unsigned threadCount = hardwareThreads == 0 ? 1 : (hardwareThreads < maxThreads ? hardwareThreads : maxThreads);
+
+		std::vector<std::thread> threads;
+		for (unsigned i = 1; i < threadCount; i++)
+		{
+			threads.emplace_back(&TreeRemover::Work, this);
+		}
+
+		Work();
+
+		for (std::thread& thread : threads)
+		{
+			thread.join();
+		}
+	}
+
+private:
+
+	// COMMENT: a directory is removed when its own listing is processed and all its subdirectories are removed,
+	// pending counts both.
+	struct DirNode
+	{
+		DirNode(const Path& path, DirNode* parent)
+			: path(path)
+			, parent(parent)
+			, pending(1)
+		{
+		}
+
+		Path path;
+		DirNode* parent;
+		std::atomic<unsigned> pending;
+	};
+
+	void Work()
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		for (;;)
+		{
+			queueChanged.wait(lock, [this]() { return !queue.empty() || busyWorkers == 0; });
+			if (queue.empty())
+			{
+				return;
+			}
+
+			DirNode* node = queue.front();
+			queue.pop_front();
+			busyWorkers++;
+
+			lock.unlock();
+			ProcessDir(node);
+			lock.lock();
+
+			busyWorkers--;
+			if (busyWorkers == 0 && queue.empty())
+			{
+				queueChanged.notify_all();
+			}
+		}
+	}
+
+	void ProcessDir(DirNode* node)
+	{
+		std::vector<Path> subDirPaths;
+		Primitives::RemoveEntries(node->path, subDirPaths);
+
+		if (!subDirPaths.empty())
+		{
+			node->pending += static_cast<unsigned>(subDirPaths.size());
+
+			std::lock_guard<std::mutex> lock(mutex);
+			for (const Path& subDirPath : subDirPaths)
+			{
+				nodes.emplace_back(new DirNode(subDirPath, node));
+				queue.push_back(nodes.back().get());
+			}
+			queueChanged.notify_all();
+		}
+
+		Release(node);
+	}
+
+	void Release(DirNode* node)
+	{
+		while (node != nullptr && --node->pending == 0)
+		{
+			Primitives::RemoveEmptyDir(node->path);
+			node = node->parent;
+		}
+	}
+
+private:
+
+	std::mutex mutex;
+	std::condition_variable queueChanged;
+	std::deque<DirNode*> queue;
+	std::vector<std::unique_ptr<DirNode>> nodes;
+	unsigned busyWorkers = 0;
+};
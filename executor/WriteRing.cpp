@@ -0,0 +1,60 @@
+#include "WriteRing.h"
+
+// COMMENT: overlapped writes need every handle opened with FILE_FLAG_OVERLAPPED, which every other method of File
+// would then have to honor. Until then Windows, like any system without io_uring, writes synchronously.
+
+WriteRing::WriteRing()
+	: ringFd(-1)
+	, buffersRegistered(false)
+	, prepared(0)
+	, sqRing(nullptr)
+	, sqRingSize(0)
+	, cqRing(nullptr)
+	, cqRingSize(0)
+	, sqes(nullptr)
+	, sqesSize(0)
+	, sqHead(nullptr)
+	, sqTail(nullptr)
+	, sqMask(nullptr)
+	, sqEntries(nullptr)
+	, sqArray(nullptr)
+	, cqHead(nullptr)
+	, cqTail(nullptr)
+	, cqMask(nullptr)
+	, cqes(nullptr)
+{
+}
+
+WriteRing::~WriteRing()
+{
+}
+
+Error WriteRing::Open(unsigned /*entries*/, uint8_t* /*buffers*/, uint32_t /*bufferSize*/, unsigned /*bufferCount*/)
+{
+	return Error(L"batched kernel writes are supported on Linux only");
+}
+
+bool WriteRing::IsOpen() const
+{
+	return false;
+}
+
+bool WriteRing::PrepareWrite(File::NativeHandle /*handle*/, unsigned /*bufferIndex*/, const uint8_t* /*data*/, uint32_t /*size*/, uint64_t /*offset*/,
+	uint64_t /*userData*/)
+{
+	return false;
+}
+
+Error WriteRing::Submit(unsigned /*waitCount*/)
+{
+	return Error(L"batched kernel writes are supported on Linux only");
+}
+
+bool WriteRing::PopCompletion(Completion& /*completion*/)
+{
+	return false;
+}
+
+void WriteRing::Close()
+{
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include "Error.hpp"
+#include "File.h"
+#include <cstddef>
+#include <cstdint>
+
+// COMMENT: passes writes to the kernel in batches and collects their completions without a thread per write,
+// io_uring on Linux. The buffers of the writer are registered once, so the kernel does not map and pin them again
+// for every write. Open fails where there is no such interface or it is forbidden, as by the seccomp profiles of
+// many containers, and the writes are then made synchronously. Used by one thread only.
+class WriteRing
+{
+public:
+
+	struct Completion
+	{
+		uint64_t userData;
+		// COMMENT: bytes written or a negative errno.
+		int32_t result;
+	};
+
+	WriteRing();
+	~WriteRing();
+
+	WriteRing(const WriteRing&) = delete;
+	WriteRing& operator=(const WriteRing&) = delete;
+
+	// COMMENT: entries is the number of writes that may be in flight, bufferCount buffers of bufferSize follow each other at buffers.
+	Error Open(unsigned entries, uint8_t* buffers, uint32_t bufferSize, unsigned bufferCount);
+	bool IsOpen() const;
+
+	// COMMENT: queues a write of size bytes at data, which lies in the buffer bufferIndex. False when the queue is full.
+	bool PrepareWrite(File::NativeHandle handle, unsigned bufferIndex, const uint8_t* data, uint32_t size, uint64_t offset, uint64_t userData);
+
+	// COMMENT: hands the queued writes over in one call and returns when at least waitCount writes have completed.
+	Error Submit(unsigned waitCount);
+
+	bool PopCompletion(Completion& completion);
+
+	// COMMENT: writes still in the ring are abandoned, their completions are never reported.
+	void Close();
+
+private:
+
+	int ringFd;
+	bool buffersRegistered;
+	unsigned prepared;
+	void* sqRing;
+	size_t sqRingSize;
+	void* cqRing;
+	size_t cqRingSize;
+	void* sqes;
+	size_t sqesSize;
+	unsigned* sqHead;
+	unsigned* sqTail;
+	unsigned* sqMask;
+	unsigned* sqEntries;
+	unsigned* sqArray;
+	unsigned* cqHead;
+	unsigned* cqTail;
+	unsigned* cqMask;
+	void* cqes;
+};
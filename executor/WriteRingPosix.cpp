@@ -0,0 +1,222 @@
+#include "WriteRing.h"
+#include <cerrno>
+#include <cstring>
+#include <vector>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+// COMMENT: the raw system calls, the build does not depend on liburing. The rings are shared with the kernel,
+// the tails it reads and the heads it writes are accessed with acquire and release ordering.
+
+namespace
+{
+
+const int InvalidDescriptor = -1;
+
+template <typename T>
+T* At(void* base, uint32_t offset)
+{
+	return reinterpret_cast<T*>(static_cast<uint8_t*>(base) + offset);
+}
+
+} // namespace
+
+WriteRing::WriteRing()
+	: ringFd(InvalidDescriptor)
+	, buffersRegistered(false)
+	, prepared(0)
+	, sqRing(MAP_FAILED)
+	, sqRingSize(0)
+	, cqRing(MAP_FAILED)
+	, cqRingSize(0)
+	, sqes(MAP_FAILED)
+	, sqesSize(0)
+	, sqHead(nullptr)
+	, sqTail(nullptr)
+	, sqMask(nullptr)
+	, sqEntries(nullptr)
+	, sqArray(nullptr)
+	, cqHead(nullptr)
+	, cqTail(nullptr)
+	, cqMask(nullptr)
+	, cqes(nullptr)
+{
+}
+
+WriteRing::~WriteRing()
+{
+	Close();
+}
+
+Error WriteRing::Open(unsigned entries, uint8_t* buffers, uint32_t bufferSize, unsigned bufferCount)
+{
+	Close();
+
+	io_uring_params params;
+	memset(&params, 0, sizeof(params));
+	const long fd = syscall(__NR_io_uring_setup, entries, &params);
+	if (fd < 0)
+	{
+		return Error::makeByErrno(errno);
+	}
+	ringFd = static_cast<int>(fd);
+
+	sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+	cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+	const bool singleMap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+	if (singleMap)
+	{
+		sqRingSize = sqRingSize > cqRingSize ? sqRingSize : cqRingSize;
+		cqRingSize = sqRingSize;
+	}
+
+	sqRing = mmap(nullptr, sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_SQ_RING);
+	if (sqRing == MAP_FAILED)
+	{
+		const int mapErr = errno;
+		Close();
+		return Error::makeByErrno(mapErr);
+	}
+
+	if (!singleMap)
+	{
+		cqRing = mmap(nullptr, cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_CQ_RING);
+		if (cqRing == MAP_FAILED)
+		{
+			const int mapErr = errno;
+			Close();
+			return Error::makeByErrno(mapErr);
+		}
+	}
+
+	sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+	sqes = mmap(nullptr, sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_SQES);
+	if (sqes == MAP_FAILED)
+	{
+		const int mapErr = errno;
+		Close();
+		return Error::makeByErrno(mapErr);
+	}
+
+	void* completionRing = singleMap ? sqRing : cqRing;
+	sqHead = At<unsigned>(sqRing, params.sq_off.head);
+	sqTail = At<unsigned>(sqRing, params.sq_off.tail);
+	sqMask = At<unsigned>(sqRing, params.sq_off.ring_mask);
+	sqEntries = At<unsigned>(sqRing, params.sq_off.ring_entries);
+	sqArray = At<unsigned>(sqRing, params.sq_off.array);
+	cqHead = At<unsigned>(completionRing, params.cq_off.head);
+	cqTail = At<unsigned>(completionRing, params.cq_off.tail);
+	cqMask = At<unsigned>(completionRing, params.cq_off.ring_mask);
+	cqes = At<void>(completionRing, params.cq_off.cqes);
+
+	// COMMENT: registered buffers are pinned memory, charged to RLIMIT_MEMLOCK on older kernels. Beyond the limit
+	// the writes pass plain addresses, which still saves the thread and the system call per write.
+	std::vector<iovec> iovecs(bufferCount);
+	for (unsigned i = 0; i < bufferCount; i++)
+	{
+		iovecs[i].iov_base = buffers + static_cast<size_t>(i) * bufferSize;
+		iovecs[i].iov_len = bufferSize;
+	}
+	buffersRegistered = syscall(__NR_io_uring_register, ringFd, IORING_REGISTER_BUFFERS, &iovecs[0], bufferCount) == 0;
+
+	return Error();
+}
+
+bool WriteRing::IsOpen() const
+{
+	return ringFd != InvalidDescriptor;
+}
+
+bool WriteRing::PrepareWrite(File::NativeHandle handle, unsigned bufferIndex, const uint8_t* data, uint32_t size, uint64_t offset, uint64_t userData)
+{
+	const unsigned tail = *sqTail;
+	if (tail - __atomic_load_n(sqHead, __ATOMIC_ACQUIRE) >= *sqEntries)
+	{
+		return false;
+	}
+
+	const unsigned index = tail & *sqMask;
+	io_uring_sqe* sqe = static_cast<io_uring_sqe*>(sqes) + index;
+	memset(sqe, 0, sizeof(*sqe));
+	sqe->opcode = buffersRegistered ? IORING_OP_WRITE_FIXED : IORING_OP_WRITE;
+	sqe->fd = handle;
+	sqe->addr = reinterpret_cast<uintptr_t>(data);
+	sqe->len = size;
+	sqe->off = offset;
+	sqe->buf_index = static_cast<uint16_t>(bufferIndex);
+	sqe->user_data = userData;
+	sqArray[index] = index;
+
+	__atomic_store_n(sqTail, tail + 1, __ATOMIC_RELEASE);
+	prepared++;
+	return true;
+}
+
+Error WriteRing::Submit(unsigned waitCount)
+{
+	if (prepared == 0 && waitCount == 0)
+	{
+		return Error();
+	}
+
+	for (;;)
+	{
+		const long res = syscall(__NR_io_uring_enter, ringFd, prepared, waitCount, waitCount != 0 ? IORING_ENTER_GETEVENTS : 0, nullptr, 0);
+		if (res >= 0)
+		{
+			prepared -= static_cast<unsigned>(res);
+			return Error();
+		}
+
+		if (errno != EINTR)
+		{
+			return Error::makeByErrno(errno);
+		}
+	}
+}
+
+bool WriteRing::PopCompletion(Completion& completion)
+{
+	const unsigned head = *cqHead;
+	if (head == __atomic_load_n(cqTail, __ATOMIC_ACQUIRE))
+	{
+		return false;
+	}
+
+	const io_uring_cqe* cqe = static_cast<const io_uring_cqe*>(cqes) + (head & *cqMask);
+	completion.userData = cqe->user_data;
+	completion.result = cqe->res;
+
+	__atomic_store_n(cqHead, head + 1, __ATOMIC_RELEASE);
+	return true;
+}
+
+void WriteRing::Close()
+{
+	if (sqes != MAP_FAILED)
+	{
+		munmap(sqes, sqesSize);
+		sqes = MAP_FAILED;
+	}
+	if (cqRing != MAP_FAILED)
+	{
+		munmap(cqRing, cqRingSize);
+		cqRing = MAP_FAILED;
+	}
+	if (sqRing != MAP_FAILED)
+	{
+		munmap(sqRing, sqRingSize);
+		sqRing = MAP_FAILED;
+	}
+	if (ringFd != InvalidDescriptor)
+	{
+		close(ringFd);
+		ringFd = InvalidDescriptor;
+	}
+
+	buffersRegistered = false;
+	prepared = 0;
+}
@@ -1,7 +1,13 @@
 #include "ZipArchive.h"
+#include "ExtractionJournal.h"
+#include "DirectoryCache.h"
+#include "CloseQueue.h"
+#include "AsyncWriter.h"
+#include "Trace.h"
 #include "File.h"
 #include "Path.hpp"
 #include "StringConverter.hpp"
+#include <cstring>
 
 #define ZIP_STATIC
 #include <zip.h>
@@ -9,6 +15,9 @@
 namespace
 {
 
+// COMMENT: FILE_ATTRIBUTE_READONLY, DOS and NTFS entries keep the attributes of the file in the low byte.
+const zip_uint32_t DosReadOnlyAttribute = 0x01;
+
 struct ZipError
 {
 	zip_error_t error;
@@ -48,7 +57,7 @@ struct ZipArchive
 {
 public:
 
-	ZipArchive::~ZipArchive()
+	~ZipArchive()
 	{
 		Close();
 	}
@@ -75,6 +84,36 @@ public:
 		return Error();
 	}
 
+	Error ComputeContentHash(uint64_t& hash)
+	{
+		const uint64_t FnvPrime = 1099511628211ULL;
+
+		auto mix = [&hash](const void* data, size_t size)
+		{
+			const uint8_t* bytes = static_cast<const uint8_t*>(data);
+			for (size_t i = 0; i < size; i++)
+			{
+				hash = (hash ^ bytes[i]) * FnvPrime;
+			}
+		};
+
+		const zip_int64_t count = zip_get_num_entries(zipArchive, 0);
+		for (zip_int64_t fileIndex = 0; fileIndex < count; fileIndex++)
+		{
+			zip_stat_t sb;
+			if (zip_stat_index(zipArchive, fileIndex, 0, &sb) != 0)
+			{
+				return Error(MakeZipErrorMsg(L"can not stat entry ", ToString(*zip_get_error(zipArchive))));
+			}
+
+			mix(sb.name, strlen(sb.name) + 1);
+			mix(&sb.size, sizeof(sb.size));
+			mix(&sb.crc, sizeof(sb.crc));
+		}
+
+		return Error();
+	}
+
 	void Close()
 	{
 		if (zipArchive)
@@ -84,9 +123,98 @@ public:
 		}
 	}
 
-	Error Unpack(const std::wstring& destDir)
+	Error Unpack(const std::wstring& destDir, ProgressChannel* progressChannel, ExtractionJournal* journal, const zip_archive::UnpackOptions& unpackOptions)
 	{
 		const zip_int64_t count = zip_get_num_entries(zipArchive, 0);
+
+		progress = ProgressEvent();
+		channel = progressChannel;
+		if (channel != nullptr)
+		{
+			InitProgressTotals(count);
+			PublishProgress();
+		}
+
+		destRoot = destDir;
+		options = unpackOptions;
+		CloseQueue closeQueue;
+		AsyncWriter asyncWriter(closeQueue);
+		writer = &asyncWriter;
+		DirectoryCache dirs;
+		Error err = dirs.Open(destDir);
+		if (!err.Succeeded())
+		{
+			writer = nullptr;
+			return Error(MakeZipErrorMsg(std::wstring(L"can not open dir '").append(destDir).append(L"'. "), err.getMessage()));
+		}
+
+		err = UnpackEntries(count, dirs, journal);
+
+		// COMMENT: entries finished before a failure are journaled too, so the next run does not unpack them again.
+		uint64_t failedIndex = 0;
+		const Error writeErr = asyncWriter.Wait(failedIndex);
+		const Error journalErr = AppendFinished(journal);
+		writer = nullptr;
+		if (!err.Succeeded())
+		{
+			return err;
+		}
+		if (!writeErr.Succeeded())
+		{
+			return MakeWriteError(failedIndex, writeErr);
+		}
+		if (!journalErr.Succeeded())
+		{
+			return journalErr;
+		}
+
+		closeQueue.Wait();
+		return Error();
+	}
+
+	// COMMENT: reads every entry through the decompressor into one scratch buffer, nothing is written to disk.
+	Error Decompress(uint64_t& entries, uint64_t& bytes)
+	{
+		static const size_t ScratchBufferSize = 64 * 1024;
+
+		std::vector<uint8_t> buffer(ScratchBufferSize);
+		const zip_int64_t count = zip_get_num_entries(zipArchive, 0);
+		for (zip_int64_t fileIndex = 0; fileIndex < count; fileIndex++)
+		{
+			ZipFile zipFile(zip_fopen_index(zipArchive, fileIndex, 0));
+			if (zipFile.zf == nullptr)
+			{
+				return Error(MakeZipErrorMsg(L"can not open file from archive ", ToString(*zip_get_error(zipArchive))));
+			}
+
+			for (;;)
+			{
+				const zip_int64_t size = zip_fread(zipFile.zf, &buffer[0], ScratchBufferSize);
+				if (size < 0)
+				{
+					return Error(MakeZipErrorMsg(L"can not read file from archive ", ToString(*zip_file_get_error(zipFile.zf))));
+				}
+				if (size == 0)
+				{
+					break;
+				}
+				bytes += static_cast<uint64_t>(size);
+			}
+
+			entries++;
+		}
+
+		return Error();
+	}
+
+private:
+
+	Error UnpackEntries(zip_int64_t count, DirectoryCache& dirs, ExtractionJournal* journal)
+	{
+		// COMMENT: reused for every entry, so converting and splitting names does not allocate once they are long enough.
+		std::wstring name;
+		std::wstring dirPath;
+		std::wstring fileName;
 		for (zip_int64_t fileIndex = 0; fileIndex < count; fileIndex++)
 		{
 			zip_stat_t sb;
@@ -95,7 +223,6 @@ public:
 				continue;
 			}
 
-			std::wstring name;
 			Error err = ConvertUtf8ToUtf16(sb.name, strlen(sb.name), name);
 			if (!err.Succeeded())
 			{
@@ -104,69 +231,242 @@ public:
 
 			if (name.back() == L'/')
 			{
-				std::wstring destPath = std::wstring(destDir).append(L"\\").append(name);
-				destPath.pop_back();
-				Error err = Path::CreateDir(destPath);
+				dirPath.assign(name, 0, name.size() - 1);
+				const Directory* dir = nullptr;
+				err = dirs.Get(dirPath, dir);
 				if (!err.Succeeded())
 				{
-					return Error(MakeZipErrorMsg(std::wstring(L"can not create dir '").append(destPath).append(L"'. "), err.getMessage()));
+					return Error(MakeZipErrorMsg(std::wstring(L"can not create dir '").append(GetDestPath(dirPath)).append(L"'. "), err.getMessage()));
 				}
 			}
+			else if (journal != nullptr && journal->IsCompleted(sb.name, sb.size, sb.crc))
+			{
+				progress.bytesDone += sb.size;
+			}
 			else
 			{
-				const std::wstring destPath = std::wstring(destDir).append(L"\\").append(name);
-				Error err = UnpackFile(fileIndex, sb.size, destPath);
+				if (journal != nullptr)
+				{
+					// COMMENT: a read-only file left by the interrupted extraction could not be rewritten.
+					File::SetReadOnly(GetDestPath(name), false);
+				}
+
+				const size_t separator = name.find_last_of(L'/');
+				if (separator == std::wstring::npos)
+				{
+					dirPath.clear();
+					fileName.assign(name);
+				}
+				else
+				{
+					dirPath.assign(name, 0, separator);
+					fileName.assign(name, separator + 1, std::wstring::npos);
+				}
+
+				const Directory* dir = nullptr;
+				err = dirs.Get(dirPath, dir);
+				if (!err.Succeeded())
+				{
+					return Error(MakeZipErrorMsg(std::wstring(L"can not create dir '").append(GetDestPath(dirPath)).append(L"'. "), err.getMessage()));
+				}
+
+				const time_t modificationTime = (sb.valid & ZIP_STAT_MTIME) != 0 ? sb.mtime : 0;
+				err = UnpackFile(fileIndex, sb.size, modificationTime, *dir, fileName, name);
+				if (!err.Succeeded())
+				{
+					return err;
+				}
+
+				// COMMENT: a failed write is noticed some entries later, the caller reports it with the name of its own entry.
+				if (writer->Failed())
+				{
+					return Error();
+				}
+
+				err = AppendFinished(journal);
 				if (!err.Succeeded())
 				{
 					return err;
 				}
 			}
+
+			progress.entriesDone++;
+			PublishProgress();
 		}
 
 		return Error();
 	}
 
-private:
+	// COMMENT: an entry is journaled only when the writer has written, resized and handed over its file, never when its
+	// writes are merely queued.
+	Error AppendFinished(ExtractionJournal* journal)
+	{
+		writer->TakeFinished(finishedIndices);
+		if (journal == nullptr)
+		{
+			return Error();
+		}
+
+		for (uint64_t fileIndex : finishedIndices)
+		{
+			zip_stat_t sb;
+			if (zip_stat_index(zipArchive, fileIndex, 0, &sb) != 0)
+			{
+				continue;
+			}
+
+			Error err = journal->Append(sb.name, sb.size, sb.crc);
+			if (!err.Succeeded())
+			{
+				return Error(MakeZipErrorMsg(L"can not write extraction journal. ", err.getMessage()));
+			}
+		}
+
+		return Error();
+	}
 
-	Error UnpackFile(zip_int64_t fileIndex, zip_int64_t uncompressedSize, const std::wstring& destPath)
+	// COMMENT: name is the whole entry name, it is needed only for error messages.
+	Error UnpackFile(zip_int64_t fileIndex, zip_int64_t uncompressedSize, time_t modificationTime, const Directory& dir, const std::wstring& fileName,
+		const std::wstring& name)
 	{
-		static const size_t FileBufferSize = 64 * 1024;
+		static const size_t ChunksPerProgressEvent = 16;
+
+		Trace::Scope traceScope("UnpackFile");
+		if (Trace::IsEnabled())
+		{
+			const char* entryName = zip_get_name(zipArchive, fileIndex, 0);
+			traceScope.SetDetail(entryName != nullptr ? entryName : "");
+			traceScope.SetBytes(static_cast<uint64_t>(uncompressedSize));
+		}
 
-		File dstFile;
-		Error err = dstFile.OpenWrite(destPath);
+		const unsigned flags = options.temporary ? File::WriteTemporary : 0;
+		const bool direct = options.directIoThreshold != 0 && static_cast<uint64_t>(uncompressedSize) >= options.directIoThreshold;
+
+		std::unique_ptr<File> newFile(new File());
+		Error err = newFile->OpenWrite(dir, fileName, direct ? flags | File::WriteDirect : flags);
+		if (!err.Succeeded() && direct)
+		{
+			// COMMENT: file systems without direct I/O, like tmpfs, refuse to open the file. The padded writes work anyway.
+			err = newFile->OpenWrite(dir, fileName, flags);
+		}
 		if (!err.Succeeded())
 		{
-			return Error(MakeZipErrorMsg(std::wstring(L"can not create file '").append(destPath).append(L"'. "), err.getMessage()));
+			return Error(MakeZipErrorMsg(std::wstring(L"can not create file '").append(GetDestPath(name)).append(L"'. "), err.getMessage()));
+		}
+
+		// COMMENT: a file written at once is allocated in one piece anyway. A failed reservation is only a lost hint,
+		// a full disk fails the writes below.
+		if (options.preallocate && uncompressedSize > static_cast<zip_int64_t>(AsyncWriter::BufferSize))
+		{
+			newFile->Preallocate(static_cast<uint64_t>(uncompressedSize));
 		}
 
+		// COMMENT: from here the writer owns the file and closes it even if this entry fails.
+		File* dstFile = writer->Add(std::move(newFile), static_cast<uint64_t>(fileIndex));
+
 		ZipFile zipFile(zip_fopen_index(zipArchive, fileIndex, 0));
 		if (zipFile.zf == nullptr)
 		{
 			return Error(MakeZipErrorMsg(L"can not open file from archive ", ToString(*zip_get_error(zipArchive))));
 		}
 
-		std::vector<uint8_t> buffer(FileBufferSize);
 		zip_int64_t totalSize = 0;
-		while (totalSize < uncompressedSize)
+		size_t chunkCount = 0;
+		while (totalSize < uncompressedSize && !writer->Failed())
 		{
-			zip_int64_t size = zip_fread(zipFile.zf, &buffer[0], FileBufferSize);
-			if (size < 0)
+			uint8_t* buffer = writer->AcquireBuffer();
+			zip_int64_t size = zip_fread(zipFile.zf, buffer, AsyncWriter::BufferSize);
+			if (size <= 0)
 			{
-				return Error(MakeZipErrorMsg(L"can not read file from archive ", ToString(*zip_file_get_error(zipFile.zf))));
+				writer->Write(dstFile, buffer, 0);
+				return Error(MakeZipErrorMsg(L"can not read file from archive ", size < 0 ? ToString(*zip_file_get_error(zipFile.zf)) : L"unexpected end of data"));
 			}
 
-			Error err = dstFile.Write(&buffer[0], static_cast<DWORD>(size));
-			if (!err.Succeeded())
+			// COMMENT: zip_fread fills the whole buffer unless the entry ends, so only the last chunk of a direct write is padded.
+			uint32_t writeSize = static_cast<uint32_t>(size);
+			if (direct && writeSize % File::DirectIoAlignment != 0)
 			{
-				return Error(MakeZipErrorMsg(std::wstring(L"can not write to file '").append(destPath).append(L"'. "), err.getMessage()));
+				const uint32_t paddedSize = (writeSize / File::DirectIoAlignment + 1) * File::DirectIoAlignment;
+				memset(buffer + writeSize, 0, paddedSize - writeSize);
+				writeSize = paddedSize;
 			}
 
+			writer->Write(dstFile, buffer, writeSize);
 			totalSize += size;
+
+			progress.bytesDone += size;
+			if (++chunkCount % ChunksPerProgressEvent == 0)
+			{
+				PublishProgress();
+			}
 		}
 
+		// COMMENT: the JVM validates class data sharing archives against jar timestamps, so they must not change between extractions.
+		writer->Finish(dstFile, direct ? static_cast<uint64_t>(uncompressedSize) : 0, modificationTime, options.readOnly && IsReadOnly(fileIndex));
 		return Error();
 	}
 
+	bool IsReadOnly(zip_int64_t fileIndex)
+	{
+		zip_uint8_t opsys = 0;
+		zip_uint32_t attributes = 0;
+		if (zip_file_get_external_attributes(zipArchive, fileIndex, 0, &opsys, &attributes) != 0)
+		{
+			return false;
+		}
+
+		if (opsys == ZIP_OPSYS_UNIX)
+		{
+			const zip_uint32_t mode = attributes >> 16;
+			return mode != 0 && (mode & 0222) == 0;
+		}
+
+		if (opsys == ZIP_OPSYS_DOS || opsys == ZIP_OPSYS_WINDOWS_NTFS)
+		{
+			return (attributes & DosReadOnlyAttribute) != 0;
+		}
+
+		return false;
+	}
+
+	void InitProgressTotals(zip_int64_t count)
+	{
+		progress.entriesTotal = static_cast<uint32_t>(count);
+		for (zip_int64_t fileIndex = 0; fileIndex < count; fileIndex++)
+		{
+			zip_stat_t sb;
+			if (zip_stat_index(zipArchive, fileIndex, 0, &sb) == 0 && (sb.valid & ZIP_STAT_SIZE) != 0)
+			{
+				progress.bytesTotal += sb.size;
+			}
+		}
+	}
+
+	void PublishProgress()
+	{
+		if (channel != nullptr)
+		{
+			channel->Publish(progress);
+		}
+	}
+
+	Error MakeWriteError(uint64_t fileIndex, const Error& err)
+	{
+		std::wstring name;
+		const char* utf8Name = zip_get_name(zipArchive, static_cast<zip_uint64_t>(fileIndex), 0);
+		if (utf8Name != nullptr)
+		{
+			ConvertUtf8ToUtf16(utf8Name, strlen(utf8Name), name);
+		}
+
+		return Error(MakeZipErrorMsg(std::wstring(L"can not write to file '").append(GetDestPath(name)).append(L"'. "), err.getMessage()));
+	}
+
+	std::wstring GetDestPath(const std::wstring& name) const
+	{
+		return std::wstring(destRoot).append(1, Path::Separator).append(name);
+	}
+
 	std::wstring MakeZipErrorMsg(const std::wstring& msg, const std::wstring& errorMsg)
 	{
 		static const std::wstring ZipErrorMessage = L"Error in zip archive: ";
@@ -193,6 +493,12 @@ private:
 
 	zip_source_t* zipSourceBuffer = nullptr;
 	zip_t* zipArchive = nullptr;
+	ProgressChannel* channel = nullptr;
+	AsyncWriter* writer = nullptr;
+	std::vector<uint64_t> finishedIndices;
+	ProgressEvent progress;
+	std::wstring destRoot;
+	zip_archive::UnpackOptions options;
 };
 
 } // namespace
@@ -200,7 +506,8 @@ private:
 namespace zip_archive
 {
 
-Error UnpackToFolder(uint8_t* pZipContent, size_t size, const std::wstring& destPath)
+Error UnpackToFolder(uint8_t* pZipContent, size_t size, const std::wstring& destPath, ProgressChannel* progressChannel, ExtractionJournal* journal,
+	const UnpackOptions& options)
 {
 	ZipArchive zipArchive;
 	Error err = zipArchive.Open(pZipContent, size);
@@ -209,7 +516,7 @@ Error UnpackToFolder(uint8_t* pZipContent, size_t size, const std::wstring& dest
 		return err;
 	}
 
-	err = zipArchive.Unpack(destPath);
+	err = zipArchive.Unpack(destPath, progressChannel, journal, options);
 	if (!err.Succeeded())
 	{
 		return err;
@@ -219,4 +526,80 @@ Error UnpackToFolder(uint8_t* pZipContent, size_t size, const std::wstring& dest
 	return Error();
 }
 
+Error ComputeContentHash(uint8_t* pZipContent, size_t size, uint64_t& hash)
+{
+	ZipArchive zipArchive;
+	Error err = zipArchive.Open(pZipContent, size);
+	if (!err.Succeeded())
+	{
+		return err;
+	}
+
+	return zipArchive.ComputeContentHash(hash);
+}
+
+Error Decompress(uint8_t* pZipContent, size_t size, uint64_t& entries, uint64_t& bytes)
+{
+	ZipArchive zipArchive;
+	Error err = zipArchive.Open(pZipContent, size);
+	if (!err.Succeeded())
+	{
+		return err;
+	}
+
+	return zipArchive.Decompress(entries, bytes);
+}
+
+Error CompressFile(const std::wstring& srcPath, const std::wstring& entryName, const std::wstring& zipPath)
+{
+	// COMMENT: libzip takes UTF-8 paths on every platform.
+	std::string srcPathUtf8, entryNameUtf8, zipPathUtf8;
+	Error err = ConvertUtf16ToUtf8(srcPath, srcPathUtf8);
+	if (err.Succeeded())
+	{
+		err = ConvertUtf16ToUtf8(entryName, entryNameUtf8);
+	}
+	if (err.Succeeded())
+	{
+		err = ConvertUtf16ToUtf8(zipPath, zipPathUtf8);
+	}
+	if (!err.Succeeded())
+	{
+		return err;
+	}
+
+	int zipErr = 0;
+	zip_t* archive = zip_open(zipPathUtf8.c_str(), ZIP_CREATE | ZIP_TRUNCATE, &zipErr);
+	if (archive == nullptr)
+	{
+		std::wstring msg;
+		msg.append(L"can not create zip archive '").append(zipPath).append(L"', zip error = ").append(std::to_wstring(zipErr));
+		return Error(std::move(msg));
+	}
+
+	zip_source_t* source = zip_source_file(archive, srcPathUtf8.c_str(), 0, -1);
+	if (source == nullptr || zip_file_add(archive, entryNameUtf8.c_str(), source, ZIP_FL_ENC_UTF_8 | ZIP_FL_OVERWRITE) < 0)
+	{
+		if (source != nullptr)
+		{
+			zip_source_free(source);
+		}
+
+		std::wstring msg;
+		msg.append(L"can not add '").append(srcPath).append(L"' to zip archive, zip error = ").append(std::to_wstring(zip_error_code_zip(zip_get_error(archive))));
+		zip_discard(archive);
+		return Error(std::move(msg));
+	}
+
+	if (zip_close(archive) != 0)
+	{
+		std::wstring msg;
+		msg.append(L"can not write zip archive '").append(zipPath).append(L"', zip error = ").append(std::to_wstring(zip_error_code_zip(zip_get_error(archive))));
+		zip_discard(archive);
+		return Error(std::move(msg));
+	}
+
+	return Error();
+}
+
 } // namespace zip_archive
\ No newline at end of file
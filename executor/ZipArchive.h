@@ -1,12 +1,42 @@
 #pragma once
 
 #include "Error.hpp"
+#include "ProgressChannel.h"
 #include <vector>
 #include <string>
 
+class ExtractionJournal;
+
 namespace zip_archive
 {
 
-Error UnpackToFolder(uint8_t* pZipContent, size_t size, const std::wstring& destPath);
+struct UnpackOptions
+{
+	// COMMENT: the files are removed when the run ends, so they are created temporary and kept in the cache.
+	bool temporary = false;
+	// COMMENT: entries marked read-only in the archive become read-only files. Only for directories kept between runs,
+	// where a private clone may share such files by hardlinks; a per-run directory stays writable for the application.
+	bool readOnly = false;
+	// COMMENT: files larger than one write get their disk space reserved before they are written.
+	bool preallocate = true;
+	// COMMENT: files of at least this size are written past the page cache, so unpacking a large payload does not evict
+	// the cache of other programs. 0 writes every file through the cache.
+	uint64_t directIoThreshold = 0;
+};
+
+// COMMENT: with a journal, entries it reports as completed are skipped and every unpacked file is appended to it.
+Error UnpackToFolder(uint8_t* pZipContent, size_t size, const std::wstring& destPath, ProgressChannel* progressChannel = nullptr,
+	ExtractionJournal* journal = nullptr, const UnpackOptions& options = UnpackOptions());
+
+// COMMENT: hash of entry names, sizes and CRCs from the central directory, cheap to compute even for a large archive.
+// hash is an in/out value so several archives can be chained.
+Error ComputeContentHash(uint8_t* pZipContent, size_t size, uint64_t& hash);
+
+// COMMENT: decompresses every entry in memory and discards the data, measures the CPU side of an extraction.
+// entries and bytes are in/out values so several archives can be chained.
+Error Decompress(uint8_t* pZipContent, size_t size, uint64_t& entries, uint64_t& bytes);
+
+// COMMENT: creates zipPath containing the single deflated entry entryName with the content of srcPath.
+Error CompressFile(const std::wstring& srcPath, const std::wstring& entryName, const std::wstring& zipPath);
 
 }
\ No newline at end of file
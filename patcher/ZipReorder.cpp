@@ -0,0 +1,192 @@
+#include "ZipReorder.h"
+#include "../common/StringConverter.hpp"
+#include <fstream>
+#include <unordered_map>
+
+#define ZIP_STATIC
+#include <zip.h>
+
+namespace
+{
+
+std::wstring MakeZipError(const std::wstring& msg, zip_t* archive)
+{
+	std::wstring result(msg);
+	result.append(L", zip error = ").append(std::to_wstring(zip_error_code_zip(zip_get_error(archive))));
+	return result;
+}
+
+Error CopyEntry(zip_t* src, zip_uint64_t srcIndex, zip_t* dest)
+{
+	zip_stat_t sb;
+	if (zip_stat_index(src, srcIndex, 0, &sb) != 0)
+	{
+		return Error(MakeZipError(L"can not stat entry", src));
+	}
+
+	const std::string name(sb.name);
+	if (!name.empty() && name.back() == '/')
+	{
+		if (zip_dir_add(dest, name.c_str(), ZIP_FL_ENC_UTF_8) < 0)
+		{
+			return Error(MakeZipError(L"can not add directory", dest));
+		}
+		return Error();
+	}
+
+	zip_source_t* source = zip_source_zip(dest, src, srcIndex, 0, 0, -1);
+	if (source == nullptr)
+	{
+		return Error(MakeZipError(L"can not read entry", dest));
+	}
+
+	const zip_int64_t destIndex = zip_file_add(dest, name.c_str(), source, ZIP_FL_ENC_UTF_8);
+	if (destIndex < 0)
+	{
+		zip_source_free(source);
+		return Error(MakeZipError(L"can not add entry", dest));
+	}
+
+	// COMMENT: the executor restores the time and the read-only attribute from the entry.
+	zip_uint8_t opsys = 0;
+	zip_uint32_t attributes = 0;
+	if (zip_file_get_external_attributes(src, srcIndex, 0, &opsys, &attributes) == 0)
+	{
+		zip_file_set_external_attributes(dest, destIndex, 0, opsys, attributes);
+	}
+	if ((sb.valid & ZIP_STAT_MTIME) != 0)
+	{
+		zip_file_set_mtime(dest, destIndex, sb.mtime, 0);
+	}
+	if ((sb.valid & ZIP_STAT_COMP_METHOD) != 0)
+	{
+		zip_set_file_compression(dest, destIndex, sb.comp_method, 0);
+	}
+
+	return Error();
+}
+
+} // namespace
+
+Error LoadAccessProfile(const std::wstring& profilePath, std::vector<std::string>& entries)
+{
+	entries.clear();
+
+	std::ifstream profile(profilePath, std::ios::in | std::ios::binary);
+	if (!profile)
+	{
+		std::wstring msg;
+		msg.append(L"can not read access profile '").append(profilePath).append(L"'");
+		return Error(std::move(msg));
+	}
+
+	std::string line;
+	while (std::getline(profile, line))
+	{
+		if (!line.empty() && line.back() == '\r')
+		{
+			line.pop_back();
+		}
+		if (!line.empty())
+		{
+			entries.push_back(line);
+		}
+	}
+
+	return Error();
+}
+
+Error ReorderZip(const std::wstring& srcZipPath, const std::vector<std::string>& profile, const std::wstring& destZipPath)
+{
+	std::string srcPathUtf8, destPathUtf8;
+	Error err = ConvertUtf16ToUtf8(srcZipPath, srcPathUtf8);
+	if (err.Succeeded())
+	{
+		err = ConvertUtf16ToUtf8(destZipPath, destPathUtf8);
+	}
+	if (!err.Succeeded())
+	{
+		return err;
+	}
+
+	int zipErr = 0;
+	zip_t* src = zip_open(srcPathUtf8.c_str(), ZIP_RDONLY, &zipErr);
+	if (src == nullptr)
+	{
+		std::wstring msg;
+		msg.append(L"can not open zip archive '").append(srcZipPath).append(L"', zip error = ").append(std::to_wstring(zipErr));
+		return Error(std::move(msg));
+	}
+
+	zip_t* dest = zip_open(destPathUtf8.c_str(), ZIP_CREATE | ZIP_TRUNCATE, &zipErr);
+	if (dest == nullptr)
+	{
+		zip_discard(src);
+
+		std::wstring msg;
+		msg.append(L"can not create zip archive '").append(destZipPath).append(L"', zip error = ").append(std::to_wstring(zipErr));
+		return Error(std::move(msg));
+	}
+
+	const zip_int64_t count = zip_get_num_entries(src, 0);
+	std::unordered_map<std::string, zip_uint64_t> files;
+	std::vector<zip_uint64_t> order;
+	std::vector<bool> placed(static_cast<size_t>(count), false);
+	for (zip_int64_t i = 0; i < count; i++)
+	{
+		const char* name = zip_get_name(src, i, 0);
+		if (name == nullptr)
+		{
+			continue;
+		}
+
+		const std::string entryName(name);
+		if (!entryName.empty() && entryName.back() == '/')
+		{
+			order.push_back(i);
+			placed[i] = true;
+		}
+		else
+		{
+			files.emplace(entryName, i);
+		}
+	}
+
+	for (const std::string& entryName : profile)
+	{
+		auto it = files.find(entryName);
+		if (it != files.end() && !placed[it->second])
+		{
+			order.push_back(it->second);
+			placed[it->second] = true;
+		}
+	}
+
+	for (zip_int64_t i = 0; i < count; i++)
+	{
+		if (!placed[i])
+		{
+			order.push_back(i);
+		}
+	}
+
+	for (size_t i = 0; i < order.size() && err.Succeeded(); i++)
+	{
+		err = CopyEntry(src, order[i], dest);
+	}
+
+	// COMMENT: entry data is read from src while dest is written, so src is closed last.
+	if (err.Succeeded() && zip_close(dest) != 0)
+	{
+		std::wstring msg;
+		msg.append(L"can not write zip archive '").append(destZipPath).append(L"'");
+		err = Error(MakeZipError(msg, dest));
+	}
+	if (!err.Succeeded())
+	{
+		zip_discard(dest);
+	}
+
+	zip_discard(src);
+	return err;
+}
@@ -0,0 +1,14 @@
+#pragma once
+
+#include "../common/Error.hpp"
+#include <string>
+#include <vector>
+
+// COMMENT: reads a profile written by the executor in a profiling run (INFOMAXIMUM_ACCESS_PROFILE),
+// one '/' separated entry name per line in the order of the first access.
+Error LoadAccessProfile(const std::wstring& profilePath, std::vector<std::string>& entries);
+
+// COMMENT: writes destZipPath with the entries of srcZipPath reordered: directories first, so they exist before
+// their files are unpacked, then the files of the profile in profile order, then the rest in the original order.
+// Whole entries are copied by libzip without recompression, names, times and attributes are kept.
+Error ReorderZip(const std::wstring& srcZipPath, const std::vector<std::string>& profile, const std::wstring& destZipPath);
@@ -0,0 +1,140 @@
+#include "Check.hpp"
+#include "AccessProfile.h"
+#include "Cleanup.h"
+#include "File.h"
+#include "Path.hpp"
+#include <string>
+#include <vector>
+
+// COMMENT: files of a temporary tree are opened in a known order after Start, the profile must list each of them once,
+// in the order of the first open, relative to the root with '/' at every depth. Opens of directories and of files
+// outside the tree are not recorded.
+
+namespace
+{
+
+std::wstring Join(const std::wstring& dir, const wchar_t* name)
+{
+	return std::wstring(dir).append(1, Path::Separator).append(name);
+}
+
+bool MakeFile(const std::wstring& path)
+{
+	File file;
+	const uint8_t content = 1;
+	return CHECK(file.OpenWrite(path).Succeeded()) && CHECK(file.Write(&content, 1).Succeeded());
+}
+
+void OpenFile(const std::wstring& path)
+{
+	File file;
+	CHECK(file.OpenRead(path).Succeeded());
+}
+
+bool ReadProfile(const std::wstring& path, std::vector<std::string>& lines)
+{
+	File file;
+	std::vector<uint8_t> content;
+	if (!CHECK(file.OpenRead(path).Succeeded()) || !CHECK(file.Read(content).Succeeded()))
+	{
+		return false;
+	}
+
+	lines.clear();
+	std::string line;
+	for (const uint8_t c : content)
+	{
+		if (c == '\n')
+		{
+			lines.push_back(line);
+			line.clear();
+		}
+		else
+		{
+			line.push_back(static_cast<char>(c));
+		}
+	}
+	return CHECK(line.empty());
+}
+
+void CheckOrder(const std::wstring& dir)
+{
+	const std::wstring root = Join(dir, L"root");
+	const std::wstring lib = Join(root, L"lib");
+	const std::wstring modules = Join(lib, L"modules");
+	const std::wstring outside = Join(dir, L"outside");
+	if (!CHECK(Path::CreateDir(root).Succeeded()) || !CHECK(Path::CreateDir(lib).Succeeded())
+		|| !CHECK(Path::CreateDir(modules).Succeeded()))
+	{
+		return;
+	}
+
+	const std::wstring release = Join(root, L"release");
+	const std::wstring jvm = Join(lib, L"jvm.cfg");
+	const std::wstring image = Join(modules, L"image");
+	const std::wstring unused = Join(lib, L"unused");
+	if (!MakeFile(release) || !MakeFile(jvm) || !MakeFile(image) || !MakeFile(unused) || !MakeFile(outside))
+	{
+		return;
+	}
+
+	AccessProfile profile;
+	if (!CHECK(profile.Start(root).Succeeded()))
+	{
+		return;
+	}
+
+	OpenFile(image);
+	OpenFile(outside);
+	OpenFile(release);
+	OpenFile(image);
+	OpenFile(jvm);
+	OpenFile(release);
+	{
+		Directory opened;
+		CHECK(opened.Open(modules).Succeeded());
+	}
+
+	const std::wstring profilePath = Join(dir, L"profile.txt");
+	if (!CHECK(profile.Stop(profilePath).Succeeded()))
+	{
+		return;
+	}
+
+	std::vector<std::string> lines;
+	if (ReadProfile(profilePath, lines))
+	{
+		CHECK(lines == std::vector<std::string>({ "lib/modules/image", "release", "lib/jvm.cfg" }));
+	}
+
+	// COMMENT: opens after Stop belong to no run.
+	OpenFile(unused);
+	CHECK(profile.Stop(profilePath).Succeeded());
+	if (ReadProfile(profilePath, lines))
+	{
+		CHECK(lines.size() == 3);
+	}
+}
+
+void CheckMissingRoot(const std::wstring& dir)
+{
+	AccessProfile profile;
+	CHECK(!profile.Start(Join(dir, L"missing")).Succeeded());
+}
+
+} // namespace
+
+int main()
+{
+	std::wstring dir;
+	if (!CHECK(Path::GetTempDirPath(L"infomaximum_test_", dir).Succeeded()))
+	{
+		return TEST_RESULT();
+	}
+
+	CheckOrder(dir);
+	CheckMissingRoot(dir);
+
+	Cleanup::RemoveTree(dir);
+	return TEST_RESULT();
+}
@@ -0,0 +1,271 @@
+#include "Check.hpp"
+#include "AsyncWriter.h"
+#include "Cleanup.h"
+#include "CloseQueue.h"
+#include "Path.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+#ifndef _WIN32
+#include <sys/stat.h>
+#endif
+
+// COMMENT: files are written through the pool of buffers, each with more chunks than BufferCount so AcquireBuffer has
+// to wait for the writer thread, then read back. Only files written and finished without a failure are reported by
+// TakeFinished. After a failure the remaining operations must be skipped without losing a buffer, and the failure must
+// name the file it happened on. Every check runs with batched and with synchronous writes, batched writes complete
+// out of order and so may finish files out of order.
+
+namespace
+{
+
+const time_t ModificationTime = 1500000000;
+const uint64_t FirstTag = 7;
+const uint64_t SecondTag = 8;
+
+std::vector<uint8_t> MakeContent(size_t size, uint8_t seed)
+{
+	std::vector<uint8_t> content(size);
+	for (size_t i = 0; i < size; i++)
+	{
+		content[i] = static_cast<uint8_t>(i * 31 + seed);
+	}
+	return content;
+}
+
+// COMMENT: the content is written in BufferSize chunks, the last one padded to a full buffer as direct writes are.
+void WriteContent(AsyncWriter& writer, File* file, const std::vector<uint8_t>& content, bool padded)
+{
+	for (size_t offset = 0; offset < content.size(); offset += AsyncWriter::BufferSize)
+	{
+		const size_t left = content.size() - offset;
+		const uint32_t size = static_cast<uint32_t>(left < AsyncWriter::BufferSize ? left : AsyncWriter::BufferSize);
+		uint8_t* buffer = writer.AcquireBuffer();
+		memset(buffer, 0xEE, AsyncWriter::BufferSize);
+		memcpy(buffer, &content[offset], size);
+		writer.Write(file, buffer, padded ? AsyncWriter::BufferSize : size);
+	}
+}
+
+bool HasContent(const std::wstring& path, const std::vector<uint8_t>& content)
+{
+	File file;
+	std::vector<uint8_t> actual;
+	return file.OpenRead(path).Succeeded() && file.Read(actual).Succeeded() && actual == content;
+}
+
+#ifdef _WIN32
+bool IsReadOnly(const std::wstring& path)
+{
+	const DWORD attributes = GetFileAttributesW(path.c_str());
+	return attributes != INVALID_FILE_ATTRIBUTES && (attributes & FILE_ATTRIBUTE_READONLY) != 0;
+}
+
+bool HasModificationTime(const std::wstring& /*path*/, time_t /*time*/)
+{
+	return true;
+}
+#else
+bool GetStat(const std::wstring& path, struct stat& sb)
+{
+	std::string nativePath;
+	return ConvertUtf16ToUtf8(path, nativePath).Succeeded() && stat(nativePath.c_str(), &sb) == 0;
+}
+
+bool IsReadOnly(const std::wstring& path)
+{
+	struct stat sb;
+	return GetStat(path, sb) && (sb.st_mode & (S_IWUSR | S_IWGRP | S_IWOTH)) == 0;
+}
+
+bool HasModificationTime(const std::wstring& path, time_t time)
+{
+	struct stat sb;
+	return GetStat(path, sb) && sb.st_mtime == time;
+}
+#endif
+
+std::wstring GetFilePath(const std::wstring& dir, const wchar_t* name)
+{
+	return std::wstring(dir).append(1, Path::Separator).append(name);
+}
+
+File* AddFile(AsyncWriter& writer, const std::wstring& path, uint64_t tag)
+{
+	std::unique_ptr<File> file(new File());
+	if (!CHECK(file->OpenWrite(path).Succeeded()))
+	{
+		return nullptr;
+	}
+	return writer.Add(std::move(file), tag);
+}
+
+std::vector<uint64_t> TakeSortedFinished(AsyncWriter& writer)
+{
+	std::vector<uint64_t> finished;
+	writer.TakeFinished(finished);
+	std::sort(finished.begin(), finished.end());
+	return finished;
+}
+
+void CheckWrites(const std::wstring& dir, bool batchWrites)
+{
+	const std::wstring firstPath = GetFilePath(dir, L"first");
+	const std::wstring secondPath = GetFilePath(dir, L"second");
+	const std::vector<uint8_t> firstContent = MakeContent(AsyncWriter::BufferSize * (AsyncWriter::BufferCount + 3) + 123, 1);
+	const std::vector<uint8_t> secondContent = MakeContent(AsyncWriter::BufferSize * 2 + 5, 2);
+
+	CloseQueue closeQueue;
+	{
+		AsyncWriter writer(closeQueue, batchWrites);
+		File* first = AddFile(writer, firstPath, FirstTag);
+		File* second = AddFile(writer, secondPath, SecondTag);
+		if (first == nullptr || second == nullptr)
+		{
+			return;
+		}
+
+		WriteContent(writer, first, firstContent, false);
+		writer.Write(first, writer.AcquireBuffer(), 0);
+		writer.Finish(first, 0, ModificationTime, true);
+
+		// COMMENT: the padding of the last chunk is cut off by the size passed to Finish.
+		WriteContent(writer, second, secondContent, true);
+		writer.Finish(second, secondContent.size(), 0, false);
+
+		uint64_t failedTag = 0;
+		CHECK(writer.Wait(failedTag).Succeeded());
+		CHECK(!writer.Failed());
+
+		CHECK(TakeSortedFinished(writer) == std::vector<uint64_t>({ FirstTag, SecondTag }));
+		CHECK(TakeSortedFinished(writer).empty());
+	}
+	closeQueue.Wait();
+
+	CHECK(HasContent(firstPath, firstContent));
+	CHECK(HasContent(secondPath, secondContent));
+	CHECK(IsReadOnly(firstPath));
+	CHECK(!IsReadOnly(secondPath));
+	CHECK(HasModificationTime(firstPath, ModificationTime));
+
+	File::SetReadOnly(firstPath, false);
+}
+
+void CheckFailure(const std::wstring& dir, bool batchWrites)
+{
+	const std::vector<uint8_t> content = MakeContent(AsyncWriter::BufferSize * (AsyncWriter::BufferCount + 1), 3);
+
+	CloseQueue closeQueue;
+	AsyncWriter writer(closeQueue, batchWrites);
+
+	// COMMENT: a file that was never opened fails its first write.
+	File* broken = writer.Add(std::unique_ptr<File>(new File()), FirstTag);
+	File* skipped = AddFile(writer, GetFilePath(dir, L"skipped"), SecondTag);
+	if (skipped == nullptr)
+	{
+		return;
+	}
+
+	WriteContent(writer, broken, content, false);
+	writer.Finish(broken, 0, 0, false);
+	WriteContent(writer, skipped, content, false);
+	writer.Finish(skipped, 0, 0, false);
+
+	uint64_t failedTag = 0;
+	CHECK(!writer.Wait(failedTag).Succeeded());
+	CHECK(failedTag == FirstTag);
+	CHECK(writer.Failed());
+
+	// COMMENT: neither the failed file nor the skipped one may be journaled.
+	CHECK(TakeSortedFinished(writer).empty());
+
+	// COMMENT: would wait forever if a skipped write kept its buffer.
+	std::vector<uint8_t*> buffers;
+	for (size_t i = 0; i < AsyncWriter::BufferCount; i++)
+	{
+		buffers.push_back(writer.AcquireBuffer());
+	}
+	for (uint8_t* buffer : buffers)
+	{
+		writer.Write(skipped, buffer, 0);
+	}
+	CHECK(!writer.Wait(failedTag).Succeeded());
+}
+
+void CheckManyFiles(const std::wstring& dir, bool batchWrites)
+{
+	// COMMENT: more empty files than MaxPendingFiles, Add must wait for the writer and not for the caller.
+	const size_t fileCount = AsyncWriter::MaxPendingFiles * 3;
+
+	CloseQueue closeQueue;
+	AsyncWriter writer(closeQueue, batchWrites);
+	std::vector<uint64_t> expected;
+	for (size_t i = 0; i < fileCount; i++)
+	{
+		File* file = AddFile(writer, GetFilePath(dir, std::wstring(L"empty").append(std::to_wstring(i)).c_str()), i);
+		if (file == nullptr)
+		{
+			return;
+		}
+		writer.Finish(file, 0, 0, false);
+		expected.push_back(i);
+	}
+
+	uint64_t failedTag = 0;
+	CHECK(writer.Wait(failedTag).Succeeded());
+
+	CHECK(TakeSortedFinished(writer) == expected);
+}
+
+void CheckUnfinished(const std::wstring& dir, bool batchWrites)
+{
+	const std::vector<uint8_t> content = MakeContent(AsyncWriter::BufferSize + 1, 4);
+
+	CloseQueue closeQueue;
+	{
+		// COMMENT: unpacking stopped before the file was finished, the destructor closes it.
+		AsyncWriter writer(closeQueue, batchWrites);
+		File* file = AddFile(writer, GetFilePath(dir, L"unfinished"), FirstTag);
+		if (file == nullptr)
+		{
+			return;
+		}
+		WriteContent(writer, file, content, false);
+	}
+
+	CHECK(File::Delete(GetFilePath(dir, L"unfinished")).Succeeded());
+}
+
+} // namespace
+
+int main()
+{
+	std::wstring dir;
+	if (!CHECK(Path::GetTempDirPath(L"infomaximum_test_", dir).Succeeded()))
+	{
+		return TEST_RESULT();
+	}
+
+	for (const bool batchWrites : { true, false })
+	{
+		CheckWrites(dir, batchWrites);
+		CheckFailure(dir, batchWrites);
+		CheckManyFiles(dir, batchWrites);
+		CheckUnfinished(dir, batchWrites);
+	}
+
+#ifdef __linux__
+	// COMMENT: where io_uring is forbidden the writer falls back, say so rather than pass silently.
+	CloseQueue closeQueue;
+	if (!AsyncWriter(closeQueue).IsBatched())
+	{
+		std::printf("io_uring is not available, only synchronous writes were checked\n");
+	}
+#endif
+
+	Cleanup::RemoveTree(dir);
+	return TEST_RESULT();
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <cstdio>
+#include <cstdlib>
+
+// COMMENT: the tests are plain executables run by ctest. A failed CHECK is reported with its location and
+// the test carries on, TEST_RESULT makes main fail if any check failed.
+namespace test
+{
+
+inline unsigned& FailureCount()
+{
+	static unsigned failures = 0;
+	return failures;
+}
+
+inline bool Report(bool passed, const char* expression, const char* file, int line)
+{
+	if (!passed)
+	{
+		FailureCount()++;
+		std::fprintf(stderr, "%s(%d): check failed: %s\n", file, line, expression);
+	}
+	return passed;
+}
+
+}
+
+#define CHECK(expression) test::Report((expression) ? true : false, #expression, __FILE__, __LINE__)
+
+#define TEST_RESULT() (test::FailureCount() == 0 ? EXIT_SUCCESS : EXIT_FAILURE)
@@ -0,0 +1,194 @@
+#include "Check.hpp"
+#include "ChildProcess.h"
+#include "File.h"
+#include "Path.hpp"
+#include <chrono>
+#include <cstring>
+#include <string>
+#include <thread>
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+// COMMENT: the ready handshake with the test executable itself standing in for java. Started with ChildArg, it connects
+// to the pipe named in ChildProcess::ReadyPipeVariable if asked to, waits until the parent creates the release file
+// named in ReleaseVariable, and exits with the requested code. Without the handshake it exits right away.
+
+namespace
+{
+
+const char* const ChildArg = "--child";
+const wchar_t* const ReleaseVariable = L"INFOMAXIMUM_TEST_RELEASE";
+const wchar_t* const ExpectedVariable = L"INFOMAXIMUM_TEST_EXPECTED";
+const wchar_t* const ExpectedValue = L"value with spaces";
+
+// COMMENT: the child exits with these when its environment is not what the parent passed.
+const int NoReadyPipe = 90;
+const int UnexpectedValue = 91;
+
+#ifdef _WIN32
+const ChildProcess::NativeHandle NoOutput = NULL;
+#else
+const ChildProcess::NativeHandle NoOutput = -1;
+#endif
+
+std::wstring GetVariable(const wchar_t* name)
+{
+#ifdef _WIN32
+	const wchar_t* value = _wgetenv(name);
+	return value != nullptr ? std::wstring(value) : std::wstring();
+#else
+	std::string nativeName;
+	ConvertUtf16ToUtf8(name, nativeName);
+	const char* value = getenv(nativeName.c_str());
+	std::wstring result;
+	if (value != nullptr)
+	{
+		ConvertUtf8ToUtf16(std::string(value), result);
+	}
+	return result;
+#endif
+}
+
+void SetVariable(const wchar_t* name, const wchar_t* value)
+{
+#ifdef _WIN32
+	SetEnvironmentVariableW(name, value);
+	_wputenv_s(name, value);
+#else
+	std::string nativeName;
+	std::string nativeValue;
+	ConvertUtf16ToUtf8(name, nativeName);
+	ConvertUtf16ToUtf8(value, nativeValue);
+	setenv(nativeName.c_str(), nativeValue.c_str(), 1);
+#endif
+}
+
+bool ConnectReadyPipe()
+{
+	const std::wstring pipeName = GetVariable(ChildProcess::ReadyPipeVariable);
+#ifdef _WIN32
+	const HANDLE hPipe = CreateFileW(pipeName.c_str(), GENERIC_WRITE, 0, NULL, OPEN_EXISTING, 0, NULL);
+	if (hPipe == INVALID_HANDLE_VALUE)
+	{
+		return false;
+	}
+	CloseHandle(hPipe);
+#else
+	std::string path;
+	ConvertUtf16ToUtf8(pipeName, path);
+	const int fd = open(path.c_str(), O_WRONLY | O_NONBLOCK);
+	if (fd < 0)
+	{
+		return false;
+	}
+	close(fd);
+#endif
+	return true;
+}
+
+int RunChild(bool connect, int exitCode)
+{
+	if (GetVariable(ExpectedVariable) != ExpectedValue)
+	{
+		return UnexpectedValue;
+	}
+
+	if (!connect)
+	{
+		return exitCode;
+	}
+
+	if (!ConnectReadyPipe())
+	{
+		return NoReadyPipe;
+	}
+
+	// COMMENT: the child stays alive until the parent has seen the handshake, so exit can not overtake it.
+	const std::wstring releasePath = GetVariable(ReleaseVariable);
+	for (int i = 0; i < 3000 && !releasePath.empty() && !File::Exists(releasePath); i++)
+	{
+		std::this_thread::sleep_for(std::chrono::milliseconds(10));
+	}
+
+	return exitCode;
+}
+
+std::wstring MakeChildCommand(bool connect, int exitCode)
+{
+	std::wstring executable;
+	Path::GetApplicationFilePath(executable);
+
+	std::wstring cmd;
+	cmd.append(L"\"").append(executable).append(L"\" ");
+	for (const char* arg = ChildArg; *arg != '\0'; arg++)
+	{
+		cmd.push_back(static_cast<wchar_t>(*arg));
+	}
+	cmd.append(connect ? L" ready " : L" silent ").append(std::to_wstring(exitCode));
+	return cmd;
+}
+
+void CheckHandshake(bool connect, int exitCode)
+{
+	std::wstring releasePath;
+	if (!CHECK(Path::GetTempDirPath(L"infomaximum_test_", releasePath).Succeeded()))
+	{
+		return;
+	}
+	const std::wstring releaseDir = releasePath;
+	releasePath.push_back(Path::Separator);
+	releasePath.append(L"release");
+
+	ChildProcess::Environment environment;
+	environment.emplace_back(ExpectedVariable, ExpectedValue);
+	environment.emplace_back(ReleaseVariable, releasePath);
+
+	ChildProcess child;
+	if (CHECK(child.Start(MakeChildCommand(connect, exitCode), std::wstring(), NoOutput, environment).Succeeded()))
+	{
+		ChildProcess::State state = ChildProcess::State::Exited;
+		CHECK(child.WaitReady(state).Succeeded());
+		CHECK(state == (connect ? ChildProcess::State::Ready : ChildProcess::State::Exited));
+
+		File release;
+		CHECK(release.OpenWrite(releasePath).Succeeded());
+		release.Close();
+
+		uint32_t actualExitCode = 0;
+		CHECK(child.WaitExit(actualExitCode).Succeeded());
+		CHECK(actualExitCode == static_cast<uint32_t>(exitCode));
+	}
+
+	File::Delete(releasePath);
+#ifdef _WIN32
+	RemoveDirectoryW(releaseDir.c_str());
+#else
+	std::string nativeDir;
+	ConvertUtf16ToUtf8(releaseDir, nativeDir);
+	rmdir(nativeDir.c_str());
+#endif
+}
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+	if (argc == 4 && strcmp(argv[1], ChildArg) == 0)
+	{
+		return RunChild(strcmp(argv[2], "ready") == 0, atoi(argv[3]));
+	}
+
+	// COMMENT: the variables of this process must not reach the child when the parent passes its own values.
+	SetVariable(ChildProcess::ReadyPipeVariable, L"stale_pipe_name");
+	SetVariable(ExpectedVariable, L"stale value");
+
+	CheckHandshake(true, 0);
+	CheckHandshake(true, 7);
+	CheckHandshake(false, 3);
+
+	return TEST_RESULT();
+}
@@ -0,0 +1,263 @@
+#include "Check.hpp"
+#include "Cleanup.h"
+#include "File.h"
+#include "FileLock.h"
+#include "Path.hpp"
+#include <chrono>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <dirent.h>
+#include <unistd.h>
+#endif
+
+// COMMENT: trees are removed in place and through tombstones. The temp and cache directories point into a directory
+// of the test, so the sweeper, the test executable itself started with Cleanup::SweepArg, never touches the tombstones
+// of real runs.
+
+namespace
+{
+
+const char* const TombstonePrefix = "infomaximum_tombstone_";
+const int TreeDepth = 4;
+const int TreeWidth = 3;
+
+void SetVariable(const wchar_t* name, const std::wstring& value)
+{
+#ifdef _WIN32
+	SetEnvironmentVariableW(name, value.c_str());
+#else
+	std::string nativeName;
+	std::string nativeValue;
+	ConvertUtf16ToUtf8(name, nativeName);
+	ConvertUtf16ToUtf8(value, nativeValue);
+	setenv(nativeName.c_str(), nativeValue.c_str(), 1);
+#endif
+}
+
+std::wstring Join(const std::wstring& dir, const std::wstring& name)
+{
+	return std::wstring(dir).append(1, Path::Separator).append(name);
+}
+
+bool MakeTree(const std::wstring& dir, int depth)
+{
+	if (!Path::CreateDir(dir).Succeeded())
+	{
+		return false;
+	}
+
+	for (int i = 0; i < TreeWidth; i++)
+	{
+		File file;
+		if (!file.OpenWrite(Join(dir, std::wstring(L"file").append(std::to_wstring(i)))).Succeeded())
+		{
+			return false;
+		}
+
+		if (depth > 0 && !MakeTree(Join(dir, std::wstring(L"dir").append(std::to_wstring(i))), depth - 1))
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+size_t CountTombstones(const std::wstring& dir)
+{
+	size_t count = 0;
+#ifdef _WIN32
+	WIN32_FIND_DATAW data;
+	const HANDLE hFind = FindFirstFileW(Join(dir, L"infomaximum_tombstone_*").c_str(), &data);
+	if (hFind != INVALID_HANDLE_VALUE)
+	{
+		do
+		{
+			count++;
+		} while (FindNextFileW(hFind, &data));
+		FindClose(hFind);
+	}
+#else
+	std::string nativeDir;
+	ConvertUtf16ToUtf8(dir, nativeDir);
+	DIR* pDir = opendir(nativeDir.c_str());
+	if (pDir != nullptr)
+	{
+		while (const dirent* entry = readdir(pDir))
+		{
+			if (strncmp(entry->d_name, TombstonePrefix, strlen(TombstonePrefix)) == 0)
+			{
+				count++;
+			}
+		}
+		closedir(pDir);
+	}
+#endif
+	return count;
+}
+
+void CheckRemoveTree(const std::wstring& root)
+{
+	const std::wstring tree = Join(root, L"tree");
+	if (!CHECK(MakeTree(tree, TreeDepth)))
+	{
+		return;
+	}
+
+	Cleanup::RemoveTree(tree);
+	CHECK(!File::Exists(tree));
+
+	// COMMENT: nothing to remove is not a failure.
+	Cleanup::RemoveTree(tree);
+}
+
+#ifndef _WIN32
+void CheckSymbolicLink(const std::wstring& root)
+{
+	const std::wstring tree = Join(root, L"linking");
+	const std::wstring target = Join(root, L"target");
+	if (!CHECK(MakeTree(tree, 1)) || !CHECK(MakeTree(target, 0)))
+	{
+		return;
+	}
+
+	std::string nativeTarget;
+	std::string nativeLink;
+	ConvertUtf16ToUtf8(target, nativeTarget);
+	ConvertUtf16ToUtf8(Join(Join(tree, L"dir0"), L"link"), nativeLink);
+	if (!CHECK(symlink(nativeTarget.c_str(), nativeLink.c_str()) == 0))
+	{
+		return;
+	}
+
+	Cleanup::RemoveTree(tree);
+	CHECK(!File::Exists(tree));
+	CHECK(File::Exists(Join(target, L"file0")));
+
+	// COMMENT: a link passed as the tree is removed, the directory it points to is kept.
+	const std::wstring link = Join(root, L"link");
+	std::string nativeRootLink;
+	ConvertUtf16ToUtf8(link, nativeRootLink);
+	if (CHECK(symlink(nativeTarget.c_str(), nativeRootLink.c_str()) == 0))
+	{
+		Cleanup::RemoveTree(link);
+		CHECK(!File::Exists(link));
+		CHECK(File::Exists(Join(target, L"file0")));
+	}
+
+	Cleanup::RemoveTree(target);
+}
+#endif
+
+void CheckRemove(const std::wstring& root)
+{
+	const std::wstring tree = Join(root, L"removed");
+	if (!CHECK(MakeTree(tree, TreeDepth)))
+	{
+		return;
+	}
+
+	// COMMENT: the path is free at once, the tombstone is removed by the sweeper in the background.
+	Cleanup::Remove(tree);
+	CHECK(!File::Exists(tree));
+
+	for (int i = 0; i < 1000 && CountTombstones(root) != 0; i++)
+	{
+		std::this_thread::sleep_for(std::chrono::milliseconds(10));
+	}
+	CHECK(CountTombstones(root) == 0);
+}
+
+void CheckSweep(const std::wstring& root)
+{
+	// COMMENT: left by a run that crashed before its sweeper started.
+	if (!CHECK(MakeTree(Join(root, L"infomaximum_tombstone_1_0"), 1)) || !CHECK(MakeTree(Join(root, L"kept"), 0)))
+	{
+		return;
+	}
+
+	Cleanup::Sweep();
+	CHECK(CountTombstones(root) == 0);
+	CHECK(File::Exists(Join(Join(root, L"kept"), L"file0")));
+}
+
+// COMMENT: a sweeper waits for the one before it to finish and lists the tombstones only then.
+void CheckSweepersTakeTurns(const std::wstring& root)
+{
+	const std::wstring tombstone = Join(root, L"infomaximum_tombstone_2_0");
+	if (!CHECK(MakeTree(tombstone, 1)))
+	{
+		return;
+	}
+
+	FileLock lock;
+	if (!CHECK(lock.Lock(Join(root, L"infomaximum_sweeper.lock")).Succeeded()))
+	{
+		return;
+	}
+
+	std::thread sweeper(&Cleanup::Sweep);
+	std::this_thread::sleep_for(std::chrono::milliseconds(300));
+	CHECK(File::Exists(tombstone));
+
+	lock.Unlock();
+	sweeper.join();
+	CHECK(CountTombstones(root) == 0);
+
+	for (int i = 0; i < 4; i++)
+	{
+		CHECK(MakeTree(Join(root, std::wstring(L"infomaximum_tombstone_3_").append(std::to_wstring(i))), TreeDepth));
+	}
+
+	std::vector<std::thread> sweepers;
+	for (int i = 0; i < 4; i++)
+	{
+		sweepers.emplace_back(&Cleanup::Sweep);
+	}
+	for (std::thread& concurrent : sweepers)
+	{
+		concurrent.join();
+	}
+	CHECK(CountTombstones(root) == 0);
+}
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+	if (argc == 2 && strcmp(argv[1], Cleanup::SweepArg) == 0)
+	{
+		Cleanup::Sweep();
+		return EXIT_SUCCESS;
+	}
+
+	std::wstring root;
+	if (!CHECK(Path::GetTempDirPath(L"infomaximum_test_", root).Succeeded()))
+	{
+		return TEST_RESULT();
+	}
+
+#ifdef _WIN32
+	SetVariable(L"TMP", root);
+	SetVariable(L"LOCALAPPDATA", root);
+#else
+	SetVariable(L"TMPDIR", root);
+	SetVariable(L"XDG_CACHE_HOME", root);
+#endif
+
+	CheckRemoveTree(root);
+#ifndef _WIN32
+	CheckSymbolicLink(root);
+#endif
+	CheckRemove(root);
+	CheckSweep(root);
+	CheckSweepersTakeTurns(root);
+
+	Cleanup::RemoveTree(root);
+	return TEST_RESULT();
+}
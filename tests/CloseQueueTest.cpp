@@ -0,0 +1,119 @@
+#include "Check.hpp"
+#include "Cleanup.h"
+#include "CloseQueue.h"
+#include "Path.hpp"
+#include <string>
+#ifdef __linux__
+#include <dirent.h>
+#endif
+
+// COMMENT: more files than CloseQueue::MaxPending are pushed, so Push has to wait for the workers. Every handle must be
+// closed once Wait returns, and by the destructor without Wait. Open handles are counted on Linux only, elsewhere the
+// test checks that neither call hangs and that the files can be deleted, which Windows refuses for an open file.
+
+namespace
+{
+
+const size_t FileCount = CloseQueue::MaxPending * 3;
+
+#ifdef __linux__
+int CountOpenDescriptors()
+{
+	DIR* dir = opendir("/proc/self/fd");
+	if (dir == nullptr)
+	{
+		return -1;
+	}
+
+	int count = 0;
+	while (readdir(dir) != nullptr)
+	{
+		count++;
+	}
+	closedir(dir);
+	return count;
+}
+#else
+int CountOpenDescriptors()
+{
+	return 0;
+}
+#endif
+
+std::wstring GetFilePath(const std::wstring& dir, size_t index)
+{
+	return std::wstring(dir).append(1, Path::Separator).append(std::to_wstring(index));
+}
+
+void PushFiles(CloseQueue& queue, const std::wstring& dir)
+{
+	for (size_t i = 0; i < FileCount; i++)
+	{
+		File file;
+		if (!CHECK(file.OpenWrite(GetFilePath(dir, i)).Succeeded()))
+		{
+			return;
+		}
+		queue.Push(file);
+	}
+}
+
+void CheckDeletable(const std::wstring& dir)
+{
+	for (size_t i = 0; i < FileCount; i++)
+	{
+		if (!CHECK(File::Delete(GetFilePath(dir, i)).Succeeded()))
+		{
+			return;
+		}
+	}
+}
+
+void CheckWait(const std::wstring& dir)
+{
+	const int openBefore = CountOpenDescriptors();
+
+	CloseQueue queue;
+	PushFiles(queue, dir);
+	queue.Wait();
+
+	CHECK(CountOpenDescriptors() == openBefore);
+	CheckDeletable(dir);
+
+	// COMMENT: the queue is reusable after Wait and Wait on an empty queue returns at once.
+	PushFiles(queue, dir);
+	queue.Wait();
+	queue.Wait();
+
+	CHECK(CountOpenDescriptors() == openBefore);
+	CheckDeletable(dir);
+}
+
+void CheckDestruction(const std::wstring& dir)
+{
+	const int openBefore = CountOpenDescriptors();
+	{
+		CloseQueue queue;
+		PushFiles(queue, dir);
+	}
+
+	CHECK(CountOpenDescriptors() == openBefore);
+	CheckDeletable(dir);
+}
+
+} // namespace
+
+int main()
+{
+	std::wstring dir;
+	if (!CHECK(Path::GetTempDirPath(L"infomaximum_test_", dir).Succeeded()))
+	{
+		return TEST_RESULT();
+	}
+
+	CheckWait(dir);
+	CheckDestruction(dir);
+
+	Cleanup::RemoveTree(dir);
+	return TEST_RESULT();
+}
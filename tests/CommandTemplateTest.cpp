@@ -0,0 +1,117 @@
+#include "Check.hpp"
+#include "CommandTemplate.h"
+#include <string>
+
+// COMMENT: templates are compiled once and expanded against a set of variables, as CMD_LINE and WORKING_DIR are.
+// Unknown names and text that only looks like a placeholder are kept as written, "<<" writes a literal '<'.
+
+namespace
+{
+
+CommandTemplate::Variables MakeVariables()
+{
+	CommandTemplate::Variables variables;
+	variables[L"dir_path"] = CommandTemplate::MakeConstant(L"C:\\Program Files\\App");
+	variables[L"cpus"] = CommandTemplate::MakeConstant(L"4");
+	variables[L"echo"] = [](const std::wstring& argument, std::wstring& value)
+	{
+		value = std::wstring(L"[").append(argument).append(L"]");
+		return Error();
+	};
+	variables[L"failing"] = [](const std::wstring& /*argument*/, std::wstring& value)
+	{
+		value.clear();
+		return Error(L"no value");
+	};
+	return variables;
+}
+
+std::wstring Expand(const std::wstring& text)
+{
+	CommandTemplate compiled;
+	compiled.Compile(text);
+
+	std::wstring result;
+	CHECK(compiled.Expand(MakeVariables(), result).Succeeded());
+	return result;
+}
+
+void CheckPlaceholders()
+{
+	CHECK(Expand(L"") == L"");
+	CHECK(Expand(L"plain text") == L"plain text");
+	CHECK(Expand(L"<dir_path>") == L"C:\\Program Files\\App");
+	CHECK(Expand(L"\"<dir_path>\\jre\\bin\\java\" -XX:ActiveProcessorCount=<cpus> -cp <dir_path>\\lib")
+		== L"\"C:\\Program Files\\App\\jre\\bin\\java\" -XX:ActiveProcessorCount=4 -cp C:\\Program Files\\App\\lib");
+	CHECK(Expand(L"<cpus><cpus>") == L"44");
+
+	// COMMENT: the argument is everything up to '>', including characters a name may not have.
+	CHECK(Expand(L"-Xmx<echo:50>") == L"-Xmx[50]");
+	CHECK(Expand(L"<echo:a b:c>") == L"[a b:c]");
+	CHECK(Expand(L"<echo:>") == L"[]");
+
+	// COMMENT: a compiled template is reused for several expansions.
+	CommandTemplate compiled;
+	compiled.Compile(L"<cpus>");
+	std::wstring first;
+	std::wstring second;
+	CHECK(compiled.Expand(MakeVariables(), first).Succeeded() && compiled.Expand(MakeVariables(), second).Succeeded());
+	CHECK(first == L"4" && second == L"4");
+}
+
+void CheckUnknownNames()
+{
+	CHECK(Expand(L"<unknown>") == L"<unknown>");
+	CHECK(Expand(L"<unknown:argument> <cpus>") == L"<unknown:argument> 4");
+	// COMMENT: names are case sensitive.
+	CHECK(Expand(L"<CPUS>") == L"<CPUS>");
+}
+
+void CheckLiteralBrackets()
+{
+	CHECK(Expand(L"a < b > c") == L"a < b > c");
+	CHECK(Expand(L"java 2>&1 <input") == L"java 2>&1 <input");
+	CHECK(Expand(L"<>") == L"<>");
+	CHECK(Expand(L"<:argument>") == L"<:argument>");
+	CHECK(Expand(L"<cpus") == L"<cpus");
+	CHECK(Expand(L"<cpus-1>") == L"<cpus-1>");
+	// COMMENT: a '<' before the closing bracket starts over, the inner placeholder is still expanded.
+	CHECK(Expand(L"<echo:<cpus>") == L"<echo:4");
+	CHECK(Expand(L"trailing <") == L"trailing <");
+}
+
+void CheckEscaping()
+{
+	CHECK(Expand(L"<<cpus>") == L"<cpus>");
+	CHECK(Expand(L"<<<cpus>") == L"<4");
+	CHECK(Expand(L"<<<<cpus>") == L"<<cpus>");
+	CHECK(Expand(L"a <<b") == L"a <b");
+	CHECK(Expand(L"<<") == L"<");
+	CHECK(Expand(L"<<echo:x> <echo:x>") == L"<echo:x> [x]");
+}
+
+void CheckFailingVariable()
+{
+	CommandTemplate compiled;
+	compiled.Compile(L"-Xmx<failing:50>");
+
+	std::wstring result;
+	const Error err = compiled.Expand(MakeVariables(), result);
+	CHECK(!err.Succeeded());
+	// COMMENT: the message names the placeholder as written in the template.
+	CHECK(err.getMessage().find(L"<failing:50>") != std::wstring::npos);
+	CHECK(err.getMessage().find(L"no value") != std::wstring::npos);
+}
+
+} // namespace
+
+int main()
+{
+	CheckPlaceholders();
+	CheckUnknownNames();
+	CheckLiteralBrackets();
+	CheckEscaping();
+	CheckFailingVariable();
+
+	return TEST_RESULT();
+}
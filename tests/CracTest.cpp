@@ -0,0 +1,159 @@
+#include "Check.hpp"
+#include "Cleanup.h"
+#include "Crac.h"
+#include "File.h"
+#include "Path.hpp"
+#include <string>
+
+// COMMENT: what Crac does with the image when the JVM exits, with the JVM played by files put into the checkpoint
+// directory. An image is published only after the checkpoint exit with a complete image, and no exit of a run from
+// scratch but the checkpoint leads to another launch.
+
+namespace
+{
+
+const uint32_t CheckpointExitCode = 137;
+const wchar_t* const CheckpointOption = L"-XX:CRaCCheckpointTo=\"";
+const wchar_t* const RestoreOption = L"-XX:CRaCRestoreFrom=\"";
+const wchar_t* const CmdLine = L"/usr/bin/java -jar app.jar";
+
+// COMMENT: the directory in a -XX option, empty when the option is not the expected one.
+std::wstring GetOptionDir(const Crac& crac, const wchar_t* option)
+{
+	const std::wstring options = crac.GetJvmOptions();
+	const std::wstring prefix(option);
+	if (options.compare(0, prefix.size(), prefix) != 0 || options.back() != L'"')
+	{
+		return std::wstring();
+	}
+
+	return options.substr(prefix.size(), options.size() - prefix.size() - 1);
+}
+
+bool WriteFile(const std::wstring& path)
+{
+	File file;
+	return file.OpenWrite(path).Succeeded();
+}
+
+// COMMENT: a dump that failed half way, CRIU left some of the image and its log behind.
+bool MakePartialImage(const std::wstring& dir)
+{
+	return Path::CreateDir(dir).Succeeded() && WriteFile(std::wstring(dir).append(L"/dump.log"))
+		&& WriteFile(std::wstring(dir).append(L"/pages-1.img"));
+}
+
+bool MakeCompleteImage(const std::wstring& dir)
+{
+	return MakePartialImage(dir) && WriteFile(std::wstring(dir).append(L"/inventory.img"));
+}
+
+void CheckNormalExit(const std::wstring& payloadDir)
+{
+	Crac crac;
+	CHECK(crac.Prepare(payloadDir, CmdLine).Succeeded());
+	const std::wstring stagingDir = GetOptionDir(crac, CheckpointOption);
+	if (!CHECK(!stagingDir.empty()) || !CHECK(MakeCompleteImage(stagingDir)))
+	{
+		return;
+	}
+
+	// COMMENT: the user closed the application before it checkpointed, the run is over whatever the directory holds.
+	CHECK(!crac.Continue(ChildProcess::State::Exited, 0));
+	CHECK(!crac.Continue(ChildProcess::State::Ready, 0));
+	CHECK(crac.GetJvmOptions().empty());
+	CHECK(!File::Exists(stagingDir));
+	CHECK(!File::Exists(std::wstring(payloadDir).append(L"/crac/image")));
+}
+
+void CheckFailedDump(const std::wstring& payloadDir)
+{
+	Crac crac;
+	CHECK(crac.Prepare(payloadDir, CmdLine).Succeeded());
+	const std::wstring stagingDir = GetOptionDir(crac, CheckpointOption);
+	if (!CHECK(!stagingDir.empty()) || !CHECK(MakePartialImage(stagingDir)))
+	{
+		return;
+	}
+
+	CHECK(!crac.Continue(ChildProcess::State::Exited, CheckpointExitCode));
+	CHECK(crac.GetJvmOptions().empty());
+	CHECK(!File::Exists(stagingDir));
+	CHECK(!File::Exists(std::wstring(payloadDir).append(L"/crac/image")));
+}
+
+void CheckFailedJvm(const std::wstring& payloadDir)
+{
+	Crac crac;
+	CHECK(crac.Prepare(payloadDir, CmdLine).Succeeded());
+	const std::wstring stagingDir = GetOptionDir(crac, CheckpointOption);
+	if (!CHECK(!stagingDir.empty()) || !CHECK(MakeCompleteImage(stagingDir)))
+	{
+		return;
+	}
+
+	CHECK(!crac.Continue(ChildProcess::State::Exited, 1));
+	CHECK(!File::Exists(stagingDir));
+}
+
+void CheckCheckpoint(const std::wstring& payloadDir)
+{
+	const std::wstring imageDir = std::wstring(payloadDir).append(L"/crac/image");
+	{
+		Crac crac;
+		CHECK(crac.Prepare(payloadDir, CmdLine).Succeeded());
+		const std::wstring stagingDir = GetOptionDir(crac, CheckpointOption);
+		if (!CHECK(!stagingDir.empty()) || !CHECK(MakeCompleteImage(stagingDir)))
+		{
+			return;
+		}
+
+		CHECK(crac.Continue(ChildProcess::State::Exited, CheckpointExitCode));
+		CHECK(GetOptionDir(crac, RestoreOption) == imageDir);
+		CHECK(File::Exists(std::wstring(imageDir).append(L"/inventory.img")));
+		CHECK(!File::Exists(stagingDir));
+
+		// COMMENT: the restored application was closed by the user.
+		CHECK(!crac.Continue(ChildProcess::State::Ready, 0));
+	}
+
+	{
+		Crac crac;
+		CHECK(crac.Prepare(payloadDir, CmdLine).Succeeded());
+		CHECK(GetOptionDir(crac, RestoreOption) == imageDir);
+	}
+
+	// COMMENT: an image of another command line is never restored.
+	{
+		Crac crac;
+		CHECK(crac.Prepare(payloadDir, L"/usr/bin/java -jar other.jar").Succeeded());
+		CHECK(!GetOptionDir(crac, CheckpointOption).empty());
+		CHECK(!File::Exists(imageDir));
+	}
+}
+
+} // namespace
+
+int main()
+{
+	if (!Crac::IsSupported())
+	{
+		Crac crac;
+		CHECK(!crac.Prepare(std::wstring(), CmdLine).Succeeded());
+		return TEST_RESULT();
+	}
+
+	std::wstring payloadDir;
+	if (!CHECK(Path::GetTempDirPath(L"infomaximum_test_", payloadDir).Succeeded()))
+	{
+		return TEST_RESULT();
+	}
+
+	CheckNormalExit(payloadDir);
+	CheckFailedDump(payloadDir);
+	CheckFailedJvm(payloadDir);
+	CheckCheckpoint(payloadDir);
+
+	Cleanup::RemoveTree(payloadDir);
+	return TEST_RESULT();
+}
@@ -0,0 +1,432 @@
+#include "Check.hpp"
+#include "DaemonClient.h"
+#include "Cleanup.h"
+#include "File.h"
+#include "Path.hpp"
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <string>
+#include <thread>
+#include <vector>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+// COMMENT: DaemonClient against ReferenceHost, a host of the daemon protocol on a unix socket. The client runs in this
+// process with stdin, stdout and stderr redirected to files. The host checks the frame order of every invocation
+// (Argument frames, WorkingDir, Environment frames, Run, Stdin frames, StdinEnd), echoes stdin as Stdout, answers on
+// Stderr and ends with the exit code, which the client must return as is, including one above INT32_MAX.
+
+namespace
+{
+
+typedef DaemonClient::FrameType FrameType;
+
+const char* const EnvironmentEntry = "INFOMAXIMUM_TEST_DAEMON=value with spaces";
+const char* const StdinContent = "line one\nline two\n";
+const char* const StderrContent = "reported by the host";
+const int ReceiveTimeoutSeconds = 5;
+
+// COMMENT: serves invocations one connection after another, as a java host would in daemon mode. Everything it
+// received is kept for the checks once Join returns.
+class ReferenceHost
+{
+public:
+
+	struct Invocation
+	{
+		// COMMENT: the types of the received frames, consecutive frames of one type recorded once.
+		std::string frameOrder;
+		std::vector<std::string> arguments;
+		std::string workingDir;
+		std::vector<std::string> environment;
+		std::string stdinData;
+	};
+
+	ReferenceHost()
+		: listener(-1)
+	{
+	}
+
+	~ReferenceHost()
+	{
+		Join();
+	}
+
+	bool Listen(const std::string& path)
+	{
+		sockaddr_un address;
+		memset(&address, 0, sizeof(address));
+		address.sun_family = AF_UNIX;
+		if (path.size() >= sizeof(address.sun_path))
+		{
+			return false;
+		}
+		memcpy(address.sun_path, path.c_str(), path.size());
+
+		listener = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+		return listener >= 0 && bind(listener, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) == 0
+			&& listen(listener, 4) == 0;
+	}
+
+	// COMMENT: a negative exit code closes the connection after Run without an Exit frame, as a crashed host would.
+	void Serve(const std::vector<int64_t>& exitCodes)
+	{
+		thread = std::thread([this, exitCodes]()
+		{
+			for (const int64_t exitCode : exitCodes)
+			{
+				const int connection = accept(listener, nullptr, nullptr);
+				if (connection < 0)
+				{
+					return;
+				}
+				// COMMENT: a client that never sends StdinEnd fails the checks instead of hanging the test.
+				timeval timeout;
+				timeout.tv_sec = ReceiveTimeoutSeconds;
+				timeout.tv_usec = 0;
+				setsockopt(connection, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+				invocations.push_back(Invocation());
+				ServeConnection(connection, exitCode, invocations.back());
+				close(connection);
+			}
+		});
+	}
+
+	void Join()
+	{
+		if (thread.joinable())
+		{
+			thread.join();
+		}
+		if (listener >= 0)
+		{
+			close(listener);
+			listener = -1;
+		}
+	}
+
+	const std::vector<Invocation>& GetInvocations() const
+	{
+		return invocations;
+	}
+
+private:
+
+	static bool ReadExact(int connection, uint8_t* data, size_t size)
+	{
+		while (size > 0)
+		{
+			const ssize_t res = recv(connection, data, size, 0);
+			if (res < 0 && errno == EINTR)
+			{
+				continue;
+			}
+			if (res <= 0)
+			{
+				return false;
+			}
+			data += res;
+			size -= static_cast<size_t>(res);
+		}
+		return true;
+	}
+
+	static bool ReadFrame(int connection, FrameType& type, std::string& payload)
+	{
+		uint8_t header[5];
+		if (!ReadExact(connection, header, sizeof(header)))
+		{
+			return false;
+		}
+
+		const uint32_t size = (static_cast<uint32_t>(header[0]) << 24) | (static_cast<uint32_t>(header[1]) << 16)
+			| (static_cast<uint32_t>(header[2]) << 8) | header[3];
+		type = static_cast<FrameType>(header[4]);
+		payload.resize(size);
+		return size == 0 || ReadExact(connection, reinterpret_cast<uint8_t*>(&payload[0]), size);
+	}
+
+	static bool WriteFrame(int connection, FrameType type, const std::string& payload)
+	{
+		const uint32_t size = static_cast<uint32_t>(payload.size());
+		std::string frame;
+		frame.push_back(static_cast<char>(size >> 24));
+		frame.push_back(static_cast<char>(size >> 16));
+		frame.push_back(static_cast<char>(size >> 8));
+		frame.push_back(static_cast<char>(size));
+		frame.push_back(static_cast<char>(type));
+		frame.append(payload);
+		return send(connection, frame.data(), frame.size(), MSG_NOSIGNAL) == static_cast<ssize_t>(frame.size());
+	}
+
+	static void ServeConnection(int connection, int64_t exitCode, Invocation& invocation)
+	{
+		// COMMENT: the invocation is complete with Run, stdin follows while the application runs.
+		FrameType type = FrameType::Run;
+		std::string payload;
+		bool running = false;
+		while (ReadFrame(connection, type, payload))
+		{
+			const char typeChar = static_cast<char>(type);
+			if (invocation.frameOrder.empty() || invocation.frameOrder.back() != typeChar)
+			{
+				invocation.frameOrder.push_back(typeChar);
+			}
+
+			if (type == FrameType::Argument)
+			{
+				invocation.arguments.push_back(payload);
+			}
+			else if (type == FrameType::WorkingDir)
+			{
+				invocation.workingDir = payload;
+			}
+			else if (type == FrameType::Environment)
+			{
+				invocation.environment.push_back(payload);
+			}
+			else if (type == FrameType::Run)
+			{
+				running = true;
+				if (exitCode < 0)
+				{
+					return;
+				}
+			}
+			else if (type == FrameType::Stdin)
+			{
+				invocation.stdinData.append(payload);
+			}
+			else if (type == FrameType::StdinEnd)
+			{
+				break;
+			}
+		}
+
+		if (!running)
+		{
+			return;
+		}
+
+		const uint32_t code = static_cast<uint32_t>(exitCode);
+		std::string exitPayload;
+		exitPayload.push_back(static_cast<char>(code >> 24));
+		exitPayload.push_back(static_cast<char>(code >> 16));
+		exitPayload.push_back(static_cast<char>(code >> 8));
+		exitPayload.push_back(static_cast<char>(code));
+
+		WriteFrame(connection, FrameType::Stdout, invocation.stdinData);
+		WriteFrame(connection, FrameType::Stderr, StderrContent);
+		WriteFrame(connection, FrameType::Exit, exitPayload);
+	}
+
+private:
+
+	int listener;
+	std::thread thread;
+	std::vector<Invocation> invocations;
+};
+
+// COMMENT: points a standard descriptor at a file for the lifetime of the object.
+class Redirect
+{
+public:
+
+	Redirect(int fd, const std::string& path, int flags)
+		: fd(fd)
+		, saved(dup(fd))
+	{
+		fflush(stdout);
+		fflush(stderr);
+		const int file = open(path.c_str(), flags | O_CLOEXEC, 0600);
+		if (file >= 0)
+		{
+			dup2(file, fd);
+			close(file);
+		}
+	}
+
+	~Redirect()
+	{
+		fflush(stdout);
+		fflush(stderr);
+		dup2(saved, fd);
+		close(saved);
+	}
+
+private:
+
+	int fd;
+	int saved;
+};
+
+std::string ToNative(const std::wstring& path)
+{
+	std::string nativePath;
+	ConvertUtf16ToUtf8(path, nativePath);
+	return nativePath;
+}
+
+std::string ReadText(const std::wstring& path)
+{
+	File file;
+	std::vector<uint8_t> content;
+	if (!file.OpenRead(path).Succeeded() || !file.Read(content).Succeeded())
+	{
+		return std::string();
+	}
+	return std::string(content.begin(), content.end());
+}
+
+bool WriteText(const std::wstring& path, const std::string& text)
+{
+	File file;
+	return file.OpenWrite(path).Succeeded() && (text.empty() || file.Write(reinterpret_cast<const uint8_t*>(text.data()), static_cast<uint32_t>(text.size())).Succeeded());
+}
+
+std::wstring Join(const std::wstring& dir, const wchar_t* name)
+{
+	return std::wstring(dir).append(1, Path::Separator).append(name);
+}
+
+// COMMENT: runs one invocation with stdin read from stdinText, stdout and stderr are returned.
+Error RunClient(const std::wstring& dir, const std::wstring& socketPath, const std::string& stdinText, bool& connected,
+	uint32_t& exitCode, std::string& stdoutText, std::string& stderrText)
+{
+	const std::wstring stdinPath = Join(dir, L"stdin");
+	const std::wstring stdoutPath = Join(dir, L"stdout");
+	const std::wstring stderrPath = Join(dir, L"stderr");
+	WriteText(stdinPath, stdinText);
+
+	Error err;
+	{
+		Redirect input(STDIN_FILENO, ToNative(stdinPath), O_RDONLY);
+		Redirect output(STDOUT_FILENO, ToNative(stdoutPath), O_WRONLY | O_CREAT | O_TRUNC);
+		Redirect errors(STDERR_FILENO, ToNative(stderrPath), O_WRONLY | O_CREAT | O_TRUNC);
+
+		const std::vector<std::wstring> arguments = { L"first", L"with space", L"юникод" };
+		DaemonClient client;
+		err = client.Connect(socketPath, connected);
+		if (err.Succeeded() && connected)
+		{
+			err = client.Run(arguments, dir, exitCode);
+		}
+	}
+
+	stdoutText = ReadText(stdoutPath);
+	stderrText = ReadText(stderrPath);
+	return err;
+}
+
+void CheckInvocations(const std::wstring& dir)
+{
+	const std::wstring socketPath = Join(dir, L"host.sock");
+	const uint32_t LargeExitCode = 0xC0000005;
+
+	ReferenceHost host;
+	if (!CHECK(host.Listen(ToNative(socketPath))))
+	{
+		return;
+	}
+	host.Serve({ 42, LargeExitCode, 0 });
+
+	bool connected = false;
+	uint32_t exitCode = 0;
+	std::string stdoutText;
+	std::string stderrText;
+	CHECK(RunClient(dir, socketPath, StdinContent, connected, exitCode, stdoutText, stderrText).Succeeded());
+	CHECK(connected);
+	CHECK(exitCode == 42);
+	CHECK(stdoutText == StdinContent);
+	CHECK(stderrText == StderrContent);
+
+	CHECK(RunClient(dir, socketPath, StdinContent, connected, exitCode, stdoutText, stderrText).Succeeded());
+	CHECK(exitCode == LargeExitCode);
+
+	// COMMENT: empty stdin still ends with StdinEnd, without any Stdin frame.
+	CHECK(RunClient(dir, socketPath, std::string(), connected, exitCode, stdoutText, stderrText).Succeeded());
+	CHECK(exitCode == 0);
+	CHECK(stdoutText.empty());
+
+	host.Join();
+	const std::vector<ReferenceHost::Invocation>& invocations = host.GetInvocations();
+	if (!CHECK(invocations.size() == 3))
+	{
+		return;
+	}
+
+	const ReferenceHost::Invocation& invocation = invocations[0];
+	CHECK(invocation.frameOrder == "ADER0.");
+	CHECK(invocation.arguments == std::vector<std::string>({ "first", "with space", "\xd1\x8e\xd0\xbd\xd0\xb8\xd0\xba\xd0\xbe\xd0\xb4" }));
+	CHECK(invocation.workingDir == ToNative(dir));
+	bool passed = false;
+	for (const std::string& entry : invocation.environment)
+	{
+		passed = passed || entry == EnvironmentEntry;
+	}
+	CHECK(passed);
+	CHECK(invocation.stdinData == StdinContent);
+	CHECK(invocations[2].frameOrder == "ADER.");
+}
+
+void CheckNoHost(const std::wstring& dir)
+{
+	DaemonClient client;
+	bool connected = true;
+	CHECK(client.Connect(Join(dir, L"missing.sock"), connected).Succeeded());
+	CHECK(!connected);
+
+	// COMMENT: the socket file of an exited host is left behind and refuses connections.
+	const std::wstring socketPath = Join(dir, L"stale.sock");
+	{
+		ReferenceHost host;
+		CHECK(host.Listen(ToNative(socketPath)));
+	}
+	connected = true;
+	CHECK(client.Connect(socketPath, connected).Succeeded());
+	CHECK(!connected);
+}
+
+void CheckHostExit(const std::wstring& dir)
+{
+	const std::wstring socketPath = Join(dir, L"crashing.sock");
+
+	ReferenceHost host;
+	if (!CHECK(host.Listen(ToNative(socketPath))))
+	{
+		return;
+	}
+	host.Serve({ -1 });
+
+	bool connected = false;
+	uint32_t exitCode = 0;
+	std::string stdoutText;
+	std::string stderrText;
+	CHECK(!RunClient(dir, socketPath, StdinContent, connected, exitCode, stdoutText, stderrText).Succeeded());
+	CHECK(connected);
+}
+
+} // namespace
+
+int main()
+{
+	std::wstring dir;
+	if (!CHECK(Path::GetTempDirPath(L"infomaximum_test_", dir).Succeeded()))
+	{
+		return TEST_RESULT();
+	}
+
+	putenv(const_cast<char*>(EnvironmentEntry));
+
+	CheckInvocations(dir);
+	CheckNoHost(dir);
+	CheckHostExit(dir);
+
+	Cleanup::RemoveTree(dir);
+	return TEST_RESULT();
+}
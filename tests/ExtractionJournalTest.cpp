@@ -0,0 +1,237 @@
+#include "Check.hpp"
+#include "Cleanup.h"
+#include "ExtractionJournal.h"
+#include "File.h"
+#include "Path.hpp"
+#include <string>
+#include <vector>
+
+// COMMENT: a journal is written, dropped as an interrupted extraction would drop it and opened again. Complete records
+// of files still on the disk must survive, a torn or corrupted record and all after it must not, and appending
+// continues right after the last complete record.
+
+namespace
+{
+
+// COMMENT: more than the threads that verify the files on open.
+const size_t VerifiedEntryCount = 40;
+
+uint32_t Crc32(const std::string& data)
+{
+	uint32_t crc = 0xFFFFFFFFU;
+	for (char c : data)
+	{
+		crc ^= static_cast<uint8_t>(c);
+		for (int bit = 0; bit < 8; bit++)
+		{
+			crc = (crc & 1) != 0 ? (crc >> 1) ^ 0xEDB88320U : crc >> 1;
+		}
+	}
+	return ~crc;
+}
+
+class JournalDir
+{
+public:
+
+	Error Create()
+	{
+		Error err = Path::GetTempDirPath(L"infomaximum_test_", dir);
+		journalPath.assign(dir).push_back(Path::Separator);
+		journalPath.append(L"journal");
+		return err;
+	}
+
+	~JournalDir()
+	{
+		if (!dir.empty())
+		{
+			Cleanup::RemoveTree(dir);
+		}
+	}
+
+	bool WriteEntry(const std::string& name, const std::string& content)
+	{
+		File file;
+		return file.OpenWrite(GetEntryPath(name)).Succeeded()
+			&& file.Write(reinterpret_cast<const uint8_t*>(content.data()), static_cast<uint32_t>(content.size())).Succeeded();
+	}
+
+	bool AppendEntry(ExtractionJournal& journal, const std::string& name, const std::string& content)
+	{
+		return WriteEntry(name, content) && journal.Append(name, content.size(), Crc32(content)).Succeeded();
+	}
+
+	bool IsCompleted(const ExtractionJournal& journal, const std::string& name, const std::string& content) const
+	{
+		return journal.IsCompleted(name, content.size(), Crc32(content));
+	}
+
+	uint64_t GetJournalSize() const
+	{
+		uint64_t size = 0;
+		File::GetSize(journalPath, size);
+		return size;
+	}
+
+	// COMMENT: overwrites the journal from offset, as a write torn by the interruption or a bad sector would.
+	bool PatchJournal(uint64_t offset, const std::string& bytes)
+	{
+		File file;
+		return file.OpenReadWrite(journalPath).Succeeded() && file.Seek(offset).Succeeded()
+			&& file.Write(reinterpret_cast<const uint8_t*>(bytes.data()), static_cast<uint32_t>(bytes.size())).Succeeded();
+	}
+
+	std::wstring GetEntryPath(const std::string& name) const
+	{
+		return std::wstring(dir).append(1, Path::Separator).append(name.begin(), name.end());
+	}
+
+	std::wstring dir;
+	std::wstring journalPath;
+};
+
+void CheckReplay(JournalDir& dir)
+{
+	{
+		ExtractionJournal journal;
+		CHECK(!ExtractionJournal::Exists(dir.journalPath));
+		CHECK(journal.Open(dir.journalPath, dir.dir).Succeeded());
+		CHECK(ExtractionJournal::Exists(dir.journalPath));
+		CHECK(dir.AppendEntry(journal, "a.txt", "alpha"));
+		CHECK(dir.AppendEntry(journal, "b.txt", "bravo"));
+		CHECK(dir.IsCompleted(journal, "a.txt", "alpha"));
+	}
+
+	ExtractionJournal journal;
+	CHECK(journal.Open(dir.journalPath, dir.dir).Succeeded());
+	CHECK(dir.IsCompleted(journal, "a.txt", "alpha"));
+	CHECK(dir.IsCompleted(journal, "b.txt", "bravo"));
+	CHECK(!dir.IsCompleted(journal, "a.txt", "alpha2"));
+	CHECK(!journal.IsCompleted("a.txt", 5, Crc32("alpha") ^ 1));
+	CHECK(!dir.IsCompleted(journal, "c.txt", "charlie"));
+}
+
+void CheckTornRecord(JournalDir& dir)
+{
+	const uint64_t validSize = dir.GetJournalSize();
+
+	// COMMENT: the first bytes of a record, its name length promises more than is there.
+	CHECK(dir.PatchJournal(validSize, std::string("\x05\x00" "c.t", 5)));
+	{
+		ExtractionJournal journal;
+		CHECK(journal.Open(dir.journalPath, dir.dir).Succeeded());
+		CHECK(dir.GetJournalSize() == validSize);
+		CHECK(dir.IsCompleted(journal, "a.txt", "alpha"));
+		CHECK(dir.IsCompleted(journal, "b.txt", "bravo"));
+		CHECK(dir.AppendEntry(journal, "c.txt", "charlie"));
+	}
+
+	ExtractionJournal journal;
+	CHECK(journal.Open(dir.journalPath, dir.dir).Succeeded());
+	CHECK(dir.IsCompleted(journal, "c.txt", "charlie"));
+}
+
+void CheckCorruptedRecord(JournalDir& dir)
+{
+	// COMMENT: the magic is followed by the record of a.txt: <u16 length>a.txt<u64 size><u32 crc><u32 checksum>.
+	const uint64_t bRecordOffset = 8 + 2 + 5 + 8 + 4 + 4;
+	CHECK(dir.PatchJournal(bRecordOffset + 2, "x"));
+
+	ExtractionJournal journal;
+	CHECK(journal.Open(dir.journalPath, dir.dir).Succeeded());
+	CHECK(dir.GetJournalSize() == bRecordOffset);
+	CHECK(dir.IsCompleted(journal, "a.txt", "alpha"));
+	CHECK(!dir.IsCompleted(journal, "b.txt", "bravo"));
+	CHECK(!dir.IsCompleted(journal, "c.txt", "charlie"));
+}
+
+void CheckVerification(JournalDir& dir)
+{
+	std::vector<std::string> names;
+	{
+		ExtractionJournal journal;
+		CHECK(journal.Open(dir.journalPath, dir.dir).Succeeded());
+		for (size_t i = 0; i < VerifiedEntryCount; i++)
+		{
+			names.push_back(std::string("file").append(std::to_string(i)).append(".txt"));
+			CHECK(dir.AppendEntry(journal, names.back(), "content"));
+		}
+	}
+
+	// COMMENT: the journal reached the disk, the data of the files did not: a file of the journaled size holds other
+	// bytes, wherever it is in the journal, or the file is shorter or missing.
+	CHECK(dir.WriteEntry("a.txt", "alph"));
+	CHECK(dir.WriteEntry(names.front(), "CONTENT"));
+	CHECK(dir.WriteEntry(names[names.size() / 2], std::string(7, '\0')));
+	CHECK(dir.WriteEntry(names.back(), "CONTENT"));
+	CHECK(File::Delete(dir.GetEntryPath(names[names.size() - 2])).Succeeded());
+
+	ExtractionJournal journal;
+	CHECK(journal.Open(dir.journalPath, dir.dir).Succeeded());
+	CHECK(!dir.IsCompleted(journal, "a.txt", "alpha"));
+	CHECK(!dir.IsCompleted(journal, names.front(), "content"));
+	CHECK(!dir.IsCompleted(journal, names[names.size() / 2], "content"));
+	CHECK(!dir.IsCompleted(journal, names.back(), "content"));
+	CHECK(!dir.IsCompleted(journal, names[names.size() - 2], "content"));
+	for (size_t i = 1; i < names.size() - 2; i++)
+	{
+		CHECK(i == names.size() / 2 || dir.IsCompleted(journal, names[i], "content"));
+	}
+
+	CHECK(journal.Remove().Succeeded());
+	CHECK(!ExtractionJournal::Exists(dir.journalPath));
+	CHECK(!dir.IsCompleted(journal, names[1], "content"));
+}
+
+void CheckRewrittenEntry(JournalDir& dir)
+{
+	{
+		ExtractionJournal journal;
+		CHECK(journal.Open(dir.journalPath, dir.dir).Succeeded());
+		CHECK(dir.AppendEntry(journal, "a.txt", "alpha"));
+		CHECK(dir.AppendEntry(journal, "a.txt", "alpha2"));
+	}
+
+	ExtractionJournal journal;
+	CHECK(journal.Open(dir.journalPath, dir.dir).Succeeded());
+	CHECK(dir.IsCompleted(journal, "a.txt", "alpha2"));
+	CHECK(!dir.IsCompleted(journal, "a.txt", "alpha"));
+}
+
+void CheckForeignFile(JournalDir& dir)
+{
+	File::Delete(dir.journalPath);
+	CHECK(dir.PatchJournal(0, "not a journal at all"));
+	{
+		ExtractionJournal journal;
+		CHECK(journal.Open(dir.journalPath, dir.dir).Succeeded());
+		CHECK(!dir.IsCompleted(journal, "a.txt", "alpha2"));
+		CHECK(dir.GetJournalSize() == 8);
+		CHECK(dir.AppendEntry(journal, "b.txt", "bravo"));
+	}
+
+	ExtractionJournal journal;
+	CHECK(journal.Open(dir.journalPath, dir.dir).Succeeded());
+	CHECK(dir.IsCompleted(journal, "b.txt", "bravo"));
+}
+
+} // namespace
+
+int main()
+{
+	JournalDir dir;
+	if (!CHECK(dir.Create().Succeeded()))
+	{
+		return TEST_RESULT();
+	}
+
+	CheckReplay(dir);
+	CheckTornRecord(dir);
+	CheckCorruptedRecord(dir);
+	CheckVerification(dir);
+	CheckRewrittenEntry(dir);
+	CheckForeignFile(dir);
+
+	return TEST_RESULT();
+}
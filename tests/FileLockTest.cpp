@@ -0,0 +1,126 @@
+#include "Check.hpp"
+#include "Cleanup.h"
+#include "FileLock.h"
+#include "Path.hpp"
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+// COMMENT: two locks on one file exclude each other even in one process, as two instances of the executor would.
+
+namespace
+{
+
+const int LockingThreads = 4;
+const int LocksPerThread = 200;
+
+void CheckWaiting(const std::wstring& lockPath)
+{
+	FileLock holder;
+	if (!CHECK(holder.Lock(lockPath).Succeeded()))
+	{
+		return;
+	}
+
+	std::atomic<bool> released(false);
+	std::atomic<bool> acquired(false);
+	std::atomic<bool> acquiredBeforeRelease(false);
+	std::thread waiter([&]()
+	{
+		FileLock lock;
+		if (lock.Lock(lockPath).Succeeded())
+		{
+			acquiredBeforeRelease = !released;
+			acquired = true;
+		}
+	});
+
+	std::this_thread::sleep_for(std::chrono::milliseconds(200));
+	CHECK(!acquired);
+
+	released = true;
+	holder.Unlock();
+	waiter.join();
+
+	CHECK(acquired);
+	CHECK(!acquiredBeforeRelease);
+}
+
+void CheckReleaseOnDestruction(const std::wstring& lockPath)
+{
+	{
+		FileLock lock;
+		CHECK(lock.Lock(lockPath).Succeeded());
+	}
+
+	// COMMENT: would wait forever if the destroyed lock were still held.
+	FileLock lock;
+	CHECK(lock.Lock(lockPath).Succeeded());
+}
+
+void CheckExclusion(const std::wstring& lockPath)
+{
+	std::atomic<int> holders(0);
+	std::atomic<int> overlaps(0);
+	int counter = 0;
+
+	std::vector<std::thread> threads;
+	for (int i = 0; i < LockingThreads; i++)
+	{
+		threads.emplace_back([&]()
+		{
+			FileLock lock;
+			for (int j = 0; j < LocksPerThread; j++)
+			{
+				if (!lock.Lock(lockPath).Succeeded())
+				{
+					overlaps++;
+					continue;
+				}
+
+				if (++holders != 1)
+				{
+					overlaps++;
+				}
+				counter++;
+				holders--;
+				lock.Unlock();
+			}
+		});
+	}
+
+	for (std::thread& thread : threads)
+	{
+		thread.join();
+	}
+
+	CHECK(overlaps == 0);
+	CHECK(counter == LockingThreads * LocksPerThread);
+}
+
+} // namespace
+
+int main()
+{
+	std::wstring dir;
+	if (!CHECK(Path::GetTempDirPath(L"infomaximum_test_", dir).Succeeded()))
+	{
+		return TEST_RESULT();
+	}
+
+	std::wstring lockPath(dir);
+	lockPath.push_back(Path::Separator);
+	lockPath.append(L"lock");
+
+	CheckWaiting(lockPath);
+	CheckReleaseOnDestruction(lockPath);
+	CheckExclusion(lockPath);
+
+	FileLock lock;
+	CHECK(!lock.Lock(std::wstring(dir).append(1, Path::Separator).append(L"missing").append(1, Path::Separator).append(L"lock")).Succeeded());
+
+	Cleanup::RemoveTree(dir);
+	return TEST_RESULT();
+}
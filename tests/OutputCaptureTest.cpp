@@ -0,0 +1,255 @@
+#include "Check.hpp"
+#include "OutputCapture.h"
+#include "Cleanup.h"
+#include "File.h"
+#include "Path.hpp"
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#endif
+
+// COMMENT: the test executable itself, started with ChildArg, stands in for java and writes a known stream to stdout,
+// several times the rotation size. The log and its segments together must end with that stream, no older segments
+// than maxSegments may be kept. A rotated segment is compressed while the writer goes on: the fake compressor blocks
+// until the rest of the stream has reached the log.
+
+namespace
+{
+
+const char* const ChildArg = "--child";
+const uint64_t SegmentSize = 32 * 1024;
+const unsigned SegmentCount = 2;
+const int WaitSteps = 500;
+const int WaitStepMs = 10;
+
+uint8_t GetStreamByte(size_t i)
+{
+	return static_cast<uint8_t>('a' + (i + i / 4096) % 26);
+}
+
+std::vector<uint8_t> MakeStream(size_t size)
+{
+	std::vector<uint8_t> stream(size);
+	for (size_t i = 0; i < size; i++)
+	{
+		stream[i] = GetStreamByte(i);
+	}
+	return stream;
+}
+
+int RunChild(size_t size)
+{
+#ifdef _WIN32
+	_setmode(_fileno(stdout), _O_BINARY);
+#endif
+	const std::vector<uint8_t> stream = MakeStream(size);
+	// COMMENT: small writes, so the reader sees the stream in many pieces as it would from java.
+	for (size_t offset = 0; offset < stream.size(); offset += 1000)
+	{
+		const size_t left = stream.size() - offset;
+		std::fwrite(&stream[offset], 1, left < 1000 ? left : 1000, stdout);
+		std::fflush(stdout);
+	}
+	return 0;
+}
+
+std::wstring MakeChildCommand(size_t size)
+{
+	std::wstring executable;
+	Path::GetApplicationFilePath(executable);
+
+	std::wstring cmd;
+	cmd.append(L"\"").append(executable).append(L"\" ");
+	for (const char* arg = ChildArg; *arg != '\0'; arg++)
+	{
+		cmd.push_back(static_cast<wchar_t>(*arg));
+	}
+	cmd.append(L" ").append(std::to_wstring(size));
+	return cmd;
+}
+
+std::wstring Join(const std::wstring& dir, const wchar_t* name)
+{
+	return std::wstring(dir).append(1, Path::Separator).append(name);
+}
+
+bool ReadAll(const std::wstring& path, std::vector<uint8_t>& content)
+{
+	File file;
+	content.clear();
+	return file.OpenRead(path).Succeeded() && file.Read(content).Succeeded();
+}
+
+uint64_t GetSize(const std::wstring& path)
+{
+	uint64_t size = 0;
+	return File::GetSize(path, size).Succeeded() ? size : 0;
+}
+
+OutputCapture::Options MakeOptions()
+{
+	OutputCapture::Options options;
+	options.bufferSize = 64 * 1024;
+	options.batchSize = 4 * 1024;
+	options.flushIntervalMs = 50;
+	options.maxSegmentSize = SegmentSize;
+	options.maxSegments = SegmentCount;
+	return options;
+}
+
+bool RunChildInto(OutputCapture& capture, size_t size)
+{
+	ChildProcess child;
+	const Error err = child.Start(MakeChildCommand(size), std::wstring(), capture.GetChildHandle());
+	capture.OnChildStarted();
+	if (!CHECK(err.Succeeded()))
+	{
+		return false;
+	}
+
+	uint32_t exitCode = 1;
+	return CHECK(child.WaitExit(exitCode).Succeeded()) && CHECK(exitCode == 0);
+}
+
+void CheckRotation(const std::wstring& dir)
+{
+	const std::wstring logPath = Join(dir, L"rotation.log");
+	const std::vector<uint8_t> stream = MakeStream(static_cast<size_t>(SegmentSize * 5 + 1000));
+
+	OutputCapture capture;
+	if (!CHECK(capture.Start(logPath, MakeOptions()).Succeeded()) || !RunChildInto(capture, stream.size()))
+	{
+		return;
+	}
+	CHECK(capture.Stop().Succeeded());
+
+	// COMMENT: the oldest kept segment has the highest number, the log itself is the newest.
+	std::vector<uint8_t> kept;
+	for (const wchar_t* name : { L"rotation.2.log", L"rotation.1.log", L"rotation.log" })
+	{
+		std::vector<uint8_t> segment;
+		if (!CHECK(ReadAll(Join(dir, name), segment)))
+		{
+			return;
+		}
+		CHECK(segment.size() <= SegmentSize);
+		kept.insert(kept.end(), segment.begin(), segment.end());
+	}
+	CHECK(!File::Exists(Join(dir, L"rotation.3.log")));
+
+	CHECK(kept.size() > SegmentSize * SegmentCount / 2 && kept.size() < stream.size());
+	CHECK(std::equal(kept.begin(), kept.end(), stream.end() - kept.size()));
+}
+
+// COMMENT: the compressor stays blocked until the test opens the gate.
+struct Gate
+{
+	std::mutex mutex;
+	std::condition_variable opened;
+	bool open = false;
+	bool entered = false;
+	std::wstring entryName;
+
+	void Open()
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		open = true;
+		opened.notify_all();
+	}
+};
+
+void CheckCompression(const std::wstring& dir)
+{
+	const std::wstring logPath = Join(dir, L"compressed.log");
+	const std::wstring segmentPath = Join(dir, L"compressed.1.log");
+	const std::vector<uint8_t> stream = MakeStream(static_cast<size_t>(SegmentSize + SegmentSize / 2));
+
+	Gate gate;
+	OutputCapture::Options options = MakeOptions();
+	options.compressSegment = [&gate](const std::wstring& srcPath, const std::wstring& entryName, const std::wstring& zipPath)
+	{
+		{
+			std::unique_lock<std::mutex> lock(gate.mutex);
+			gate.entered = true;
+			gate.entryName = entryName;
+			gate.opened.wait(lock, [&gate]() { return gate.open; });
+		}
+
+		// COMMENT: a copy stands in for the archive, the test only needs to see which file was compressed when.
+		std::vector<uint8_t> content;
+		File zip;
+		if (!ReadAll(srcPath, content) || !zip.OpenWrite(zipPath).Succeeded() || !zip.Write(&content[0], static_cast<uint32_t>(content.size())).Succeeded())
+		{
+			return Error(L"can not copy the segment");
+		}
+		return Error();
+	};
+
+	OutputCapture capture;
+	if (!CHECK(capture.Start(logPath, options).Succeeded()))
+	{
+		return;
+	}
+	if (!RunChildInto(capture, stream.size()))
+	{
+		gate.Open();
+		return;
+	}
+
+	// COMMENT: would time out if the writer compressed the segment itself, the rest of the stream would not be written.
+	bool drained = false;
+	for (int i = 0; i < WaitSteps && !drained; i++)
+	{
+		std::this_thread::sleep_for(std::chrono::milliseconds(WaitStepMs));
+		drained = GetSize(segmentPath) + GetSize(logPath) == stream.size();
+	}
+	CHECK(drained);
+	{
+		std::lock_guard<std::mutex> lock(gate.mutex);
+		CHECK(gate.entered);
+		CHECK(gate.entryName == L"compressed.log");
+	}
+	gate.Open();
+	CHECK(capture.Stop().Succeeded());
+
+	std::vector<uint8_t> compressed;
+	std::vector<uint8_t> log;
+	if (CHECK(ReadAll(Join(dir, L"compressed.1.log.zip"), compressed)) && CHECK(ReadAll(logPath, log)))
+	{
+		compressed.insert(compressed.end(), log.begin(), log.end());
+		CHECK(compressed == stream);
+	}
+	CHECK(!File::Exists(segmentPath));
+}
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+	if (argc == 3 && strcmp(argv[1], ChildArg) == 0)
+	{
+		return RunChild(static_cast<size_t>(strtoull(argv[2], nullptr, 10)));
+	}
+
+	std::wstring dir;
+	if (!CHECK(Path::GetTempDirPath(L"infomaximum_test_", dir).Succeeded()))
+	{
+		return TEST_RESULT();
+	}
+
+	CheckRotation(dir);
+	CheckCompression(dir);
+
+	Cleanup::RemoveTree(dir);
+	return TEST_RESULT();
+}
@@ -0,0 +1,113 @@
+#include "Check.hpp"
+#include "SnapshotSlot.hpp"
+#include <cstdint>
+#include <initializer_list>
+#include <thread>
+
+namespace
+{
+
+// COMMENT: all fields carry the same sequence number, a torn snapshot shows as differing fields.
+struct Snapshot
+{
+	uint64_t first = 0;
+	uint32_t middle[6] = {};
+	uint64_t last = 0;
+
+	explicit Snapshot(uint64_t sequence = 0)
+		: first(sequence)
+		, last(sequence)
+	{
+		for (uint32_t& value : middle)
+		{
+			value = static_cast<uint32_t>(sequence);
+		}
+	}
+
+	bool IsConsistent() const
+	{
+		for (uint32_t value : middle)
+		{
+			if (value != static_cast<uint32_t>(first))
+			{
+				return false;
+			}
+		}
+		return first == last;
+	}
+};
+
+void CheckSingleThread()
+{
+	SnapshotSlot<Snapshot> slot;
+	Snapshot taken;
+	CHECK(!slot.TryTake(taken));
+
+	slot.Publish(Snapshot(1));
+	CHECK(slot.TryTake(taken) && taken.first == 1);
+	CHECK(!slot.TryTake(taken));
+
+	// COMMENT: values the consumer did not take in time are superseded, the latest one is kept.
+	for (uint64_t sequence = 2; sequence <= 10; sequence++)
+	{
+		slot.Publish(Snapshot(sequence));
+	}
+	CHECK(slot.TryTake(taken) && taken.first == 10 && taken.IsConsistent());
+	CHECK(!slot.TryTake(taken));
+}
+
+void CheckConcurrent(uint64_t count)
+{
+	SnapshotSlot<Snapshot> slot;
+
+	std::thread producer([&slot, count]()
+	{
+		for (uint64_t sequence = 1; sequence <= count; sequence++)
+		{
+			slot.Publish(Snapshot(sequence));
+		}
+	});
+
+	uint64_t lastSeen = 0;
+	bool consistent = true;
+	bool increasing = true;
+	Snapshot taken;
+	while (lastSeen != count)
+	{
+		if (!slot.TryTake(taken))
+		{
+			std::this_thread::yield();
+			continue;
+		}
+
+		consistent = consistent && taken.IsConsistent();
+		increasing = increasing && taken.first > lastSeen;
+		lastSeen = taken.first;
+		if (!increasing)
+		{
+			break;
+		}
+	}
+
+	producer.join();
+
+	// COMMENT: the final value must arrive however the threads interleave, it is what the splash shows last.
+	CHECK(consistent);
+	CHECK(increasing);
+	CHECK(lastSeen == count);
+	CHECK(!slot.TryTake(taken));
+}
+
+} // namespace
+
+int main()
+{
+	CheckSingleThread();
+
+	for (uint64_t count : { 1, 2, 3, 1000, 1000000 })
+	{
+		CheckConcurrent(count);
+	}
+
+	return TEST_RESULT();
+}
@@ -0,0 +1,323 @@
+#include "Check.hpp"
+#include "StringConverter.hpp"
+#include <cstdint>
+#include <string>
+
+// COMMENT: ConvertUtf8ToUtf16 against an independent decoder on every code point, surrogates included, on all sequences
+// of up to three bytes and on four byte sequences at the edges of the valid ranges. Every input is also placed behind
+// ASCII prefixes of the lengths where the SSE2 loop hands over to the scalar one. Invalid input must turn into U+FFFD
+// per maximal subpart, as MultiByteToWideChar does, which on Windows is checked against directly.
+// The conversion before the transcoder, kept below, must give the same result on all well-formed input.
+
+namespace
+{
+
+const char32_t Replacement = 0xFFFD;
+
+void AppendWide(char32_t codePoint, std::wstring& dst)
+{
+	if (sizeof(wchar_t) == 2 && codePoint >= 0x10000)
+	{
+		codePoint -= 0x10000;
+		dst.push_back(static_cast<wchar_t>(0xD800 + (codePoint >> 10)));
+		dst.push_back(static_cast<wchar_t>(0xDC00 + (codePoint & 0x3FF)));
+	}
+	else
+	{
+		dst.push_back(static_cast<wchar_t>(codePoint));
+	}
+}
+
+// COMMENT: table 3-7 of the Unicode standard, a sequence ends at the first byte outside its well-formed range.
+std::wstring ReferenceUtf8ToWide(const std::string& src)
+{
+	std::wstring dst;
+	size_t pos = 0;
+	while (pos < src.size())
+	{
+		const uint8_t lead = static_cast<uint8_t>(src[pos++]);
+		size_t length = 1;
+		char32_t codePoint = lead;
+		uint8_t secondMin = 0x80;
+		uint8_t secondMax = 0xBF;
+		if (lead >= 0xC2 && lead <= 0xDF)
+		{
+			length = 2;
+			codePoint = lead & 0x1F;
+		}
+		else if (lead >= 0xE0 && lead <= 0xEF)
+		{
+			length = 3;
+			codePoint = lead & 0x0F;
+			secondMin = lead == 0xE0 ? 0xA0 : 0x80;
+			secondMax = lead == 0xED ? 0x9F : 0xBF;
+		}
+		else if (lead >= 0xF0 && lead <= 0xF4)
+		{
+			length = 4;
+			codePoint = lead & 0x07;
+			secondMin = lead == 0xF0 ? 0x90 : 0x80;
+			secondMax = lead == 0xF4 ? 0x8F : 0xBF;
+		}
+		else if (lead >= 0x80)
+		{
+			codePoint = Replacement;
+		}
+
+		for (size_t i = 1; i < length; i++)
+		{
+			const uint8_t next = pos < src.size() ? static_cast<uint8_t>(src[pos]) : 0;
+			if (pos >= src.size() || next < (i == 1 ? secondMin : 0x80) || next > (i == 1 ? secondMax : 0xBF))
+			{
+				codePoint = Replacement;
+				break;
+			}
+			codePoint = (codePoint << 6) | (next & 0x3F);
+			pos++;
+		}
+
+		AppendWide(codePoint, dst);
+	}
+	return dst;
+}
+
+// COMMENT: the scalar decoder StringConverter.hpp had before the transcoder. It replaces a whole ill-formed sequence
+// with one U+FFFD, so it is compared on well-formed input only.
+std::wstring LegacyUtf8ToWide(const std::string& src)
+{
+	std::wstring dst;
+	size_t pos = 0;
+	while (pos < src.size())
+	{
+		const uint8_t lead = static_cast<uint8_t>(src[pos++]);
+		if (lead < 0x80)
+		{
+			dst.push_back(lead);
+			continue;
+		}
+
+		size_t continuationCount = 0;
+		char32_t codePoint = 0;
+		char32_t minCodePoint = 0;
+		if ((lead & 0xE0) == 0xC0)
+		{
+			continuationCount = 1;
+			codePoint = lead & 0x1F;
+			minCodePoint = 0x80;
+		}
+		else if ((lead & 0xF0) == 0xE0)
+		{
+			continuationCount = 2;
+			codePoint = lead & 0x0F;
+			minCodePoint = 0x800;
+		}
+		else if ((lead & 0xF8) == 0xF0)
+		{
+			continuationCount = 3;
+			codePoint = lead & 0x07;
+			minCodePoint = 0x10000;
+		}
+		else
+		{
+			AppendWide(Replacement, dst);
+			continue;
+		}
+
+		bool truncated = false;
+		for (size_t i = 0; i < continuationCount; i++)
+		{
+			if (pos >= src.size() || (static_cast<uint8_t>(src[pos]) & 0xC0) != 0x80)
+			{
+				truncated = true;
+				break;
+			}
+			codePoint = (codePoint << 6) | (static_cast<uint8_t>(src[pos++]) & 0x3F);
+		}
+
+		const bool invalid = truncated || codePoint < minCodePoint || codePoint > 0x10FFFF || (codePoint >= 0xD800 && codePoint <= 0xDFFF);
+		AppendWide(invalid ? Replacement : codePoint, dst);
+	}
+	return dst;
+}
+
+#ifdef _WIN32
+std::wstring SystemUtf8ToWide(const std::string& src)
+{
+	std::wstring dst;
+	const int len = src.empty() ? 0 : MultiByteToWideChar(CP_UTF8, 0, src.data(), static_cast<int>(src.size()), NULL, 0);
+	if (len > 0)
+	{
+		dst.resize(len);
+		MultiByteToWideChar(CP_UTF8, 0, src.data(), static_cast<int>(src.size()), &dst[0], len);
+	}
+	return dst;
+}
+#endif
+
+void EncodeUtf8(char32_t codePoint, std::string& dst)
+{
+	if (codePoint < 0x80)
+	{
+		dst.push_back(static_cast<char>(codePoint));
+	}
+	else if (codePoint < 0x800)
+	{
+		dst.push_back(static_cast<char>(0xC0 | (codePoint >> 6)));
+		dst.push_back(static_cast<char>(0x80 | (codePoint & 0x3F)));
+	}
+	else if (codePoint < 0x10000)
+	{
+		dst.push_back(static_cast<char>(0xE0 | (codePoint >> 12)));
+		dst.push_back(static_cast<char>(0x80 | ((codePoint >> 6) & 0x3F)));
+		dst.push_back(static_cast<char>(0x80 | (codePoint & 0x3F)));
+	}
+	else
+	{
+		dst.push_back(static_cast<char>(0xF0 | (codePoint >> 18)));
+		dst.push_back(static_cast<char>(0x80 | ((codePoint >> 12) & 0x3F)));
+		dst.push_back(static_cast<char>(0x80 | ((codePoint >> 6) & 0x3F)));
+		dst.push_back(static_cast<char>(0x80 | (codePoint & 0x3F)));
+	}
+}
+
+class Checker
+{
+public:
+
+	void Check(const std::string& input, bool wellFormed)
+	{
+		checked++;
+		ConvertUtf8ToUtf16(input, actual);
+		ConvertUtf8ToUtf16(input.data(), input.size(), actualFromPointer);
+
+		bool passed = actual == ReferenceUtf8ToWide(input) && actualFromPointer == actual;
+		if (wellFormed)
+		{
+			passed = passed && actual == LegacyUtf8ToWide(input);
+		}
+#ifdef _WIN32
+		passed = passed && actual == SystemUtf8ToWide(input);
+#endif
+		if (!passed && mismatches++ < MaxReported)
+		{
+			std::string hex;
+			for (char c : input)
+			{
+				char byte[4];
+				std::snprintf(byte, sizeof(byte), "%02X", static_cast<uint8_t>(c));
+				hex.append(byte);
+			}
+			std::fprintf(stderr, "mismatch on %s\n", hex.c_str());
+		}
+	}
+
+	// COMMENT: around every length where the 16-byte ASCII loop hands over to the scalar one.
+	void CheckAfterAscii(const std::string& tail, bool wellFormed)
+	{
+		for (size_t prefix : { 0, 1, 15, 16, 17, 31, 32, 33 })
+		{
+			Check(std::string(prefix, 'a').append(tail).append(17, 'b'), wellFormed);
+		}
+	}
+
+	static const uint64_t MaxReported = 16;
+
+	uint64_t checked = 0;
+	uint64_t mismatches = 0;
+
+private:
+
+	std::wstring actual;
+	std::wstring actualFromPointer;
+};
+
+void CheckCodePoints(Checker& checker)
+{
+	std::string encoded;
+	std::wstring wide;
+	std::string roundTrip;
+	for (char32_t codePoint = 0; codePoint <= 0x10FFFF; codePoint++)
+	{
+		// COMMENT: surrogates are encoded too, they must be rejected like the bytes of any other invalid sequence.
+		const bool surrogate = codePoint >= 0xD800 && codePoint <= 0xDFFF;
+		encoded.clear();
+		EncodeUtf8(codePoint, encoded);
+		checker.CheckAfterAscii(encoded, !surrogate);
+
+		if (!surrogate)
+		{
+			ConvertUtf8ToUtf16(encoded, wide);
+			ConvertUtf16ToUtf8(wide, roundTrip);
+			if (!CHECK(roundTrip == encoded))
+			{
+				return;
+			}
+		}
+	}
+}
+
+void CheckShortSequences(Checker& checker)
+{
+	std::string bytes(3, '\0');
+	for (uint32_t value = 0; value < 0x1000000; value++)
+	{
+		bytes[0] = static_cast<char>(value >> 16);
+		bytes[1] = static_cast<char>(value >> 8);
+		bytes[2] = static_cast<char>(value);
+		checker.Check(bytes, false);
+		if ((value & 0xFFFF) == 0)
+		{
+			checker.Check(bytes.substr(0, 1), false);
+		}
+		if (value < 0x10000)
+		{
+			checker.Check(bytes.substr(1), false);
+		}
+	}
+}
+
+void CheckLongSequences(Checker& checker)
+{
+	// COMMENT: four byte sequences only with continuation bytes at the edges of the valid ranges.
+	const uint8_t edges[] = { 0x00, 0x7F, 0x80, 0x8F, 0x90, 0x9F, 0xA0, 0xBF, 0xC0, 0xFF };
+	for (uint32_t lead = 0xF0; lead <= 0xFF; lead++)
+	{
+		for (uint32_t second = 0; second <= 0xFF; second++)
+		{
+			for (uint8_t third : edges)
+			{
+				for (uint8_t fourth : edges)
+				{
+					const char sequence[] = { static_cast<char>(lead), static_cast<char>(second), static_cast<char>(third), static_cast<char>(fourth) };
+					checker.CheckAfterAscii(std::string(sequence, sizeof(sequence)), false);
+				}
+			}
+		}
+	}
+}
+
+void CheckEmpty()
+{
+	std::wstring wide(L"x");
+	CHECK(ConvertUtf8ToUtf16(std::string(), wide).Succeeded() && wide.empty());
+
+	std::string narrow("x");
+	CHECK(ConvertUtf16ToUtf8(std::wstring(), narrow).Succeeded() && narrow.empty());
+}
+
+} // namespace
+
+int main()
+{
+	CheckEmpty();
+
+	Checker checker;
+	CheckCodePoints(checker);
+	CheckShortSequences(checker);
+	CheckLongSequences(checker);
+
+	std::printf("%llu inputs, %llu mismatches\n", static_cast<unsigned long long>(checker.checked), static_cast<unsigned long long>(checker.mismatches));
+	CHECK(checker.mismatches == 0);
+
+	return TEST_RESULT();
+}
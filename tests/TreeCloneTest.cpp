@@ -0,0 +1,182 @@
+#include "Check.hpp"
+#include "TreeClone.h"
+#include "Cleanup.h"
+#include "File.h"
+#include "Path.hpp"
+#include "StringConverter.hpp"
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// COMMENT: a tree with a writable, a read-only, an empty and a large file in nested directories is cloned into an empty
+// directory. On a file system without block sharing, as ext4 and tmpfs are, the read-only file must be hardlinked and
+// the others copied, the large one bigger than the copy buffer. Contents, modes and modification times
+// must match the source, a symlink is skipped.
+
+namespace
+{
+
+const size_t LargeFileSize = 1024 * 1024 + 17;
+
+std::wstring Join(const std::wstring& dir, const wchar_t* name)
+{
+	return std::wstring(dir).append(1, Path::Separator).append(name);
+}
+
+std::string ToNative(const std::wstring& path)
+{
+	std::string nativePath;
+	ConvertUtf16ToUtf8(path, nativePath);
+	return nativePath;
+}
+
+std::vector<uint8_t> MakeContent(size_t size, uint8_t seed)
+{
+	std::vector<uint8_t> content(size);
+	for (size_t i = 0; i < size; i++)
+	{
+		content[i] = static_cast<uint8_t>(i * 31 + seed);
+	}
+	return content;
+}
+
+bool MakeFile(const std::wstring& path, const std::vector<uint8_t>& content, mode_t mode)
+{
+	File file;
+	if (!CHECK(file.OpenWrite(path).Succeeded())
+		|| (!content.empty() && !CHECK(file.Write(&content[0], static_cast<uint32_t>(content.size())).Succeeded())))
+	{
+		return false;
+	}
+	file.Close();
+
+	// COMMENT: a time in the past with nanoseconds, so a copy that does not carry the time over is told apart.
+	const timespec times[2] = { { 1500000000, 0 }, { 1500000000, 123456789 } };
+	return CHECK(utimensat(AT_FDCWD, ToNative(path).c_str(), times, 0) == 0) && CHECK(chmod(ToNative(path).c_str(), mode) == 0);
+}
+
+bool ReadContent(const std::wstring& path, std::vector<uint8_t>& content)
+{
+	File file;
+	return CHECK(file.OpenRead(path).Succeeded()) && CHECK(file.Read(content).Succeeded());
+}
+
+bool Stat(const std::wstring& path, struct stat& sb)
+{
+	return CHECK(lstat(ToNative(path).c_str(), &sb) == 0);
+}
+
+void CheckSameFile(const std::wstring& sourcePath, const std::wstring& destPath, const std::vector<uint8_t>& content)
+{
+	std::vector<uint8_t> cloned;
+	if (ReadContent(destPath, cloned))
+	{
+		CHECK(cloned == content);
+	}
+
+	struct stat source;
+	struct stat dest;
+	if (Stat(sourcePath, source) && Stat(destPath, dest))
+	{
+		CHECK((dest.st_mode & 07777) == (source.st_mode & 07777));
+		CHECK(dest.st_mtim.tv_sec == source.st_mtim.tv_sec && dest.st_mtim.tv_nsec == source.st_mtim.tv_nsec);
+	}
+}
+
+bool IsSameInode(const std::wstring& first, const std::wstring& second)
+{
+	struct stat firstStat;
+	struct stat secondStat;
+	return Stat(first, firstStat) && Stat(second, secondStat) && firstStat.st_dev == secondStat.st_dev && firstStat.st_ino == secondStat.st_ino;
+}
+
+void CheckClone(const std::wstring& dir)
+{
+	const std::wstring source = Join(dir, L"source");
+	const std::wstring sourceLib = Join(source, L"lib");
+	const std::wstring sourceModules = Join(sourceLib, L"modules");
+	const std::wstring dest = Join(dir, L"dest");
+	if (!CHECK(Path::CreateDir(source).Succeeded()) || !CHECK(Path::CreateDir(sourceLib).Succeeded())
+		|| !CHECK(Path::CreateDir(sourceModules).Succeeded()) || !CHECK(Path::CreateDir(dest).Succeeded()))
+	{
+		return;
+	}
+
+	const std::vector<uint8_t> writable = MakeContent(4096, 1);
+	const std::vector<uint8_t> readOnly = MakeContent(100, 2);
+	const std::vector<uint8_t> large = MakeContent(LargeFileSize, 3);
+	if (!MakeFile(Join(source, L"release"), writable, 0644) || !MakeFile(Join(sourceLib, L"jvm.cfg"), readOnly, 0444)
+		|| !MakeFile(Join(sourceModules, L"image"), large, 0640) || !MakeFile(Join(sourceLib, L"empty"), std::vector<uint8_t>(), 0600))
+	{
+		return;
+	}
+
+	if (!CHECK(symlink("release", ToNative(Join(source, L"link")).c_str()) == 0))
+	{
+		return;
+	}
+
+	TreeClone::Stats stats;
+	if (!CHECK(TreeClone::Clone(source, dest, stats).Succeeded()))
+	{
+		return;
+	}
+
+	const std::wstring destLib = Join(dest, L"lib");
+	CheckSameFile(Join(source, L"release"), Join(dest, L"release"), writable);
+	CheckSameFile(Join(sourceLib, L"jvm.cfg"), Join(destLib, L"jvm.cfg"), readOnly);
+	CheckSameFile(Join(sourceModules, L"image"), Join(Join(destLib, L"modules"), L"image"), large);
+	CheckSameFile(Join(sourceLib, L"empty"), Join(destLib, L"empty"), std::vector<uint8_t>());
+
+	struct stat link;
+	CHECK(lstat(ToNative(Join(dest, L"link")).c_str(), &link) != 0);
+
+	CHECK(stats.cloned + stats.hardlinked + stats.copied == 4);
+
+	// COMMENT: a writable file is never shared with the source, a change through the copy stays in the copy.
+	CHECK(!IsSameInode(Join(source, L"release"), Join(dest, L"release")));
+	CHECK(!IsSameInode(Join(sourceModules, L"image"), Join(Join(destLib, L"modules"), L"image")));
+
+	if (stats.cloned == 0)
+	{
+		CHECK(stats.hardlinked == 1);
+		CHECK(stats.copied == 3);
+		CHECK(IsSameInode(Join(sourceLib, L"jvm.cfg"), Join(destLib, L"jvm.cfg")));
+	}
+	else
+	{
+		std::printf("the file system shares blocks, the hardlink and copy fallbacks are not exercised\n");
+	}
+}
+
+void CheckMissingSource(const std::wstring& dir)
+{
+	const std::wstring dest = Join(dir, L"missing_dest");
+	if (!CHECK(Path::CreateDir(dest).Succeeded()))
+	{
+		return;
+	}
+
+	TreeClone::Stats stats;
+	CHECK(!TreeClone::Clone(Join(dir, L"missing"), dest, stats).Succeeded());
+}
+
+} // namespace
+
+int main()
+{
+	std::wstring dir;
+	if (!CHECK(Path::GetTempDirPath(L"infomaximum_test_", dir).Succeeded()))
+	{
+		return TEST_RESULT();
+	}
+
+	CheckClone(dir);
+	CheckMissingSource(dir);
+
+	Cleanup::RemoveTree(dir);
+	return TEST_RESULT();
+}